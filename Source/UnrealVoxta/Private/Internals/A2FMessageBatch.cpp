@@ -0,0 +1,250 @@
+// Copyright(c) 2024 grrimgrriefer & DZnnah, see LICENSE for details.
+
+#include "A2FMessageBatch.h"
+#include "LipSyncGenerator.h"
+#include "LipSyncDataA2F.h"
+#include "VoxtaDefines.h"
+#include "Logging/StructuredLog.h"
+#include "Misc/ScopeLock.h"
+#include "Async/Async.h"
+
+A2FMessageBatch::A2FMessageBatch(TWeakPtr<Audio2FaceRESTHandler> A2FRestHandler, int numOfChunks) :
+	m_A2FRestHandler(A2FRestHandler)
+{
+	m_members.SetNum(numOfChunks);
+	for (int i = 0; i < numOfChunks; i++)
+	{
+		m_members[i].ChunkIndex = i;
+	}
+}
+
+bool A2FMessageBatch::TrySubmit(int chunkIndex, const FSharedAudioBytes& wavData, uint64 contentHash,
+	FVoxtaCancellationTokenPtr cancellationToken, TFunction<void(ULipSyncDataA2F*)> callback)
+{
+	{
+		FScopeLock lock(&m_lock);
+		if (m_state != BatchState::Collecting || !m_members.IsValidIndex(chunkIndex) || m_members[chunkIndex].IsResolved)
+		{
+			return false;
+		}
+
+		FMember& member = m_members[chunkIndex];
+		member.IsResolved = true;
+		member.IsSubmitted = true;
+		member.WavData = wavData;
+		member.ContentHash = contentHash;
+		member.CancellationToken = MoveTemp(cancellationToken);
+		member.Callback = MoveTemp(callback);
+	}
+	DispatchIfComplete();
+	return true;
+}
+
+bool A2FMessageBatch::Withdraw(int chunkIndex)
+{
+	bool wasSubmitted = false;
+	{
+		FScopeLock lock(&m_lock);
+		if (!m_members.IsValidIndex(chunkIndex))
+		{
+			return false;
+		}
+
+		FMember& member = m_members[chunkIndex];
+		if (m_state == BatchState::Solving)
+		{
+			if (member.IsSubmitted && !member.IsAbandoned)
+			{
+				member.IsAbandoned = true;
+				const bool isAbandoned = !m_members.ContainsByPredicate([] (const FMember& other)
+					{
+						return other.IsSubmitted && !other.IsAbandoned;
+					});
+				if (isAbandoned)
+				{
+					m_cancellationToken->Cancel();
+				}
+			}
+			return false;
+		}
+		if (m_state != BatchState::Collecting)
+		{
+			return false;
+		}
+
+		wasSubmitted = member.IsSubmitted;
+		member.IsResolved = true;
+		member.IsSubmitted = false;
+		member.WavData.Reset();
+		member.CancellationToken.Reset();
+		member.Callback = nullptr;
+	}
+	DispatchIfComplete();
+	return wasSubmitted;
+}
+
+void A2FMessageBatch::Promote(int chunkIndex)
+{
+	FScopeLock lock(&m_lock);
+	TSharedPtr<Audio2FaceRESTHandler> restHandler = m_A2FRestHandler.Pin();
+	if (!restHandler.IsValid())
+	{
+		return;
+	}
+	if (m_state == BatchState::Solving)
+	{
+		m_isPromoted = true;
+		if (m_jobId != 0)
+		{
+			restHandler->SetJobPriority(m_jobId, A2FJobPriority::PlayingChunk);
+		}
+	}
+	else if (const uint64* separateJobId = m_separateJobIds.Find(chunkIndex))
+	{
+		restHandler->SetJobPriority(*separateJobId, A2FJobPriority::PlayingChunk);
+	}
+}
+
+void A2FMessageBatch::DispatchIfComplete()
+{
+	TArray<FMember> submittedMembers;
+	{
+		FScopeLock lock(&m_lock);
+		if (m_state != BatchState::Collecting)
+		{
+			return;
+		}
+		const bool isComplete = !m_members.ContainsByPredicate([] (const FMember& member)
+			{
+				return !member.IsResolved;
+			});
+		if (!isComplete)
+		{
+			return;
+		}
+
+		for (const FMember& member : m_members)
+		{
+			if (member.IsSubmitted)
+			{
+				submittedMembers.Add(member);
+			}
+		}
+		m_state = submittedMembers.Num() >= 2 ? BatchState::Solving : BatchState::Done;
+	}
+
+	if (submittedMembers.Num() < 2)
+	{
+		SolveSeparatelyAsync(MoveTemp(submittedMembers));
+		return;
+	}
+
+	// Concatenating & writing the WAVs is too slow for whichever thread resolved the last member.
+	Async(EAsyncExecution::ThreadPool, [Self = AsShared(), Members = MoveTemp(submittedMembers)] () mutable
+	{
+		Self->Solve(MoveTemp(Members));
+	});
+}
+
+void A2FMessageBatch::SolveSeparatelyAsync(TArray<FMember>&& members)
+{
+	if (members.IsEmpty())
+	{
+		return;
+	}
+
+	// Writing the WAVs is too slow for the game thread, which resolves members through CleanupData & promotion.
+	Async(EAsyncExecution::ThreadPool, [Self = AsShared(), Members = MoveTemp(members)] () mutable
+	{
+		Self->SolveSeparately(MoveTemp(Members));
+	});
+}
+
+void A2FMessageBatch::Solve(TArray<FMember>&& members)
+{
+	TArray<FA2FBatchVoiceLine> voiceLines;
+	for (const FMember& member : members)
+	{
+		voiceLines.Add({ member.WavData, member.ContentHash });
+	}
+
+	A2FJobPriority priority;
+	{
+		FScopeLock lock(&m_lock);
+		priority = m_isPromoted ? A2FJobPriority::PlayingChunk : A2FJobPriority::Prefetch;
+	}
+
+	UE_LOGFMT(VoxtaLog, Log, "Solving the A2F lipsync of {0} chunks of the message in one batch.", members.Num());
+	// The callback keeps the batch alive, so the results always reach the members.
+	const uint64 jobId = LipSyncGenerator::GenerateA2FLipSyncDataBatch(voiceLines, m_A2FRestHandler, priority,
+		m_cancellationToken, [Self = AsShared(), Members = MoveTemp(members)] (TArray<ULipSyncDataA2F*>&& results) mutable
+		{
+			Self->OnSolved(MoveTemp(Members), MoveTemp(results));
+		});
+
+	FScopeLock lock(&m_lock);
+	m_jobId = jobId;
+	// Promoted while the job was being queued.
+	if (jobId != 0 && priority != A2FJobPriority::PlayingChunk && m_isPromoted)
+	{
+		if (TSharedPtr<Audio2FaceRESTHandler> restHandler = m_A2FRestHandler.Pin())
+		{
+			restHandler->SetJobPriority(jobId, A2FJobPriority::PlayingChunk);
+		}
+	}
+}
+
+void A2FMessageBatch::OnSolved(TArray<FMember>&& members, TArray<ULipSyncDataA2F*>&& results)
+{
+	{
+		FScopeLock lock(&m_lock);
+		m_state = BatchState::Done;
+	}
+
+	if (results.Num() != members.Num())
+	{
+		if (m_cancellationToken->IsCancelled())
+		{
+			for (const FMember& member : members)
+			{
+				member.Callback(nullptr);
+			}
+			return;
+		}
+		UE_LOGFMT(VoxtaLog, Warning, "The A2F batch of {0} chunks failed, solving them one by one instead.",
+			members.Num());
+		SolveSeparatelyAsync(MoveTemp(members));
+		return;
+	}
+
+	// Chunks that were cleaned up in the meantime release the data they receive themselves.
+	for (int i = 0; i < members.Num(); i++)
+	{
+		members[i].Callback(results[i]);
+	}
+}
+
+void A2FMessageBatch::SolveSeparately(TArray<FMember>&& members)
+{
+	for (FMember& member : members)
+	{
+		if (member.CancellationToken.IsValid() && member.CancellationToken->IsCancelled())
+		{
+			member.Callback(nullptr);
+			continue;
+		}
+		// A batch that failed after it was promoted keeps that class for its chunks.
+		const uint64 jobId = LipSyncGenerator::GenerateA2FLipSyncData(member.WavData, member.ContentHash,
+			m_A2FRestHandler, A2FJobPriority::Prefetch, member.CancellationToken, MoveTemp(member.Callback));
+
+		FScopeLock lock(&m_lock);
+		m_separateJobIds.Add(member.ChunkIndex, jobId);
+		if (m_isPromoted && jobId != 0)
+		{
+			if (TSharedPtr<Audio2FaceRESTHandler> restHandler = m_A2FRestHandler.Pin())
+			{
+				restHandler->SetJobPriority(jobId, A2FJobPriority::PlayingChunk);
+			}
+		}
+	}
+}
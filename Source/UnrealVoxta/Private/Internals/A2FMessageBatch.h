@@ -0,0 +1,127 @@
+// Copyright(c) 2024 grrimgrriefer & DZnnah, see LICENSE for details.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "WavChunkWalker.h"
+#include "VoxtaCancellationToken.h"
+#include "Audio2FaceRESTHandler.h"
+
+class ULipSyncDataA2F;
+
+/**
+ * A2FMessageBatch
+ * Internal utility class that collects the WAVs of all chunks of one message, and solves them with a single A2F job
+ * instead of one per chunk. That pays the fixed solver & REST overhead once, and A2F sees the audio around the edges
+ * of every chunk.
+ *
+ * Every chunk of the message is a member, and either submits its WAV or withdraws (cached lipsync, failed download,
+ * cleaned up, or playback needs it right away). The batch is solved once every member did one of both. Chunks that
+ * playback starts waiting for before that withdraw with their WAV and are solved on their own, so progressive
+ * playback never waits for the rest of the message. Batches of less than 2 WAVs, or a batch that failed, fall back to
+ * solving each chunk on its own.
+ *
+ * Note: All functions are thread-safe, member callbacks are invoked on the game thread.
+ */
+class A2FMessageBatch : public TSharedFromThis<A2FMessageBatch, ESPMode::ThreadSafe>
+{
+#pragma region public API
+public:
+	/**
+	 * @param A2FRestHandler Weak pointer to the A2F REST handler that solves the batch.
+	 * @param numOfChunks The number of chunks of the message, their indices are the member ids.
+	 */
+	A2FMessageBatch(TWeakPtr<Audio2FaceRESTHandler> A2FRestHandler, int numOfChunks);
+
+	/**
+	 * Add the WAV of a chunk to the batch.
+	 *
+	 * @param chunkIndex The index of the chunk in its message.
+	 * @param wavData The 16-bit WAV bytes of the chunk.
+	 * @param contentHash Hash of the downloaded bytes, for the VoiceLineCache. 0 to skip caching.
+	 * @param cancellationToken The token of the chunk, used if it ends up being solved on its own.
+	 * @param callback Invoked on the game thread with the lipsync data of the chunk, or nullptr if it failed.
+	 *
+	 * @return False if the batch no longer accepts the chunk, the callback is then never invoked.
+	 */
+	bool TrySubmit(int chunkIndex, const FSharedAudioBytes& wavData, uint64 contentHash,
+		FVoxtaCancellationTokenPtr cancellationToken, TFunction<void(ULipSyncDataA2F*)> callback);
+
+	/**
+	 * Take a chunk out of the batch, so the batch stops waiting for it. Does nothing once the batch is solving.
+	 *
+	 * @param chunkIndex The index of the chunk in its message.
+	 *
+	 * @return True if the chunk had submitted its WAV, the callback is then never invoked and the chunk has to
+	 * generate its lipsync itself.
+	 */
+	bool Withdraw(int chunkIndex);
+
+	/**
+	 * Move the A2F job of the batch to the PlayingChunk class, as playback is waiting for one of its chunks.
+	 * If the batch fell back to solving its chunks one by one, only the job of that chunk is promoted.
+	 *
+	 * @param chunkIndex The index of the chunk that playback is waiting for.
+	 */
+	void Promote(int chunkIndex);
+#pragma endregion
+
+#pragma region private helper classes
+private:
+	/** Internal helper class, easier to keep track of what's going on, as well as user-friendly logging. */
+	enum class BatchState : uint8
+	{
+		Collecting,
+		Solving,
+		Done
+	};
+
+	struct FMember
+	{
+		int ChunkIndex = 0;
+		/** Submitted or withdrawn, the batch doesn't wait for it anymore. */
+		bool IsResolved = false;
+		bool IsSubmitted = false;
+		/** Cleaned up while the batch was solving. */
+		bool IsAbandoned = false;
+		FSharedAudioBytes WavData;
+		uint64 ContentHash = 0;
+		FVoxtaCancellationTokenPtr CancellationToken;
+		TFunction<void(ULipSyncDataA2F*)> Callback;
+	};
+#pragma endregion
+
+#pragma region data
+private:
+	const TWeakPtr<Audio2FaceRESTHandler> m_A2FRestHandler;
+	/** Cancelled once every chunk of a solving batch was cleaned up. */
+	const TSharedRef<FVoxtaCancellationToken, ESPMode::ThreadSafe> m_cancellationToken =
+		MakeShared<FVoxtaCancellationToken, ESPMode::ThreadSafe>();
+
+	FCriticalSection m_lock;
+	TArray<FMember> m_members;
+	BatchState m_state = BatchState::Collecting;
+	uint64 m_jobId = 0;
+	bool m_isPromoted = false;
+	/** The A2F jobs of the chunks, once the batch fell back to solving them one by one. */
+	TMap<int, uint64> m_separateJobIds;
+#pragma endregion
+
+#pragma region private API
+private:
+	/** Start solving once every member submitted or withdrew. */
+	void DispatchIfComplete();
+
+	/** Concatenate the WAVs of the submitted members and queue the A2F job. (worker thread) */
+	void Solve(TArray<FMember>&& members);
+
+	/** Hand the batch results to the members, or solve them one by one if the batch failed. (game thread) */
+	void OnSolved(TArray<FMember>&& members, TArray<ULipSyncDataA2F*>&& results);
+
+	/** Run SolveSeparately on a worker thread, whichever thread the members were resolved on. */
+	void SolveSeparatelyAsync(TArray<FMember>&& members);
+
+	/** Generate the lipsync of every member with its own A2F job, like chunks without a batch. (worker thread) */
+	void SolveSeparately(TArray<FMember>&& members);
+#pragma endregion
+};
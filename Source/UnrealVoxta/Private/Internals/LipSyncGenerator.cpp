@@ -3,84 +3,302 @@
 #include "LipSyncGenerator.h"
 #include "Logging/StructuredLog.h"
 #include "VoxtaDefines.h"
-#include "Serialization/JsonReader.h"
 #if WITH_OVRLIPSYNC
-#include "OVRLipSyncContextWrapper.h"
 #include "OVRLipSyncFrame.h"
 #include "LipSyncDataOVR.h"
+#include "OVRLipSyncWorkerPool.h"
 #endif
 #include "Audio2FaceRESTHandler.h"
 #include "LipSyncDataA2F.h"
+#include "A2FBlendshapeParser.h"
+#include "A2FCurveCache.h"
+#include "A2FCompactCurves.h"
 #include "LipSyncDataCustom.h"
+#include "VoxtaObjectPool.h"
 #include "Interfaces/IPluginManager.h"
+#include "VoiceLineCache.h"
+#include "LipSyncType.h"
+#include "Serialization/MemoryWriter.h"
+#include "Serialization/MemoryReader.h"
+
+namespace
+{
+	/** Leads A2F payloads with compacted curves, payloads of raw curves start with their (positive) fps instead. */
+	constexpr int32 A2F_COMPACT_PAYLOAD_MARKER = -1;
+
+	/** The curves of one voiceline on their way to the game thread, compacted on the worker thread if enabled. */
+	struct FA2FCurves
+	{
+		int32 Fps = 0;
+		TArray<float> CurveWeights;
+		A2FCompactCurves CompactCurves;
+		bool IsCompact = false;
+
+		/** Move the curves into the lipsync data. (game thread) */
+		void ApplyTo(ULipSyncDataA2F* data)
+		{
+			if (IsCompact)
+			{
+				data->SetA2FCompactCurves(MoveTemp(CompactCurves));
+			}
+			else
+			{
+				data->SetA2FCurveWeights(MoveTemp(CurveWeights), Fps);
+			}
+		}
+	};
+
+	/** Compact the curves if A2FCompactCurves::IsEnabled, the raw ones are kept otherwise. */
+	FA2FCurves PrepareA2FCurves(TArray<float>&& curveWeights, int32 fps)
+	{
+		FA2FCurves curves;
+		curves.Fps = fps;
+		curves.IsCompact = A2FCompactCurves::IsEnabled();
+		if (curves.IsCompact)
+		{
+			curves.CompactCurves = A2FCompactCurves::Encode(curveWeights, fps, A2FCompactCurves::GetTolerance());
+		}
+		else
+		{
+			curves.CurveWeights = MoveTemp(curveWeights);
+		}
+		return curves;
+	}
+
+	/** @return The curves in the VoiceLineCache payload format, see CreateA2FLipSyncDataFromCache. */
+	TArray<uint8> WriteA2FPayload(FA2FCurves& curves)
+	{
+		TArray<uint8> payload;
+		FMemoryWriter writer(payload);
+		if (curves.IsCompact)
+		{
+			int32 marker = A2F_COMPACT_PAYLOAD_MARKER;
+			writer << marker << curves.CompactCurves;
+		}
+		else
+		{
+			writer << curves.Fps << curves.CurveWeights;
+		}
+		return payload;
+	}
+
+	/** @return The A2FCurveCache key of the samples of a parsed RIFF/WAVE buffer. */
+	uint64 HashA2FSamples(const uint8* wavData, const FWavLayout& waveLayout)
+	{
+		return A2FCurveCache::HashSamples(wavData + waveLayout.DataOffset, waveLayout.DataSize, waveLayout.SampleRate,
+			waveLayout.NumChannels, waveLayout.BitsPerSample);
+	}
+
+	/** Delete the files exchanged with A2F for one request, the results are kept in the A2FCurveCache instead. */
+	void DeleteA2FExchangeFiles(const FString& wavFullPath, const FString& jsonFullPath)
+	{
+		IFileManager::Get().Delete(*wavFullPath, false, false, true);
+		IFileManager::Get().Delete(*jsonFullPath, false, false, true);
+	}
+
+	/** @return True if the bytes were written to the folder that the A2F player reads its tracks from. */
+	bool WriteA2FExchangeFile(const FString& cacheFolder, const FString& wavName, const uint8* data, int64 size)
+	{
+		if (!IFileManager::Get().DirectoryExists(*cacheFolder) && !IFileManager::Get().MakeDirectory(*cacheFolder, true))
+		{
+			UE_LOGFMT(VoxtaLog, Error, "Failed to create wav data folder for A2F processing.");
+			return false;
+		}
+		IFileHandle* FileHandle = FPlatformFileManager::Get().GetPlatformFile().OpenWrite(
+			*FPaths::Combine(cacheFolder, wavName));
+		if (!FileHandle)
+		{
+			UE_LOGFMT(VoxtaLog, Error, "Failed to write wav data to disk for A2F processing.");
+			return false;
+		}
+		FileHandle->Write(data, size);
+		delete FileHandle;
+		return true;
+	}
+
+	/** Read & parse the blendshapes that A2F exported, deleting the exchanged files either way. (worker thread) */
+	bool TryReadA2FResult(const FString& wavFullPath, const FString& jsonFullPath, FA2FBlendshapeResult& outResult)
+	{
+		TArray<uint8> fileContents;
+		FString error;
+		const bool isLoaded = FFileHelper::LoadFileToArray(fileContents, *jsonFullPath);
+		DeleteA2FExchangeFiles(wavFullPath, jsonFullPath);
+		if (!isLoaded)
+		{
+			UE_LOGFMT(VoxtaLog, Error, "Failed to read the A2F blendshape file {0}.", jsonFullPath);
+			return false;
+		}
+		if (!A2FBlendshapeParser::TryParse(fileContents.GetData(), fileContents.Num(), outResult, error))
+		{
+			UE_LOGFMT(VoxtaLog, Error, "Failed to parse JSON A2F LipSyncData: {0}", error);
+			return false;
+		}
+		return true;
+	}
+
+	/**
+	 * Store the curves of one voiceline in the A2FCurveCache and the VoiceLineCache. (worker thread)
+	 *
+	 * @return The curves, prepared for the game thread.
+	 */
+	FA2FCurves StoreA2FResult(uint64 contentHash, uint64 pcmHash, TArray<float>&& curveWeights, int32 fps)
+	{
+		A2FCurveCache::Get().Store(pcmHash, curveWeights, fps);
+		FA2FCurves curves = PrepareA2FCurves(MoveTemp(curveWeights), fps);
+		if (contentHash != 0 && VoiceLineCache::IsEnabled())
+		{
+			VoiceLineCache::Get().StoreLipSync(contentHash, static_cast<uint8>(LipSyncType::Audio2Face),
+				WriteA2FPayload(curves));
+		}
+		return curves;
+	}
+
+	/**
+	 * Resample the part of the curves that belongs to one voiceline of a batch, so its first frame lines up with its
+	 * first sample instead of with the nearest frame of the batch.
+	 *
+	 * @return The curves of the voiceline, frame-major. Empty if the batch has no frames.
+	 */
+	TArray<float> SliceA2FCurves(const TArray<float>& curveWeights, int32 fps, uint32 sampleRate, int64 sampleOffset,
+		int64 numOfSamples)
+	{
+		constexpr int CURVE_COUNT = ULipSyncDataA2F::CURVE_COUNT;
+		TArray<float> slice;
+		const int64 numOfFrames = curveWeights.Num() / CURVE_COUNT;
+		if (numOfFrames == 0)
+		{
+			return slice;
+		}
+
+		const double firstFrame = static_cast<double>(sampleOffset) * fps / sampleRate;
+		const int64 numOfSliceFrames = FMath::Max<int64>(1,
+			FMath::CeilToInt64(static_cast<double>(numOfSamples) * fps / sampleRate));
+		slice.SetNumUninitialized(numOfSliceFrames * CURVE_COUNT);
+		for (int64 i = 0; i < numOfSliceFrames; i++)
+		{
+			const double frame = FMath::Min(firstFrame + i, static_cast<double>(numOfFrames - 1));
+			const int64 floorFrame = FMath::FloorToInt64(frame);
+			const int64 ceilingFrame = FMath::Min(floorFrame + 1, numOfFrames - 1);
+			ULipSyncDataA2F::LerpCurves(curveWeights.GetData() + floorFrame * CURVE_COUNT,
+				curveWeights.GetData() + ceilingFrame * CURVE_COUNT, static_cast<float>(frame - floorFrame),
+				slice.GetData() + i * CURVE_COUNT);
+		}
+		return slice;
+	}
 
 #if WITH_OVRLIPSYNC
-void LipSyncGenerator::GenerateOVRLipSyncData(const TArray<uint8>& rawAudioData,
-	TFunction<void(ULipSyncDataOVR*)> callback)
+	/**
+	 * Build the frame sequence of a voiceline in one pass. The sequence only takes a viseme array per frame, so one
+	 * buffer is sized once and refilled for every frame.
+	 */
+	UOVRLipSyncFrameSequence* CreateOVRFrameSequence(const FOVRLipSyncFrames& frames, UObject* outer)
+	{
+		UOVRLipSyncFrameSequence* sequence = NewObject<UOVRLipSyncFrameSequence>(outer);
+		TArray<float> viseme;
+		viseme.SetNumUninitialized(frames.NumOfVisemes);
+		for (int i = 0; i < frames.Num(); i++)
+		{
+			FMemory::Memcpy(viseme.GetData(), frames.GetVisemeScores(i).GetData(), frames.NumOfVisemes * sizeof(float));
+			sequence->Add(viseme, frames.LaughterScores[i]);
+		}
+		return sequence;
+	}
+#endif
+}
+
+#if WITH_OVRLIPSYNC
+void LipSyncGenerator::GenerateOVRLipSyncData(FSharedAudioBytes rawAudioData, uint64 contentHash,
+	FVoxtaCancellationTokenPtr cancellationToken, TFunction<void(ULipSyncDataOVR*)> callback)
 {
-	if (rawAudioData.Num() <= 44)
+	FWavLayout waveLayout;
+	if (!rawAudioData.IsValid() || !WavChunkWalker::TryParse(rawAudioData->GetData(), rawAudioData->Num(), waveLayout))
 	{
-		UE_LOGFMT(VoxtaLog, Error, "Invalid rawAudioData, cannot generate OVR lipsync data.");
+		UE_LOGFMT(VoxtaLog, Error, "Invalid wave header detected, cannot generate OVR lipsync data.");
 		callback(nullptr);
 		return;
 	}
-
-	FWaveModInfo waveInfo;
-	uint8* waveData = const_cast<uint8*>(rawAudioData.GetData());
-
-	if (waveInfo.ReadWaveInfo(waveData, rawAudioData.Num()))
+	if (waveLayout.BitsPerSample != 16)
 	{
-		int16_t* pcmData = reinterpret_cast<int16_t*>(waveData + 44);
-		FString modelPath = FPaths::Combine(FPaths::ProjectPluginsDir(), TEXT("OVRLipSync"),
-			TEXT("OfflineModel"), TEXT("ovrlipsync_offline_model.pb"));
+		UE_LOGFMT(VoxtaLog, Error, "OVR lipsync requires 16-bit PCM audio, got {0} bits per sample.",
+			waveLayout.BitsPerSample);
+		callback(nullptr);
+		return;
+	}
 
-		Async(EAsyncExecution::Thread, [WaveInfo = waveInfo, ModelPath = modelPath,
-			PCMData = pcmData, Callback1 = callback] ()
+	// The job holds its own reference to the bytes, so the PCM data stays valid even if the chunk is cleaned up.
+	OVRLipSyncWorkerPool::Get().Enqueue(MoveTemp(rawAudioData), waveLayout, MoveTemp(cancellationToken),
+		[ContentHash = contentHash, Callback1 = MoveTemp(callback)] (FOVRLipSyncJobResult&& result)
+	{
+		if (result.WasCancelled)
 		{
-			int32 numChannels = *WaveInfo.pChannels;
-			int32 sampleRate = *WaveInfo.pSamplesPerSec;
-			auto pcmDataSize = WaveInfo.SampleDataSize / sizeof(int16_t);
-			int32 chunkSizeSamples = static_cast<int32>(sampleRate * (1.f / 100.f));
-			int32 chunkSize = numChannels * chunkSizeSamples;
-			int bufferSize = 4096;
+			UE_LOGFMT(VoxtaLog, Log, "OVR lipsync generation was cancelled after {0} frames.", result.Frames.Num());
+			AsyncTask(ENamedThreads::GameThread, [Callback2 = Callback1] () { Callback2(nullptr); });
+			return;
+		}
 
-			UOVRLipSyncContextWrapper context(ovrLipSyncContextProvider_Enhanced, sampleRate, bufferSize, ModelPath);
-			float laughterScore = 0.0f;
-			int32_t FrameDelayInMs = 0;
+		if (ContentHash != 0 && VoiceLineCache::IsEnabled())
+		{
+			TArray<uint8> payload;
+			FMemoryWriter writer(payload);
+			int32 numFrames = result.Frames.Num();
+			writer << numFrames;
 			TArray<float> viseme;
-			TArray<TTuple<TArray<float>, float>> frames;
-			for (uint64 offs = 0; (offs + chunkSize) <= pcmDataSize; offs += chunkSize)
+			for (int i = 0; i < numFrames; i++)
 			{
 				viseme.Reset();
-				context.ProcessFrame(PCMData + offs, chunkSizeSamples, viseme, laughterScore, FrameDelayInMs,
-					numChannels > 1);
-				frames.Emplace(viseme, laughterScore);
+				viseme.Append(result.Frames.GetVisemeScores(i));
+				writer << viseme << result.Frames.LaughterScores[i];
 			}
-			AsyncTask(ENamedThreads::GameThread, [Frames = MoveTemp(frames), Callback2 = Callback1] ()
-			{
-				ULipSyncDataOVR* data = NewObject<ULipSyncDataOVR>();
-				UOVRLipSyncFrameSequence* sequence = NewObject<UOVRLipSyncFrameSequence>(data);
-				for (int i = 0; i < Frames.Num(); i++)
-				{
-					sequence->Add(Frames[i].Key, Frames[i].Value);
-				}
-				data->SetFrameSequence(sequence);
-				UE_LOGFMT(VoxtaLog, Log, "Successfully generated OVR lipsync data: {0} frames of data.", Frames.Num());
+			VoiceLineCache::Get().StoreLipSync(ContentHash, static_cast<uint8>(LipSyncType::OVRLipSync), MoveTemp(payload));
+		}
 
-				Callback2(data);
-			});
+		AsyncTask(ENamedThreads::GameThread, [Result = MoveTemp(result), Callback2 = Callback1] ()
+		{
+			const double startTime = FPlatformTime::Seconds();
+			ULipSyncDataOVR* data = VoxtaObjectPool::Get().Acquire<ULipSyncDataOVR>();
+			data->SetFrameSequence(CreateOVRFrameSequence(Result.Frames, data));
+			const double buildSeconds = FPlatformTime::Seconds() - startTime;
+			OVRLipSyncWorkerPool::Get().RecordSequenceBuild(buildSeconds);
+
+			UE_LOGFMT(VoxtaLog, Log, "Successfully generated OVR lipsync data: {0} frames of data. OVR job {1} processed "
+				"in {2} ms, context {3} in {4} ms, after {5} ms in the queue. Sequence built in {6} ms.",
+				Result.Frames.Num(), Result.JobId, FMath::RoundToInt(Result.ProcessSeconds * 1000.0),
+				Result.ReusedContext ? TEXT("reused") : TEXT("created"), FMath::RoundToInt(Result.ContextSeconds * 1000.0),
+				FMath::RoundToInt(Result.QueueSeconds * 1000.0), FMath::RoundToInt(buildSeconds * 1000.0));
+			Callback2(data);
 		});
+	});
+}
+
+ULipSyncDataOVR* LipSyncGenerator::CreateOVRLipSyncDataFromCache(const TArray<uint8>& payload)
+{
+	FMemoryReader reader(payload);
+	int32 numFrames = 0;
+	reader << numFrames;
+	if (reader.IsError() || numFrames < 0)
+	{
+		UE_LOGFMT(VoxtaLog, Error, "Invalid cached OVR lipsync data, it will be regenerated next time.");
+		return nullptr;
 	}
-	else
+
+	ULipSyncDataOVR* data = VoxtaObjectPool::Get().Acquire<ULipSyncDataOVR>();
+	UOVRLipSyncFrameSequence* sequence = NewObject<UOVRLipSyncFrameSequence>(data);
+	TArray<float> viseme;
+	float laughterScore = 0.f;
+	for (int i = 0; i < numFrames && !reader.IsError(); i++)
 	{
-		UE_LOGFMT(VoxtaLog, Error, "Invalid wave header detected, cannot generate A2F lipsync data.");
-		callback(nullptr);
+		reader << viseme << laughterScore;
+		sequence->Add(viseme, laughterScore);
 	}
+	data->SetFrameSequence(sequence);
+	UE_LOGFMT(VoxtaLog, Log, "Restored OVR lipsync data from the voiceline cache: {0} frames of data.", numFrames);
+	return data;
 }
 #endif
 
-void LipSyncGenerator::GenerateA2FLipSyncData(const TArray<uint8>& rawAudioData, TWeakPtr<Audio2FaceRESTHandler> A2FRestHandler,
-	TFunction<void(ULipSyncDataA2F*)> callback)
+uint64 LipSyncGenerator::GenerateA2FLipSyncData(const FSharedAudioBytes& rawAudioData, uint64 contentHash,
+	TWeakPtr<Audio2FaceRESTHandler> A2FRestHandler, A2FJobPriority priority,
+	FVoxtaCancellationTokenPtr cancellationToken, TFunction<void(ULipSyncDataA2F*)> callback)
 {
 	FString guid = FGuid::NewGuid().ToString();
 	FString cacheFolder = FString::Format(TEXT("{0}\\A2FCache"),
@@ -89,110 +307,311 @@ void LipSyncGenerator::GenerateA2FLipSyncData(const TArray<uint8>& rawAudioData,
 	FString jsonName = FString::Format(TEXT("A2FCachedData{0}"), { guid });
 	FString jsonImportName = FString::Format(TEXT("{0}_bsweight.json"), { jsonName });
 
-	FWaveModInfo waveInfo;
-	uint8* waveData = const_cast<uint8*>(rawAudioData.GetData());
-
-	if (waveInfo.ReadWaveInfo(waveData, rawAudioData.Num()))
+	FWavLayout waveLayout;
+	if (!rawAudioData.IsValid() || !WavChunkWalker::TryParse(rawAudioData->GetData(), rawAudioData->Num(), waveLayout))
 	{
-		if (!IFileManager::Get().DirectoryExists(*cacheFolder))
-		{
-			if (!IFileManager::Get().MakeDirectory(*cacheFolder, true))
-			{
-				UE_LOGFMT(VoxtaLog, Error, "Failed to create wav data folder for A2F processing.");
-				callback(nullptr);
-				return;
-			}
-		}
-		IFileHandle* FileHandle = FPlatformFileManager::Get().GetPlatformFile().OpenWrite(
-			*FPaths::Combine(cacheFolder, wavName));
-
-		if (FileHandle)
-		{
-			FileHandle->Write(waveData, waveInfo.SampleDataStart - waveData);
-			FileHandle->Write(waveInfo.SampleDataStart, waveInfo.SampleDataSize);
-			delete FileHandle;
-		}
-		else
-		{
-			UE_LOGFMT(VoxtaLog, Error, "Failed to write wav data to disk for A2F processing.");
-			callback(nullptr);
-			return;
-		}
+		UE_LOGFMT(VoxtaLog, Error, "Invalid wave header detected, cannot generate A2F lipsync data.");
+		callback(nullptr);
+		return 0;
 	}
-	else
+	// Checked before the exchange file is written, nothing would delete it otherwise.
+	TSharedPtr<Audio2FaceRESTHandler> restHandler = A2FRestHandler.Pin();
+	if (!restHandler.IsValid())
 	{
-		UE_LOGFMT(VoxtaLog, Error, "Invalid wave header detected, cannot generate OVR lipsync data.");
+		UE_LOGFMT(VoxtaLog, Error, "A2FRestHandler was invalid while trying to generate lipsync data.");
 		callback(nullptr);
-		return;
+		return 0;
 	}
-
-	if (!A2FRestHandler.IsValid())
+	// Everything up to the end of the sample data, trailing chunks are irrelevant for A2F.
+	if (!WriteA2FExchangeFile(cacheFolder, wavName, rawAudioData->GetData(), waveLayout.DataOffset + waveLayout.DataSize))
 	{
-		UE_LOGFMT(VoxtaLog, Error, "A2FRestHandler was invalid while trying to generate lipsync data.");
 		callback(nullptr);
-		return;
+		return 0;
 	}
 
-	A2FRestHandler.Pin()->GetBlendshapes(wavName, cacheFolder, jsonName,
-		[Callback = callback, JsonFullPath = FPaths::Combine(cacheFolder, jsonImportName)]
+	return restHandler->GetBlendshapes(wavName, cacheFolder, jsonName, priority, cancellationToken,
+		[Callback = callback, ContentHash = contentHash, PcmHash = HashA2FSamples(rawAudioData->GetData(), waveLayout),
+		WavFullPath = FPaths::Combine(cacheFolder, wavName), JsonFullPath = FPaths::Combine(cacheFolder, jsonImportName),
+		Token = cancellationToken]
 		(FString shapesFile, bool success)
 		{
+			if (Token.IsValid() && Token->IsCancelled())
+			{
+				UE_LOGFMT(VoxtaLog, Log, "A2F lipsync generation was cancelled, skipping the import of the curves.");
+				DeleteA2FExchangeFiles(WavFullPath, JsonFullPath);
+				Callback(nullptr);
+				return;
+			}
 			if (!success)
 			{
 				UE_LOGFMT(VoxtaLog, Error, "A2F failed to generate blendshape curves from the audiofile, aborting.");
+				DeleteA2FExchangeFiles(WavFullPath, JsonFullPath);
 				Callback(nullptr);
 				return;
 			}
 
-			FString FileContents;
-			FFileHelper::LoadFileToString(FileContents, *JsonFullPath);
+			// Reading & parsing thousands of weights is far too slow for the game thread, only the UObject is created there.
+			Async(EAsyncExecution::ThreadPool, [Callback1 = Callback, ContentHash, PcmHash, WavFullPath, JsonFullPath, Token] ()
+			{
+				FA2FBlendshapeResult result;
+				if (!TryReadA2FResult(WavFullPath, JsonFullPath, result))
+				{
+					AsyncTask(ENamedThreads::GameThread, [Callback2 = Callback1] () { Callback2(nullptr); });
+					return;
+				}
+				// Rejected like in the batched path, every frame of the flat buffer is assumed to hold CURVE_COUNT values.
+				if (result.NumOfCurvesPerFrame != ULipSyncDataA2F::CURVE_COUNT)
+				{
+					UE_LOGFMT(VoxtaLog, Error, "A2F generated {0} curves per frame instead of the {1} ARKit "
+						"blendshapes, the curves would not line up.", result.NumOfCurvesPerFrame,
+						ULipSyncDataA2F::CURVE_COUNT);
+					AsyncTask(ENamedThreads::GameThread, [Callback2 = Callback1] () { Callback2(nullptr); });
+					return;
+				}
+				FA2FCurves curves = StoreA2FResult(ContentHash, PcmHash, MoveTemp(result.CurveWeights), result.Fps);
 
-			TSharedPtr<FJsonObject> JsonObject = MakeShareable(new FJsonObject());
-			const TSharedRef<TJsonReader<>> JsonReader = TJsonReaderFactory<>::Create(FileContents);
+				AsyncTask(ENamedThreads::GameThread, [Curves = MoveTemp(curves), NumOfFrames = result.NumOfFrames,
+					Callback2 = Callback1, Token] () mutable
+				{
+					if (Token.IsValid() && Token->IsCancelled())
+					{
+						UE_LOGFMT(VoxtaLog, Log, "A2F lipsync generation was cancelled while parsing the curves.");
+						Callback2(nullptr);
+						return;
+					}
 
-			if (!(JsonObject.IsValid() && FJsonSerializer::Deserialize(JsonReader, JsonObject)))
-			{
-				UE_LOGFMT(VoxtaLog, Error, "Failed to parse JSON A2F LipSyncData, this should never happen?");
-				Callback(nullptr);
-				return;
-			}
+					ULipSyncDataA2F* data = VoxtaObjectPool::Get().Acquire<ULipSyncDataA2F>();
+					Curves.ApplyTo(data);
+					UE_LOGFMT(VoxtaLog, Log, "Successfully generated A2F lipsync data: {0} frames of data.",
+						NumOfFrames);
 
-			int32 fps;
-			JsonObject->TryGetNumberField(TEXT("exportFps"), fps);
-			int32 numFrames;
-			JsonObject->TryGetNumberField(TEXT("numFrames"), numFrames);
-			const TArray<TSharedPtr<FJsonValue>>* WeightMat;
-			if (!JsonObject->TryGetArrayField(TEXT("weightMat"), WeightMat) || !WeightMat)
+					Callback2(data);
+				});
+			});
+		});
+}
+
+uint64 LipSyncGenerator::GenerateA2FLipSyncDataBatch(const TArray<FA2FBatchVoiceLine>& voiceLines,
+	TWeakPtr<Audio2FaceRESTHandler> A2FRestHandler, A2FJobPriority priority,
+	FVoxtaCancellationTokenPtr cancellationToken, TFunction<void(TArray<ULipSyncDataA2F*>&&)> callback)
+{
+	// A2F gets one continuous track, so every voiceline must have the same sample format.
+	TArray<FWavLayout> waveLayouts;
+	for (const FA2FBatchVoiceLine& voiceLine : voiceLines)
+	{
+		FWavLayout& waveLayout = waveLayouts.AddDefaulted_GetRef();
+		if (!voiceLine.RawAudioData.IsValid() ||
+			!WavChunkWalker::TryParse(voiceLine.RawAudioData->GetData(), voiceLine.RawAudioData->Num(), waveLayout))
+		{
+			UE_LOGFMT(VoxtaLog, Error, "Invalid wave header detected, cannot batch the A2F lipsync generation.");
+			callback({});
+			return 0;
+		}
+		const FWavLayout& firstLayout = waveLayouts[0];
+		if (waveLayout.FormatTag != firstLayout.FormatTag || waveLayout.NumChannels != firstLayout.NumChannels ||
+			waveLayout.SampleRate != firstLayout.SampleRate || waveLayout.BitsPerSample != firstLayout.BitsPerSample ||
+			waveLayout.NumChannels == 0 || waveLayout.BitsPerSample < 8)
+		{
+			UE_LOGFMT(VoxtaLog, Warning, "The voicelines of the A2F batch don't share one sample format, they cannot "
+				"be concatenated.");
+			callback({});
+			return 0;
+		}
+	}
+
+	const FWavLayout& format = waveLayouts[0];
+	const uint16 blockAlign = format.NumChannels * (format.BitsPerSample / 8);
+	int64 totalDataSize = 0;
+	for (const FWavLayout& waveLayout : waveLayouts)
+	{
+		totalDataSize += waveLayout.DataSize - waveLayout.DataSize % blockAlign;
+	}
+
+	// Canonical 44-byte header, followed by the samples of every voiceline back to back.
+	TArray<uint8> wavData;
+	wavData.Reserve(44 + totalDataSize);
+	auto appendBytes = [&wavData] (const void* bytes, int32 size)
+		{
+			wavData.Append(static_cast<const uint8*>(bytes), size);
+		};
+	const uint32 riffSize = static_cast<uint32>(36 + totalDataSize);
+	const uint32 fmtSize = 16;
+	const uint32 byteRate = format.SampleRate * blockAlign;
+	const uint32 dataSize = static_cast<uint32>(totalDataSize);
+	appendBytes("RIFF", 4);
+	appendBytes(&riffSize, sizeof(riffSize));
+	appendBytes("WAVEfmt ", 8);
+	appendBytes(&fmtSize, sizeof(fmtSize));
+	appendBytes(&format.FormatTag, sizeof(format.FormatTag));
+	appendBytes(&format.NumChannels, sizeof(format.NumChannels));
+	appendBytes(&format.SampleRate, sizeof(format.SampleRate));
+	appendBytes(&byteRate, sizeof(byteRate));
+	appendBytes(&blockAlign, sizeof(blockAlign));
+	appendBytes(&format.BitsPerSample, sizeof(format.BitsPerSample));
+	appendBytes("data", 4);
+	appendBytes(&dataSize, sizeof(dataSize));
+
+	TArray<int64> sampleOffsets;
+	TArray<int64> numOfSamples;
+	TArray<uint64> pcmHashes;
+	int64 sampleOffset = 0;
+	for (int i = 0; i < voiceLines.Num(); i++)
+	{
+		const FWavLayout& waveLayout = waveLayouts[i];
+		const int64 alignedSize = waveLayout.DataSize - waveLayout.DataSize % blockAlign;
+		wavData.Append(voiceLines[i].RawAudioData->GetData() + waveLayout.DataOffset, alignedSize);
+		sampleOffsets.Add(sampleOffset);
+		numOfSamples.Add(alignedSize / blockAlign);
+		pcmHashes.Add(HashA2FSamples(voiceLines[i].RawAudioData->GetData(), waveLayout));
+		sampleOffset += alignedSize / blockAlign;
+	}
+
+	FString guid = FGuid::NewGuid().ToString();
+	FString cacheFolder = FString::Format(TEXT("{0}\\A2FCache"),
+		{ IPluginManager::Get().FindPlugin("UnrealVoxta")->GetContentDir() });
+	FString wavName = FString::Format(TEXT("A2FBatchData{0}.wav"), { guid });
+	FString jsonName = FString::Format(TEXT("A2FBatchData{0}"), { guid });
+	FString jsonImportName = FString::Format(TEXT("{0}_bsweight.json"), { jsonName });
+	TSharedPtr<Audio2FaceRESTHandler> restHandler = A2FRestHandler.Pin();
+	if (!restHandler.IsValid())
+	{
+		UE_LOGFMT(VoxtaLog, Error, "A2FRestHandler was invalid while trying to generate batched lipsync data.");
+		callback({});
+		return 0;
+	}
+	if (!WriteA2FExchangeFile(cacheFolder, wavName, wavData.GetData(), wavData.Num()))
+	{
+		callback({});
+		return 0;
+	}
+
+	TArray<uint64> contentHashes;
+	for (const FA2FBatchVoiceLine& voiceLine : voiceLines)
+	{
+		contentHashes.Add(voiceLine.ContentHash);
+	}
+
+	UE_LOGFMT(VoxtaLog, Log, "Queueing one A2F job for a batch of {0} voicelines ({1} samples).", voiceLines.Num(),
+		sampleOffset);
+	return restHandler->GetBlendshapes(wavName, cacheFolder, jsonName, priority, cancellationToken,
+		[Callback = MoveTemp(callback), ContentHashes = MoveTemp(contentHashes), PcmHashes = MoveTemp(pcmHashes),
+		SampleOffsets = MoveTemp(sampleOffsets), NumOfSamples = MoveTemp(numOfSamples), SampleRate = format.SampleRate,
+		WavFullPath = FPaths::Combine(cacheFolder, wavName), JsonFullPath = FPaths::Combine(cacheFolder, jsonImportName),
+		Token = cancellationToken]
+		(FString shapesFile, bool success)
+		{
+			if ((Token.IsValid() && Token->IsCancelled()) || !success)
 			{
-				UE_LOGFMT(VoxtaLog, Error, "A2F JSON missing 'weightMat' array.");
-				Callback(nullptr);
+				UE_LOGFMT(VoxtaLog, Log, "Batched A2F lipsync generation stopped (cancelled: {0}).",
+					Token.IsValid() && Token->IsCancelled());
+				DeleteA2FExchangeFiles(WavFullPath, JsonFullPath);
+				Callback({});
 				return;
 			}
 
-			TArray<TArray<float>> curveValues;
-			for (const TSharedPtr<FJsonValue>& Row : *WeightMat)
+			Async(EAsyncExecution::ThreadPool, [Callback1 = Callback, ContentHashes, PcmHashes, SampleOffsets, NumOfSamples,
+				SampleRate, WavFullPath, JsonFullPath, Token] ()
 			{
-				TArray<float> FloatRow;
-				const TArray<TSharedPtr<FJsonValue>>& values = Row->AsArray();
-				for (const TSharedPtr<FJsonValue>& Value : values)
+				FA2FBlendshapeResult result;
+				if (!TryReadA2FResult(WavFullPath, JsonFullPath, result))
 				{
-					FloatRow.Add(Value->AsNumber());
+					AsyncTask(ENamedThreads::GameThread, [Callback2 = Callback1] () { Callback2({}); });
+					return;
+				}
+				if (result.NumOfCurvesPerFrame != ULipSyncDataA2F::CURVE_COUNT)
+				{
+					UE_LOGFMT(VoxtaLog, Error, "A2F generated {0} curves per frame instead of the {1} ARKit "
+						"blendshapes, the batch cannot be split per voiceline.", result.NumOfCurvesPerFrame,
+						ULipSyncDataA2F::CURVE_COUNT);
+					AsyncTask(ENamedThreads::GameThread, [Callback2 = Callback1] () { Callback2({}); });
+					return;
 				}
-				curveValues.Add(FloatRow);
-			}
 
-			JsonObject.Reset();
+				TArray<FA2FCurves> slices;
+				for (int i = 0; i < SampleOffsets.Num(); i++)
+				{
+					slices.Add(StoreA2FResult(ContentHashes[i], PcmHashes[i], SliceA2FCurves(result.CurveWeights,
+						result.Fps, SampleRate, SampleOffsets[i], NumOfSamples[i]), result.Fps));
+				}
 
-			ULipSyncDataA2F* data = NewObject<ULipSyncDataA2F>();
-			data->SetA2FCurveWeights(curveValues, fps);
-			UE_LOGFMT(VoxtaLog, Log, "Successfully generated A2F lipsync data: {0} frames of data.", numFrames);
+				AsyncTask(ENamedThreads::GameThread, [Slices = MoveTemp(slices), Callback2 = Callback1, Token] () mutable
+				{
+					if (Token.IsValid() && Token->IsCancelled())
+					{
+						UE_LOGFMT(VoxtaLog, Log, "Batched A2F lipsync generation was cancelled while parsing the curves.");
+						Callback2({});
+						return;
+					}
 
-			Callback(data);
+					TArray<ULipSyncDataA2F*> lipSyncData;
+					for (FA2FCurves& slice : Slices)
+					{
+						ULipSyncDataA2F* data = VoxtaObjectPool::Get().Acquire<ULipSyncDataA2F>();
+						slice.ApplyTo(data);
+						lipSyncData.Add(data);
+					}
+					UE_LOGFMT(VoxtaLog, Log, "Successfully generated batched A2F lipsync data for {0} voicelines.",
+						lipSyncData.Num());
+					Callback2(MoveTemp(lipSyncData));
+				});
+			});
 		});
 }
 
+bool LipSyncGenerator::TryLoadA2FLipSyncPayload(const TArray<uint8>& rawAudioData, TArray<uint8>& outPayload)
+{
+	FWavLayout waveLayout;
+	if (!A2FCurveCache::IsEnabled() || !WavChunkWalker::TryParse(rawAudioData.GetData(), rawAudioData.Num(), waveLayout))
+	{
+		return false;
+	}
+
+	TArray<float> curveValues;
+	int32 fps = 0;
+	if (!A2FCurveCache::Get().TryLoad(HashA2FSamples(rawAudioData.GetData(), waveLayout), curveValues, fps))
+	{
+		return false;
+	}
+
+	FA2FCurves curves = PrepareA2FCurves(MoveTemp(curveValues), fps);
+	outPayload = WriteA2FPayload(curves);
+	return true;
+}
+
+ULipSyncDataA2F* LipSyncGenerator::CreateA2FLipSyncDataFromCache(const TArray<uint8>& payload)
+{
+	FMemoryReader reader(payload);
+	int32 fpsOrMarker = 0;
+	reader << fpsOrMarker;
+	FA2FCurves curves;
+	if (fpsOrMarker == A2F_COMPACT_PAYLOAD_MARKER)
+	{
+		reader << curves.CompactCurves;
+		curves.IsCompact = true;
+	}
+	else
+	{
+		// Raw curves, stored with compaction disabled or before it existed. They are played back raw, as this runs on
+		// the game thread; only fresh A2F results are compacted, on the worker thread that parsed them.
+		curves.Fps = fpsOrMarker;
+		reader << curves.CurveWeights;
+	}
+	if (reader.IsError() || (!curves.IsCompact &&
+		(curves.Fps <= 0 || curves.CurveWeights.Num() % ULipSyncDataA2F::CURVE_COUNT != 0)))
+	{
+		UE_LOGFMT(VoxtaLog, Error, "Invalid cached A2F lipsync data, it will be regenerated next time.");
+		return nullptr;
+	}
+
+	ULipSyncDataA2F* data = VoxtaObjectPool::Get().Acquire<ULipSyncDataA2F>();
+	curves.ApplyTo(data);
+	UE_LOGFMT(VoxtaLog, Log, "Restored A2F lipsync data from the voiceline cache: {0} frames of data.",
+		data->GetNumOfFrames());
+	return data;
+}
+
 ULipSyncDataCustom* LipSyncGenerator::GenerateCustomLipSyncData()
 {
-	ULipSyncDataCustom* data = NewObject<ULipSyncDataCustom>();
+	ULipSyncDataCustom* data = VoxtaObjectPool::Get().Acquire<ULipSyncDataCustom>();
 	return data;
 }
\ No newline at end of file
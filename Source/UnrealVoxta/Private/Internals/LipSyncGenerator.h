@@ -3,13 +3,27 @@
 #pragma once
 
 #include "CoreMinimal.h"
+#include "WavChunkWalker.h"
+#include "VoxtaCancellationToken.h"
 
 #if WITH_OVRLIPSYNC
 #include "LipSyncDataOVR.h"
 #endif
 #include "LipSyncDataA2F.h"
 #include "LipSyncDataCustom.h"
-class Audio2FaceRESTHandler;
+#include "Audio2FaceRESTHandler.h"
+
+/**
+ * FA2FBatchVoiceLine
+ * One voiceline of a batched A2F solve, see LipSyncGenerator::GenerateA2FLipSyncDataBatch.
+ */
+struct FA2FBatchVoiceLine
+{
+	/** The raw audiodata in bytes (wav). */
+	FSharedAudioBytes RawAudioData;
+	/** Hash of RawAudioData, used to store the result in the VoiceLineCache. 0 to skip caching. */
+	uint64 ContentHash = 0;
+};
 
 /**
  * LipSyncGenerator
@@ -26,11 +40,24 @@ public:
 	 * Generate a UOVRLipSyncFrameSequence in a background thread and attach it to the ULipSyncDataOVR instance.
 	 * Note: Returned object of ULipSyncDataOVR* is attached to Root on creation, to avoid premature deletion.
 	 *
-	 * @param rawAudioData The raw audiodata in bytes.
+	 * @param rawAudioData The raw audiodata in bytes (16-bit PCM wav), kept alive by the background task until it's done.
+	 * @param contentHash Hash of rawAudioData, used to store the result in the VoiceLineCache. 0 to skip caching.
+	 * @param cancellationToken Optional token, the generation stops early once it is cancelled and reports nullptr.
 	 * @param callback The callback that will be triggered when the OVR lipsync data has been created & pushed
 	 * back on the gamethread.
 	 */
-	static void GenerateOVRLipSyncData(const TArray<uint8>& rawAudioData, TFunction<void(ULipSyncDataOVR*)> callback);
+	static void GenerateOVRLipSyncData(FSharedAudioBytes rawAudioData, uint64 contentHash,
+		FVoxtaCancellationTokenPtr cancellationToken, TFunction<void(ULipSyncDataOVR*)> callback);
+
+	/**
+	 * Recreate the OVR lipsync data from a payload that was stored in the VoiceLineCache by GenerateOVRLipSyncData.
+	 * Note: Returned object of ULipSyncDataOVR* is attached to Root on creation, to avoid premature deletion.
+	 *
+	 * @param payload The cached payload.
+	 *
+	 * @return The lipsync data, or nullptr if the payload was invalid.
+	 */
+	static ULipSyncDataOVR* CreateOVRLipSyncDataFromCache(const TArray<uint8>& payload);
 #endif
 
 	/**
@@ -38,12 +65,58 @@ public:
 	 * Note: Returned object of ULipSyncDataA2F* is attached to Root on creation, to avoid premature deletion.
 	 *
 	 * @param rawAudioData The raw audiodata in bytes.
+	 * @param contentHash Hash of rawAudioData, used to store the result in the VoiceLineCache. 0 to skip caching.
+	 * The result is always stored in the A2FCurveCache as well, keyed by the hash of the samples.
 	 * @param A2FRestHandler Weak pointer to the A2F REST API handler; the callback is skipped if the handler is no longer valid.
+	 * @param priority The priority class of the A2F job.
+	 * @param cancellationToken Optional token, cancelling it aborts the A2F requests and reports nullptr.
 	 * @param callback The callback that will be triggered when the A2F curves have been created and imported
 	 * back into the gamethread.
+	 *
+	 * @return The id of the queued A2F job, to change its priority later. 0 if it could not be queued.
+	 */
+	static uint64 GenerateA2FLipSyncData(const FSharedAudioBytes& rawAudioData, uint64 contentHash,
+		TWeakPtr<Audio2FaceRESTHandler> A2FRestHandler, A2FJobPriority priority,
+		FVoxtaCancellationTokenPtr cancellationToken, TFunction<void(ULipSyncDataA2F*)> callback);
+
+	/**
+	 * Generate the A2F curves of several voicelines with a single A2F job, by concatenating their samples into one
+	 * track. The curves are split again at the exact sample offset of every voiceline, so each one starts at its own
+	 * first sample. Every slice is stored in the caches like the result of GenerateA2FLipSyncData.
+	 * Note: Returned objects of ULipSyncDataA2F* are attached to Root on creation, to avoid premature deletion.
+	 *
+	 * @param voiceLines The voicelines, in playback order. They must share one sample format.
+	 * @param A2FRestHandler Weak pointer to the A2F REST API handler.
+	 * @param priority The priority class of the A2F job.
+	 * @param cancellationToken Optional token, cancelling it aborts the A2F requests and reports no results.
+	 * @param callback Invoked on the gamethread with the lipsync data of every voiceline in the same order, or with an
+	 * empty array if the batch failed.
+	 *
+	 * @return The id of the queued A2F job, to change its priority later. 0 if it could not be queued.
+	 */
+	static uint64 GenerateA2FLipSyncDataBatch(const TArray<FA2FBatchVoiceLine>& voiceLines,
+		TWeakPtr<Audio2FaceRESTHandler> A2FRestHandler, A2FJobPriority priority,
+		FVoxtaCancellationTokenPtr cancellationToken, TFunction<void(TArray<ULipSyncDataA2F*>&&)> callback);
+
+	/**
+	 * Look the samples up in the persistent A2FCurveCache, where GenerateA2FLipSyncData stores every result. (any thread)
+	 *
+	 * @param rawAudioData The raw audiodata in bytes, as it would be sent to A2F.
+	 * @param outPayload The result in the VoiceLineCache payload format, for CreateA2FLipSyncDataFromCache.
+	 *
+	 * @return True if A2F processed the same samples before, so the REST round trip can be skipped.
+	 */
+	static bool TryLoadA2FLipSyncPayload(const TArray<uint8>& rawAudioData, TArray<uint8>& outPayload);
+
+	/**
+	 * Recreate the A2F lipsync data from a payload that was stored in the VoiceLineCache by GenerateA2FLipSyncData.
+	 * Note: Returned object of ULipSyncDataA2F* is attached to Root on creation, to avoid premature deletion.
+	 *
+	 * @param payload The cached payload.
+	 *
+	 * @return The lipsync data, or nullptr if the payload was invalid.
 	 */
-	static void GenerateA2FLipSyncData(const TArray<uint8>& rawAudioData, TWeakPtr<Audio2FaceRESTHandler> A2FRestHandler,
-		TFunction<void(ULipSyncDataA2F*)> callback);
+	static ULipSyncDataA2F* CreateA2FLipSyncDataFromCache(const TArray<uint8>& payload);
 
 	/**
 	 * Generate an empty ULipSyncDataCustom wrapper, currently only used for integration tests.
@@ -6,53 +6,99 @@
 #include "LipSyncGenerator.h"
 #include "RuntimeAudioImporter/RuntimeAudioImporterLibrary.h"
 #include "RuntimeAudioImporter/ImportedSoundWave.h"
-#include "HttpModule.h"
-#include "Interfaces/IHttpBase.h"
-#include "Interfaces/IHttpRequest.h"
 #include "Audio2FaceRESTHandler.h"
+#include "A2FMessageBatch.h"
 #include "LipSyncBaseData.h"
-#include "Interfaces/IHttpResponse.h"
 #include "LogUtility/Public/Defines.h"
+#include "Async/Async.h"
 
 MessageChunkAudioContainer::MessageChunkAudioContainer(const FString& fullUrl,
 	LipSyncType lipSyncType,
 	TWeakPtr<Audio2FaceRESTHandler> A2FRestHandler,
 	TFunction<void(const MessageChunkAudioContainer* newState)> callback,
-	int id) :
+	int id,
+	TSharedPtr<A2FMessageBatch, ESPMode::ThreadSafe> A2FBatch) :
 	INDEX(id),
 	LIP_SYNC_TYPE(lipSyncType),
 	FULL_DOWNLOAD_URL(fullUrl),
 	ON_STATE_CHANGED(callback),
-	m_A2FRestHandler(A2FRestHandler)
+	m_A2FRestHandler(A2FRestHandler),
+	m_A2FBatch(A2FBatch)
 {}
 
-void MessageChunkAudioContainer::Continue()
+TSharedPtr<MessageChunkAudioContainer> MessageChunkAudioContainer::CreateUnprocessedCopy() const
 {
-	switch (m_state)
+	// The batch is done with this chunk by now, so the copy generates its lipsync on its own.
+	return MakeShared<MessageChunkAudioContainer>(FULL_DOWNLOAD_URL, LIP_SYNC_TYPE, m_A2FRestHandler,
+		ON_STATE_CHANGED, INDEX, m_A2FBatch);
+}
+
+void MessageChunkAudioContainer::StartProcessing(VoxtaDownloadPriority downloadPriority)
+{
+	if (m_state != MessageChunkState::Idle)
 	{
-		case MessageChunkState::Idle:
-			DownloadData();
-			break;
-		case MessageChunkState::Idle_Downloaded:
-			ProcessAudioData();
-			break;
-		case MessageChunkState::Idle_Processed:
-			if (LIP_SYNC_TYPE == LipSyncType::None)
+		UE_LOGFMT(VoxtaLog, Warning, "Cannot start processing the MessageChunkAudioContainer as it was not Idle. "
+			"Current state: {0}", UEnum::GetValueAsString(m_state));
+		return;
+	}
+	m_state = MessageChunkState::Busy;
+	{
+		FScopeLock lock(&m_downloadGuard);
+		m_downloadPriority = downloadPriority;
+	}
+
+	AsyncTask(ENamedThreads::AnyBackgroundThreadNormalTask,
+		[Self = TWeakPtr<MessageChunkAudioContainer>(AsShared()),
+		context = MakeShared<FProcessingContext, ESPMode::ThreadSafe>(m_cancellationToken)] ()
+		{
+			if (TSharedPtr<MessageChunkAudioContainer> sharedSelf = Self.Pin())
 			{
-				UpdateState(MessageChunkState::ReadyForPlayback);
+				sharedSelf->FetchAudioData(context);
 			}
-			else
+		});
+}
+
+void MessageChunkAudioContainer::PromoteProcessing()
+{
+	{
+		FScopeLock lock(&m_downloadGuard);
+		if (m_downloadPriority == VoxtaDownloadPriority::PlayingChunk)
+		{
+			return;
+		}
+		m_downloadPriority = VoxtaDownloadPriority::PlayingChunk;
+		if (m_download.IsValid())
+		{
+			m_download->SetPriority(m_downloadPriority);
+		}
+		TSharedPtr<Audio2FaceRESTHandler> restHandler = m_A2FRestHandler.Pin();
+		if (m_A2FJobId != 0 && restHandler.IsValid())
+		{
+			restHandler->SetJobPriority(m_A2FJobId, A2FJobPriority::PlayingChunk);
+		}
+	}
+
+	// Playback can't wait for the rest of the message, so a chunk that is still collected by the batch leaves it.
+	if (m_A2FBatch.IsValid())
+	{
+		if (m_A2FBatch->Withdraw(INDEX))
+		{
+			TSharedPtr<FProcessingContext, ESPMode::ThreadSafe> batchedContext;
 			{
-				GenerateLipSync();
+				FScopeLock lock(&m_downloadGuard);
+				batchedContext = MoveTemp(m_batchedContext);
 			}
-			break;
-		case MessageChunkState::Busy:
-		case MessageChunkState::ReadyForPlayback:
-		default:
-			UE_LOGFMT(VoxtaLog, Warning, "Cannot continue the MessageChunkAudioContainer, please check the current "
-				"state before attempting to continue into the next state. Current state: {0}",
-				UEnum::GetValueAsString(m_state));
-			break;
+			if (batchedContext.IsValid())
+			{
+				UE_LOGFMT(VoxtaLog, Log, "MessageChunkAudioContainer with index {0} left the A2F batch, as playback "
+					"is waiting for it.", INDEX);
+				GenerateA2FLipSync(batchedContext.ToSharedRef());
+			}
+		}
+		else
+		{
+			m_A2FBatch->Promote(INDEX);
+		}
 	}
 }
 
@@ -60,9 +106,16 @@ void MessageChunkAudioContainer::CleanupData()
 {
 	UE_LOGFMT(VoxtaLog, Log, "Cleaning up MessageChunkAudioContainer for index: {0}", INDEX);
 
+	// Anything still running for this chunk would only produce audio that nobody will hear.
+	m_cancellationToken->Cancel();
+	{
+		FScopeLock lock(&m_downloadGuard);
+		m_download.Reset();
+	}
+
 	if (m_soundWave != nullptr && m_state != MessageChunkState::CleanedUp)
 	{
-		m_soundWave->RemoveFromRoot();
+		URuntimeAudioImporterLibrary::RecycleImportedSoundWave(m_soundWave);
 		m_soundWave = nullptr;
 	}
 	if (LIP_SYNC_TYPE != LipSyncType::None && m_lipSyncData != nullptr)
@@ -70,13 +123,28 @@ void MessageChunkAudioContainer::CleanupData()
 		m_lipSyncData->ReleaseData();
 		m_lipSyncData = nullptr;
 	}
-	m_rawAudioData.Empty();
+	m_rawAudioData.Reset();
 	m_state = MessageChunkState::CleanedUp;
+
+	if (m_A2FBatch.IsValid() && m_A2FBatch->Withdraw(INDEX))
+	{
+		TSharedPtr<FProcessingContext, ESPMode::ThreadSafe> batchedContext;
+		{
+			FScopeLock lock(&m_downloadGuard);
+			batchedContext = MoveTemp(m_batchedContext);
+		}
+		// Finishes the pipeline, which releases whatever it created so far.
+		if (batchedContext.IsValid())
+		{
+			CompleteStage(batchedContext.ToSharedRef(), false);
+		}
+	}
 }
 
 const TArray<uint8>& MessageChunkAudioContainer::GetRawAudioData() const
 {
-	return m_rawAudioData;
+	static const TArray<uint8> EMPTY_AUDIO_DATA;
+	return m_rawAudioData.IsValid() ? *m_rawAudioData : EMPTY_AUDIO_DATA;
 }
 
 MessageChunkState MessageChunkAudioContainer::GetCurrentState() const
@@ -93,236 +161,500 @@ UImportedSoundWave* MessageChunkAudioContainer::GetSoundWave() const
 	return nullptr;
 }
 
-void MessageChunkAudioContainer::DownloadData()
+FVoxtaAudioMemoryUsage MessageChunkAudioContainer::GetMemoryUsage() const
 {
-	if (m_state != MessageChunkState::Idle)
+	FVoxtaAudioMemoryUsage memoryUsage;
+	memoryUsage.EncodedBytes = m_rawAudioData.IsValid() ? m_rawAudioData->Num() : 0;
+	if (m_soundWave != nullptr)
 	{
-		UE_LOGFMT(VoxtaLog, Warning, "Cannot download data for MessageChunkAudioContainer as it was not Idle. "
-			"Current state: {0}", UEnum::GetValueAsString(m_state));
+		memoryUsage.EncodedBytes += m_soundWave->GetAllocatedEncodedSize();
+		memoryUsage.DecodedBytes = m_soundWave->GetAllocatedPCMSize();
+	}
+	if (LIP_SYNC_TYPE != LipSyncType::None && m_lipSyncData != nullptr)
+	{
+		memoryUsage.LipSyncBytes = m_lipSyncData->GetAllocatedSize();
+	}
+	return memoryUsage;
+}
+
+void MessageChunkAudioContainer::FetchAudioData(TSharedRef<FProcessingContext, ESPMode::ThreadSafe> context)
+{
+	if (m_cancellationToken->IsCancelled())
+	{
+		return;
+	}
+
+	// Custom lipsync exposes the raw bytes to blueprints, so those always need to be downloaded.
+	if (LIP_SYNC_TYPE != LipSyncType::Custom && VoiceLineCache::IsEnabled() &&
+		VoiceLineCache::Get().TryFindByUrl(FULL_DOWNLOAD_URL, static_cast<uint8>(LIP_SYNC_TYPE), context->CachedEntry))
+	{
+		UE_LOGFMT(VoxtaLog, Log, "Found audio data for index {0} in the voiceline cache, skipping the download.", INDEX);
+		ProcessAudioData(context);
 		return;
 	}
-	UpdateState(MessageChunkState::Busy);
 
-	TSharedRef<IHttpRequest, ESPMode::ThreadSafe> httpRequest = FHttpModule::Get().CreateRequest();
-	httpRequest->SetVerb(TEXT("GET"));
-	httpRequest->SetURL(FULL_DOWNLOAD_URL);
-	httpRequest->OnProcessRequestComplete().BindLambda([Self = TWeakPtr<MessageChunkAudioContainer>(AsShared())]
-	(FHttpRequestPtr request, FHttpResponsePtr response, bool bWasSuccessful)
+	// Completes on the http thread, nothing in the response handling needs the game thread.
+	VoxtaResilientDownload::FOnDownloadComplete onComplete =
+		[Self = TWeakPtr<MessageChunkAudioContainer>(AsShared()), context, Url = FULL_DOWNLOAD_URL]
+		(bool success, TArray<uint8>&& content, const FString& contentType)
 		{
-			if (bWasSuccessful && response.IsValid() && EHttpResponseCodes::IsOk(response->GetResponseCode()) &&
-							response->GetContentLength() > 0)
+			if (!success)
+			{
+				SENSITIVE_LOG1(VoxtaLog, Error, "Failed to download audio data from: {0}", Url);
+			}
+			else if (!Self.IsValid())
+			{
+				SENSITIVE_LOG1(VoxtaLog, Error, "Downloaded audio data from: {0} "
+					"But the messageChunkContainer was destroyed?", Url);
+				return;
+			}
+
+			AsyncTask(ENamedThreads::AnyBackgroundThreadNormalTask, [Self, context, success,
+				rawContent = MoveTemp(content), contentType, Url] () mutable
 			{
 				if (TSharedPtr<MessageChunkAudioContainer> sharedSelf = Self.Pin())
 				{
-					TArray<uint8> rawcontent = response->GetContent();
-					AsyncTask(ENamedThreads::GameThread, [sharedSelf, contentCopy = MoveTemp(rawcontent), url = request->GetURL()] () mutable
+					if (success)
 					{
-						if (!sharedSelf.IsValid()) 
-						{ 
-							return; 
-						}
-						sharedSelf->m_rawAudioData = MoveTemp(contentCopy);
-						SENSITIVE_LOG1(VoxtaLog, Log, "Successfully downloaded audio data from: {0}", url);
-						sharedSelf->UpdateState(MessageChunkState::Idle_Downloaded);
-					});
-				}
-				else
-				{
-					SENSITIVE_LOG1(VoxtaLog, Error, "Downloaded audio data from: {0} "
-						"But the messageChunkContainer was destroyed?", request->GetURL());
+						sharedSelf->OnAudioDataDownloaded(context, MoveTemp(rawContent), contentType, Url);
+					}
+					else
+					{
+						// Neither the sound wave nor the lipsync can be made, so the chunk is marked as failed and
+						// playback skips it instead of waiting forever.
+						sharedSelf->CompleteStage(context, false);
+						sharedSelf->CompleteStage(context, false);
+					}
 				}
-			}
-			else
-			{
-				SENSITIVE_LOG1(VoxtaLog, Error, "Failed to download audio data from: {0}", request->GetURL());
-			}
-		});
+			});
+		};
 
 	SENSITIVE_LOG2(VoxtaLog, Log, "Attempting to request audio data for index {0}, from url: {1}", INDEX, FULL_DOWNLOAD_URL);
-	httpRequest->ProcessRequest();
+	// Taken under the lock, a failed download can already have reset m_download from another thread.
+	TWeakPtr<VoxtaResilientDownload, ESPMode::ThreadSafe> weakDownload;
+	{
+		FScopeLock lock(&m_downloadGuard);
+		m_download = VoxtaResilientDownload::Start(FULL_DOWNLOAD_URL, m_downloadPriority,
+			DOWNLOAD_ATTEMPT_DEADLINE_SECONDS, MoveTemp(onComplete));
+		weakDownload = m_download;
+	}
+	m_cancellationToken->OnCancelled([WeakDownload = MoveTemp(weakDownload)] ()
+	{
+		if (TSharedPtr<VoxtaResilientDownload, ESPMode::ThreadSafe> download = WeakDownload.Pin())
+		{
+			download->Cancel();
+		}
+	});
+}
+
+void MessageChunkAudioContainer::OnAudioDataDownloaded(TSharedRef<FProcessingContext, ESPMode::ThreadSafe> context,
+	TArray<uint8>&& rawContent, const FString& contentType, const FString& url)
+{
+	{
+		FScopeLock lock(&m_downloadGuard);
+		m_download.Reset();
+	}
+
+	// After fixing the streaming placeholders the bytes become immutable, and are shared by the decoder and the
+	// lipsync generators.
+	WavChunkWalker::FixStreamingSizes(rawContent.GetData(), rawContent.Num());
+	context->RawAudioData = MakeShared<const TArray<uint8>, ESPMode::ThreadSafe>(MoveTemp(rawContent));
+	context->AudioFormat = URuntimeAudioImporterLibrary::GetAudioFormatFromContentType(contentType);
+
+	// Same bytes from a different url (e.g. a repeated greeting) can still skip decoding & lipsync.
+	if (VoiceLineCache::IsEnabled())
+	{
+		context->ContentHash = VoiceLineCache::HashContent(*context->RawAudioData);
+		if (VoiceLineCache::Get().TryFindByContentHash(context->ContentHash, context->CachedEntry))
+		{
+			VoiceLineCache::Get().AddUrlAlias(url, context->ContentHash);
+		}
+	}
+
+	SENSITIVE_LOG1(VoxtaLog, Log, "Successfully downloaded audio data from: {0}", url);
+	ProcessAudioData(context);
 }
 
-void MessageChunkAudioContainer::ProcessAudioData()
+void MessageChunkAudioContainer::ProcessAudioData(TSharedRef<FProcessingContext, ESPMode::ThreadSafe> context)
 {
-	if (m_state != MessageChunkState::Idle_Downloaded)
+	if (m_cancellationToken->IsCancelled())
 	{
-		UE_LOGFMT(VoxtaLog, Warning, "Cannot process the raw audiodata for MessageChunkAudioContainer as it was not "
-			"in Idle_Downloaded. Current state: {0}", UEnum::GetValueAsString(m_state));
+		UE_LOGFMT(VoxtaLog, Log, "Processing of audio data for index {0} was cancelled before decoding.", INDEX);
 		return;
 	}
 
-	UE_LOGFMT(VoxtaLog, Log, "Attempting to process raw audio data into UImportedSoundWave for index {0}.", INDEX);
-	URuntimeAudioImporterLibrary::ImportAudioFromBuffer(TArray64<uint8>(m_rawAudioData),
-		[Self = TWeakPtr<MessageChunkAudioContainer>(AsShared())] (UImportedSoundWave* soundWave)
+	const bool hasCachedLipSync = context->CachedEntry.HasLipSync(static_cast<uint8>(LIP_SYNC_TYPE));
+	const bool needsWavForLipSync = !hasCachedLipSync &&
+		(LIP_SYNC_TYPE == LipSyncType::OVRLipSync || LIP_SYNC_TYPE == LipSyncType::Audio2Face);
+
+	// Lipsync that doesn't need the decoded audio runs next to the decoder, from the same bytes.
+	if (!needsWavForLipSync)
+	{
+		CompleteStage(context, true);
+	}
+	else if (context->AudioFormat == ERuntimeAudioFormat::Wav)
+	{
+		GenerateLipSync(context);
+	}
+
+	TFunction<void(UImportedSoundWave*)> onImported =
+		[Self = TWeakPtr<MessageChunkAudioContainer>(AsShared()), context] (UImportedSoundWave* soundWave)
 		{
-			if (soundWave)
+			if (!soundWave && !context->CancellationToken->IsCancelled())
 			{
-				if (TSharedPtr<MessageChunkAudioContainer> sharedSelf = Self.Pin())
-				{
-					sharedSelf->m_soundWave = soundWave;
-					sharedSelf->m_soundWave->AddToRoot();
-
-					UE_LOGFMT(VoxtaLog, Log, "Successfully processed raw audio data into UImportedSoundWave for "
-						"index {0}", sharedSelf->INDEX);
-					sharedSelf->UpdateState(MessageChunkState::Idle_Processed);
-				}
+				UE_LOGFMT(VoxtaLog, Error, "Failed to process raw audio data into UImportedSoundWave.");
+			}
+			context->SoundWave = soundWave;
+			if (TSharedPtr<MessageChunkAudioContainer> sharedSelf = Self.Pin())
+			{
+				UE_LOGFMT(VoxtaLog, Log, "Successfully processed raw audio data into UImportedSoundWave for "
+					"index {0}", sharedSelf->INDEX);
+				sharedSelf->CompleteStage(context, soundWave != nullptr);
 			}
 			else
 			{
-				UE_LOGFMT(VoxtaLog, Error, "Failed to process raw audio data into UImportedSoundWave.");
+				ReleaseResults(*context);
 			}
-		});
+		};
+
+	if (context->CachedEntry.DecodedAudio.IsValid())
+	{
+		UE_LOGFMT(VoxtaLog, Log, "Creating UImportedSoundWave for index {0} from the voiceline cache.", INDEX);
+		const FDecodedAudioStruct& cachedAudio = *context->CachedEntry.DecodedAudio;
+		if (needsWavForLipSync && context->AudioFormat != ERuntimeAudioFormat::Wav)
+		{
+			TArray<uint8> wavData;
+			if (URuntimeAudioImporterLibrary::EncodeWavPCM16(cachedAudio, wavData))
+			{
+				context->TranscodedWav = MakeShared<const TArray<uint8>, ESPMode::ThreadSafe>(MoveTemp(wavData));
+			}
+			GenerateLipSync(context);
+		}
+		URuntimeAudioImporterLibrary::ImportAudioFromDecodedInfo(FDecodedAudioStruct(cachedAudio), onImported);
+		return;
+	}
+
+	// The lipsync generators only understand 16-bit WAV, so compressed voicelines get a WAV copy of the decoded PCM.
+	const bool needsWavFromDecoder = needsWavForLipSync && context->AudioFormat != ERuntimeAudioFormat::Wav;
+	TFunction<void(const FDecodedAudioStruct&)> onDecoded =
+		[Self = TWeakPtr<MessageChunkAudioContainer>(AsShared()), context, needsWavFromDecoder, Url = FULL_DOWNLOAD_URL]
+		(const FDecodedAudioStruct& decodedAudio)
+		{
+			if (context->ContentHash != 0)
+			{
+				VoiceLineCache::Get().StoreDecodedAudio(Url, context->ContentHash, decodedAudio);
+			}
+			if (needsWavFromDecoder)
+			{
+				if (decodedAudio.SoundWaveBasicInfo.AudioFormat != ERuntimeAudioFormat::Wav)
+				{
+					TArray<uint8> wavData;
+					if (URuntimeAudioImporterLibrary::EncodeWavPCM16(decodedAudio, wavData))
+					{
+						context->TranscodedWav = MakeShared<const TArray<uint8>, ESPMode::ThreadSafe>(MoveTemp(wavData));
+					}
+				}
+				if (TSharedPtr<MessageChunkAudioContainer> sharedSelf = Self.Pin())
+				{
+					sharedSelf->GenerateLipSync(context);
+				}
+			}
+		};
+
+	// With lazy decoding the full PCM is never materialized, so it is only requested when lipsync needs a WAV copy of it.
+	// The voiceline cache stores the full PCM, so it takes precedence over lazy decoding while it is enabled.
+	const bool isCachingAudio = context->ContentHash != 0;
+	const bool needsDecodedAudio = !URuntimeAudioImporterLibrary::IsLazyDecodeEnabled() || needsWavFromDecoder ||
+		isCachingAudio;
+	if (isCachingAudio && URuntimeAudioImporterLibrary::IsLazyDecodeEnabled())
+	{
+		static std::atomic<bool> hasLoggedCachePrecedence{false};
+		if (!hasLoggedCachePrecedence.exchange(true))
+		{
+			UE_LOGFMT(VoxtaLog, Log, "voxta.Audio.LazyDecode is ignored while voxta.Audio.VoiceLineCache.Enabled is on, "
+				"as the cache needs the fully decoded audio.");
+		}
+	}
+
+	if (m_cancellationToken->IsCancelled())
+	{
+		CompleteStage(context, false);
+		if (needsWavFromDecoder)
+		{
+			CompleteStage(context, false);
+		}
+		return;
+	}
+
+	UE_LOGFMT(VoxtaLog, Log, "Attempting to process raw audio data into UImportedSoundWave for index {0}.", INDEX);
+	URuntimeAudioImporterLibrary::ImportAudioFromBuffer(context->RawAudioData, context->AudioFormat, onImported,
+		needsDecodedAudio ? onDecoded : nullptr);
 }
 
-void MessageChunkAudioContainer::GenerateLipSync()
+void MessageChunkAudioContainer::GenerateLipSync(TSharedRef<FProcessingContext, ESPMode::ThreadSafe> context)
 {
-	if (m_state != MessageChunkState::Idle_Processed)
+	if (m_cancellationToken->IsCancelled())
 	{
-		UE_LOGFMT(VoxtaLog, Warning, "Cannot generate lipsync data for MessageChunkAudioContainer as it was not "
-			"in Idle_Processed. Current state: {0}", UEnum::GetValueAsString(m_state));
+		CompleteStage(context, false);
 		return;
 	}
 
-	UpdateState(MessageChunkState::Busy);
+	const FSharedAudioBytes wavData = context->TranscodedWav.IsValid() ? context->TranscodedWav : context->RawAudioData;
+	if (!wavData.IsValid())
+	{
+		UE_LOGFMT(VoxtaLog, Error, "No WAV data available to generate lipsync for index {0}.", INDEX);
+		CompleteStage(context, false);
+		return;
+	}
 
 	switch (LIP_SYNC_TYPE)
 	{
 		case LipSyncType::OVRLipSync:
 #if WITH_OVRLIPSYNC
-			UE_LOGFMT(VoxtaLog, Log, "Starting OVR lipsync generation for MessageChunkAudioContainer with index: {0}",
-				INDEX);
-			LipSyncGenerator::GenerateOVRLipSyncData(m_rawAudioData,
-				[Self = TWeakPtr<MessageChunkAudioContainer>(AsShared())] (ULipSyncDataOVR* lipsyncData)
-				{
-					if (lipsyncData)
+			{
+				UE_LOGFMT(VoxtaLog, Log, "Starting OVR lipsync generation for MessageChunkAudioContainer with index: {0}",
+					INDEX);
+				LipSyncGenerator::GenerateOVRLipSyncData(wavData, context->ContentHash, m_cancellationToken,
+					[Self = TWeakPtr<MessageChunkAudioContainer>(AsShared()), context] (ULipSyncDataOVR* lipsyncData)
 					{
+						if (!lipsyncData && !context->CancellationToken->IsCancelled())
+						{
+							UE_LOGFMT(VoxtaLog, Error, "Failed to generate OVR lipsyncdata for MessageChunkAudioContainer.");
+						}
+						context->LipSyncData = Cast<ILipSyncBaseData>(lipsyncData);
 						if (TSharedPtr<MessageChunkAudioContainer> sharedSelf = Self.Pin())
 						{
-							sharedSelf->m_lipSyncData = Cast<ILipSyncBaseData>(lipsyncData);
-
-							UE_LOGFMT(VoxtaLog, Log, "Successfully generated OVR lipsyncdata for "
-								"index {0}", sharedSelf->INDEX);
-							sharedSelf->UpdateState(MessageChunkState::ReadyForPlayback);
+							sharedSelf->CompleteStage(context, lipsyncData != nullptr);
 						}
 						else
 						{
 							UE_LOGFMT(VoxtaLog, Error, "Generated OVR lipsyncdata, but the messageChunkContainer "
 								"was destroyed?");
+							ReleaseResults(*context);
 						}
-					}
-					else
-					{
-						UE_LOGFMT(VoxtaLog, Error, "Failed to generate OVR lipsyncdata for MessageChunkAudioContainer.");
-					}
-				});
+					});
+			}
+#else
+			UE_LOGFMT(VoxtaLog, Error, "OvrLipSync was selected, but the module is not present in the project.");
+			CompleteStage(context, false);
 #endif
 			break;
 		case LipSyncType::Audio2Face:
 			{
-				if (!m_A2FRestHandler.IsValid())
+				// Results of earlier sessions skip A2F entirely, FinishProcessing wraps them like VoiceLineCache hits.
+				TArray<uint8> payload;
+				if (LipSyncGenerator::TryLoadA2FLipSyncPayload(*wavData, payload))
 				{
-					UE_LOGFMT(VoxtaLog, Error, "Audio2Face selected but no REST handler supplied, aborting.");
-					UpdateState(MessageChunkState::Idle_Processed);
-					return;
-				}
-
-				TSharedPtr<Audio2FaceRESTHandler> resthandler = m_A2FRestHandler.Pin();
-				if (!resthandler->IsAvailable())
-				{
-					if (resthandler->IsInitializing())
-					{
-						FTSTicker::GetCoreTicker().AddTicker(FTickerDelegate::CreateLambda(
-							[Self = TWeakPtr<MessageChunkAudioContainer>(AsShared())] (float deltaTime)
-							{
-								if (Self.IsValid())
-								{
-									if (TSharedPtr<MessageChunkAudioContainer> sharedSelf = Self.Pin())
-									{
-										if (sharedSelf->m_A2FRestHandler.IsValid())
-										{
-											return sharedSelf->m_A2FRestHandler.Pin()->IsInitializing();
-										}
-										else
-										{
-											sharedSelf->m_state = MessageChunkState::Idle_Processed;
-											sharedSelf->GenerateLipSync();
-											return false;
-										}
-									}
-								}
-								UE_LOGFMT(VoxtaLog, Error, "MessageChunkContainer was destroyed before A2F finished "
-									"with initializing.");
-								return false;
-							}));
-					}
-					else
+					UE_LOGFMT(VoxtaLog, Log, "Found the A2F lipsync of MessageChunkAudioContainer with index {0} in the "
+						"curve cache.", INDEX);
+					if (context->ContentHash != 0 && VoiceLineCache::IsEnabled())
 					{
-						UE_LOGFMT(VoxtaLog, Warning, "A2F is still busy at the moment, skipping lipsync generation request, "
-							"moving the state back into Idle_Processed so it can be re-attempted in a bit.");
-						m_state = MessageChunkState::Idle_Processed; // TODO find a more clean way to do this
+						VoiceLineCache::Get().StoreLipSync(context->ContentHash, static_cast<uint8>(LIP_SYNC_TYPE),
+							CopyTemp(payload));
 					}
-					return;
+					context->CachedEntry.LipSyncPayloads.Add(static_cast<uint8>(LIP_SYNC_TYPE),
+						MakeShared<const TArray<uint8>, ESPMode::ThreadSafe>(MoveTemp(payload)));
+					CompleteStage(context, true);
+					break;
 				}
-
-				UE_LOGFMT(VoxtaLog, Log, "Starting A2F lipsync generation for MessageChunkAudioContainer with index: {0}",
-					INDEX);
-				LipSyncGenerator::GenerateA2FLipSyncData(m_rawAudioData, m_A2FRestHandler,
-					[Self = TWeakPtr<MessageChunkAudioContainer>(AsShared())] (ULipSyncDataA2F* lipsyncData)
-					{
-							if (lipsyncData)
-							{
-								if (TSharedPtr<MessageChunkAudioContainer> sharedSelf = Self.Pin())
-								{
-									sharedSelf->m_lipSyncData = Cast<ILipSyncBaseData>(lipsyncData);
-
-									UE_LOGFMT(VoxtaLog, Log, "Successfully generated A2F lipsyncdata for "
-										"index {0}", sharedSelf->INDEX);
-									sharedSelf->UpdateState(MessageChunkState::ReadyForPlayback);
-								}
-								else
-								{
-									UE_LOGFMT(VoxtaLog, Error, "Generated A2F lipsyncdata, but the messageChunkContainer "
-										"was destroyed?");
-								}
-							}
-							else
-							{
-								UE_LOGFMT(VoxtaLog, Error, "Failed to generate A2F lipsyncdata for MessageChunkAudioContainer.");
-							}
-					});
+				GenerateA2FLipSync(context);
 			}
 			break;
-		case LipSyncType::Custom:
-			m_lipSyncData = Cast<ILipSyncBaseData>(LipSyncGenerator::GenerateCustomLipSyncData());
-			UpdateState(MessageChunkState::ReadyForPlayback);
-			break;
 		default:
 			UE_LOGFMT(VoxtaLog, Error, "Missing LipSync support for {0}.", UEnum::GetValueAsString(LIP_SYNC_TYPE));
+			CompleteStage(context, false);
 			break;
 	}
 }
 
-void MessageChunkAudioContainer::UpdateState(MessageChunkState newState)
+void MessageChunkAudioContainer::GenerateA2FLipSync(TSharedRef<FProcessingContext, ESPMode::ThreadSafe> context)
 {
-	if (m_state == MessageChunkState::CleanedUp)
+	if (!m_A2FRestHandler.IsValid())
 	{
-		UE_LOGFMT(VoxtaLog, Error, "Some process was still running on the MessageChunkAudioContainer after "
-			"it was cleaned up.");
+		UE_LOGFMT(VoxtaLog, Error, "Audio2Face selected but no REST handler supplied, aborting.");
+		CompleteStage(context, false);
 		return;
 	}
 
-	AsyncTask(ENamedThreads::GameThread, [Self = TWeakPtr<MessageChunkAudioContainer>(AsShared()), newState] ()
+	A2FJobPriority priority;
 	{
-		if (Self.IsValid())
+		FScopeLock lock(&m_downloadGuard);
+		priority = m_downloadPriority == VoxtaDownloadPriority::PlayingChunk ?
+			A2FJobPriority::PlayingChunk : A2FJobPriority::Prefetch;
+	}
+
+	const FSharedAudioBytes wavData = context->TranscodedWav.IsValid() ? context->TranscodedWav : context->RawAudioData;
+	TFunction<void(ULipSyncDataA2F*)> onGenerated =
+		[Self = TWeakPtr<MessageChunkAudioContainer>(AsShared()), context] (ULipSyncDataA2F* lipsyncData)
 		{
+			if (!lipsyncData && !context->CancellationToken->IsCancelled())
+			{
+				UE_LOGFMT(VoxtaLog, Error, "Failed to generate A2F lipsyncdata for MessageChunkAudioContainer.");
+			}
+			context->LipSyncData = Cast<ILipSyncBaseData>(lipsyncData);
 			if (TSharedPtr<MessageChunkAudioContainer> sharedSelf = Self.Pin())
 			{
-				sharedSelf->m_state = newState;
-				if (sharedSelf->m_state != MessageChunkState::Busy)
-				{
-					sharedSelf->ON_STATE_CHANGED(sharedSelf.Get());
-				}
+				sharedSelf->CompleteStage(context, lipsyncData != nullptr);
 			}
+			else
+			{
+				UE_LOGFMT(VoxtaLog, Error, "Generated A2F lipsyncdata, but the messageChunkContainer "
+					"was destroyed?");
+				ReleaseResults(*context);
+			}
+		};
+
+	// The chunk that playback waits for is never held back by the rest of the message.
+	if (m_A2FBatch.IsValid() && priority == A2FJobPriority::Prefetch)
+	{
+		{
+			FScopeLock lock(&m_downloadGuard);
+			m_batchedContext = context;
+		}
+		if (m_A2FBatch->TrySubmit(INDEX, wavData, context->ContentHash, m_cancellationToken, onGenerated))
+		{
+			UE_LOGFMT(VoxtaLog, Log, "Added the A2F lipsync generation of MessageChunkAudioContainer with index {0} "
+				"to the batch of its message.", INDEX);
+			return;
+		}
+		FScopeLock lock(&m_downloadGuard);
+		m_batchedContext.Reset();
+	}
+	else if (m_A2FBatch.IsValid())
+	{
+		m_A2FBatch->Withdraw(INDEX);
+	}
+
+	// Queued by the REST handler until one of the A2F endpoints is free, the chunk that is about to play goes first.
+	UE_LOGFMT(VoxtaLog, Log, "Starting A2F lipsync generation for MessageChunkAudioContainer with index: {0}", INDEX);
+	const uint64 jobId = LipSyncGenerator::GenerateA2FLipSyncData(wavData, context->ContentHash, m_A2FRestHandler,
+		priority, m_cancellationToken, MoveTemp(onGenerated));
+
+	FScopeLock lock(&m_downloadGuard);
+	m_A2FJobId = jobId;
+	// Promoted while the job was being queued.
+	if (jobId != 0 && priority != A2FJobPriority::PlayingChunk && m_downloadPriority == VoxtaDownloadPriority::PlayingChunk)
+	{
+		if (TSharedPtr<Audio2FaceRESTHandler> restHandler = m_A2FRestHandler.Pin())
+		{
+			restHandler->SetJobPriority(jobId, A2FJobPriority::PlayingChunk);
+		}
+	}
+}
+
+void MessageChunkAudioContainer::CompleteStage(TSharedRef<FProcessingContext, ESPMode::ThreadSafe> context, bool success)
+{
+	if (!success)
+	{
+		context->bFailed = true;
+	}
+	if (context->NumOfPendingStages.fetch_sub(1) != 1)
+	{
+		return;
+	}
+
+	// The sound wave & lipsync UObjects are created on the game thread, so usually no extra hop is needed here.
+	if (IsInGameThread())
+	{
+		FinishProcessing(context);
+		return;
+	}
+	AsyncTask(ENamedThreads::GameThread, [Self = TWeakPtr<MessageChunkAudioContainer>(AsShared()), context] ()
+	{
+		if (TSharedPtr<MessageChunkAudioContainer> sharedSelf = Self.Pin())
+		{
+			sharedSelf->FinishProcessing(context);
+		}
+	});
+}
+
+void MessageChunkAudioContainer::FinishProcessing(TSharedRef<FProcessingContext, ESPMode::ThreadSafe> context)
+{
+	// Chunks that never submitted their WAV (cached lipsync, failures) stop holding up the batch of their message.
+	if (m_A2FBatch.IsValid())
+	{
+		m_A2FBatch->Withdraw(INDEX);
+		FScopeLock lock(&m_downloadGuard);
+		m_batchedContext.Reset();
+	}
+	if (m_state == MessageChunkState::CleanedUp)
+	{
+		UE_LOGFMT(VoxtaLog, Log, "MessageChunkAudioContainer with index {0} was cleaned up while processing, "
+			"discarding the results.", INDEX);
+		ReleaseResults(*context);
+		return;
+	}
+	if (context->bFailed)
+	{
+		UE_LOGFMT(VoxtaLog, Error, "Processing of the MessageChunkAudioContainer with index {0} failed, "
+			"it will not be played.", INDEX);
+		ReleaseResults(*context);
+		m_state = MessageChunkState::Failed;
+		ON_STATE_CHANGED(this);
+		return;
+	}
+
+	// Already rooted by the import, until it is recycled.
+	m_soundWave = context->SoundWave;
+	m_lipSyncData = context->LipSyncData;
+
+	// Lipsync data that doesn't need generating only has to be wrapped in its UObject.
+	if (m_lipSyncData == nullptr)
+	{
+		const FSharedAudioBytes cachedLipSync = context->CachedEntry.GetLipSyncPayload(static_cast<uint8>(LIP_SYNC_TYPE));
+		switch (LIP_SYNC_TYPE)
+		{
+			case LipSyncType::OVRLipSync:
+#if WITH_OVRLIPSYNC
+				m_lipSyncData = cachedLipSync.IsValid() ?
+					Cast<ILipSyncBaseData>(LipSyncGenerator::CreateOVRLipSyncDataFromCache(*cachedLipSync)) : nullptr;
+#endif
+				break;
+			case LipSyncType::Audio2Face:
+				m_lipSyncData = cachedLipSync.IsValid() ?
+					Cast<ILipSyncBaseData>(LipSyncGenerator::CreateA2FLipSyncDataFromCache(*cachedLipSync)) : nullptr;
+				break;
+			case LipSyncType::Custom:
+				m_lipSyncData = Cast<ILipSyncBaseData>(LipSyncGenerator::GenerateCustomLipSyncData());
+				break;
+			default:
+				break;
 		}
-	});	
-}
\ No newline at end of file
+
+		if (LIP_SYNC_TYPE != LipSyncType::None && m_lipSyncData == nullptr)
+		{
+			UE_LOGFMT(VoxtaLog, Error, "Failed to restore the lipsync data of the MessageChunkAudioContainer with "
+				"index {0}, it will not be played.", INDEX);
+			URuntimeAudioImporterLibrary::RecycleImportedSoundWave(m_soundWave);
+			m_soundWave = nullptr;
+			m_state = MessageChunkState::Failed;
+			ON_STATE_CHANGED(this);
+			return;
+		}
+	}
+
+	// Custom lipsync hands the bytes to blueprints, everything else is done with them once playback is possible.
+	// The decoder & lipsync generators hold their own reference while running, so this never frees memory in use.
+	if (LIP_SYNC_TYPE == LipSyncType::Custom)
+	{
+		m_rawAudioData = context->RawAudioData;
+	}
+
+	UE_LOGFMT(VoxtaLog, Log, "MessageChunkAudioContainer with index {0} is ready for playback.", INDEX);
+	m_state = MessageChunkState::ReadyForPlayback;
+	ON_STATE_CHANGED(this);
+}
+
+void MessageChunkAudioContainer::ReleaseResults(FProcessingContext& context)
+{
+	if (context.SoundWave != nullptr)
+	{
+		URuntimeAudioImporterLibrary::RecycleImportedSoundWave(context.SoundWave);
+		context.SoundWave = nullptr;
+	}
+	if (context.LipSyncData != nullptr)
+	{
+		context.LipSyncData->ReleaseData();
+		context.LipSyncData = nullptr;
+	}
+}
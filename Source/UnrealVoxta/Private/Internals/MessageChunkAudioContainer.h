@@ -5,9 +5,17 @@
 #include "CoreMinimal.h"
 #include "LipSyncType.h"
 #include "MessageChunkState.h"
+#include "WavChunkWalker.h"
+#include "VoiceLineCache.h"
+#include "VoxtaCancellationToken.h"
+#include "VoxtaAudioMemoryBudget.h"
+#include "VoxtaDownloadScheduler.h"
+#include "VoxtaResilientDownload.h"
+#include <atomic>
 
 class UImportedSoundWave;
 class Audio2FaceRESTHandler;
+class A2FMessageBatch;
 class ILipSyncBaseData;
 
 /**
@@ -16,7 +24,9 @@ class ILipSyncBaseData;
  * audio chunk (voiceline) of an AI character. Handles async download from the VoxtaServer REST API,
  * conversion to a playable sound wave, and optional lipsync data generation (A2F, OVR, or custom).
  *
- * The object manages its own state machine and notifies a callback on state transitions.
+ * Once started, download, decode and lipsync generation are chained on worker threads, with decoding and lipsync
+ * generation running in parallel from the same bytes. The game thread is only involved to create the UObjects and to
+ * receive the single ReadyForPlayback notification.
  * Not a UObject; must be managed via shared pointers.
  */
 class MessageChunkAudioContainer : public TSharedFromThis<MessageChunkAudioContainer>
@@ -29,8 +39,9 @@ public:
 	 * @param fullUrl The full URL to download the audio data from (VoxtaServer REST API).
 	 * @param lipSyncType The type of lipsync data to generate for this chunk.
 	 * @param A2FRestHandler Weak pointer to the A2F REST handler (required for A2F lipsync).
-	 * @param callback Callback to invoke on state transitions.
+	 * @param callback Callback invoked on the game thread once the chunk is ready for playback.
 	 * @param id Index of this chunk in the parent VoxtaAudioPlayback's chunk list.
+	 * @param A2FBatch Optional batch shared by all chunks of the message, to solve their A2F lipsync with one job.
 	 *
 	 * TODO: avoid requiring the A2FRestHandler injection, I kinda wanna move it to main subsystem but idk yet.
 	 */
@@ -38,18 +49,32 @@ public:
 		LipSyncType lipSyncType,
 		TWeakPtr<Audio2FaceRESTHandler> A2FRestHandler,
 		TFunction<void(const MessageChunkAudioContainer* newState)> callback,
-		int id);
+		int id,
+		TSharedPtr<A2FMessageBatch, ESPMode::ThreadSafe> A2FBatch = nullptr);
 
 	virtual ~MessageChunkAudioContainer() = default;
 
 	/**
-	 * Advance the internal state machine to the next processing step (download, decode, lipsync, etc).
-	 * Should be called when the previous step is complete.
+	 * Create an idle container for the same voiceline, e.g. to prepare it again after this one was evicted.
+	 *
+	 * @return The new container, it reports to the same callback.
 	 */
-	void Continue();
+	TSharedPtr<MessageChunkAudioContainer> CreateUnprocessedCopy() const;
+
+	/**
+	 * Start downloading and processing the voiceline in the background, up to the point where it can be played.
+	 * Only valid while Idle, must be called from the game thread.
+	 *
+	 * @param downloadPriority The priority class of the download, PlayingChunk if playback is waiting for this chunk.
+	 */
+	void StartProcessing(VoxtaDownloadPriority downloadPriority);
+
+	/** Move the download and the A2F job to the PlayingChunk class, as playback is now waiting for this chunk. */
+	void PromoteProcessing();
 
 	/**
 	 * Clean up all dynamically created objects and data, and mark this chunk as cleaned up.
+	 * Cancels the download, decoding and lipsync generation if they are still running.
 	 * After this call, the chunk cannot be used again.
 	 */
 	void CleanupData();
@@ -57,9 +82,10 @@ public:
 	/**
 	 * Get a reference to the raw audio data bytes for this chunk.
 	 *
-	 * @return Immutable reference to the raw audio data.
+	 * @return Immutable reference to the raw audio data, empty once no consumer needs it anymore.
 	 *
 	 * Note: Main use-case is for custom lipsync, where blueprints could want access to the bytes to do whatever custom logic.
+	 * For the other lipsync types the bytes are released as soon as the chunk is ready for playback.
 	 */
 	const TArray<uint8>& GetRawAudioData() const;
 
@@ -84,6 +110,12 @@ public:
 	 */
 	UImportedSoundWave* GetSoundWave() const;
 
+	/**
+	 * @return The number of bytes this chunk holds on to: the encoded & decoded audio, and the lipsync data.
+	 * 0 until the chunk is ready for playback.
+	 */
+	FVoxtaAudioMemoryUsage GetMemoryUsage() const;
+
 #pragma endregion
 
 #pragma region data
@@ -98,35 +130,112 @@ private:
 	const FString FULL_DOWNLOAD_URL;
 	const TFunction<void(const MessageChunkAudioContainer* chunk)> ON_STATE_CHANGED;
 
-	TArray<uint8> m_rawAudioData;
+	/** Only set once the chunk is ready for playback, and only kept for custom lipsync. */
+	FSharedAudioBytes m_rawAudioData;
 	TWeakPtr<Audio2FaceRESTHandler> m_A2FRestHandler = nullptr;
 	MessageChunkState m_state = MessageChunkState::Idle;
 
+	/** Guards the download, the A2F job & their priority, both are started from a worker thread. */
+	FCriticalSection m_downloadGuard;
+	TSharedPtr<VoxtaResilientDownload, ESPMode::ThreadSafe> m_download;
+	VoxtaDownloadPriority m_downloadPriority = VoxtaDownloadPriority::Prefetch;
+	uint64 m_A2FJobId = 0;
+	/** The pipeline that waits for the A2F batch, kept to generate the lipsync itself if it leaves the batch. */
+	struct FProcessingContext;
+	TSharedPtr<FProcessingContext, ESPMode::ThreadSafe> m_batchedContext;
+	const TSharedPtr<A2FMessageBatch, ESPMode::ThreadSafe> m_A2FBatch;
+
+	/** Time after which a download attempt that didn't complete is retried, including the time spent queued. */
+	static constexpr float DOWNLOAD_ATTEMPT_DEADLINE_SECONDS = 15.f;
+
+	/** Shared with all background work of this chunk, cancelled when the chunk is cleaned up. */
+	const TSharedRef<FVoxtaCancellationToken, ESPMode::ThreadSafe> m_cancellationToken =
+		MakeShared<FVoxtaCancellationToken, ESPMode::ThreadSafe>();
+
 	// UObjects added to root while this object is alive; as UPROPERTY doesn't work with normal classes
 	UImportedSoundWave* m_soundWave = nullptr;
 	ILipSyncBaseData* m_lipSyncData = nullptr;
 #pragma endregion
 
+#pragma region private helper classes
+private:
+	/**
+	 * Everything one run of the processing pipeline produces. Shared by the stages instead of being stored in members,
+	 * so the worker threads never touch data that the game thread can clean up in the meantime.
+	 */
+	struct FProcessingContext
+	{
+		explicit FProcessingContext(const TSharedRef<FVoxtaCancellationToken, ESPMode::ThreadSafe>& cancellationToken) :
+			CancellationToken(cancellationToken)
+		{}
+
+		/** The token of the chunk, so callbacks can still check it after the chunk is gone. */
+		const TSharedRef<FVoxtaCancellationToken, ESPMode::ThreadSafe> CancellationToken;
+
+		FSharedAudioBytes RawAudioData;
+		/** Format announced by the Content-Type of the download, Auto if the server didn't specify a known one. */
+		ERuntimeAudioFormat AudioFormat = ERuntimeAudioFormat::Auto;
+		/** Hash of RawAudioData, 0 if the audio was never downloaded because it was found in the VoiceLineCache. */
+		uint64 ContentHash = 0;
+		/** Whatever the VoiceLineCache already had for this voiceline, lets the processing skip the matching steps. */
+		FVoiceLineCacheEntry CachedEntry;
+		/** 16-bit WAV copy of compressed voicelines, for the lipsync generators. */
+		FSharedAudioBytes TranscodedWav;
+
+		/** Created on the game thread by the stages, added to root until the chunk takes them over. */
+		UImportedSoundWave* SoundWave = nullptr;
+		ILipSyncBaseData* LipSyncData = nullptr;
+
+		/** The sound wave and the lipsync data, the last stage to complete finishes the processing. */
+		std::atomic<int32> NumOfPendingStages = 2;
+		std::atomic<bool> bFailed = false;
+	};
+#pragma endregion
+
 #pragma region private API
 private:
-	/** Download the audio data into memory from the VoxtaServer REST api. */
-	void DownloadData();
+	/** Look the voiceline up in the VoiceLineCache, or download it from the VoxtaServer REST api. (worker thread) */
+	void FetchAudioData(TSharedRef<FProcessingContext, ESPMode::ThreadSafe> context);
 
-	/** Convert the imported raw audiodata into a UImportedSoundWave that can be played. */
-	void ProcessAudioData();
+	/**
+	 * Hash the downloaded bytes and check whether the VoiceLineCache knows them from another url. (worker thread)
+	 *
+	 * @param context The pipeline context.
+	 * @param rawContent The downloaded bytes.
+	 * @param contentType The Content-Type of the download.
+	 * @param url The url the bytes were downloaded from.
+	 */
+	void OnAudioDataDownloaded(TSharedRef<FProcessingContext, ESPMode::ThreadSafe> context, TArray<uint8>&& rawContent,
+		const FString& contentType, const FString& url);
+
+	/** Decode the audio into a UImportedSoundWave and start the lipsync generation next to it. (worker thread) */
+	void ProcessAudioData(TSharedRef<FProcessingContext, ESPMode::ThreadSafe> context);
 
 	/**
-	 * Generate lipsync data based on the raw audiodata, and populate the m_lipSyncData with the result
+	 * Generate lipsync data from the 16-bit WAV bytes. (any thread)
 	 *
-	 * Note: This only supports A2F and OVR at the moment.
+	 * Note: Custom lipsync and cached lipsync data only need a UObject, those are created in FinishProcessing.
+	 */
+	void GenerateLipSync(TSharedRef<FProcessingContext, ESPMode::ThreadSafe> context);
+
+	/**
+	 * Queue the A2F job, with the priority class of the download. (any thread)
+	 * Prefetched chunks of a batched message hand their WAV to the batch instead.
 	 */
-	void GenerateLipSync();
+	void GenerateA2FLipSync(TSharedRef<FProcessingContext, ESPMode::ThreadSafe> context);
 
 	/**
-	 * Update the internal state to keep track where this instance is with processing the data for the voiceline.
+	 * Mark one of the pending stages as done, the last one finishes the processing. (any thread)
 	 *
-	 * @param newState The new state that this instance should consider itself in. (will be broadcasted after setting internally)
+	 * @param context The pipeline context.
+	 * @param success Whether the stage produced its result.
 	 */
-	void UpdateState(MessageChunkState newState);
+	void CompleteStage(TSharedRef<FProcessingContext, ESPMode::ThreadSafe> context, bool success);
+
+	/** Take over the results of the pipeline and notify that the chunk is ready for playback. (game thread) */
+	void FinishProcessing(TSharedRef<FProcessingContext, ESPMode::ThreadSafe> context);
+
+	/** Unroot whatever the pipeline created so far, for when the chunk never takes it over. (game thread) */
+	static void ReleaseResults(FProcessingContext& context);
 #pragma endregion
 };
@@ -0,0 +1,365 @@
+// Copyright(c) 2024 grrimgrriefer & DZnnah, see LICENSE for details.
+
+#if WITH_OVRLIPSYNC
+#include "OVRLipSyncWorkerPool.h"
+#include "VoxtaDefines.h"
+#include "OVRLipSyncContextWrapper.h"
+#include "HAL/RunnableThread.h"
+#include "HAL/IConsoleManager.h"
+#include "Misc/CoreDelegates.h"
+#include "Misc/Paths.h"
+#include "Misc/ScopeLock.h"
+#include "Logging/StructuredLog.h"
+
+namespace
+{
+	TAutoConsoleVariable<int32> CVarOVRNumOfWorkers(
+		TEXT("voxta.OVR.NumOfWorkers"),
+		2,
+		TEXT("Maximum number of threads that generate OVR lipsync in parallel, each keeps its own OVR contexts."));
+
+	FAutoConsoleCommand OVRDumpCommand(
+		TEXT("voxta.OVR.Dump"),
+		TEXT("Log the queue wait, context & processing times of the OVR lipsync worker pool."),
+		FConsoleCommandDelegate::CreateLambda([] ()
+		{
+			OVRLipSyncWorkerPool::Get().DumpToLog();
+		}));
+
+	/** OVR produces one frame per 10 ms of audio. */
+	constexpr int32 FRAMES_PER_SECOND = 100;
+	constexpr int32 CONTEXT_BUFFER_SIZE = 4096;
+
+	bool IsCancelled(const FVoxtaCancellationTokenPtr& cancellationToken)
+	{
+		return cancellationToken.IsValid() && cancellationToken->IsCancelled();
+	}
+}
+
+OVRLipSyncWorkerPool& OVRLipSyncWorkerPool::Get()
+{
+	static OVRLipSyncWorkerPool instance;
+	return instance;
+}
+
+OVRLipSyncWorkerPool::OVRLipSyncWorkerPool() :
+	m_modelPath(FPaths::Combine(FPaths::ProjectPluginsDir(), TEXT("OVRLipSync"), TEXT("OfflineModel"),
+		TEXT("ovrlipsync_offline_model.pb"))),
+	m_jobAvailable(FPlatformProcess::GetSynchEventFromPool(true))
+{
+	m_preExitHandle = FCoreDelegates::OnPreExit.AddRaw(this, &OVRLipSyncWorkerPool::Shutdown);
+}
+
+OVRLipSyncWorkerPool::~OVRLipSyncWorkerPool()
+{
+	Shutdown();
+	FPlatformProcess::ReturnSynchEventToPool(m_jobAvailable);
+	m_jobAvailable = nullptr;
+}
+
+void OVRLipSyncWorkerPool::Enqueue(FSharedAudioBytes audioData, const FWavLayout& waveLayout,
+	FVoxtaCancellationTokenPtr cancellationToken, FOnJobComplete&& onComplete)
+{
+	bool isShutDown = false;
+	{
+		FScopeLock lock(&m_lock);
+		isShutDown = m_isShutDown;
+		if (!isShutDown)
+		{
+			// Only start another worker if the idle ones can't take all queued jobs.
+			const int32 maxWorkers = FMath::Clamp(CVarOVRNumOfWorkers.GetValueOnAnyThread(), 1, MAX_WORKERS);
+			const int32 numOfIdleWorkers = m_workers.Num() - m_numOfBusyWorkers;
+			if (m_queue.Num() >= numOfIdleWorkers && m_workers.Num() < maxWorkers)
+			{
+				TUniquePtr<FWorker> worker = MakeUnique<FWorker>(*this, m_workers.Num());
+				if (worker->IsRunning())
+				{
+					m_workers.Add(MoveTemp(worker));
+				}
+			}
+		}
+
+		if (!isShutDown && !m_workers.IsEmpty())
+		{
+			FJob& job = m_queue.AddDefaulted_GetRef();
+			job.Id = m_nextJobId++;
+			job.AudioData = MoveTemp(audioData);
+			job.WaveLayout = waveLayout;
+			job.CancellationToken = MoveTemp(cancellationToken);
+			job.OnComplete = MoveTemp(onComplete);
+			job.QueuedTime = FPlatformTime::Seconds();
+			m_stats.NumOfJobs++;
+			m_jobAvailable->Trigger();
+			return;
+		}
+	}
+
+	// Outside of the lock, the callback may queue follow-up work.
+	if (isShutDown)
+	{
+		UE_LOGFMT(VoxtaLog, Warning, "OVR lipsync worker pool is shut down, the job is reported as cancelled.");
+	}
+	else
+	{
+		UE_LOGFMT(VoxtaLog, Error, "Failed to start an OVR lipsync worker, FRunnableThread::Create returned nullptr. "
+			"The job is reported as cancelled.");
+	}
+	FOVRLipSyncJobResult result;
+	result.WasCancelled = true;
+	onComplete(MoveTemp(result));
+}
+
+void OVRLipSyncWorkerPool::RecordSequenceBuild(double seconds)
+{
+	FScopeLock lock(&m_lock);
+	m_stats.NumOfSequenceBuilds++;
+	m_stats.TotalSequenceBuildSeconds += seconds;
+	m_stats.MaxSequenceBuildSeconds = FMath::Max(m_stats.MaxSequenceBuildSeconds, seconds);
+}
+
+FOVRLipSyncPoolStats OVRLipSyncWorkerPool::GetStats() const
+{
+	FScopeLock lock(&m_lock);
+	return m_stats;
+}
+
+void OVRLipSyncWorkerPool::DumpToLog() const
+{
+	FScopeLock lock(&m_lock);
+	const int64 numOfCompleted = FMath::Max<int64>(m_stats.NumOfJobs - m_queue.Num() - m_numOfBusyWorkers, 1);
+	const int64 numOfStarted = FMath::Max<int64>(m_stats.NumOfContextsCreated + m_stats.NumOfContextsReused, 1);
+	UE_LOGFMT(VoxtaLog, Log, "OVR: {0} of at most {1} workers started, {2} busy, {3} jobs queued.", m_workers.Num(),
+		FMath::Clamp(CVarOVRNumOfWorkers.GetValueOnAnyThread(), 1, MAX_WORKERS), m_numOfBusyWorkers, m_queue.Num());
+	UE_LOGFMT(VoxtaLog, Log, "OVR: {0} jobs, {1} cancelled, {2} seconds of audio. Contexts {3} created, {4} reused.",
+		m_stats.NumOfJobs, m_stats.NumOfCancelled, FMath::RoundToInt(m_stats.TotalAudioSeconds),
+		m_stats.NumOfContextsCreated, m_stats.NumOfContextsReused);
+	UE_LOGFMT(VoxtaLog, Log, "OVR: Queued avg {0} ms (max {1} ms), context avg {2} ms (max {3} ms), processing avg "
+		"{4} ms (max {5} ms), sequence build avg {6} ms (max {7} ms).",
+		FMath::RoundToInt(m_stats.TotalQueueSeconds * 1000.0 / numOfCompleted),
+		FMath::RoundToInt(m_stats.MaxQueueSeconds * 1000.0),
+		FMath::RoundToInt(m_stats.TotalContextSeconds * 1000.0 / numOfStarted),
+		FMath::RoundToInt(m_stats.MaxContextSeconds * 1000.0),
+		FMath::RoundToInt(m_stats.TotalProcessSeconds * 1000.0 / numOfStarted),
+		FMath::RoundToInt(m_stats.MaxProcessSeconds * 1000.0),
+		FMath::RoundToInt(m_stats.TotalSequenceBuildSeconds * 1000.0 /
+			FMath::Max<int64>(m_stats.NumOfSequenceBuilds, 1)),
+		FMath::RoundToInt(m_stats.MaxSequenceBuildSeconds * 1000.0));
+}
+
+void OVRLipSyncWorkerPool::Shutdown()
+{
+	TArray<TUniquePtr<FWorker>> workers;
+	TArray<FJob> droppedJobs;
+	{
+		FScopeLock lock(&m_lock);
+		if (m_isShutDown)
+		{
+			return;
+		}
+		m_isShutDown = true;
+		FCoreDelegates::OnPreExit.Remove(m_preExitHandle);
+		for (TUniquePtr<FWorker>& worker : m_workers)
+		{
+			worker->Stop();
+		}
+		workers = MoveTemp(m_workers);
+		droppedJobs = MoveTemp(m_queue);
+		m_jobAvailable->Trigger();
+	}
+
+	// Joins the threads, outside of the lock as they need it to return from WaitForJob.
+	workers.Empty();
+	UE_LOGFMT(VoxtaLog, Log, "Stopped the OVR lipsync worker pool, {0} queued jobs are reported as cancelled.",
+		droppedJobs.Num());
+	for (FJob& job : droppedJobs)
+	{
+		FOVRLipSyncJobResult result;
+		result.JobId = job.Id;
+		result.WasCancelled = true;
+		job.OnComplete(MoveTemp(result));
+	}
+}
+
+bool OVRLipSyncWorkerPool::WaitForJob(const FThreadSafeBool& isStopped, FJob& outJob)
+{
+	while (!isStopped)
+	{
+		{
+			FScopeLock lock(&m_lock);
+			if (!m_queue.IsEmpty())
+			{
+				outJob = MoveTemp(m_queue[0]);
+				m_queue.RemoveAt(0, 1, EAllowShrinking::No);
+				m_numOfBusyWorkers++;
+				return true;
+			}
+			// Under the lock, so a job that is queued right after this still wakes us up.
+			if (!m_isShutDown)
+			{
+				m_jobAvailable->Reset();
+			}
+		}
+		m_jobAvailable->Wait();
+	}
+	return false;
+}
+
+void OVRLipSyncWorkerPool::OnJobComplete(const FOVRLipSyncJobResult& result, double audioSeconds)
+{
+	FScopeLock lock(&m_lock);
+	m_numOfBusyWorkers--;
+	m_stats.NumOfCancelled += result.WasCancelled ? 1 : 0;
+	m_stats.TotalAudioSeconds += audioSeconds;
+	m_stats.TotalQueueSeconds += result.QueueSeconds;
+	m_stats.MaxQueueSeconds = FMath::Max(m_stats.MaxQueueSeconds, result.QueueSeconds);
+	m_stats.TotalContextSeconds += result.ContextSeconds;
+	m_stats.MaxContextSeconds = FMath::Max(m_stats.MaxContextSeconds, result.ContextSeconds);
+	m_stats.TotalProcessSeconds += result.ProcessSeconds;
+	m_stats.MaxProcessSeconds = FMath::Max(m_stats.MaxProcessSeconds, result.ProcessSeconds);
+	if (result.WasStarted)
+	{
+		m_stats.NumOfContextsCreated += result.ReusedContext ? 0 : 1;
+		m_stats.NumOfContextsReused += result.ReusedContext ? 1 : 0;
+	}
+}
+
+OVRLipSyncWorkerPool::FWorker::FWorker(OVRLipSyncWorkerPool& pool, int32 index) :
+	m_pool(pool),
+	m_isStopped(false)
+{
+	m_thread = FRunnableThread::Create(this, *FString::Printf(TEXT("VoxtaOVRLipSyncWorker%d"), index), 0,
+		EThreadPriority::TPri_BelowNormal);
+}
+
+OVRLipSyncWorkerPool::FWorker::~FWorker()
+{
+	if (m_thread != nullptr)
+	{
+		Stop();
+		m_thread->WaitForCompletion();
+		delete m_thread;
+		m_thread = nullptr;
+	}
+}
+
+uint32 OVRLipSyncWorkerPool::FWorker::Run()
+{
+	FJob job;
+	while (m_pool.WaitForJob(m_isStopped, job))
+	{
+		Process(job);
+		job = FJob();
+	}
+
+	// Destroyed on the thread that created them.
+	m_contexts.Empty();
+	return 0;
+}
+
+void OVRLipSyncWorkerPool::FWorker::Stop()
+{
+	m_isStopped = true;
+}
+
+void OVRLipSyncWorkerPool::FWorker::Process(FJob& job)
+{
+	FOVRLipSyncJobResult result;
+	result.JobId = job.Id;
+	result.QueueSeconds = FPlatformTime::Seconds() - job.QueuedTime;
+
+	const FWavLayout& waveLayout = job.WaveLayout;
+	const int16* pcmData = reinterpret_cast<const int16*>(job.AudioData->GetData() + waveLayout.DataOffset);
+	const int64 pcmDataSize = waveLayout.DataSize / sizeof(int16);
+	const int32 numChannels = waveLayout.NumChannels;
+	const int32 chunkSizeSamples = static_cast<int32>(waveLayout.SampleRate / FRAMES_PER_SECOND);
+	const int32 chunkSize = numChannels * chunkSizeSamples;
+	const int64 numOfFrames = chunkSize > 0 ? pcmDataSize / chunkSize : 0;
+
+	if (IsCancelled(job.CancellationToken))
+	{
+		result.WasCancelled = true;
+	}
+	else if (numOfFrames > 0)
+	{
+		FContext& context = AcquireContext(waveLayout.SampleRate, result);
+		result.WasStarted = true;
+		const double startTime = FPlatformTime::Seconds();
+		FOVRLipSyncFrames& frames = result.Frames;
+		frames.LaughterScores.Reserve(numOfFrames);
+		float laughterScore = 0.f;
+		for (int64 frame = 0; frame < numOfFrames; frame++)
+		{
+			if (IsCancelled(job.CancellationToken))
+			{
+				result.WasCancelled = true;
+				break;
+			}
+			m_visemes.Reset();
+			context.Wrapper->ProcessFrame(pcmData + frame * chunkSize, chunkSizeSamples, m_visemes, laughterScore,
+				context.FrameDelayInMs, numChannels > 1);
+			if (frame == 0)
+			{
+				frames.NumOfVisemes = m_visemes.Num();
+				frames.VisemeScores.Reserve(numOfFrames * frames.NumOfVisemes);
+			}
+			frames.VisemeScores.Append(m_visemes);
+			frames.LaughterScores.Add(laughterScore);
+		}
+		context.IsDirty = true;
+		context.LastUsedTime = FPlatformTime::Seconds();
+		result.ProcessSeconds = context.LastUsedTime - startTime;
+	}
+
+	const double audioSeconds = static_cast<double>(result.Frames.Num()) / FRAMES_PER_SECOND;
+	m_pool.OnJobComplete(result, audioSeconds);
+	job.OnComplete(MoveTemp(result));
+}
+
+OVRLipSyncWorkerPool::FWorker::FContext& OVRLipSyncWorkerPool::FWorker::AcquireContext(uint32 sampleRate,
+	FOVRLipSyncJobResult& outResult)
+{
+	const double startTime = FPlatformTime::Seconds();
+	FContext* context = m_contexts.Find(sampleRate);
+	outResult.ReusedContext = context != nullptr;
+	if (context == nullptr)
+	{
+		if (m_contexts.Num() >= MAX_CONTEXTS)
+		{
+			uint32 leastRecentlyUsed = 0;
+			double oldestTime = TNumericLimits<double>::Max();
+			for (const TPair<uint32, FContext>& pair : m_contexts)
+			{
+				if (pair.Value.LastUsedTime < oldestTime)
+				{
+					oldestTime = pair.Value.LastUsedTime;
+					leastRecentlyUsed = pair.Key;
+				}
+			}
+			m_contexts.Remove(leastRecentlyUsed);
+		}
+
+		context = &m_contexts.Add(sampleRate);
+		context->Wrapper = MakeUnique<UOVRLipSyncContextWrapper>(ovrLipSyncContextProvider_Enhanced, sampleRate,
+			CONTEXT_BUFFER_SIZE, m_pool.m_modelPath);
+	}
+	else if (context->IsDirty)
+	{
+		// The wrapper can't reset its context, silence for the latency of the provider brings it back to how a new
+		// context starts.
+		const int32 chunkSizeSamples = static_cast<int32>(sampleRate / FRAMES_PER_SECOND);
+		const int32 numOfFrames = FMath::DivideAndRoundUp(FMath::Max(context->FrameDelayInMs, 0),
+			1000 / FRAMES_PER_SECOND) + 1;
+		m_silence.SetNumZeroed(chunkSizeSamples);
+		float laughterScore = 0.f;
+		for (int32 i = 0; i < numOfFrames; i++)
+		{
+			m_visemes.Reset();
+			context->Wrapper->ProcessFrame(m_silence.GetData(), chunkSizeSamples, m_visemes, laughterScore,
+				context->FrameDelayInMs, false);
+		}
+	}
+	context->IsDirty = false;
+	outResult.ContextSeconds = FPlatformTime::Seconds() - startTime;
+	return *context;
+}
+#endif
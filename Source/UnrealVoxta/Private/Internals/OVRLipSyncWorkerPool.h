@@ -0,0 +1,262 @@
+// Copyright(c) 2024 grrimgrriefer & DZnnah, see LICENSE for details.
+
+#pragma once
+
+#if WITH_OVRLIPSYNC
+#include "CoreMinimal.h"
+#include "HAL/Runnable.h"
+#include "HAL/ThreadSafeBool.h"
+#include "WavChunkWalker.h"
+#include "VoxtaCancellationToken.h"
+
+class FRunnableThread;
+class FEvent;
+class UOVRLipSyncContextWrapper;
+
+/**
+ * FOVRLipSyncFrames
+ * The OVR visemes of one voiceline, one frame per 10 ms of audio, stored in one flat buffer instead of an array per frame.
+ */
+struct FOVRLipSyncFrames
+{
+	/** Number of viseme scores per frame, the same for every frame of a provider. */
+	int32 NumOfVisemes = 0;
+	/** Frame-major, NumOfVisemes scores per frame. */
+	TArray<float> VisemeScores;
+	TArray<float> LaughterScores;
+
+	/** @return The number of frames. */
+	int32 Num() const
+	{
+		return LaughterScores.Num();
+	}
+
+	/** @return The viseme scores of one frame. */
+	TConstArrayView<float> GetVisemeScores(int32 frame) const
+	{
+		return TConstArrayView<float>(VisemeScores.GetData() + frame * NumOfVisemes, NumOfVisemes);
+	}
+};
+
+/**
+ * FOVRLipSyncJobResult
+ * The outcome of one job of the OVRLipSyncWorkerPool, with the time spent per step.
+ */
+struct FOVRLipSyncJobResult
+{
+	uint64 JobId = 0;
+	/** True if the job was cancelled (or could not run), Frames then only holds what was processed. */
+	bool WasCancelled = false;
+	/** True if the job got an OVR context, false if it was cancelled while queued or had no audio. */
+	bool WasStarted = false;
+	/** True if an initialized context was reused, false if one had to be created (and the model loaded). */
+	bool ReusedContext = false;
+	FOVRLipSyncFrames Frames;
+	/** Time between being queued and a worker picking the job up. */
+	double QueueSeconds = 0.0;
+	/** Time spent creating the context, or resetting the reused one. */
+	double ContextSeconds = 0.0;
+	/** Time spent in OVR processing the audio. */
+	double ProcessSeconds = 0.0;
+};
+
+/**
+ * FOVRLipSyncPoolStats
+ * Counters of the OVRLipSyncWorkerPool since startup.
+ */
+struct FOVRLipSyncPoolStats
+{
+	int64 NumOfJobs = 0;
+	/** Jobs that were cancelled, whether they were still queued or already running. */
+	int64 NumOfCancelled = 0;
+	int64 NumOfContextsCreated = 0;
+	int64 NumOfContextsReused = 0;
+	/** Seconds of audio that were processed. */
+	double TotalAudioSeconds = 0.0;
+	double TotalQueueSeconds = 0.0;
+	double MaxQueueSeconds = 0.0;
+	double TotalContextSeconds = 0.0;
+	double MaxContextSeconds = 0.0;
+	double TotalProcessSeconds = 0.0;
+	double MaxProcessSeconds = 0.0;
+	/** Time spent on the game thread turning the frames into a UOVRLipSyncFrameSequence. */
+	int64 NumOfSequenceBuilds = 0;
+	double TotalSequenceBuildSeconds = 0.0;
+	double MaxSequenceBuildSeconds = 0.0;
+};
+
+/**
+ * OVRLipSyncWorkerPool
+ * Process-wide pool of long-lived threads that generate the OVR visemes of voicelines, instead of a new thread per
+ * voiceline that loads the offline model all over again.
+ *
+ * Each worker keeps its initialized OVR contexts, one per sample rate, and reuses them for the next job. A reused
+ * context is fed a few frames of silence first, so the smoothing of the previous voiceline doesn't leak into it.
+ * Workers are started when jobs are queued while all others are busy, up to voxta.OVR.NumOfWorkers, and stay alive
+ * until the engine exits. Jobs are picked up in the order they were queued.
+ *
+ * Use 'voxta.OVR.Dump' to log the queue wait, context & processing times, to size the pool.
+ *
+ * Note: All functions are thread-safe. Job callbacks run on the worker thread.
+ */
+class OVRLipSyncWorkerPool
+{
+#pragma region public API
+public:
+	/**
+	 * Invoked exactly once per job, on the worker thread. Jobs that can't run because the pool is shut down (or no
+	 * worker could be started) are reported as cancelled, on the calling thread.
+	 *
+	 * @param result The frames and timings of the job.
+	 */
+	using FOnJobComplete = TFunction<void(FOVRLipSyncJobResult&& result)>;
+
+	/** @return The process-wide pool instance. */
+	static OVRLipSyncWorkerPool& Get();
+
+	/**
+	 * Queue the OVR processing of a voiceline.
+	 *
+	 * @param audioData The raw audiodata in bytes (16-bit PCM wav), kept alive until the job is done.
+	 * @param waveLayout The parsed layout of audioData.
+	 * @param cancellationToken Optional token, the job stops early once it is cancelled.
+	 * @param onComplete Invoked on the worker thread once the job is done or cancelled.
+	 */
+	void Enqueue(FSharedAudioBytes audioData, const FWavLayout& waveLayout,
+		FVoxtaCancellationTokenPtr cancellationToken, FOnJobComplete&& onComplete);
+
+	/**
+	 * Add the time it took to build the frame sequence of a job on the game thread to the counters.
+	 *
+	 * @param seconds The time spent on the game thread.
+	 */
+	void RecordSequenceBuild(double seconds);
+
+	/** @return A snapshot of the counters. */
+	FOVRLipSyncPoolStats GetStats() const;
+
+	/** Log the counters. */
+	void DumpToLog() const;
+
+	~OVRLipSyncWorkerPool();
+#pragma endregion
+
+#pragma region private helper classes
+private:
+	struct FJob
+	{
+		uint64 Id = 0;
+		FSharedAudioBytes AudioData;
+		FWavLayout WaveLayout;
+		FVoxtaCancellationTokenPtr CancellationToken;
+		FOnJobComplete OnComplete;
+		double QueuedTime = 0.0;
+	};
+
+	/**
+	 * FWorker
+	 * One thread of the pool, with the OVR contexts it initialized.
+	 */
+	class FWorker : public FRunnable
+	{
+	public:
+		FWorker(OVRLipSyncWorkerPool& pool, int32 index);
+
+		/** Stops the thread and waits for it to finish its current job. */
+		virtual ~FWorker() override;
+
+		/** Take jobs from the queue until stopped. */
+		virtual uint32 Run() override;
+
+		/** Stop taking new jobs, the current one is still finished. */
+		virtual void Stop() override;
+
+		/** @return True if the thread was started. */
+		bool IsRunning() const
+		{
+			return m_thread != nullptr;
+		}
+
+	private:
+		struct FContext
+		{
+			TUniquePtr<UOVRLipSyncContextWrapper> Wrapper;
+			/** The latency of the provider as reported on the last processed frame. */
+			int32 FrameDelayInMs = 0;
+			/** True once a voiceline was processed, the context has to be reset before the next one. */
+			bool IsDirty = false;
+			double LastUsedTime = 0.0;
+		};
+
+		/** More sample rates than this are unusual, the least recently used context is dropped. */
+		static constexpr int32 MAX_CONTEXTS = 4;
+
+		OVRLipSyncWorkerPool& m_pool;
+		FRunnableThread* m_thread = nullptr;
+		FThreadSafeBool m_isStopped;
+		/** Only touched by this worker's thread. */
+		TMap<uint32, FContext> m_contexts;
+		/** Reused per frame, only touched by this worker's thread. */
+		TArray<float> m_visemes;
+		TArray<int16> m_silence;
+
+		/** Process the audio of a job & report the result. */
+		void Process(FJob& job);
+
+		/**
+		 * Get an OVR context that is ready for a new voiceline, reusing an initialized one if possible.
+		 *
+		 * @param sampleRate The sample rate of the voiceline.
+		 * @param outResult Receives whether the context was reused and the time it took.
+		 *
+		 * @return The context.
+		 */
+		FContext& AcquireContext(uint32 sampleRate, FOVRLipSyncJobResult& outResult);
+	};
+#pragma endregion
+
+#pragma region data
+private:
+	/** Upper bound for voxta.OVR.NumOfWorkers, every worker holds its own model in memory. */
+	static constexpr int32 MAX_WORKERS = 8;
+
+	const FString m_modelPath;
+	mutable FCriticalSection m_lock;
+	TArray<FJob> m_queue;
+	TArray<TUniquePtr<FWorker>> m_workers;
+	int32 m_numOfBusyWorkers = 0;
+	uint64 m_nextJobId = 1;
+	bool m_isShutDown = false;
+	/** Manual-reset, signalled while jobs are queued or the pool is shutting down. */
+	FEvent* m_jobAvailable = nullptr;
+	FDelegateHandle m_preExitHandle;
+	FOVRLipSyncPoolStats m_stats;
+#pragma endregion
+
+#pragma region private API
+private:
+	OVRLipSyncWorkerPool();
+
+	/** Stop all workers before the engine (and the OVRLipSync module) shuts down. Queued jobs are reported as cancelled. */
+	void Shutdown();
+
+	/**
+	 * Block until a job is queued, and take it. (worker threads)
+	 *
+	 * @param isStopped The stop flag of the calling worker.
+	 * @param outJob Receives the job.
+	 *
+	 * @return False if the worker was stopped instead.
+	 */
+	bool WaitForJob(const FThreadSafeBool& isStopped, FJob& outJob);
+
+	/**
+	 * Bookkeeping once a worker finished a job, frees the worker for the next one. (worker threads)
+	 *
+	 * @param result The result of the job.
+	 * @param audioSeconds The duration of the processed audio.
+	 */
+	void OnJobComplete(const FOVRLipSyncJobResult& result, double audioSeconds);
+#pragma endregion
+};
+#endif
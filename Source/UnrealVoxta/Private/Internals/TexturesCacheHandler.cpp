@@ -2,6 +2,7 @@
 
 #include "TexturesCacheHandler.h"
 #include "VoxtaDefines.h"
+#include "VoxtaDownloadScheduler.h"
 #include "HttpModule.h"
 #include "Interfaces/IHttpBase.h"
 #include "Interfaces/IHttpRequest.h"
@@ -54,8 +55,8 @@ void TexturesCacheHandler::FetchTextureFromUrl(const FString& url, FDownloadedTe
 	TSharedRef<IHttpRequest, ESPMode::ThreadSafe> httpRequest = FHttpModule::Get().CreateRequest();
 	httpRequest->SetURL(url);
 	httpRequest->SetVerb(TEXT("GET"));
-	httpRequest->SetTimeout(10.0f);
-	httpRequest->OnProcessRequestComplete().BindLambda([Self = TWeakPtr<TexturesCacheHandler>(AsShared()), URL = url]
+	FHttpRequestCompleteDelegate onComplete = FHttpRequestCompleteDelegate::CreateLambda(
+		[Self = TWeakPtr<TexturesCacheHandler>(AsShared()), URL = url]
 	(FHttpRequestPtr request, FHttpResponsePtr response, bool bWasSuccessful)
 		{
 			if (TSharedPtr<TexturesCacheHandler> sharedSelf = Self.Pin())
@@ -131,5 +132,7 @@ void TexturesCacheHandler::FetchTextureFromUrl(const FString& url, FDownloadedTe
 			}			
 		});
 
-	httpRequest->ProcessRequest();
+	// Thumbnails are queued behind all voicelines, so a long character list never delays the audio.
+	VoxtaDownloadScheduler::Get().Enqueue(httpRequest, VoxtaDownloadPriority::Thumbnail, THUMBNAIL_DEADLINE_SECONDS,
+		MoveTemp(onComplete));
 }
\ No newline at end of file
@@ -57,5 +57,8 @@ private:
 
 	FCriticalSection m_wrapperLock;
 	TArray<TSharedPtr<IImageWrapper>> m_imageWrappers;
+
+	/** Time after which a thumbnail download that didn't complete is considered failed, including the time queued. */
+	static constexpr float THUMBNAIL_DEADLINE_SECONDS = 10.f;
 #pragma endregion
 };
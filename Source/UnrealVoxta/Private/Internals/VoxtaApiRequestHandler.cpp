@@ -4,9 +4,17 @@
 #include "VoxtaDefines.h"
 #include "SignalR/Public/SignalRValue.h"
 #include "AiCharData.h"
+#include "RuntimeAudioImporter/RuntimeAudioImporterLibrary.h"
 
 FSignalRValue VoxtaApiRequestHandler::GetAuthenticateRequestData()
 {
+	// Advertised in order of preference, so the server picks the most compact format we can decode.
+	TArray<FSignalRValue> acceptedAudioContentTypes;
+	for (const FString& contentType : URuntimeAudioImporterLibrary::GetSupportedContentTypes())
+	{
+		acceptedAudioContentTypes.Emplace(contentType);
+	}
+
 	return FSignalRValue(TMap<FString, FSignalRValue> {
 		{ EASY_STRING("$type"), SIGNALR_STRING("authenticate") },
 		{ EASY_STRING("client"), SIGNALR_STRING("UnrealVoxta") },
@@ -15,8 +23,7 @@ FSignalRValue VoxtaApiRequestHandler::GetAuthenticateRequestData()
 		{ EASY_STRING("capabilities"), FSignalRValue(TMap<FString, FSignalRValue> {
 			{ EASY_STRING("audioInput"),  SIGNALR_STRING("WebSocketStream") },
 			{ EASY_STRING("audioOutput"),  SIGNALR_STRING("Url") },
-			{ EASY_STRING("acceptedAudioContentTypes"), FSignalRValue(TArray<FSignalRValue> {
-				SIGNALR_STRING("audio/x-wav") }) }
+			{ EASY_STRING("acceptedAudioContentTypes"), FSignalRValue(MoveTemp(acceptedAudioContentTypes)) }
 		}) }
 	});
 }
@@ -0,0 +1,234 @@
+// Copyright(c) 2024 grrimgrriefer & DZnnah, see LICENSE for details.
+
+#include "VoxtaAudioMemoryBudget.h"
+#include "VoxtaAudioPlayback.h"
+#include "MessageChunkAudioContainer.h"
+#include "VoxtaDefines.h"
+#include "Logging/StructuredLog.h"
+#include "HAL/IConsoleManager.h"
+#include "Stats/Stats.h"
+
+DECLARE_STATS_GROUP(TEXT("VoxtaAudio"), STATGROUP_VoxtaAudio, STATCAT_Advanced);
+DECLARE_MEMORY_STAT(TEXT("Encoded audio"), STAT_VoxtaAudioEncodedMemory, STATGROUP_VoxtaAudio);
+DECLARE_MEMORY_STAT(TEXT("Decoded audio"), STAT_VoxtaAudioDecodedMemory, STATGROUP_VoxtaAudio);
+DECLARE_MEMORY_STAT(TEXT("Lipsync data"), STAT_VoxtaAudioLipSyncMemory, STATGROUP_VoxtaAudio);
+DECLARE_DWORD_ACCUMULATOR_STAT(TEXT("Playback components"), STAT_VoxtaAudioPlaybackComponents, STATGROUP_VoxtaAudio);
+DECLARE_DWORD_ACCUMULATOR_STAT(TEXT("Evicted chunks"), STAT_VoxtaAudioEvictedChunks, STATGROUP_VoxtaAudio);
+DECLARE_DWORD_ACCUMULATOR_STAT(TEXT("Throttled preparations"), STAT_VoxtaAudioThrottledPreparations, STATGROUP_VoxtaAudio);
+
+namespace
+{
+	TAutoConsoleVariable<int32> CVarAudioMemoryBudgetMB(
+		TEXT("voxta.Audio.Memory.BudgetMB"),
+		256,
+		TEXT("Soft limit for the memory of all voiceline playback combined, prepared chunks that are not needed yet "
+			"are evicted above it. 0 disables the budget."));
+
+	TAutoConsoleVariable<int32> CVarAudioMemoryPrepareThresholdPercent(
+		TEXT("voxta.Audio.Memory.PrepareThresholdPercent"),
+		75,
+		TEXT("Percentage of the budget above which queued messages are no longer prepared ahead of time."));
+
+	FAutoConsoleCommand AudioMemoryDumpCommand(
+		TEXT("voxta.Audio.Memory.Dump"),
+		TEXT("Log the memory used by voiceline playback, per playback component."),
+		FConsoleCommandDelegate::CreateLambda([] ()
+		{
+			VoxtaAudioMemoryBudget::Get().DumpToLog();
+		}));
+}
+
+VoxtaAudioMemoryBudget& VoxtaAudioMemoryBudget::Get()
+{
+	static VoxtaAudioMemoryBudget instance;
+	return instance;
+}
+
+int64 VoxtaAudioMemoryBudget::GetBudgetBytes()
+{
+	return static_cast<int64>(FMath::Max(CVarAudioMemoryBudgetMB.GetValueOnGameThread(), 0)) * 1024 * 1024;
+}
+
+void VoxtaAudioMemoryBudget::UpdateUsage(UVoxtaAudioPlayback* owner, const FVoxtaAudioMemoryUsage& usage)
+{
+	check(IsInGameThread());
+
+	FVoxtaAudioMemoryUsage& ownerUsage = m_usagePerOwner.FindOrAdd(owner);
+	m_totalUsage -= ownerUsage;
+	ownerUsage = usage;
+	m_totalUsage += usage;
+	m_peakBytes = FMath::Max(m_peakBytes, m_totalUsage.GetTotal());
+
+	const int64 budgetBytes = GetBudgetBytes();
+	if (!m_isEvicting && budgetBytes > 0 && m_totalUsage.GetTotal() > budgetBytes)
+	{
+		EnforceBudget();
+	}
+	ResumeThrottledOwners();
+	UpdateStats();
+}
+
+void VoxtaAudioMemoryBudget::RemoveOwner(const UVoxtaAudioPlayback* owner)
+{
+	check(IsInGameThread());
+
+	const TWeakObjectPtr<UVoxtaAudioPlayback> key(const_cast<UVoxtaAudioPlayback*>(owner));
+	FVoxtaAudioMemoryUsage removedUsage;
+	if (m_usagePerOwner.RemoveAndCopyValue(key, removedUsage))
+	{
+		m_totalUsage -= removedUsage;
+	}
+	m_throttledOwners.Remove(key);
+
+	// Components that were destroyed without ending play.
+	for (auto it = m_usagePerOwner.CreateIterator(); it; ++it)
+	{
+		if (!it->Key.IsValid())
+		{
+			m_totalUsage -= it->Value;
+			it.RemoveCurrent();
+		}
+	}
+	ResumeThrottledOwners();
+	UpdateStats();
+}
+
+bool VoxtaAudioMemoryBudget::TryReservePreparation(UVoxtaAudioPlayback* owner)
+{
+	check(IsInGameThread());
+
+	if (IsBelowPrepareThreshold())
+	{
+		return true;
+	}
+
+	if (!m_throttledOwners.Contains(owner))
+	{
+		UE_LOGFMT(VoxtaLog, Log, "Audio memory usage of {0} KiB is above the prepare threshold, queued messages of "
+			"character with id: {1} will be prepared once memory is available.",
+			m_totalUsage.GetTotal() / 1024, owner->m_characterId);
+		m_throttledOwners.Add(owner);
+	}
+	m_numOfThrottledPreparations++;
+	INC_DWORD_STAT(STAT_VoxtaAudioThrottledPreparations);
+	return false;
+}
+
+FVoxtaAudioMemoryStats VoxtaAudioMemoryBudget::GetStats() const
+{
+	FVoxtaAudioMemoryStats stats;
+	stats.Usage = m_totalUsage;
+	stats.PeakBytes = m_peakBytes;
+	stats.BudgetBytes = GetBudgetBytes();
+	stats.NumOfEvictions = m_numOfEvictions;
+	stats.EvictedBytes = m_evictedBytes;
+	stats.NumOfThrottledPreparations = m_numOfThrottledPreparations;
+	stats.NumOfPlaybackComponents = m_usagePerOwner.Num();
+	return stats;
+}
+
+void VoxtaAudioMemoryBudget::DumpToLog() const
+{
+	const FVoxtaAudioMemoryStats stats = GetStats();
+	UE_LOGFMT(VoxtaLog, Log, "AudioMemory: {0} KiB of {1} KiB budget in use (peak {2} KiB), {3} KiB encoded, {4} KiB "
+		"decoded, {5} KiB lipsync.", stats.Usage.GetTotal() / 1024, stats.BudgetBytes / 1024, stats.PeakBytes / 1024,
+		stats.Usage.EncodedBytes / 1024, stats.Usage.DecodedBytes / 1024, stats.Usage.LipSyncBytes / 1024);
+	UE_LOGFMT(VoxtaLog, Log, "AudioMemory: {0} evicted chunks ({1} KiB), {2} throttled preparations, {3} playback "
+		"components.", stats.NumOfEvictions, stats.EvictedBytes / 1024, stats.NumOfThrottledPreparations,
+		stats.NumOfPlaybackComponents);
+
+	for (const TPair<TWeakObjectPtr<UVoxtaAudioPlayback>, FVoxtaAudioMemoryUsage>& entry : m_usagePerOwner)
+	{
+		const UVoxtaAudioPlayback* owner = entry.Key.Get();
+		UE_LOGFMT(VoxtaLog, Log, "  {0} (character {1}): {2} KiB encoded, {3} KiB decoded, {4} KiB lipsync{5}",
+			owner ? owner->GetReadableName() : TEXT("<destroyed>"), owner ? owner->m_characterId : FGuid(),
+			entry.Value.EncodedBytes / 1024, entry.Value.DecodedBytes / 1024, entry.Value.LipSyncBytes / 1024,
+			m_throttledOwners.Contains(entry.Key) ? TEXT(", throttled") : TEXT(""));
+	}
+}
+
+bool VoxtaAudioMemoryBudget::IsBelowPrepareThreshold() const
+{
+	const int64 budgetBytes = GetBudgetBytes();
+	if (budgetBytes == 0)
+	{
+		return true;
+	}
+	const int32 thresholdPercent = FMath::Clamp(CVarAudioMemoryPrepareThresholdPercent.GetValueOnGameThread(), 0, 100);
+	return m_totalUsage.GetTotal() < budgetBytes * thresholdPercent / 100;
+}
+
+void VoxtaAudioMemoryBudget::EnforceBudget()
+{
+	TArray<TPair<UVoxtaAudioPlayback*, FVoxtaAudioEvictionCandidate>> candidates;
+	for (const TPair<TWeakObjectPtr<UVoxtaAudioPlayback>, FVoxtaAudioMemoryUsage>& entry : m_usagePerOwner)
+	{
+		if (UVoxtaAudioPlayback* owner = entry.Key.Get())
+		{
+			TArray<FVoxtaAudioEvictionCandidate> ownerCandidates;
+			owner->CollectEvictionCandidates(ownerCandidates);
+			for (FVoxtaAudioEvictionCandidate& candidate : ownerCandidates)
+			{
+				candidates.Emplace(owner, MoveTemp(candidate));
+			}
+		}
+	}
+
+	// Furthest from playback first, so the chunks that are needed soonest stay prepared.
+	candidates.Sort([] (const TPair<UVoxtaAudioPlayback*, FVoxtaAudioEvictionCandidate>& a,
+		const TPair<UVoxtaAudioPlayback*, FVoxtaAudioEvictionCandidate>& b)
+		{
+			return a.Value.Distance != b.Value.Distance ? a.Value.Distance > b.Value.Distance : a.Value.Bytes > b.Value.Bytes;
+		});
+
+	TGuardValue<bool> evictingGuard(m_isEvicting, true);
+	const int64 budgetBytes = GetBudgetBytes();
+	for (const TPair<UVoxtaAudioPlayback*, FVoxtaAudioEvictionCandidate>& candidate : candidates)
+	{
+		if (m_totalUsage.GetTotal() <= budgetBytes)
+		{
+			break;
+		}
+		const TSharedPtr<MessageChunkAudioContainer> chunk = candidate.Value.Chunk.Pin();
+		if (chunk.IsValid() && candidate.Key->EvictPreparedChunk(chunk.Get()))
+		{
+			m_numOfEvictions++;
+			m_evictedBytes += candidate.Value.Bytes;
+			INC_DWORD_STAT(STAT_VoxtaAudioEvictedChunks);
+		}
+	}
+
+	if (m_totalUsage.GetTotal() > budgetBytes)
+	{
+		UE_LOGFMT(VoxtaLog, Verbose, "Audio memory usage of {0} KiB stays above the budget of {1} KiB, nothing else "
+			"can be evicted.", m_totalUsage.GetTotal() / 1024, budgetBytes / 1024);
+	}
+}
+
+void VoxtaAudioMemoryBudget::ResumeThrottledOwners()
+{
+	// While evicting, resumed owners could start preparing the chunks that were just dropped.
+	if (m_isEvicting || m_throttledOwners.Num() == 0 || !IsBelowPrepareThreshold())
+	{
+		return;
+	}
+
+	// Resuming reports new usage, which can throttle the owners again.
+	TSet<TWeakObjectPtr<UVoxtaAudioPlayback>> resumedOwners = MoveTemp(m_throttledOwners);
+	m_throttledOwners.Reset();
+	for (const TWeakObjectPtr<UVoxtaAudioPlayback>& owner : resumedOwners)
+	{
+		if (owner.IsValid())
+		{
+			owner->ContinueProcessingAhead();
+		}
+	}
+}
+
+void VoxtaAudioMemoryBudget::UpdateStats() const
+{
+	SET_MEMORY_STAT(STAT_VoxtaAudioEncodedMemory, m_totalUsage.EncodedBytes);
+	SET_MEMORY_STAT(STAT_VoxtaAudioDecodedMemory, m_totalUsage.DecodedBytes);
+	SET_MEMORY_STAT(STAT_VoxtaAudioLipSyncMemory, m_totalUsage.LipSyncBytes);
+	SET_DWORD_STAT(STAT_VoxtaAudioPlaybackComponents, m_usagePerOwner.Num());
+}
@@ -0,0 +1,163 @@
+// Copyright(c) 2024 grrimgrriefer & DZnnah, see LICENSE for details.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "UObject/WeakObjectPtrTemplates.h"
+
+class MessageChunkAudioContainer;
+class UVoxtaAudioPlayback;
+
+/**
+ * FVoxtaAudioMemoryUsage
+ * Bytes held for voiceline playback, split up by the kind of data.
+ */
+struct FVoxtaAudioMemoryUsage
+{
+	/** Encoded audio: the raw bytes kept for custom lipsync, and the bytes of lazily decoded sound waves. */
+	int64 EncodedBytes = 0;
+	/** Decoded PCM data, or the block cache of lazily decoded sound waves. */
+	int64 DecodedBytes = 0;
+	/** Generated lipsync data. */
+	int64 LipSyncBytes = 0;
+
+	/** @return The sum of all kinds of data. */
+	int64 GetTotal() const
+	{
+		return EncodedBytes + DecodedBytes + LipSyncBytes;
+	}
+
+	FVoxtaAudioMemoryUsage& operator+=(const FVoxtaAudioMemoryUsage& other)
+	{
+		EncodedBytes += other.EncodedBytes;
+		DecodedBytes += other.DecodedBytes;
+		LipSyncBytes += other.LipSyncBytes;
+		return *this;
+	}
+
+	FVoxtaAudioMemoryUsage& operator-=(const FVoxtaAudioMemoryUsage& other)
+	{
+		EncodedBytes -= other.EncodedBytes;
+		DecodedBytes -= other.DecodedBytes;
+		LipSyncBytes -= other.LipSyncBytes;
+		return *this;
+	}
+};
+
+/**
+ * FVoxtaAudioEvictionCandidate
+ * A chunk that was prepared ahead of time but is not needed yet, so it can be dropped and prepared again later.
+ */
+struct FVoxtaAudioEvictionCandidate
+{
+	TWeakPtr<MessageChunkAudioContainer> Chunk;
+	/** The bytes that are freed by dropping the chunk. */
+	int64 Bytes = 0;
+	/** The number of chunks its playback component will play before this one, the furthest ones are evicted first. */
+	int Distance = 0;
+};
+
+/**
+ * FVoxtaAudioMemoryStats
+ * Counters of the VoxtaAudioMemoryBudget since startup, for profiling and the dump console command.
+ */
+struct FVoxtaAudioMemoryStats
+{
+	FVoxtaAudioMemoryUsage Usage;
+	int64 PeakBytes = 0;
+	int64 BudgetBytes = 0;
+	int64 NumOfEvictions = 0;
+	int64 EvictedBytes = 0;
+	int64 NumOfThrottledPreparations = 0;
+	int32 NumOfPlaybackComponents = 0;
+};
+
+/**
+ * VoxtaAudioMemoryBudget
+ * Process-wide accounting of the memory used by voiceline playback, across all UVoxtaAudioPlayback instances.
+ * Without it every component only limits itself, so a scene with many talking characters can still pile up decoded
+ * audio of queued messages without bounds.
+ *
+ * Playback components report their usage whenever it changes. Once the total reaches the prepare threshold
+ * (voxta.Audio.Memory.PrepareThresholdPercent of voxta.Audio.Memory.BudgetMB), no component starts preparing queued
+ * messages anymore. If the total exceeds the budget, chunks that are prepared but not needed yet are evicted, the ones
+ * that would be played last go first. Chunks that are playing or next in line are never evicted, so the budget is soft.
+ *
+ * Use 'voxta.Audio.Memory.Dump' to log the usage per component, or 'stat VoxtaAudio' for the live counters.
+ *
+ * Note: Game thread only, like the playback components themselves.
+ */
+class VoxtaAudioMemoryBudget
+{
+#pragma region public API
+public:
+	/** @return The process-wide instance. */
+	static VoxtaAudioMemoryBudget& Get();
+
+	/** @return The budget in bytes, 0 if the budget is disabled. */
+	static int64 GetBudgetBytes();
+
+	/**
+	 * Register the current usage of a playback component, replacing what it reported before.
+	 * Evicts prepared chunks of any component if this pushes the total over the budget.
+	 *
+	 * @param owner The playback component.
+	 * @param usage The bytes held by all of its chunks.
+	 */
+	void UpdateUsage(UVoxtaAudioPlayback* owner, const FVoxtaAudioMemoryUsage& usage);
+
+	/**
+	 * Forget a playback component, e.g. once it ends play.
+	 *
+	 * @param owner The playback component.
+	 */
+	void RemoveOwner(const UVoxtaAudioPlayback* owner);
+
+	/**
+	 * Check whether queued messages may be prepared ahead of time. If not, the component is notified via
+	 * ContinueProcessingAhead once enough memory is available again.
+	 *
+	 * @param owner The playback component that wants to prepare a chunk.
+	 *
+	 * @return True if the total usage is below the prepare threshold.
+	 */
+	bool TryReservePreparation(UVoxtaAudioPlayback* owner);
+
+	/** @return A snapshot of the counters. */
+	FVoxtaAudioMemoryStats GetStats() const;
+
+	/** Log the stats and the usage of every playback component. */
+	void DumpToLog() const;
+#pragma endregion
+
+#pragma region data
+private:
+	TMap<TWeakObjectPtr<UVoxtaAudioPlayback>, FVoxtaAudioMemoryUsage> m_usagePerOwner;
+	/** Components that were denied a preparation, and are waiting for memory to become available. */
+	TSet<TWeakObjectPtr<UVoxtaAudioPlayback>> m_throttledOwners;
+	FVoxtaAudioMemoryUsage m_totalUsage;
+	int64 m_peakBytes = 0;
+	int64 m_numOfEvictions = 0;
+	int64 m_evictedBytes = 0;
+	int64 m_numOfThrottledPreparations = 0;
+	/** Evicting reports the new usage again, which must not start another eviction round. */
+	bool m_isEvicting = false;
+#pragma endregion
+
+#pragma region private API
+private:
+	VoxtaAudioMemoryBudget() = default;
+
+	/** @return True if the total usage is below the prepare threshold. */
+	bool IsBelowPrepareThreshold() const;
+
+	/** Evict prepared chunks, furthest from playback first, until the total is within the budget again. */
+	void EnforceBudget();
+
+	/** Let throttled components continue preparing, if the usage dropped below the prepare threshold. */
+	void ResumeThrottledOwners();
+
+	/** Publish the totals to the stats system. */
+	void UpdateStats() const;
+#pragma endregion
+};
@@ -0,0 +1,290 @@
+// Copyright(c) 2024 grrimgrriefer & DZnnah, see LICENSE for details.
+
+#include "VoxtaDownloadScheduler.h"
+#include "VoxtaDefines.h"
+#include "Interfaces/IHttpResponse.h"
+#include "Logging/StructuredLog.h"
+#include "HAL/IConsoleManager.h"
+#include "Misc/ScopeLock.h"
+
+namespace
+{
+	TAutoConsoleVariable<int32> CVarHttpMaxConnectionsPerHost(
+		TEXT("voxta.Http.MaxConnectionsPerHost"),
+		4,
+		TEXT("Maximum number of downloads in flight per host, one of them is reserved for the voiceline that is playing."));
+
+	FAutoConsoleCommand HttpDumpCommand(
+		TEXT("voxta.Http.Dump"),
+		TEXT("Log the latency & throughput of the downloads per priority class."),
+		FConsoleCommandDelegate::CreateLambda([] ()
+		{
+			VoxtaDownloadScheduler::Get().DumpToLog();
+		}));
+}
+
+VoxtaDownloadScheduler& VoxtaDownloadScheduler::Get()
+{
+	static VoxtaDownloadScheduler instance;
+	return instance;
+}
+
+void VoxtaDownloadScheduler::Enqueue(const TSharedRef<IHttpRequest, ESPMode::ThreadSafe>& request,
+	VoxtaDownloadPriority priority, float deadlineSeconds, FHttpRequestCompleteDelegate&& onComplete)
+{
+	// Lets the http module keep the connection open for the next request to the same host.
+	if (request->GetHeader(TEXT("Connection")).IsEmpty())
+	{
+		request->SetHeader(TEXT("Connection"), TEXT("keep-alive"));
+	}
+
+	{
+		FScopeLock lock(&m_lock);
+		const double now = FPlatformTime::Seconds();
+		FQueuedRequest& queuedRequest = m_queue.AddDefaulted_GetRef();
+		queuedRequest.Request = request;
+		queuedRequest.OnComplete = MoveTemp(onComplete);
+		queuedRequest.Host = GetHost(request->GetURL());
+		queuedRequest.Priority = priority;
+		queuedRequest.QueuedTime = now;
+		queuedRequest.Deadline = now + deadlineSeconds;
+		m_stats[static_cast<uint8>(priority)].NumOfRequests++;
+
+		// Stable, so each class stays in the order it was queued.
+		m_queue.StableSort([] (const FQueuedRequest& a, const FQueuedRequest& b)
+			{
+				return a.Priority < b.Priority;
+			});
+	}
+	Pump();
+}
+
+void VoxtaDownloadScheduler::SetPriority(const FHttpRequestPtr& request, VoxtaDownloadPriority priority)
+{
+	{
+		FScopeLock lock(&m_lock);
+		FQueuedRequest* queuedRequest = m_queue.FindByPredicate([&request] (const FQueuedRequest& queued)
+			{
+				return queued.Request == request;
+			});
+		if (queuedRequest == nullptr || queuedRequest->Priority == priority)
+		{
+			return;
+		}
+
+		// Counted in the class it ends up being sent with.
+		m_stats[static_cast<uint8>(queuedRequest->Priority)].NumOfRequests--;
+		m_stats[static_cast<uint8>(priority)].NumOfRequests++;
+		queuedRequest->Priority = priority;
+		m_queue.StableSort([] (const FQueuedRequest& a, const FQueuedRequest& b)
+			{
+				return a.Priority < b.Priority;
+			});
+	}
+	Pump();
+}
+
+void VoxtaDownloadScheduler::Cancel(const FHttpRequestPtr& request)
+{
+	if (!request.IsValid())
+	{
+		return;
+	}
+
+	FQueuedRequest cancelledRequest;
+	bool wasQueued = false;
+	{
+		FScopeLock lock(&m_lock);
+		const int queueIndex = m_queue.IndexOfByPredicate([&request] (const FQueuedRequest& queued)
+			{
+				return queued.Request == request;
+			});
+		if (queueIndex != INDEX_NONE)
+		{
+			cancelledRequest = MoveTemp(m_queue[queueIndex]);
+			m_queue.RemoveAt(queueIndex);
+			m_stats[static_cast<uint8>(cancelledRequest.Priority)].NumOfCancelled++;
+			wasQueued = true;
+		}
+		else if (FActiveRequest* activeRequest = m_activeRequests.Find(request.Get()))
+		{
+			activeRequest->bCancelled = true;
+		}
+		else
+		{
+			return;
+		}
+	}
+
+	if (wasQueued)
+	{
+		cancelledRequest.OnComplete.ExecuteIfBound(request, nullptr, false);
+	}
+	else
+	{
+		// Completes through OnRequestComplete, which frees the connection.
+		request->CancelRequest();
+	}
+}
+
+FVoxtaDownloadClassStats VoxtaDownloadScheduler::GetStats(VoxtaDownloadPriority priority) const
+{
+	FScopeLock lock(&m_lock);
+	return m_stats[static_cast<uint8>(priority)];
+}
+
+void VoxtaDownloadScheduler::DumpToLog() const
+{
+	int numOfQueued = 0;
+	int numOfActive = 0;
+	{
+		FScopeLock lock(&m_lock);
+		numOfQueued = m_queue.Num();
+		numOfActive = m_activeRequests.Num();
+	}
+	UE_LOGFMT(VoxtaLog, Log, "DownloadScheduler: {0} requests queued, {1} in flight, at most {2} per host.",
+		numOfQueued, numOfActive, CVarHttpMaxConnectionsPerHost.GetValueOnAnyThread());
+
+	for (uint8 i = 0; i < static_cast<uint8>(VoxtaDownloadPriority::Count); i++)
+	{
+		const VoxtaDownloadPriority priority = static_cast<VoxtaDownloadPriority>(i);
+		const FVoxtaDownloadClassStats stats = GetStats(priority);
+		const int64 numOfSent = stats.NumOfRequests - stats.NumOfExpired - stats.NumOfCancelled;
+		UE_LOGFMT(VoxtaLog, Log, "DownloadScheduler {0}: {1} requests, {2} failed, {3} expired, {4} cancelled. "
+			"Queued avg {5} ms (max {6} ms), transfer avg {7} ms (max {8} ms), {9} KiB at {10} KiB/s.",
+			GetPriorityName(priority), stats.NumOfRequests, stats.NumOfFailures, stats.NumOfExpired,
+			stats.NumOfCancelled,
+			FMath::RoundToInt(stats.TotalQueueSeconds * 1000.0 / FMath::Max<int64>(numOfSent, 1)),
+			FMath::RoundToInt(stats.MaxQueueSeconds * 1000.0),
+			FMath::RoundToInt(stats.TotalTransferSeconds * 1000.0 / FMath::Max<int64>(numOfSent, 1)),
+			FMath::RoundToInt(stats.MaxTransferSeconds * 1000.0),
+			stats.ReceivedBytes / 1024,
+			stats.TotalTransferSeconds > 0.0 ? FMath::RoundToInt(stats.ReceivedBytes / 1024.0 / stats.TotalTransferSeconds) : 0);
+	}
+}
+
+FString VoxtaDownloadScheduler::GetHost(const FString& url)
+{
+	FString host = url;
+	const int schemeEnd = host.Find(TEXT("://"));
+	if (schemeEnd != INDEX_NONE)
+	{
+		host.RightChopInline(schemeEnd + 3);
+	}
+	int pathStart = INDEX_NONE;
+	if (host.FindChar(TEXT('/'), pathStart))
+	{
+		host.LeftInline(pathStart);
+	}
+	return host.ToLower();
+}
+
+const TCHAR* VoxtaDownloadScheduler::GetPriorityName(VoxtaDownloadPriority priority)
+{
+	switch (priority)
+	{
+		case VoxtaDownloadPriority::PlayingChunk:
+			return TEXT("PlayingChunk");
+		case VoxtaDownloadPriority::Prefetch:
+			return TEXT("Prefetch");
+		case VoxtaDownloadPriority::Thumbnail:
+			return TEXT("Thumbnail");
+		default:
+			return TEXT("Unknown");
+	}
+}
+
+void VoxtaDownloadScheduler::Pump()
+{
+	TArray<FQueuedRequest> expiredRequests;
+	TArray<FQueuedRequest> startedRequests;
+	double now = 0.0;
+	{
+		FScopeLock lock(&m_lock);
+		now = FPlatformTime::Seconds();
+		const int32 maxPerHost = FMath::Max(CVarHttpMaxConnectionsPerHost.GetValueOnAnyThread(), 1);
+		for (int i = 0; i < m_queue.Num();)
+		{
+			FQueuedRequest& queuedRequest = m_queue[i];
+			FVoxtaDownloadClassStats& stats = m_stats[static_cast<uint8>(queuedRequest.Priority)];
+			if (now >= queuedRequest.Deadline)
+			{
+				stats.NumOfExpired++;
+				expiredRequests.Add(MoveTemp(queuedRequest));
+				m_queue.RemoveAt(i);
+				continue;
+			}
+
+			int32& numOfActiveRequests = m_numOfActiveRequestsPerHost.FindOrAdd(queuedRequest.Host);
+			const bool isReservedSlotUsable = queuedRequest.Priority == VoxtaDownloadPriority::PlayingChunk || maxPerHost == 1;
+			if (numOfActiveRequests >= (isReservedSlotUsable ? maxPerHost : maxPerHost - 1))
+			{
+				i++;
+				continue;
+			}
+
+			numOfActiveRequests++;
+			const double queueSeconds = now - queuedRequest.QueuedTime;
+			stats.TotalQueueSeconds += queueSeconds;
+			stats.MaxQueueSeconds = FMath::Max(stats.MaxQueueSeconds, queueSeconds);
+			m_activeRequests.Add(queuedRequest.Request.Get(), { queuedRequest.Host, queuedRequest.Priority, now });
+			startedRequests.Add(MoveTemp(queuedRequest));
+			m_queue.RemoveAt(i);
+		}
+	}
+
+	for (const FQueuedRequest& expiredRequest : expiredRequests)
+	{
+		SENSITIVE_LOG1(VoxtaLog, Warning, "Download from: {0} was never sent, it passed its deadline while queued.",
+			expiredRequest.Request->GetURL());
+		expiredRequest.OnComplete.ExecuteIfBound(expiredRequest.Request, nullptr, false);
+	}
+
+	for (FQueuedRequest& startedRequest : startedRequests)
+	{
+		startedRequest.Request->SetTimeout(FMath::Max(static_cast<float>(startedRequest.Deadline - now), 1.f));
+		startedRequest.Request->OnProcessRequestComplete().BindLambda([this, OnComplete = MoveTemp(startedRequest.OnComplete)]
+		(FHttpRequestPtr request, FHttpResponsePtr response, bool bWasSuccessful)
+			{
+				OnRequestComplete(request, response, bWasSuccessful, OnComplete);
+			});
+		startedRequest.Request->ProcessRequest();
+	}
+}
+
+void VoxtaDownloadScheduler::OnRequestComplete(FHttpRequestPtr request, FHttpResponsePtr response,
+	bool wasSuccessful, const FHttpRequestCompleteDelegate& onComplete)
+{
+	{
+		FScopeLock lock(&m_lock);
+		FActiveRequest activeRequest;
+		if (m_activeRequests.RemoveAndCopyValue(request.Get(), activeRequest))
+		{
+			int32& numOfActiveRequests = m_numOfActiveRequestsPerHost.FindChecked(activeRequest.Host);
+			if (--numOfActiveRequests <= 0)
+			{
+				m_numOfActiveRequestsPerHost.Remove(activeRequest.Host);
+			}
+
+			FVoxtaDownloadClassStats& stats = m_stats[static_cast<uint8>(activeRequest.Priority)];
+			const double transferSeconds = FPlatformTime::Seconds() - activeRequest.StartTime;
+			stats.TotalTransferSeconds += transferSeconds;
+			stats.MaxTransferSeconds = FMath::Max(stats.MaxTransferSeconds, transferSeconds);
+			if (response.IsValid())
+			{
+				stats.ReceivedBytes += response->GetContent().Num();
+			}
+			if (activeRequest.bCancelled)
+			{
+				stats.NumOfCancelled++;
+			}
+			else if (!wasSuccessful || !response.IsValid() || !EHttpResponseCodes::IsOk(response->GetResponseCode()))
+			{
+				stats.NumOfFailures++;
+			}
+		}
+	}
+
+	onComplete.ExecuteIfBound(request, response, wasSuccessful);
+	Pump();
+}
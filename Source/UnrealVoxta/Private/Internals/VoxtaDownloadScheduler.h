@@ -0,0 +1,152 @@
+// Copyright(c) 2024 grrimgrriefer & DZnnah, see LICENSE for details.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Interfaces/IHttpRequest.h"
+
+/**
+ * VoxtaDownloadPriority
+ * The priority classes of the VoxtaDownloadScheduler, from most to least urgent.
+ */
+enum class VoxtaDownloadPriority : uint8
+{
+	/** Audio the player is waiting for right now. */
+	PlayingChunk,
+	/** Audio that is prepared ahead of its playback. */
+	Prefetch,
+	/** Character thumbnails and other UI images. */
+	Thumbnail,
+
+	Count
+};
+
+/**
+ * FVoxtaDownloadClassStats
+ * Counters of one priority class of the VoxtaDownloadScheduler since startup.
+ */
+struct FVoxtaDownloadClassStats
+{
+	int64 NumOfRequests = 0;
+	int64 NumOfFailures = 0;
+	/** Requests that were still queued when their deadline passed, they never reached the server. */
+	int64 NumOfExpired = 0;
+	int64 NumOfCancelled = 0;
+	int64 ReceivedBytes = 0;
+	/** Time between being queued and being sent. */
+	double TotalQueueSeconds = 0.0;
+	double MaxQueueSeconds = 0.0;
+	/** Time between being sent and the response being complete. */
+	double TotalTransferSeconds = 0.0;
+	double MaxTransferSeconds = 0.0;
+};
+
+/**
+ * VoxtaDownloadScheduler
+ * Process-wide queue for the http downloads of the plugin (voicelines and thumbnails), so a long list of thumbnails
+ * can never delay the voiceline the player is waiting for.
+ *
+ * Requests are started in order of priority class, and per class in the order they were queued. Each host gets at most
+ * voxta.Http.MaxConnectionsPerHost requests in flight, which lets the http module reuse its kept-alive connections
+ * instead of opening new ones. One of those is reserved for PlayingChunk requests.
+ * Every request has a deadline: if it is still queued when the deadline passes it fails without being sent, otherwise
+ * the remaining time is used as the timeout of the request.
+ *
+ * Use 'voxta.Http.Dump' to log the latency & throughput per priority class.
+ *
+ * Note: All functions are thread-safe. Completion callbacks run on the thread selected by the delegate thread policy
+ * of the request.
+ */
+class VoxtaDownloadScheduler
+{
+#pragma region public API
+public:
+	/** @return The process-wide scheduler instance. */
+	static VoxtaDownloadScheduler& Get();
+
+	/**
+	 * Queue a request, it is sent as soon as a connection to its host is available.
+	 *
+	 * @param request The fully configured request, must not be started yet. Don't bind OnProcessRequestComplete.
+	 * @param priority The priority class.
+	 * @param deadlineSeconds Time from now after which the request fails.
+	 * @param onComplete Invoked exactly once, also when the request expired or was cancelled while queued.
+	 */
+	void Enqueue(const TSharedRef<IHttpRequest, ESPMode::ThreadSafe>& request, VoxtaDownloadPriority priority,
+		float deadlineSeconds, FHttpRequestCompleteDelegate&& onComplete);
+
+	/**
+	 * Move a request into another priority class, e.g. when the voiceline it downloads is now the one being played.
+	 * Does nothing if the request was already sent.
+	 *
+	 * @param request The queued request.
+	 * @param priority The new priority class.
+	 */
+	void SetPriority(const FHttpRequestPtr& request, VoxtaDownloadPriority priority);
+
+	/**
+	 * Cancel a request, whether it is queued or already sent.
+	 *
+	 * @param request The request to cancel.
+	 */
+	void Cancel(const FHttpRequestPtr& request);
+
+	/** @return A snapshot of the counters of the given priority class. */
+	FVoxtaDownloadClassStats GetStats(VoxtaDownloadPriority priority) const;
+
+	/** Log the counters of all priority classes. */
+	void DumpToLog() const;
+#pragma endregion
+
+#pragma region data
+private:
+	struct FQueuedRequest
+	{
+		TSharedPtr<IHttpRequest, ESPMode::ThreadSafe> Request;
+		FHttpRequestCompleteDelegate OnComplete;
+		FString Host;
+		VoxtaDownloadPriority Priority = VoxtaDownloadPriority::Prefetch;
+		double QueuedTime = 0.0;
+		double Deadline = 0.0;
+	};
+
+	struct FActiveRequest
+	{
+		FString Host;
+		VoxtaDownloadPriority Priority = VoxtaDownloadPriority::Prefetch;
+		double StartTime = 0.0;
+		bool bCancelled = false;
+	};
+
+	mutable FCriticalSection m_lock;
+	TArray<FQueuedRequest> m_queue;
+	TMap<const IHttpRequest*, FActiveRequest> m_activeRequests;
+	TMap<FString, int32> m_numOfActiveRequestsPerHost;
+	FVoxtaDownloadClassStats m_stats[static_cast<uint8>(VoxtaDownloadPriority::Count)];
+#pragma endregion
+
+#pragma region private API
+private:
+	VoxtaDownloadScheduler() = default;
+
+	/** @return The host and port of the url, requests to the same host share a connection limit. */
+	static FString GetHost(const FString& url);
+
+	/** @return The readable name of a priority class. */
+	static const TCHAR* GetPriorityName(VoxtaDownloadPriority priority);
+
+	/** Start as many queued requests as the connection limits allow, and fail the ones that expired. */
+	void Pump();
+
+	/**
+	 * Bookkeeping once a sent request completed, then frees its connection for the next one.
+	 *
+	 * @param request The request that completed.
+	 * @param response The response, if any.
+	 * @param wasSuccessful Whether the http module received a response.
+	 * @param onComplete The callback of the owner of the request.
+	 */
+	void OnRequestComplete(FHttpRequestPtr request, FHttpResponsePtr response, bool wasSuccessful,
+		const FHttpRequestCompleteDelegate& onComplete);
+#pragma endregion
+};
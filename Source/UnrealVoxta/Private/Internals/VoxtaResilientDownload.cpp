@@ -0,0 +1,361 @@
+// Copyright(c) 2024 grrimgrriefer & DZnnah, see LICENSE for details.
+
+#include "VoxtaResilientDownload.h"
+#include "VoxtaDefines.h"
+#include "HttpModule.h"
+#include "Interfaces/IHttpResponse.h"
+#include "Logging/StructuredLog.h"
+#include "LogUtility/Public/Defines.h"
+#include "HAL/IConsoleManager.h"
+#include "Misc/ScopeLock.h"
+
+namespace
+{
+	TAutoConsoleVariable<int32> CVarHttpMaxRetries(
+		TEXT("voxta.Http.MaxRetries"),
+		3,
+		TEXT("Number of times a failed voiceline download is retried."));
+
+	TAutoConsoleVariable<float> CVarHttpHedgePercentile(
+		TEXT("voxta.Http.HedgePercentile"),
+		95.f,
+		TEXT("Send a duplicate voiceline download if no byte arrived within this percentile of the recent "
+			"time-to-first-byte. 0 disables hedging."));
+
+	TAutoConsoleVariable<int32> CVarHttpHedgeMinSamples(
+		TEXT("voxta.Http.HedgeMinSamples"),
+		8,
+		TEXT("Number of completed downloads needed before hedging starts."));
+
+#if !UE_BUILD_SHIPPING
+	TAutoConsoleVariable<int32> CVarHttpInjectedDelayMs(
+		TEXT("voxta.Http.Debug.InjectedDelayMs"),
+		0,
+		TEXT("Delay every voiceline download attempt before it is queued, to test hedging."));
+
+	TAutoConsoleVariable<int32> CVarHttpInjectedFailurePercent(
+		TEXT("voxta.Http.Debug.InjectedFailurePercent"),
+		0,
+		TEXT("Percentage of voiceline download attempts that fail without being sent, to test the retries."));
+#endif
+
+	/** @return True if the server might respond differently to the same request later on. */
+	bool IsRetryable(const FHttpResponsePtr& response)
+	{
+		if (!response.IsValid())
+		{
+			return true;
+		}
+		const int32 code = response->GetResponseCode();
+		return code == EHttpResponseCodes::RequestTimeout || code == EHttpResponseCodes::TooManyRequests || code >= 500 ||
+			EHttpResponseCodes::IsOk(code);
+	}
+}
+
+VoxtaResilientDownload::VoxtaResilientDownload(const FString& url, VoxtaDownloadPriority priority,
+	float attemptDeadlineSeconds, FOnDownloadComplete&& onComplete) :
+	URL(url),
+	ATTEMPT_DEADLINE_SECONDS(attemptDeadlineSeconds),
+	m_onComplete(MoveTemp(onComplete)),
+	m_priority(priority)
+{}
+
+TSharedRef<VoxtaResilientDownload, ESPMode::ThreadSafe> VoxtaResilientDownload::Start(const FString& url,
+	VoxtaDownloadPriority priority, float attemptDeadlineSeconds, FOnDownloadComplete&& onComplete)
+{
+	TSharedRef<VoxtaResilientDownload, ESPMode::ThreadSafe> download = MakeShareable(
+		new VoxtaResilientDownload(url, priority, attemptDeadlineSeconds, MoveTemp(onComplete)));
+	download->StartAttempt(false);
+	return download;
+}
+
+void VoxtaResilientDownload::SetPriority(VoxtaDownloadPriority priority)
+{
+	TArray<FHttpRequestPtr, TInlineAllocator<2>> requests;
+	{
+		FScopeLock lock(&m_lock);
+		m_priority = priority;
+		for (const FAttempt& attempt : m_activeAttempts)
+		{
+			requests.Add(attempt.Request);
+		}
+	}
+	for (const FHttpRequestPtr& request : requests)
+	{
+		VoxtaDownloadScheduler::Get().SetPriority(request, priority);
+	}
+}
+
+void VoxtaResilientDownload::Cancel()
+{
+	TArray<FAttempt> cancelledAttempts;
+	{
+		FScopeLock lock(&m_lock);
+		if (m_isFinished)
+		{
+			return;
+		}
+		m_isFinished = true;
+		m_onComplete = nullptr;
+		cancelledAttempts = MoveTemp(m_activeAttempts);
+		m_activeAttempts.Reset();
+		if (m_pendingTimer.IsValid())
+		{
+			FTSTicker::GetCoreTicker().RemoveTicker(m_pendingTimer);
+			m_pendingTimer.Reset();
+		}
+	}
+	for (const FAttempt& attempt : cancelledAttempts)
+	{
+		VoxtaDownloadScheduler::Get().Cancel(attempt.Request);
+	}
+}
+
+VoxtaDownloadLatencyTracker& VoxtaResilientDownload::GetLatencyTracker()
+{
+	static VoxtaDownloadLatencyTracker tracker;
+	return tracker;
+}
+
+void VoxtaResilientDownload::StartAttempt(bool isHedge)
+{
+	TSharedRef<IHttpRequest, ESPMode::ThreadSafe> httpRequest = FHttpModule::Get().CreateRequest();
+	httpRequest->SetVerb(TEXT("GET"));
+	httpRequest->SetURL(URL);
+	httpRequest->SetDelegateThreadPolicy(EHttpRequestDelegateThreadPolicy::CompleteOnHttpThread);
+	httpRequest->OnRequestProgress64().BindLambda([WeakThis = AsWeak()]
+	(FHttpRequestPtr request, uint64 bytesSent, uint64 bytesReceived)
+		{
+			if (TSharedPtr<VoxtaResilientDownload, ESPMode::ThreadSafe> sharedThis = WeakThis.Pin())
+			{
+				sharedThis->OnAttemptProgress(request, bytesReceived);
+			}
+		});
+
+	VoxtaDownloadPriority priority;
+	{
+		FScopeLock lock(&m_lock);
+		if (m_isFinished)
+		{
+			return;
+		}
+		if (m_partialContent.Num() > 0 && !isHedge)
+		{
+			httpRequest->SetHeader(TEXT("Range"), FString::Printf(TEXT("bytes=%d-"), m_partialContent.Num()));
+		}
+		m_activeAttempts.Add({ httpRequest, FPlatformTime::Seconds(), false, isHedge });
+		m_isHedged |= isHedge;
+		priority = m_priority;
+	}
+
+	// Keeps this alive while any attempt is in flight, nothing else has to hold on to a download.
+	FHttpRequestCompleteDelegate onComplete = FHttpRequestCompleteDelegate::CreateLambda([SharedThis = AsShared()]
+	(FHttpRequestPtr request, FHttpResponsePtr response, bool bWasSuccessful)
+		{
+			SharedThis->OnAttemptComplete(request, response, bWasSuccessful);
+		});
+
+#if !UE_BUILD_SHIPPING
+	if (FMath::RandRange(0, 99) < CVarHttpInjectedFailurePercent.GetValueOnAnyThread())
+	{
+		SENSITIVE_LOG1(VoxtaLog, Warning, "Injecting a failure for the download from: {0}", URL);
+		onComplete.ExecuteIfBound(httpRequest, nullptr, false);
+		return;
+	}
+	const int32 injectedDelayMs = CVarHttpInjectedDelayMs.GetValueOnAnyThread();
+	if (injectedDelayMs > 0)
+	{
+		FTSTicker::GetCoreTicker().AddTicker(FTickerDelegate::CreateLambda(
+			[httpRequest, priority, Deadline = ATTEMPT_DEADLINE_SECONDS, OnComplete = MoveTemp(onComplete)] (float) mutable
+			{
+				VoxtaDownloadScheduler::Get().Enqueue(httpRequest, priority, Deadline, MoveTemp(OnComplete));
+				return false;
+			}), injectedDelayMs / 1000.f);
+	}
+	else
+#endif
+	{
+		VoxtaDownloadScheduler::Get().Enqueue(httpRequest, priority, ATTEMPT_DEADLINE_SECONDS, MoveTemp(onComplete));
+	}
+
+	if (!isHedge)
+	{
+		ScheduleHedge();
+	}
+}
+
+void VoxtaResilientDownload::ScheduleHedge()
+{
+	const float percentile = CVarHttpHedgePercentile.GetValueOnAnyThread();
+	double hedgeDelaySeconds = 0.0;
+	if (percentile <= 0.f || !GetLatencyTracker().TryGetPercentile(percentile,
+		CVarHttpHedgeMinSamples.GetValueOnAnyThread(), hedgeDelaySeconds))
+	{
+		return;
+	}
+
+	FScopeLock lock(&m_lock);
+	if (m_isHedged || m_isFinished || m_pendingTimer.IsValid())
+	{
+		return;
+	}
+	m_pendingTimer = FTSTicker::GetCoreTicker().AddTicker(FTickerDelegate::CreateLambda([WeakThis = AsWeak()] (float)
+		{
+			if (TSharedPtr<VoxtaResilientDownload, ESPMode::ThreadSafe> sharedThis = WeakThis.Pin())
+			{
+				bool shouldHedge = false;
+				{
+					FScopeLock timerLock(&sharedThis->m_lock);
+					sharedThis->m_pendingTimer.Reset();
+					shouldHedge = !sharedThis->m_isFinished && !sharedThis->m_isHedged &&
+						sharedThis->m_activeAttempts.Num() == 1 && !sharedThis->m_activeAttempts[0].bReceivedFirstByte;
+				}
+				if (shouldHedge)
+				{
+					SENSITIVE_LOG1(VoxtaLog, Log, "Download from: {0} is slower than usual, sending a hedged request.",
+						sharedThis->URL);
+					sharedThis->StartAttempt(true);
+				}
+			}
+			return false;
+		}), static_cast<float>(hedgeDelaySeconds));
+}
+
+void VoxtaResilientDownload::OnAttemptProgress(FHttpRequestPtr request, uint64 bytesReceived)
+{
+	if (bytesReceived == 0)
+	{
+		return;
+	}
+
+	double firstByteSeconds = -1.0;
+	{
+		FScopeLock lock(&m_lock);
+		FAttempt* attempt = m_activeAttempts.FindByPredicate([&request] (const FAttempt& active)
+			{
+				return active.Request == request;
+			});
+		if (attempt != nullptr && !attempt->bReceivedFirstByte)
+		{
+			attempt->bReceivedFirstByte = true;
+			firstByteSeconds = FPlatformTime::Seconds() - attempt->StartTime;
+		}
+	}
+	if (firstByteSeconds >= 0.0)
+	{
+		GetLatencyTracker().AddSample(firstByteSeconds);
+	}
+}
+
+void VoxtaResilientDownload::OnAttemptComplete(FHttpRequestPtr request, FHttpResponsePtr response, bool wasSuccessful)
+{
+	FOnDownloadComplete onComplete;
+	TArray<uint8> content;
+	FString contentType;
+	TArray<FAttempt> losingAttempts;
+	bool success = false;
+	{
+		FScopeLock lock(&m_lock);
+		const int attemptIndex = m_activeAttempts.IndexOfByPredicate([&request] (const FAttempt& active)
+			{
+				return active.Request == request;
+			});
+		if (m_isFinished || attemptIndex == INDEX_NONE)
+		{
+			// Cancelled, or the other attempt of a hedge already won.
+			return;
+		}
+		const FAttempt attempt = m_activeAttempts[attemptIndex];
+		m_activeAttempts.RemoveAt(attemptIndex);
+
+		const int32 responseCode = response.IsValid() ? response->GetResponseCode() : 0;
+		if (wasSuccessful && (responseCode == EHttpResponseCodes::Ok || responseCode == EHttpResponseCodes::PartialContent) &&
+			response->GetContent().Num() > 0)
+		{
+			if (!attempt.bReceivedFirstByte)
+			{
+				GetLatencyTracker().AddSample(FPlatformTime::Seconds() - attempt.StartTime);
+			}
+			if (responseCode == EHttpResponseCodes::PartialContent && m_partialContent.Num() > 0)
+			{
+				SENSITIVE_LOG2(VoxtaLog, Log, "Resumed the download from: {0} at byte {1}.", URL, m_partialContent.Num());
+				content = MoveTemp(m_partialContent);
+				content.Append(response->GetContent());
+			}
+			else
+			{
+				content = response->GetContent();
+			}
+			contentType = response->GetContentType();
+			success = true;
+		}
+		else if (m_activeAttempts.Num() > 0)
+		{
+			// The other attempt of the hedge can still make it.
+			return;
+		}
+		else if (IsRetryable(response) && m_numOfRetries < CVarHttpMaxRetries.GetValueOnAnyThread())
+		{
+			KeepPartialContent(response);
+			const float delaySeconds = VoxtaDownloadRetryPolicy::GetRetryDelaySeconds(m_numOfRetries, FMath::FRand());
+			m_numOfRetries++;
+			SENSITIVE_LOG3(VoxtaLog, Warning, "Download from: {0} failed (code {1}), retrying in {2} ms.", URL,
+				responseCode, FMath::RoundToInt(delaySeconds * 1000.f));
+			m_pendingTimer = FTSTicker::GetCoreTicker().AddTicker(FTickerDelegate::CreateLambda(
+				[SharedThis = AsShared()] (float)
+				{
+					{
+						FScopeLock timerLock(&SharedThis->m_lock);
+						SharedThis->m_pendingTimer.Reset();
+					}
+					SharedThis->StartAttempt(false);
+					return false;
+				}), delaySeconds);
+			return;
+		}
+		else
+		{
+			SENSITIVE_LOG3(VoxtaLog, Error, "Download from: {0} failed (code {1}) after {2} retries.", URL,
+				responseCode, m_numOfRetries);
+		}
+
+		m_isFinished = true;
+		onComplete = MoveTemp(m_onComplete);
+		m_onComplete = nullptr;
+		losingAttempts = MoveTemp(m_activeAttempts);
+		m_activeAttempts.Reset();
+		if (m_pendingTimer.IsValid())
+		{
+			FTSTicker::GetCoreTicker().RemoveTicker(m_pendingTimer);
+			m_pendingTimer.Reset();
+		}
+	}
+
+	for (const FAttempt& losingAttempt : losingAttempts)
+	{
+		VoxtaDownloadScheduler::Get().Cancel(losingAttempt.Request);
+	}
+	if (onComplete)
+	{
+		onComplete(success, MoveTemp(content), contentType);
+	}
+}
+
+void VoxtaResilientDownload::KeepPartialContent(const FHttpResponsePtr& response)
+{
+	if (!response.IsValid() || response->GetContent().Num() == 0)
+	{
+		return;
+	}
+
+	const int32 responseCode = response->GetResponseCode();
+	if (responseCode == EHttpResponseCodes::PartialContent && m_partialContent.Num() > 0)
+	{
+		m_partialContent.Append(response->GetContent());
+	}
+	else if (responseCode == EHttpResponseCodes::Ok &&
+		response->GetHeader(TEXT("Accept-Ranges")).Contains(TEXT("bytes")))
+	{
+		m_partialContent = response->GetContent();
+	}
+}
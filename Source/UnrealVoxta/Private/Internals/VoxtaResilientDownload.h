@@ -0,0 +1,128 @@
+// Copyright(c) 2024 grrimgrriefer & DZnnah, see LICENSE for details.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Containers/Ticker.h"
+#include "Interfaces/IHttpRequest.h"
+#include "VoxtaDownloadScheduler.h"
+#include "VoxtaDownloadRetryPolicy.h"
+
+/**
+ * VoxtaResilientDownload
+ * A single logical GET download through the VoxtaDownloadScheduler that survives slow and failing responses.
+ *
+ * - Failed attempts are retried with exponential backoff (voxta.Http.MaxRetries, voxta.Http.RetryBaseDelayMs),
+ *   for transport errors, 408, 429 and 5xx responses.
+ * - If a server advertised 'Accept-Ranges: bytes', the bytes of an interrupted attempt are kept and the retry only
+ *   requests the remainder via a Range header.
+ * - If no byte arrived within the voxta.Http.HedgePercentile of the recent time-to-first-byte, a duplicate request
+ *   is sent. The first one to succeed wins, the other one is cancelled.
+ *
+ * For testing against a local stand-in server, non-shipping builds can delay or fail attempts on purpose with
+ * voxta.Http.Debug.InjectedDelayMs and voxta.Http.Debug.InjectedFailurePercent.
+ *
+ * Note: All functions are thread-safe. The completion callback runs on the http thread, or on the thread that
+ * gave up on the download.
+ */
+class VoxtaResilientDownload : public TSharedFromThis<VoxtaResilientDownload, ESPMode::ThreadSafe>
+{
+#pragma region public API
+public:
+	/** Invoked once with the complete content, unless the download was cancelled. */
+	using FOnDownloadComplete = TFunction<void(bool success, TArray<uint8>&& content, const FString& contentType)>;
+
+	/**
+	 * Start a download.
+	 *
+	 * @param url The url to download.
+	 * @param priority The priority class in the VoxtaDownloadScheduler.
+	 * @param attemptDeadlineSeconds The deadline of each individual attempt, including the time it is queued.
+	 * @param onComplete Invoked once all attempts succeeded or failed.
+	 *
+	 * @return The download, keep it to change its priority or cancel it.
+	 */
+	static TSharedRef<VoxtaResilientDownload, ESPMode::ThreadSafe> Start(const FString& url,
+		VoxtaDownloadPriority priority, float attemptDeadlineSeconds, FOnDownloadComplete&& onComplete);
+
+	/**
+	 * Move the queued attempts into another priority class, retries and hedges will use it too.
+	 *
+	 * @param priority The new priority class.
+	 */
+	void SetPriority(VoxtaDownloadPriority priority);
+
+	/** Stop all attempts, the completion callback will not be invoked anymore. */
+	void Cancel();
+
+	/** @return The time-to-first-byte samples of all downloads, shared process-wide. */
+	static VoxtaDownloadLatencyTracker& GetLatencyTracker();
+#pragma endregion
+
+#pragma region data
+private:
+	struct FAttempt
+	{
+		TSharedPtr<IHttpRequest, ESPMode::ThreadSafe> Request;
+		double StartTime = 0.0;
+		bool bReceivedFirstByte = false;
+		bool bIsHedge = false;
+	};
+
+	const FString URL;
+	const float ATTEMPT_DEADLINE_SECONDS;
+
+	FCriticalSection m_lock;
+	FOnDownloadComplete m_onComplete;
+	VoxtaDownloadPriority m_priority;
+	TArray<FAttempt> m_activeAttempts;
+	FTSTicker::FDelegateHandle m_pendingTimer;
+
+	/** Bytes of interrupted attempts, only kept if the server supports range requests. */
+	TArray<uint8> m_partialContent;
+	FString m_contentType;
+	int m_numOfRetries = 0;
+	bool m_isHedged = false;
+	bool m_isFinished = false;
+#pragma endregion
+
+#pragma region private API
+private:
+	VoxtaResilientDownload(const FString& url, VoxtaDownloadPriority priority, float attemptDeadlineSeconds,
+		FOnDownloadComplete&& onComplete);
+
+	/**
+	 * Queue a new attempt, resuming from the partial content if possible.
+	 *
+	 * @param isHedge Whether this duplicates an attempt that is still running.
+	 */
+	void StartAttempt(bool isHedge);
+
+	/** Arm the timer that sends a hedge if the first attempt stays silent for too long. */
+	void ScheduleHedge();
+
+	/**
+	 * Track the first byte of an attempt, for the latency samples and the hedging decision.
+	 *
+	 * @param request The request of the attempt.
+	 * @param bytesReceived The number of bytes received so far.
+	 */
+	void OnAttemptProgress(FHttpRequestPtr request, uint64 bytesReceived);
+
+	/**
+	 * Either finish the download, wait for another attempt, or schedule a retry.
+	 *
+	 * @param request The request of the attempt.
+	 * @param response The response, if any.
+	 * @param wasSuccessful Whether the http module received a response.
+	 */
+	void OnAttemptComplete(FHttpRequestPtr request, FHttpResponsePtr response, bool wasSuccessful);
+
+	/**
+	 * Keep the received bytes of a failed attempt, if the server allows continuing from them. m_lock must be locked.
+	 *
+	 * @param response The response of the failed attempt.
+	 */
+	void KeepPartialContent(const FHttpResponsePtr& response);
+#pragma endregion
+};
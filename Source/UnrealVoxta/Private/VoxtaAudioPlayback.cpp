@@ -5,6 +5,9 @@
 #include "VoxtaClient.h"
 #include "Audio2FacePlaybackHandler.h"
 #include "MessageChunkAudioContainer.h"
+#include "A2FMessageBatch.h"
+#include "VoxtaAudioMemoryBudget.h"
+#include "VoxtaPlaybackQueuePolicy.h"
 #if WITH_OVRLIPSYNC
 #include "OVRLipSyncPlaybackActorComponent.h"
 #include "LipSyncDataOVR.h"
@@ -81,47 +84,60 @@ void UVoxtaAudioPlayback::PlaybackMessage(const FBaseCharData& sender, const FCh
 	// Listener gets invoked for all messages, safe to ignore the ones for other characters
 	if (sender.GetId() == m_characterId)
 	{
-		Cleanup();
-		m_currentlyPlayingMessageId = message.GetMessageId();
-
-		for (int i = 0; i < message.GetAudioUrls().Num(); i++)
-		{
-			m_orderedAudio.Add(MakeShared<MessageChunkAudioContainer>(
-				FString::Format(TEXT("http://{0}:{1}{2}"), { m_hostAddress, m_hostPort, message.GetAudioUrls()[i] }),
-				m_lipSyncType,
-				m_clientReference->GetA2FHandler(),
-				[Self = TWeakObjectPtr<UVoxtaAudioPlayback>(this)]
-				(const MessageChunkAudioContainer* chunk)
-				{
-					if (Self != nullptr)
-					{
-						Self->OnChunkStateChange(chunk);
-					}
-					else
-					{
-						UE_LOGFMT(VoxtaLog, Warning, "Recieved a messageChunk status update, but the UVoxtaAudioPlayback"
-							" was already destroyed. Did you delete the character before the playback was finished?");
-					}
-				},
-				i));
-		}
-		m_internalState = AudioPlaybackInternalState::Idle;
-		if (m_orderedAudio.Num() > 0)
+		if (m_internalState != AudioPlaybackInternalState::Done)
 		{
-			m_orderedAudio[0]->Continue();
+			switch (m_queuePolicy)
+			{
+				case VoxtaPlaybackQueuePolicy::Enqueue:
+				case VoxtaPlaybackQueuePolicy::DropOldest:
+					EnqueueMessage(message);
+					return;
+				case VoxtaPlaybackQueuePolicy::Preempt:
+				default:
+					UE_LOGFMT(VoxtaLog, Log, "Message with id: {0} preempts the playback of message with id: {1}.",
+						message.GetMessageId(), m_currentlyPlayingMessageId);
+					StopLipSync();
+					Cleanup();
+					break;
+			}
 		}
-		else
+		StartMessagePlayback(message.GetMessageId(), CreateAudioChunks(message));
+	}
+}
+
+void UVoxtaAudioPlayback::CancelMessagePlayback(const FGuid& messageId)
+{
+	const int queueIndex = m_queuedMessages.IndexOfByPredicate([&messageId] (const FQueuedMessage& queuedMessage)
 		{
-			UE_LOGFMT(VoxtaLog, Warning, "Tried to play audio for the message, but no audiodata was found? "
-				"Are you sure the TTS service is active (was active at the start? runtime activation is not yet supported)");
-			MarkAudioChunkPlaybackCompleteInternal();
-			return;
-		}
+			return queuedMessage.MessageId == messageId;
+		});
+	if (queueIndex != INDEX_NONE)
+	{
+		UE_LOGFMT(VoxtaLog, Log, "Removing cancelled message with id: {0} from the playback queue.", messageId);
+		DiscardQueuedMessage(queueIndex);
+		return;
+	}
 
-		UE_LOGFMT(VoxtaLog, Log, "Started playback for messageId: {0} of SenderId: {1}. Full message contains {2} "
-			"audio chunks that will be played in sequence.",
-			m_currentlyPlayingMessageId, m_characterId, m_orderedAudio.Num());
+	if (m_orderedAudio.Num() == 0 || m_currentlyPlayingMessageId != messageId)
+	{
+		return;
 	}
+
+	UE_LOGFMT(VoxtaLog, Log, "Cancelling playback of message with id: {0}, {1} of {2} audio chunks were played.",
+		messageId, m_currentAudioClipIndex, m_orderedAudio.Num());
+
+	// Cleanup also stops the audio component, the state is Done first so its finished callback is ignored.
+	CleanupCurrentMessage();
+	StopLipSync();
+
+	VoxtaMessageAudioPlaybackFinishedEventNative.Broadcast(messageId);
+	VoxtaMessageAudioPlaybackFinishedEvent.Broadcast(messageId);
+	StartNextQueuedMessage();
+}
+
+bool UVoxtaAudioPlayback::HasPendingPlayback() const
+{
+	return m_internalState != AudioPlaybackInternalState::Done || m_queuedMessages.Num() > 0;
 }
 
 LipSyncType UVoxtaAudioPlayback::GetLipSyncType() const
@@ -156,28 +172,19 @@ void UVoxtaAudioPlayback::EndPlay(const EEndPlayReason::Type endPlayReason)
 	}
 	OnAudioFinishedNative.Remove(m_playbackFinishedHandle);
 
-	if (m_lipSyncType == LipSyncType::Audio2Face && m_lipSyncHandler)
-	{
-		Cast<UAudio2FacePlaybackHandler>(m_lipSyncHandler)->Stop();
-	}
-#if WITH_OVRLIPSYNC
-	if (m_lipSyncType == LipSyncType::OVRLipSync && m_lipSyncHandler)
-	{
-		Cast<UOVRLipSyncPlaybackActorComponent>(m_lipSyncHandler)->Stop();
-	}
-#endif
-
+	StopLipSync();
 	Cleanup();
+	VoxtaAudioMemoryBudget::Get().RemoveOwner(this);
 	Super::EndPlay(endPlayReason);
 }
 
-void UVoxtaAudioPlayback::GetA2FCurveWeightsPreUpdate(TArray<float>& targetArrayRef)
+bool UVoxtaAudioPlayback::GetA2FCurveWeightsPreUpdate(TArrayView<float> outCurves)
 {
 	if (m_lipSyncType == LipSyncType::Audio2Face)
 	{
 		if (m_lipSyncHandler != nullptr)
 		{
-			Cast<UAudio2FacePlaybackHandler>(m_lipSyncHandler)->GetA2FCurveWeights(targetArrayRef);
+			return Cast<UAudio2FacePlaybackHandler>(m_lipSyncHandler)->GetA2FCurveWeights(outCurves);
 		}
 		else if (HasBegunPlay())
 		{
@@ -186,6 +193,7 @@ void UVoxtaAudioPlayback::GetA2FCurveWeightsPreUpdate(TArray<float>& targetArray
 		}
 	}
 	// ignore requests if we're not using A2F lipsync
+	return false;
 }
 
 void UVoxtaAudioPlayback::PlayCurrentAudioChunkIfAvailable()
@@ -196,7 +204,14 @@ void UVoxtaAudioPlayback::PlayCurrentAudioChunkIfAvailable()
 		return;
 	}
 	MessageChunkAudioContainer* currentClip = m_orderedAudio[m_currentAudioClipIndex].Get();
-	if (currentClip->GetCurrentState() == MessageChunkState::ReadyForPlayback)
+	if (currentClip->GetCurrentState() == MessageChunkState::Failed)
+	{
+		// Waiting would stall the whole message, the rest of it is still worth hearing.
+		UE_LOGFMT(VoxtaLog, Warning, "Skipping audio chunk index: {0}, as it could not be downloaded or processed.",
+			currentClip->INDEX);
+		MarkAudioChunkPlaybackCompleteInternal();
+	}
+	else if (currentClip->GetCurrentState() == MessageChunkState::ReadyForPlayback)
 	{
 		m_internalState = AudioPlaybackInternalState::Playing;
 
@@ -210,6 +225,7 @@ void UVoxtaAudioPlayback::PlayCurrentAudioChunkIfAvailable()
 		{
 			case LipSyncType::None:
 				SetSound(currentClip->GetSoundWave());
+				m_playingSoundWave = currentClip->GetSoundWave();
 				Play();
 				break;
 			case LipSyncType::Custom:
@@ -229,6 +245,7 @@ void UVoxtaAudioPlayback::PlayCurrentAudioChunkIfAvailable()
 			case LipSyncType::OVRLipSync:
 #if WITH_OVRLIPSYNC
 				SetSound(currentClip->GetSoundWave());
+				m_playingSoundWave = currentClip->GetSoundWave();
 				Cast<UOVRLipSyncPlaybackActorComponent>(m_lipSyncHandler)->Start(
 					this, currentClip->GetLipSyncData<ULipSyncDataOVR>()->GetOvrLipSyncData());
 #else
@@ -237,6 +254,7 @@ void UVoxtaAudioPlayback::PlayCurrentAudioChunkIfAvailable()
 				break;
 			case LipSyncType::Audio2Face:
 				SetSound(currentClip->GetSoundWave());
+				m_playingSoundWave = currentClip->GetSoundWave();
 				Cast<UAudio2FacePlaybackHandler>(m_lipSyncHandler)->Play(currentClip->GetLipSyncData<ULipSyncDataA2F>());
 				break;
 			default:
@@ -255,6 +273,17 @@ void UVoxtaAudioPlayback::OnAudioPlaybackFinished(UAudioComponent* component)
 	}
 	AsyncTask(ENamedThreads::GameThread, [this] ()
 	{
+		if (m_internalState != AudioPlaybackInternalState::Playing)
+		{
+			// Playback was stopped because the message was cancelled or preempted by a newer one.
+			return;
+		}
+		if (!IsPlayingSoundFinished())
+		{
+			UE_LOGFMT(VoxtaLog, Log, "Ignoring the finished callback of a stopped sound, audio chunk index: {0} is "
+				"still playing.", m_currentAudioClipIndex);
+			return;
+		}
 		UE_LOGFMT(VoxtaLog, Log, "Automatic playback of audio chunk index: {0} is complete.", m_currentAudioClipIndex);
 
 		m_internalState = AudioPlaybackInternalState::Idle;
@@ -262,8 +291,16 @@ void UVoxtaAudioPlayback::OnAudioPlaybackFinished(UAudioComponent* component)
 	});
 }
 
+bool UVoxtaAudioPlayback::IsPlayingSoundFinished() const
+{
+	// The callback can't identify its sound, but the playing one either reached its end or the component went idle.
+	const UImportedSoundWave* soundWave = m_playingSoundWave.Get();
+	return soundWave == nullptr || soundWave->IsPlaybackFinished() || !IsPlaying();
+}
+
 void UVoxtaAudioPlayback::MarkAudioChunkPlaybackCompleteInternal()
 {
+	m_playingSoundWave.Reset();
 	if (m_orderedAudio.Num() > 0)
 	{
 		m_orderedAudio[m_currentAudioClipIndex]->CleanupData();
@@ -271,64 +308,255 @@ void UVoxtaAudioPlayback::MarkAudioChunkPlaybackCompleteInternal()
 	m_currentAudioClipIndex += 1;
 	if (m_currentAudioClipIndex < m_orderedAudio.Num())
 	{
+		ContinueProcessingAhead();
 		PlayCurrentAudioChunkIfAvailable();
 	}
 	else
 	{
+		const FGuid finishedMessageId = m_currentlyPlayingMessageId;
 		UE_LOGFMT(VoxtaLog, Log, "Playback of all audiochunks for message with id: {0} is finished.",
-			m_currentlyPlayingMessageId);
+			finishedMessageId);
 
-		VoxtaMessageAudioPlaybackFinishedEventNative.Broadcast(m_currentlyPlayingMessageId);
-		VoxtaMessageAudioPlaybackFinishedEvent.Broadcast(m_currentlyPlayingMessageId);
-		Cleanup();
+		// Cleaned up before broadcasting, so listeners already see whether another message is queued.
+		CleanupCurrentMessage();
+		VoxtaMessageAudioPlaybackFinishedEventNative.Broadcast(finishedMessageId);
+		VoxtaMessageAudioPlaybackFinishedEvent.Broadcast(finishedMessageId);
+		StartNextQueuedMessage();
 	}
 }
 
 void UVoxtaAudioPlayback::OnChunkStateChange(const MessageChunkAudioContainer* chunk)
 {
-	const int ChunkIndex = chunk->INDEX;
-	TWeakObjectPtr<UVoxtaAudioPlayback> WeakThis = this;
-
-	AsyncTask(ENamedThreads::GameThread, [WeakThis, ChunkIndex] ()
+	if (m_internalState == AudioPlaybackInternalState::Done && m_queuedMessages.Num() == 0)
 	{
-		if (!WeakThis.IsValid())
-		{
-			return;
-		}
+		UE_LOGFMT(VoxtaLog, Error, "Audio playback was marked as finished, but a chunk was still underway, discarding.");
+		return;
+	}
 
-		UVoxtaAudioPlayback* This = WeakThis.Get();
+	// Chunks only report once they are ready for playback or failed, which is always on the game thread.
+	// Chunks of queued messages only have to continue the preparation.
+	const bool isCurrentChunk = m_orderedAudio.IsValidIndex(m_currentAudioClipIndex) &&
+		m_orderedAudio[m_currentAudioClipIndex].Get() == chunk;
+	const bool isChunkDone = chunk->GetCurrentState() == MessageChunkState::ReadyForPlayback ||
+		chunk->GetCurrentState() == MessageChunkState::Failed;
+	if (isCurrentChunk && isChunkDone && m_internalState == AudioPlaybackInternalState::Idle)
+	{
+		// Skipping a failed chunk already continues the preparation of the next ones.
+		PlayCurrentAudioChunkIfAvailable();
+		return;
+	}
+	ContinueProcessingAhead();
+}
 
-		if (This->m_internalState == AudioPlaybackInternalState::Done)
+void UVoxtaAudioPlayback::ContinueProcessingAhead()
+{
+	ReportMemoryUsage();
+
+	int numOfChunksInFlight = 0;
+	bool hasUnstartedChunks = false;
+	// A batch can only be solved once every chunk of the message has its audio.
+	const int lookahead = IsA2FMessageBatchingActive() ? m_orderedAudio.Num() : CHUNK_LOOKAHEAD;
+	const int endIndex = FMath::Min(m_currentAudioClipIndex + lookahead, m_orderedAudio.Num());
+	for (int i = m_currentAudioClipIndex; i < m_orderedAudio.Num(); i++)
+	{
+		if (i < endIndex && m_orderedAudio[i]->GetCurrentState() == MessageChunkState::Idle)
 		{
-			UE_LOGFMT(VoxtaLog, Error, "Audio playback was marked as finished, but a chunk was still underway, discarding.");
-			return;
+			m_orderedAudio[i]->StartProcessing(i == m_currentAudioClipIndex ?
+				VoxtaDownloadPriority::PlayingChunk : VoxtaDownloadPriority::Prefetch);
 		}
-
-		if (This->m_orderedAudio[ChunkIndex]->GetCurrentState() == MessageChunkState::ReadyForPlayback &&
-			This->m_internalState == AudioPlaybackInternalState::Idle)
+		else if (i == m_currentAudioClipIndex && m_orderedAudio[i]->GetCurrentState() == MessageChunkState::Busy)
 		{
-			This->PlayCurrentAudioChunkIfAvailable();
+			// Was prefetched, but playback is now waiting for it.
+			m_orderedAudio[i]->PromoteProcessing();
 		}
-		else if (This->m_orderedAudio[ChunkIndex]->GetCurrentState() != MessageChunkState::Busy &&
-				 This->m_orderedAudio[ChunkIndex]->GetCurrentState() != MessageChunkState::ReadyForPlayback)
+		numOfChunksInFlight += m_orderedAudio[i]->GetCurrentState() == MessageChunkState::Busy ? 1 : 0;
+		hasUnstartedChunks |= m_orderedAudio[i]->GetCurrentState() == MessageChunkState::Idle;
+	}
+
+	// Queued messages are only prepared once everything of the current message is underway, so they never delay it.
+	if (hasUnstartedChunks)
+	{
+		return;
+	}
+
+	const int64 budgetBytes = static_cast<int64>(m_queuePrepareBudgetMB) * 1024 * 1024;
+	int64 preparedBytes = 0;
+	for (const FQueuedMessage& queuedMessage : m_queuedMessages)
+	{
+		for (const TSharedPtr<MessageChunkAudioContainer>& chunk : queuedMessage.Chunks)
 		{
-			This->m_orderedAudio[ChunkIndex]->Continue();
+			preparedBytes += chunk->GetMemoryUsage().GetTotal();
 		}
+	}
 
-		const int NextIndex = ChunkIndex + 1;
-		if (NextIndex < This->m_orderedAudio.Num())
+	for (const FQueuedMessage& queuedMessage : m_queuedMessages)
+	{
+		for (const TSharedPtr<MessageChunkAudioContainer>& chunk : queuedMessage.Chunks)
 		{
-			if (This->m_orderedAudio[NextIndex]->GetCurrentState() != MessageChunkState::Busy &&
-				This->m_orderedAudio[NextIndex]->GetCurrentState() != MessageChunkState::ReadyForPlayback)
+			if (chunk->GetCurrentState() == MessageChunkState::Busy)
 			{
-				This->m_orderedAudio[NextIndex]->Continue();
+				numOfChunksInFlight++;
+			}
+			else if (chunk->GetCurrentState() == MessageChunkState::Idle)
+			{
+				if (numOfChunksInFlight >= CHUNK_LOOKAHEAD || preparedBytes >= budgetBytes)
+				{
+					return;
+				}
+				// Other components can be using up the process-wide budget, it will call this again once memory is freed.
+				if (!VoxtaAudioMemoryBudget::Get().TryReservePreparation(this))
+				{
+					return;
+				}
+				chunk->StartProcessing(VoxtaDownloadPriority::Prefetch);
+				numOfChunksInFlight++;
 			}
 		}
-	});
+	}
+}
+
+TArray<TSharedPtr<MessageChunkAudioContainer>> UVoxtaAudioPlayback::CreateAudioChunks(const FChatMessage& message)
+{
+	TArray<TSharedPtr<MessageChunkAudioContainer>> chunks;
+	const int numOfChunks = message.GetAudioUrls().Num();
+	const TSharedPtr<A2FMessageBatch, ESPMode::ThreadSafe> A2FBatch = IsA2FMessageBatchingActive() && numOfChunks > 2 ?
+		MakeShared<A2FMessageBatch, ESPMode::ThreadSafe>(m_clientReference->GetA2FHandler(), numOfChunks) : nullptr;
+	for (int i = 0; i < numOfChunks; i++)
+	{
+		chunks.Add(MakeShared<MessageChunkAudioContainer>(
+			FString::Format(TEXT("http://{0}:{1}{2}"), { m_hostAddress, m_hostPort, message.GetAudioUrls()[i] }),
+			m_lipSyncType,
+			m_clientReference->GetA2FHandler(),
+			[Self = TWeakObjectPtr<UVoxtaAudioPlayback>(this)]
+			(const MessageChunkAudioContainer* chunk)
+			{
+				if (Self != nullptr)
+				{
+					Self->OnChunkStateChange(chunk);
+				}
+				else
+				{
+					UE_LOGFMT(VoxtaLog, Warning, "Recieved a messageChunk status update, but the UVoxtaAudioPlayback"
+						" was already destroyed. Did you delete the character before the playback was finished?");
+				}
+			},
+			i,
+			A2FBatch));
+	}
+	return chunks;
+}
+
+bool UVoxtaAudioPlayback::IsA2FMessageBatchingActive() const
+{
+	return m_A2FMessageBatching && m_lipSyncType == LipSyncType::Audio2Face;
+}
+
+void UVoxtaAudioPlayback::StartMessagePlayback(const FGuid& messageId,
+	TArray<TSharedPtr<MessageChunkAudioContainer>>&& chunks)
+{
+	m_currentlyPlayingMessageId = messageId;
+	m_orderedAudio = MoveTemp(chunks);
+	m_currentAudioClipIndex = 0;
+	m_internalState = AudioPlaybackInternalState::Idle;
+	if (m_orderedAudio.Num() > 0)
+	{
+		ContinueProcessingAhead();
+		// Chunks that were prepared while queued can start right away.
+		PlayCurrentAudioChunkIfAvailable();
+	}
+	else
+	{
+		UE_LOGFMT(VoxtaLog, Warning, "Tried to play audio for the message, but no audiodata was found? "
+			"Are you sure the TTS service is active (was active at the start? runtime activation is not yet supported)");
+		MarkAudioChunkPlaybackCompleteInternal();
+		return;
+	}
+
+	UE_LOGFMT(VoxtaLog, Log, "Started playback for messageId: {0} of SenderId: {1}. Full message contains {2} "
+		"audio chunks that will be played in sequence.",
+		m_currentlyPlayingMessageId, m_characterId, m_orderedAudio.Num());
+}
+
+void UVoxtaAudioPlayback::EnqueueMessage(const FChatMessage& message)
+{
+	if (m_queuePolicy == VoxtaPlaybackQueuePolicy::DropOldest && m_queuedMessages.Num() >= FMath::Max(m_maxQueuedMessages, 1))
+	{
+		UE_LOGFMT(VoxtaLog, Warning, "Playback queue is full, dropping the oldest queued message with id: {0}.",
+			m_queuedMessages[0].MessageId);
+		DiscardQueuedMessage(0);
+	}
+
+	UE_LOGFMT(VoxtaLog, Log, "Queued message with id: {0} behind message with id: {1}, {2} message(s) are waiting.",
+		message.GetMessageId(), m_currentlyPlayingMessageId, m_queuedMessages.Num() + 1);
+	m_queuedMessages.Add({ message.GetMessageId(), CreateAudioChunks(message) });
+	ContinueProcessingAhead();
+}
+
+void UVoxtaAudioPlayback::StartNextQueuedMessage()
+{
+	if (m_queuedMessages.Num() == 0 || m_internalState != AudioPlaybackInternalState::Done)
+	{
+		return;
+	}
+
+	FQueuedMessage nextMessage = MoveTemp(m_queuedMessages[0]);
+	m_queuedMessages.RemoveAt(0);
+	StartMessagePlayback(nextMessage.MessageId, MoveTemp(nextMessage.Chunks));
+}
+
+void UVoxtaAudioPlayback::DiscardQueuedMessage(int queueIndex)
+{
+	FQueuedMessage discardedMessage = MoveTemp(m_queuedMessages[queueIndex]);
+	m_queuedMessages.RemoveAt(queueIndex);
+	for (const TSharedPtr<MessageChunkAudioContainer>& chunk : discardedMessage.Chunks)
+	{
+		chunk->CleanupData();
+	}
+
+	ReportMemoryUsage();
+
+	// The message will never be played, so for VoxtaServer its playback is done.
+	VoxtaMessageAudioPlaybackFinishedEventNative.Broadcast(discardedMessage.MessageId);
+	VoxtaMessageAudioPlaybackFinishedEvent.Broadcast(discardedMessage.MessageId);
+}
+
+void UVoxtaAudioPlayback::StopLipSync()
+{
+	if (m_lipSyncType == LipSyncType::Audio2Face && m_lipSyncHandler)
+	{
+		Cast<UAudio2FacePlaybackHandler>(m_lipSyncHandler)->Stop();
+	}
+#if WITH_OVRLIPSYNC
+	if (m_lipSyncType == LipSyncType::OVRLipSync && m_lipSyncHandler)
+	{
+		Cast<UOVRLipSyncPlaybackActorComponent>(m_lipSyncHandler)->Stop();
+	}
+#endif
 }
 
+void UVoxtaAudioPlayback::StopAudio()
+{
+	// Cleaning up a chunk returns its sound wave to the VoxtaObjectPool, so the component must not keep rendering it.
+	// The pool only hands it out again after its reuse delay, by then the audio thread has let go of it as well.
+	Stop();
+	SetSound(nullptr);
+	m_playingSoundWave.Reset();
+}
 
 void UVoxtaAudioPlayback::Cleanup()
+{
+	for (FQueuedMessage& queuedMessage : m_queuedMessages)
+	{
+		for (const TSharedPtr<MessageChunkAudioContainer>& chunk : queuedMessage.Chunks)
+		{
+			chunk->CleanupData();
+		}
+	}
+	m_queuedMessages.Empty();
+	CleanupCurrentMessage();
+}
+
+void UVoxtaAudioPlayback::CleanupCurrentMessage()
 {
 	UE_LOGFMT(VoxtaLog, Log, "Cleaning up all memory usage for audio related to audio for message with id: {0}.",
 		m_currentlyPlayingMessageId);
@@ -336,10 +564,68 @@ void UVoxtaAudioPlayback::Cleanup()
 	m_currentlyPlayingMessageId = FGuid();
 	m_currentAudioClipIndex = 0;
 	m_internalState = AudioPlaybackInternalState::Done;
+	StopAudio();
 	for (TSharedPtr<MessageChunkAudioContainer> audioChunk : m_orderedAudio)
 	{
 		audioChunk->CleanupData();
 		audioChunk.Reset();
 	}
 	m_orderedAudio.Empty();
+	ReportMemoryUsage();
+}
+
+void UVoxtaAudioPlayback::ReportMemoryUsage()
+{
+	FVoxtaAudioMemoryUsage usage;
+	for (const TSharedPtr<MessageChunkAudioContainer>& chunk : m_orderedAudio)
+	{
+		usage += chunk->GetMemoryUsage();
+	}
+	for (const FQueuedMessage& queuedMessage : m_queuedMessages)
+	{
+		for (const TSharedPtr<MessageChunkAudioContainer>& chunk : queuedMessage.Chunks)
+		{
+			usage += chunk->GetMemoryUsage();
+		}
+	}
+	VoxtaAudioMemoryBudget::Get().UpdateUsage(this, usage);
+}
+
+void UVoxtaAudioPlayback::CollectEvictionCandidates(TArray<FVoxtaAudioEvictionCandidate>& outCandidates) const
+{
+	// Chunks of the current message are never evicted, they are either playing or within the lookahead.
+	int distance = m_orderedAudio.Num() - m_currentAudioClipIndex;
+	for (const FQueuedMessage& queuedMessage : m_queuedMessages)
+	{
+		for (const TSharedPtr<MessageChunkAudioContainer>& chunk : queuedMessage.Chunks)
+		{
+			if (chunk->GetCurrentState() == MessageChunkState::ReadyForPlayback)
+			{
+				outCandidates.Add({ chunk, chunk->GetMemoryUsage().GetTotal(), distance });
+			}
+			distance++;
+		}
+	}
+}
+
+bool UVoxtaAudioPlayback::EvictPreparedChunk(const MessageChunkAudioContainer* chunk)
+{
+	for (FQueuedMessage& queuedMessage : m_queuedMessages)
+	{
+		for (TSharedPtr<MessageChunkAudioContainer>& queuedChunk : queuedMessage.Chunks)
+		{
+			if (queuedChunk.Get() == chunk)
+			{
+				UE_LOGFMT(VoxtaLog, Log, "Evicting prepared audio chunk index: {0} of queued message with id: {1} to "
+					"stay within the audio memory budget.", chunk->INDEX, queuedMessage.MessageId);
+
+				const TSharedPtr<MessageChunkAudioContainer> evictedChunk = queuedChunk;
+				queuedChunk = evictedChunk->CreateUnprocessedCopy();
+				evictedChunk->CleanupData();
+				ReportMemoryUsage();
+				return true;
+			}
+		}
+	}
+	return false;
 }
\ No newline at end of file
@@ -19,6 +19,13 @@
 #include "VoxtaData/Public/VoxtaVersionData.h"
 #include "VoxtaData/Public/ServerResponses.h"
 #include "LogUtility/Public/Defines.h"
+#include "RuntimeAudioImporter/RuntimeAudioImporterLibrary.h"
+#include "VoxtaObjectPool.h"
+#include "LipSyncDataA2F.h"
+#include "LipSyncDataCustom.h"
+#if WITH_OVRLIPSYNC
+#include "LipSyncDataOVR.h"
+#endif
 
 void UVoxtaClient::Initialize(FSubsystemCollectionBase& collection)
 {
@@ -29,6 +36,7 @@ void UVoxtaClient::Initialize(FSubsystemCollectionBase& collection)
 	m_texturesCacheHandler = MakeShared<TexturesCacheHandler>();
 	m_globalAudioPlaybackComp = nullptr;
 	SensitiveLogging::isSensitiveLogsCensored = true;
+	PrewarmObjectPools();
 	Super::Initialize(collection);
 }
 
@@ -228,7 +236,33 @@ void UVoxtaClient::NotifyAudioPlaybackComplete(const FGuid& messageId)
 	}
 
 	SendMessageToServer(VoxtaApiRequestHandler::GetNotifyAudioPlaybackCompletedData(m_chatSession->GetSessionId(), messageId));
-	SetState(VoxtaClientState::WaitingForUserResponse);
+	// Queued messages are reported one by one, the conversation only continues once all of them were played.
+	if (!IsAnyAudioPlaybackPending())
+	{
+		SetState(VoxtaClientState::WaitingForUserResponse);
+	}
+}
+
+bool UVoxtaClient::IsAnyAudioPlaybackPending() const
+{
+	for (const TPair<FGuid, TWeakObjectPtr<UVoxtaAudioPlayback>>& playbackHandler : m_registeredCharacterAudioPlaybackComps)
+	{
+		if (playbackHandler.Value.IsValid() && playbackHandler.Value->HasPendingPlayback())
+		{
+			return true;
+		}
+	}
+	return IsGlobalAudioFallbackActive() && m_globalAudioPlaybackComp->GetGlobalPlaybackComponent()->HasPendingPlayback();
+}
+
+void UVoxtaClient::PrewarmObjectPools() const
+{
+	URuntimeAudioImporterLibrary::PrewarmImportedSoundWaves(PREWARMED_POOL_SIZE);
+	VoxtaObjectPool::Get().Prewarm(ULipSyncDataA2F::StaticClass(), PREWARMED_POOL_SIZE);
+	VoxtaObjectPool::Get().Prewarm(ULipSyncDataCustom::StaticClass(), PREWARMED_POOL_SIZE);
+#if WITH_OVRLIPSYNC
+	VoxtaObjectPool::Get().Prewarm(ULipSyncDataOVR::StaticClass(), PREWARMED_POOL_SIZE);
+#endif
 }
 
 void UVoxtaClient::TryFetchAndCacheCharacterThumbnail(const FGuid& baseCharacterId, FDownloadedTextureDelegateNative onThumbnailFetched)
@@ -892,6 +926,19 @@ bool UVoxtaClient::HandleChatMessageResponse(const ServerResponseChatMessageBase
 				UE_LOGFMT(VoxtaLog, Log, "Message with id: {0} marked as cancelled, removing it from the history.",
 					derivedResponse->MESSAGE_ID);
 
+				// Stops the audio if it was already playing, and any downloads & lipsync still running for it.
+				for (const TPair<FGuid, TWeakObjectPtr<UVoxtaAudioPlayback>>& playbackHandler : m_registeredCharacterAudioPlaybackComps)
+				{
+					if (playbackHandler.Value.IsValid())
+					{
+						playbackHandler.Value->CancelMessagePlayback(derivedResponse->MESSAGE_ID);
+					}
+				}
+				if (IsGlobalAudioFallbackActive())
+				{
+					m_globalAudioPlaybackComp->GetGlobalPlaybackComponent()->CancelMessagePlayback(derivedResponse->MESSAGE_ID);
+				}
+
 				VoxtaClientCharMessageRemovedEventNative.Broadcast(messages[index]);
 				VoxtaClientCharMessageRemovedEvent.Broadcast(messages[index]);
 				m_chatSession->RemoveChatMessage(derivedResponse->MESSAGE_ID);
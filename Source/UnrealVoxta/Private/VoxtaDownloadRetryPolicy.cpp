@@ -0,0 +1,55 @@
+// Copyright(c) 2024 grrimgrriefer & DZnnah, see LICENSE for details.
+
+#include "VoxtaDownloadRetryPolicy.h"
+#include "HAL/IConsoleManager.h"
+#include "Misc/ScopeLock.h"
+
+namespace
+{
+	TAutoConsoleVariable<int32> CVarHttpRetryBaseDelayMs(
+		TEXT("voxta.Http.RetryBaseDelayMs"),
+		250,
+		TEXT("Delay before the first retry of a voiceline download, doubled for every following retry."));
+}
+
+void VoxtaDownloadLatencyTracker::AddSample(double seconds)
+{
+	FScopeLock lock(&m_lock);
+	m_samples[m_nextIndex] = seconds;
+	m_nextIndex = (m_nextIndex + 1) % WINDOW_SIZE;
+	m_numOfSamples = FMath::Min(m_numOfSamples + 1, WINDOW_SIZE);
+}
+
+bool VoxtaDownloadLatencyTracker::TryGetPercentile(float percentile, int minNumOfSamples, double& outSeconds) const
+{
+	TArray<double, TInlineAllocator<WINDOW_SIZE>> sortedSamples;
+	{
+		FScopeLock lock(&m_lock);
+		if (m_numOfSamples == 0 || m_numOfSamples < minNumOfSamples)
+		{
+			return false;
+		}
+		sortedSamples.Append(m_samples, m_numOfSamples);
+	}
+	sortedSamples.Sort();
+
+	// Nearest-rank percentile
+	const int rank = FMath::CeilToInt(FMath::Clamp(percentile, 0.f, 100.f) / 100.f * sortedSamples.Num());
+	outSeconds = sortedSamples[FMath::Clamp(rank - 1, 0, sortedSamples.Num() - 1)];
+	return true;
+}
+
+void VoxtaDownloadLatencyTracker::Reset()
+{
+	FScopeLock lock(&m_lock);
+	m_numOfSamples = 0;
+	m_nextIndex = 0;
+}
+
+float VoxtaDownloadRetryPolicy::GetRetryDelaySeconds(int retryIndex, float jitter)
+{
+	const float baseDelaySeconds = FMath::Max(CVarHttpRetryBaseDelayMs.GetValueOnAnyThread(), 0) / 1000.f;
+	const float delaySeconds = baseDelaySeconds * static_cast<float>(1 << FMath::Clamp(retryIndex, 0, 10));
+	// Between half and the full delay
+	return delaySeconds * (0.5f + 0.5f * FMath::Clamp(jitter, 0.f, 1.f));
+}
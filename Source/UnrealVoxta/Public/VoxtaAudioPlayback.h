@@ -5,15 +5,19 @@
 #include "Components/AudioComponent.h"
 #include "AbstractA2FWeightProvider.h"
 #include "LipSyncType.h"
+#include "VoxtaPlaybackQueuePolicy.h"
 #include "VoxtaAudioPlayback.generated.h"
 
 class MessageChunkAudioContainer;
 class UActorComponent;
 class UAudio2FacePlaybackHandler;
+class UImportedSoundWave;
 class UVoxtaClient;
 class USoundWaveProcedural;
+class VoxtaAudioMemoryBudget;
 struct FBaseCharData;
 struct FChatMessage;
+struct FVoxtaAudioEvictionCandidate;
 
 /**
  * UVoxtaAudioPlayback
@@ -28,6 +32,9 @@ class UNREALVOXTA_API UVoxtaAudioPlayback : public UAudioComponent, public IA2FW
 {
 	GENERATED_BODY()
 
+	/** Evicts prepared chunks and resumes preparation across all playback components. */
+	friend class VoxtaAudioMemoryBudget;
+
 #pragma region delegate declarations
 public:
 	/** Delegate fired when message audio playback is completed. */
@@ -94,12 +101,25 @@ public:
 
 	/**
 	 * The main entrypoint, hooked into the VoxtaClient and will trigger the download & playback of the audio.
+	 * If another message is still playing, the queue policy decides whether the new message preempts it or waits.
 	 *
 	 * @param sender The characterID, will skip any messages not assigned to this character.
 	 * @param message The message of which the URLs will be used to fetch the wav audio data.
 	 */
 	virtual void PlaybackMessage(const FBaseCharData& sender, const FChatMessage& message);
 
+	/**
+	 * Stop the playback of a message that was cancelled by VoxtaServer, and cancel the downloads, decoding and lipsync
+	 * generation that are still running for its audio chunks.
+	 * Queued messages are removed from the queue. Does nothing if the message is neither playing nor queued.
+	 *
+	 * @param messageId The id of the cancelled message.
+	 */
+	virtual void CancelMessagePlayback(const FGuid& messageId);
+
+	/** @return True if a message is playing or waiting in the queue. */
+	bool HasPendingPlayback() const;
+
 	/** @return The LipSyncType that this playback handler will use. */
 	LipSyncType GetLipSyncType() const;
 #pragma endregion
@@ -109,9 +129,11 @@ public:
 	/**
 	 * Retrieve the A2F curveWeights for the upcoming update tick.
 	 *
-	 * @param targetArrayRef The array that will be used to fill the new curves. Old values will be overwritten.
+	 * @param outCurves The buffer to write the ARKit curve weights into, at least 52 values.
+	 *
+	 * @return False if no A2F lipsync is playing, outCurves is left untouched in that case.
 	 */
-	virtual void GetA2FCurveWeightsPreUpdate(TArray<float>& targetArrayRef) override;
+	virtual bool GetA2FCurveWeightsPreUpdate(TArrayView<float> outCurves) override;
 #pragma endregion
 
 #pragma region UActorComponent overrides
@@ -141,12 +163,39 @@ private:
 		Playing,
 		Done
 	};
+
+	/** A message waiting for its turn, its chunks are prepared while the messages before it are playing. */
+	struct FQueuedMessage
+	{
+		FGuid MessageId;
+		TArray<TSharedPtr<MessageChunkAudioContainer>> Chunks;
+	};
 #pragma endregion
 
 #pragma region data
 protected:
 	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = "Voxta", meta = (AllowPrivateAccess = "true", DisplayName = "Lipsync Type"))
 	LipSyncType m_lipSyncType = LipSyncType::None;
+
+	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = "Voxta", meta = (AllowPrivateAccess = "true", DisplayName = "Queue Policy"))
+	VoxtaPlaybackQueuePolicy m_queuePolicy = VoxtaPlaybackQueuePolicy::Preempt;
+
+	/** Only used by the DropOldest policy. */
+	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = "Voxta", meta = (AllowPrivateAccess = "true", DisplayName = "Max Queued Messages", ClampMin = "1"))
+	int32 m_maxQueuedMessages = 4;
+
+	/** How much decoded audio of queued messages may be prepared ahead of time, in megabytes. */
+	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = "Voxta", meta = (AllowPrivateAccess = "true", DisplayName = "Queue Prepare Budget (MB)", ClampMin = "0"))
+	int32 m_queuePrepareBudgetMB = 32;
+
+	/**
+	 * Solve the A2F lipsync of all chunks of a message with one A2F job, once their audio is downloaded. Saves the
+	 * per-job overhead and keeps the context across chunk edges, the first chunk is still solved on its own.
+	 * Only used with Audio2Face lipsync, the whole message is then downloaded ahead instead of a few chunks.
+	 */
+	UPROPERTY(EditAnywhere, BlueprintReadOnly, Category = "Voxta", meta = (AllowPrivateAccess = "true", DisplayName = "A2F Whole Message Batching"))
+	bool m_A2FMessageBatching = false;
+
 	FGuid m_characterId;
 	UVoxtaClient* m_clientReference;
 
@@ -158,13 +207,19 @@ private:
 
 	FGuid m_currentlyPlayingMessageId;
 	TArray<TSharedPtr<MessageChunkAudioContainer>> m_orderedAudio;
+	TArray<FQueuedMessage> m_queuedMessages;
 
 	FDelegateHandle m_playbackFinishedHandle;
 
 	FString m_hostAddress;
 	int m_hostPort;
-	AudioPlaybackInternalState m_internalState;
+	AudioPlaybackInternalState m_internalState = AudioPlaybackInternalState::Done;
 	int m_currentAudioClipIndex = 0;
+	/** The sound wave of the chunk that the component is playing, to tell its finished callback from stale ones. */
+	TWeakObjectPtr<const UImportedSoundWave> m_playingSoundWave;
+
+	/** Number of chunks, starting from the one that is playing, that are processed in the background at once. */
+	static constexpr int CHUNK_LOOKAHEAD = 2;
 #pragma endregion
 
 #pragma region private API
@@ -186,6 +241,13 @@ private:
 	UFUNCTION()
 	void OnAudioPlaybackFinished(UAudioComponent* component);
 
+	/**
+	 * A sound that was stopped (cancelled or preempted) reports finished late, possibly after the next chunk started.
+	 *
+	 * @return True if the finished callback of the component belongs to the chunk that is playing now.
+	 */
+	bool IsPlayingSoundFinished() const;
+
 	/**
 	 * Keeps track of which index is currently being played
 	 * and will trigger the finished event if we're done playing.
@@ -199,7 +261,85 @@ private:
 	 */
 	void OnChunkStateChange(const MessageChunkAudioContainer* finishedChunk);
 
-	/** Clean up the soundwaves correctly, so there's no memory leaks. */
+	/**
+	 * Start the background processing of the current chunk and the ones right after it, so the next voiceline is
+	 * usually ready by the time the current one finishes playing.
+	 * Once the current message is fully underway, the queued messages are prepared within the prepare budget.
+	 */
+	void ContinueProcessingAhead();
+
+	/**
+	 * Create the (idle) containers for all audio chunks of a message.
+	 *
+	 * @param message The message of which the URLs will be used to fetch the audio data.
+	 *
+	 * @return The containers, in playback order.
+	 */
+	TArray<TSharedPtr<MessageChunkAudioContainer>> CreateAudioChunks(const FChatMessage& message);
+
+	/** @return True if the A2F lipsync of a message is solved in one batch, see m_A2FMessageBatching. */
+	bool IsA2FMessageBatchingActive() const;
+
+	/**
+	 * Make the given message the current one and start its playback as soon as its first chunk is ready.
+	 * Only valid while no other message is playing.
+	 *
+	 * @param messageId The id of the message.
+	 * @param chunks The containers of its audio chunks, possibly already prepared while queued.
+	 */
+	void StartMessagePlayback(const FGuid& messageId, TArray<TSharedPtr<MessageChunkAudioContainer>>&& chunks);
+
+	/**
+	 * Add a message to the playback queue, applying the queue policy if the queue is full.
+	 *
+	 * @param message The message to queue.
+	 */
+	void EnqueueMessage(const FChatMessage& message);
+
+	/** Start the playback of the oldest queued message, if nothing is playing. */
+	void StartNextQueuedMessage();
+
+	/**
+	 * Remove a message from the queue without playing it, and report its playback as finished.
+	 *
+	 * @param queueIndex The index in the queue.
+	 */
+	void DiscardQueuedMessage(int queueIndex);
+
+	/** Stop the lipsync handler that belongs to the selected lipsync type, if there is one. */
+	void StopLipSync();
+
+	/** Stop the audio component and take the sound wave of the current chunk off of it, before it is recycled. */
+	void StopAudio();
+
+	/**
+	 * Clean up the soundwaves of the current and all queued messages correctly, so there's no memory leaks.
+	 * Cancels any chunk processing that is still running.
+	 */
 	void Cleanup();
+
+	/** Clean up only the current message and stop its audio, the queued messages are kept. */
+	void CleanupCurrentMessage();
+
+	/** Report the memory held by the chunks of the current and all queued messages to the VoxtaAudioMemoryBudget. */
+	void ReportMemoryUsage();
+
+	/**
+	 * Add the chunks of queued messages that are prepared but not needed yet, they can be evicted when the process
+	 * runs out of audio memory budget.
+	 *
+	 * @param outCandidates The array to add the candidates to.
+	 */
+	void CollectEvictionCandidates(TArray<FVoxtaAudioEvictionCandidate>& outCandidates) const;
+
+	/**
+	 * Drop the prepared data of a chunk of a queued message, it is replaced by an idle copy that is prepared again
+	 * once memory is available or the message starts playing.
+	 *
+	 * @param chunk The chunk to evict.
+	 *
+	 * @return True if the chunk was found in the queue and evicted.
+	 */
+	bool EvictPreparedChunk(const MessageChunkAudioContainer* chunk);
 #pragma endregion
 };
@@ -350,6 +350,8 @@ public:
 private:
 	const FString SEND_MESSAGE_EVENT_NAME = TEXT("SendMessage");
 	const FString RECEIVE_MESSAGE_EVENT_NAME = TEXT("ReceiveMessage");
+	/** Free instances per voiceline object class, enough for the chunks that are prepared ahead of playback. */
+	const int32 PREWARMED_POOL_SIZE = 4;
 
 	UPROPERTY()
 	UVoxtaAudioInput* m_voiceInput;
@@ -382,6 +384,12 @@ private:
 	/** Register internal listeners to the event triggers of the SignalR hub connection. */
 	void StartListeningToServer();
 
+	/** @return True if any playback handler is still playing a message or has one queued. */
+	bool IsAnyAudioPlaybackPending() const;
+
+	/** Fill the VoxtaObjectPool with the sound waves & lipsync data objects of the first voicelines. */
+	void PrewarmObjectPools() const;
+
 #pragma region IHubConnection listeners
 private:
 	/** Called when a new message was received via the connection. */
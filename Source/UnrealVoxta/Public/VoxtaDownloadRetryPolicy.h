@@ -0,0 +1,62 @@
+// Copyright(c) 2024 grrimgrriefer & DZnnah, see LICENSE for details.
+
+#pragma once
+
+#include "CoreMinimal.h"
+
+/**
+ * VoxtaDownloadLatencyTracker
+ * Rolling window of the most recent time-to-first-byte samples, used to decide when a download is slow enough to hedge.
+ *
+ * Note: All functions are thread-safe.
+ */
+class UNREALVOXTA_API VoxtaDownloadLatencyTracker
+{
+#pragma region public API
+public:
+	/**
+	 * @param seconds Time between queueing a request and receiving its first byte.
+	 */
+	void AddSample(double seconds);
+
+	/**
+	 * @param percentile The percentile, between 0 and 100.
+	 * @param minNumOfSamples The number of samples needed before the result is trusted.
+	 * @param outSeconds The time-to-first-byte that the given percentage of the samples stayed under.
+	 *
+	 * @return False if there are not enough samples yet.
+	 */
+	bool TryGetPercentile(float percentile, int minNumOfSamples, double& outSeconds) const;
+
+	/** Drop all samples. */
+	void Reset();
+#pragma endregion
+
+#pragma region data
+private:
+	static constexpr int WINDOW_SIZE = 64;
+
+	mutable FCriticalSection m_lock;
+	double m_samples[WINDOW_SIZE] = {};
+	int m_numOfSamples = 0;
+	int m_nextIndex = 0;
+#pragma endregion
+};
+
+/**
+ * VoxtaDownloadRetryPolicy
+ * The backoff between the retries of a failed voiceline download (voxta.Http.RetryBaseDelayMs).
+ */
+class UNREALVOXTA_API VoxtaDownloadRetryPolicy
+{
+#pragma region public API
+public:
+	/**
+	 * @param retryIndex 0 for the first retry.
+	 * @param jitter Random value in [0, 1], spreads out the retries of chunks that failed at the same time.
+	 *
+	 * @return The time to wait before the given retry.
+	 */
+	static float GetRetryDelaySeconds(int retryIndex, float jitter);
+#pragma endregion
+};
@@ -6,6 +6,184 @@
 #include "Features/IModularFeature.h"
 #include "AudioStructs.h"
 
+/**
+ * Base runtime streaming decoder
+ * Decodes encoded audio incrementally, as the bytes arrive (e.g. while a download is still in progress).
+ * Decoded samples are interleaved 32-bit floats.
+ *
+ * Thread Safety: An instance must only be used by one thread at a time.
+ */
+class FBaseRuntimeStreamingDecoder
+{
+public:
+	virtual ~FBaseRuntimeStreamingDecoder() = default;
+
+	/**
+	 * Feed the next part of the encoded stream, decoding every packet that is complete.
+	 *
+	 * @param Data Pointer to the encoded bytes, these are copied and can be released after the call.
+	 * @param Size Number of encoded bytes.
+	 *
+	 * @return False if the stream is corrupt or not supported, the decoder can't be used anymore after that.
+	 */
+	virtual bool AppendEncodedData(const uint8* Data, int64 Size) PURE_VIRTUAL(FBaseRuntimeStreamingDecoder::AppendEncodedData, return false;)
+
+	/**
+	 * Move the PCM data that was decoded so far to the end of OutPCMData.
+	 *
+	 * @param OutPCMData Array that receives the interleaved samples.
+	 *
+	 * @return Number of frames that were added.
+	 */
+	virtual int64 ConsumeDecodedData(TArray64<float>& OutPCMData) PURE_VIRTUAL(FBaseRuntimeStreamingDecoder::ConsumeDecodedData, return 0;)
+
+	/**
+	 * Whether the headers were parsed, GetSampleRate and GetNumOfChannels are only valid after that.
+	 * @return True if the headers were parsed.
+	 */
+	virtual bool IsHeaderParsed() const PURE_VIRTUAL(FBaseRuntimeStreamingDecoder::IsHeaderParsed, return false;)
+
+	/**
+	 * Whether the last packet of the stream was decoded.
+	 * @return True if the end of the stream was reached.
+	 */
+	virtual bool IsFinished() const PURE_VIRTUAL(FBaseRuntimeStreamingDecoder::IsFinished, return false;)
+
+	/** @return The sample rate of the decoded samples. */
+	virtual uint32 GetSampleRate() const PURE_VIRTUAL(FBaseRuntimeStreamingDecoder::GetSampleRate, return 0;)
+
+	/** @return The number of interleaved channels of the decoded samples. */
+	virtual uint32 GetNumOfChannels() const PURE_VIRTUAL(FBaseRuntimeStreamingDecoder::GetNumOfChannels, return 0;)
+};
+
+/**
+ * Base runtime block decoder
+ * Decodes arbitrary frame ranges of encoded audio on demand, so the audio doesn't have to be decoded up front.
+ * Decoded samples are interleaved 32-bit floats. Reading sequentially is the cheapest, seeking may be costly depending on the codec.
+ *
+ * Thread Safety: An instance must only be used by one thread at a time.
+ */
+class FBaseRuntimeBlockDecoder
+{
+public:
+	virtual ~FBaseRuntimeBlockDecoder() = default;
+
+	/**
+	 * Decode a range of frames.
+	 *
+	 * @param FirstFrame Index of the first frame to decode.
+	 * @param NumOfFrames Number of frames to decode, frames past the end of the audio are zeroed.
+	 * @param OutPCMData Interleaved output samples, must be able to hold NumOfFrames frames.
+	 *
+	 * @return False if the encoded data turned out to be corrupt.
+	 */
+	virtual bool DecodeFrames(int64 FirstFrame, int32 NumOfFrames, float* OutPCMData) PURE_VIRTUAL(FBaseRuntimeBlockDecoder::DecodeFrames, return false;)
+
+	/** @return The total number of frames of the audio. */
+	virtual int64 GetNumOfFrames() const PURE_VIRTUAL(FBaseRuntimeBlockDecoder::GetNumOfFrames, return 0;)
+
+	/** @return The sample rate of the decoded samples. */
+	virtual uint32 GetSampleRate() const PURE_VIRTUAL(FBaseRuntimeBlockDecoder::GetSampleRate, return 0;)
+
+	/** @return The number of interleaved channels of the decoded samples. */
+	virtual uint32 GetNumOfChannels() const PURE_VIRTUAL(FBaseRuntimeBlockDecoder::GetNumOfChannels, return 0;)
+
+	/** @return The number of encoded bytes the decoder keeps alive. */
+	virtual int64 GetEncodedSize() const PURE_VIRTUAL(FBaseRuntimeBlockDecoder::GetEncodedSize, return 0;)
+};
+
+/**
+ * Block decoder for codecs that can only decode sequentially (e.g. Ogg based ones).
+ * Sequential reads continue the same streaming decoder, seeking backwards restarts decoding from the start of the data.
+ * The caller is expected to read mostly forward, as the render thread does.
+ */
+class FStreamedBlockDecoder : public FBaseRuntimeBlockDecoder
+{
+public:
+	using FCreateStreamingDecoder = TFunction<TUniquePtr<FBaseRuntimeStreamingDecoder>()>;
+
+	FStreamedBlockDecoder(const FSharedAudioBytes& InAudioData, FCreateStreamingDecoder&& InCreateStreamingDecoder, int64 InNumOfFrames, uint32 InSampleRate, uint32 InNumOfChannels)
+		: AudioData(InAudioData)
+		, CreateStreamingDecoder(MoveTemp(InCreateStreamingDecoder))
+		, NumOfFrames(InNumOfFrames)
+		, SampleRate(InSampleRate)
+		, NumOfChannels(InNumOfChannels)
+	{}
+
+	//~ Begin FBaseRuntimeBlockDecoder Interface
+	virtual bool DecodeFrames(int64 FirstFrame, int32 NumOfRequestedFrames, float* OutPCMData) override
+	{
+		if (!Decoder.IsValid() || FirstFrame < BufferStartFrame)
+		{
+			Decoder = CreateStreamingDecoder();
+			if (!Decoder.IsValid())
+			{
+				return false;
+			}
+			ReadOffset = 0;
+			BufferStartFrame = 0;
+			BufferedPCMData.Reset();
+		}
+
+		// Only feed as much of the encoded data as is needed to reach the end of the requested range
+		constexpr int64 EncodedChunkSize = 16 * 1024;
+		const int64 EndFrame = FirstFrame + NumOfRequestedFrames;
+		while (BufferStartFrame + GetNumOfBufferedFrames() < EndFrame && ReadOffset < AudioData->Num())
+		{
+			const int64 ChunkSize = FMath::Min<int64>(EncodedChunkSize, AudioData->Num() - ReadOffset);
+			if (!Decoder->AppendEncodedData(AudioData->GetData() + ReadOffset, ChunkSize))
+			{
+				return false;
+			}
+			ReadOffset += ChunkSize;
+			Decoder->ConsumeDecodedData(BufferedPCMData);
+		}
+
+		const int64 NumOfAvailableFrames = FMath::Clamp<int64>(BufferStartFrame + GetNumOfBufferedFrames() - FirstFrame, 0, NumOfRequestedFrames);
+		if (NumOfAvailableFrames > 0)
+		{
+			FMemory::Memcpy(OutPCMData, BufferedPCMData.GetData() + (FirstFrame - BufferStartFrame) * NumOfChannels, NumOfAvailableFrames * NumOfChannels * sizeof(float));
+		}
+		if (NumOfAvailableFrames < NumOfRequestedFrames)
+		{
+			FMemory::Memzero(OutPCMData + NumOfAvailableFrames * NumOfChannels, (NumOfRequestedFrames - NumOfAvailableFrames) * NumOfChannels * sizeof(float));
+		}
+
+		// Everything up to the end of the range has been handed out, the next read is expected to continue from there
+		const int64 NumOfDiscardedFrames = FMath::Clamp<int64>(EndFrame - BufferStartFrame, 0, GetNumOfBufferedFrames());
+		BufferedPCMData.RemoveAt(0, NumOfDiscardedFrames * NumOfChannels, EAllowShrinking::No);
+		BufferStartFrame += NumOfDiscardedFrames;
+		return true;
+	}
+
+	virtual int64 GetNumOfFrames() const override { return NumOfFrames; }
+	virtual uint32 GetSampleRate() const override { return SampleRate; }
+	virtual uint32 GetNumOfChannels() const override { return NumOfChannels; }
+	virtual int64 GetEncodedSize() const override { return AudioData.IsValid() ? AudioData->Num() : 0; }
+	//~ End FBaseRuntimeBlockDecoder Interface
+
+private:
+	int64 GetNumOfBufferedFrames() const
+	{
+		return NumOfChannels > 0 ? BufferedPCMData.Num() / NumOfChannels : 0;
+	}
+
+	FSharedAudioBytes AudioData;
+	FCreateStreamingDecoder CreateStreamingDecoder;
+	TUniquePtr<FBaseRuntimeStreamingDecoder> Decoder;
+
+	int64 NumOfFrames = 0;
+	uint32 SampleRate = 0;
+	uint32 NumOfChannels = 0;
+
+	/** Offset of the next encoded byte to feed to the decoder */
+	int64 ReadOffset = 0;
+
+	/** Decoded frames that were not handed out yet, starting at BufferStartFrame */
+	TArray64<float> BufferedPCMData;
+	int64 BufferStartFrame = 0;
+};
+
 /**
  * Base runtime codec
  * To add a new codec, derive from this class and implement the necessary functions.
@@ -54,4 +232,63 @@ public:
 	 * @return The audio format supported by this codec.
 	 */
 	virtual ERuntimeAudioFormat GetAudioFormat() const PURE_VIRTUAL(FBaseRuntimeCodec::GetAudioFormat, return ERuntimeAudioFormat::Invalid;)
+
+	/**
+	 * Retrieve the MIME content types this codec can decode, most specific first.
+	 * 
+	 * @return The content types, e.g. to advertise to a server or to match a response header against.
+	 */
+	virtual TArray<FString> GetContentTypes() const PURE_VIRTUAL(FBaseRuntimeCodec::GetContentTypes, return {};)
+
+	/**
+	 * Create a decoder that decodes the audio data incrementally.
+	 * 
+	 * @param PreferredSampleRate Sample rate to decode to if the codec can choose it freely, 0 to use the native rate.
+	 * 
+	 * @return The decoder, or nullptr if the codec does not support streaming.
+	 */
+	virtual TUniquePtr<FBaseRuntimeStreamingDecoder> CreateStreamingDecoder(uint32 PreferredSampleRate) const { return nullptr; }
+
+	/**
+	 * Create a decoder that decodes frame ranges on demand, directly from the encoded data.
+	 * 
+	 * @param AudioData The encoded audio data, the decoder keeps its own reference to it.
+	 * @param PreferredSampleRate Sample rate to decode to if the codec can choose it freely, 0 to use the native rate.
+	 * 
+	 * @return The decoder, or nullptr if the codec (or this particular data) does not support on demand decoding.
+	 */
+	virtual TUniquePtr<FBaseRuntimeBlockDecoder> CreateBlockDecoder(const FSharedAudioBytes& AudioData, uint32 PreferredSampleRate) const { return nullptr; }
+
+protected:
+	/**
+	 * Decode the complete encoded data in one go, through the streaming decoder of this codec.
+	 * 
+	 * @param EncodedData The encoded audio data to decode.
+	 * @param DecodedData Output parameter to receive the decoded audio data.
+	 * 
+	 * @return True if decoding was successful, false otherwise.
+	 */
+	bool DecodeWithStreamingDecoder(const FEncodedAudioStruct& EncodedData, FDecodedAudioStruct& DecodedData) const
+	{
+		TUniquePtr<FBaseRuntimeStreamingDecoder> Decoder = CreateStreamingDecoder(EncodedData.PreferredSampleRate);
+		if (!Decoder.IsValid() || !Decoder->AppendEncodedData(EncodedData.AudioData.GetView().GetData(), EncodedData.AudioData.GetView().Num()))
+		{
+			return false;
+		}
+
+		TArray64<float> PCMData;
+		const int64 NumOfFrames = Decoder->ConsumeDecodedData(PCMData);
+		if (!Decoder->IsHeaderParsed() || NumOfFrames <= 0)
+		{
+			return false;
+		}
+
+		DecodedData.PCMInfo.PCMNumOfFrames = static_cast<uint32>(NumOfFrames);
+		DecodedData.PCMInfo.PCMData = FRuntimeBulkDataBuffer<float>(PCMData);
+		DecodedData.SoundWaveBasicInfo.NumOfChannels = Decoder->GetNumOfChannels();
+		DecodedData.SoundWaveBasicInfo.SampleRate = Decoder->GetSampleRate();
+		DecodedData.SoundWaveBasicInfo.Duration = static_cast<float>(NumOfFrames) / Decoder->GetSampleRate();
+		DecodedData.SoundWaveBasicInfo.AudioFormat = GetAudioFormat();
+		return true;
+	}
 };
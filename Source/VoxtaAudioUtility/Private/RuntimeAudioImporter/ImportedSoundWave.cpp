@@ -7,20 +7,66 @@
 #include "Engine/Engine.h"
 #include "AudioThread.h"
 #include "AudioDeviceHandle.h"
+#include "Containers/Ticker.h"
+#include "HAL/PlatformProcess.h"
+#include "LazyPCMSource.h"
+#include "Misc/ScopeExit.h"
 #include "RAW_RuntimeCodec.h"
+#include "RAW_TranscodeKernels.h"
 #include "RuntimeAudioImporterLibrary.h"
 
+namespace
+{
+	/** One second of 48kHz stereo audio, allocated once so the render thread never has to grow it */
+	constexpr uint32 PCM_DATA_TAP_CAPACITY = 48000 * 2;
+
+	/** The imported sound waves serviced by the shared render support ticker */
+	struct FRenderSupportRegistry
+	{
+		FCriticalSection Guard;
+		/** Sound waves remove themselves in BeginDestroy */
+		TArray<UImportedSoundWave*> SoundWaves;
+		FTSTicker::FDelegateHandle TickerHandle;
+
+		/** Copy of SoundWaves while ticking, so listeners can create or destroy sound waves. Destroyed ones are nulled */
+		TArray<UImportedSoundWave*> TickedSoundWaves;
+	};
+
+	FRenderSupportRegistry& GetRenderSupportRegistry()
+	{
+		static FRenderSupportRegistry Registry;
+		return Registry;
+	}
+}
+
 UImportedSoundWave::UImportedSoundWave(const FObjectInitializer& ObjectInitializer)
 	: Super(ObjectInitializer)
 	, DataGuard(MakeShared<FCriticalSection>())
 	, PlaybackFinishedBroadcast(false)
 	, PlayedNumOfFrames(0)
+	, bIsPCMDataRenderable(false)
+	, NumOfRenderCallbacksInFlight(0)
+	, NumOfUnderruns(0)
+	, NumOfGlitches(0)
+	, bHasPCMDataListeners(false)
+	, OwningAudioComponentID(0)
 	, PCMBufferInfo(MakeShared<FPCMStruct>())
 	, bStopSoundOnPlaybackFinish(true)
 	, ImportedAudioFormat(ERuntimeAudioFormat::Invalid)
 {
 	ensure(PCMBufferInfo);
 
+	if (!HasAnyFlags(RF_ClassDefaultObject))
+	{
+		FRenderSupportRegistry& Registry = GetRenderSupportRegistry();
+		FScopeLock Lock(&Registry.Guard);
+		Registry.SoundWaves.Add(this);
+		if (!Registry.TickerHandle.IsValid())
+		{
+			Registry.TickerHandle = FTSTicker::GetCoreTicker().AddTicker(FTickerDelegate::CreateStatic(&UImportedSoundWave::TickAllRenderSupport));
+		}
+	}
+
 	SetImportedSampleRate(0);
 	SetSampleRate(0);
 	NumChannels = 0;
@@ -49,81 +95,225 @@ Audio::EAudioMixerStreamDataFormat::Type UImportedSoundWave::GetGeneratedPCMData
 
 int32 UImportedSoundWave::OnGeneratePCMAudio(TArray<uint8>& OutAudio, int32 NumSamples)
 {
-	TArray<float> PCMData;
+	// This runs on the audio render thread, so it must neither lock nor allocate.
+	// ReleaseMemory and PopulateAudioDataFromDecodedInfo wait for in-flight callbacks before touching the PCM data
+	NumOfRenderCallbacksInFlight.fetch_add(1);
+	ON_SCOPE_EXIT
 	{
-		FRAIScopeLock Lock(&*DataGuard);
+		NumOfRenderCallbacksInFlight.fetch_sub(1);
+	};
 
-		if (!PCMBufferInfo.IsValid())
+	if (!bIsPCMDataRenderable.load() || !PCMBufferInfo.IsValid() || NumChannels <= 0)
+	{
+		NumOfUnderruns.fetch_add(1, std::memory_order_relaxed);
+		return 0;
+	}
+
+	const uint32 NumOfChannels = static_cast<uint32>(NumChannels);
+	const uint32 TotalNumOfFrames = PCMBufferInfo->PCMNumOfFrames;
+	uint32 NumOfPlayedFrames = PlayedNumOfFrames.load(std::memory_order_acquire);
+
+	// Lack of frames means audio playback has finished
+	if (NumOfPlayedFrames >= TotalNumOfFrames)
+	{
+		return 0;
+	}
+
+	// Clamping to the remaining number of frames if the requested number is greater than the available number
+	uint32 NumOfFramesToCopy = FMath::Min(static_cast<uint32>(NumSamples) / NumOfChannels, TotalNumOfFrames - NumOfPlayedFrames);
+	if (NumOfFramesToCopy == 0)
+	{
+		NumOfGlitches.fetch_add(1, std::memory_order_relaxed);
+		return 0;
+	}
+
+	// The mixer reuses OutAudio between callbacks, so this only allocates until its capacity has settled
+	OutAudio.SetNumUninitialized(NumOfFramesToCopy * NumOfChannels * sizeof(float), EAllowShrinking::No);
+	float* OutAudioPtr = reinterpret_cast<float*>(OutAudio.GetData());
+
+	if (LazyPCMSource.IsValid())
+	{
+		// Blocks that were not decoded ahead in time are not waited for, the playhead only advances over the frames that were read
+		const uint32 NumOfReadFrames = static_cast<uint32>(LazyPCMSource->ReadFrames(NumOfPlayedFrames, NumOfFramesToCopy, OutAudioPtr));
+		if (NumOfReadFrames < NumOfFramesToCopy)
 		{
-			return 0;
+			NumOfUnderruns.fetch_add(1, std::memory_order_relaxed);
+			if (NumOfReadFrames == 0)
+			{
+				return 0;
+			}
+			NumOfFramesToCopy = NumOfReadFrames;
+			OutAudio.SetNumUninitialized(NumOfFramesToCopy * NumOfChannels * sizeof(float), EAllowShrinking::No);
 		}
-
-		// Ensure there is enough number of frames. Lack of frames means audio playback has finished
-		if (GetNumOfPlayedFrames_Internal() >= PCMBufferInfo->PCMNumOfFrames)
+	}
+	else
+	{
+		const int64 FirstSampleIndex = static_cast<int64>(NumOfPlayedFrames) * NumOfChannels;
+		const bool bIsInt16 = PCMBufferInfo->IsInt16();
+		const void* RetrievedPCMDataPtr = bIsInt16
+			? static_cast<const void*>(PCMBufferInfo->PCMDataInt16.GetView().GetData() + FirstSampleIndex)
+			: static_cast<const void*>(PCMBufferInfo->PCMData.GetView().GetData() + FirstSampleIndex);
+		if (!RetrievedPCMDataPtr)
 		{
+			NumOfGlitches.fetch_add(1, std::memory_order_relaxed);
 			return 0;
 		}
 
-		// Getting the remaining number of samples if the required number of samples is greater than the total available number
-		if (GetNumOfPlayedFrames_Internal() + (static_cast<uint32>(NumSamples) / static_cast<uint32>(NumChannels)) >= PCMBufferInfo->PCMNumOfFrames)
+		if (bIsInt16)
+		{
+			FRAW_TranscodeKernels::ConvertInt16ToFloat(static_cast<const int16*>(RetrievedPCMDataPtr), OutAudioPtr, NumOfFramesToCopy * NumOfChannels);
+		}
+		else
 		{
-			NumSamples = (PCMBufferInfo->PCMNumOfFrames - GetNumOfPlayedFrames_Internal()) * NumChannels;
+			FMemory::Memcpy(OutAudioPtr, RetrievedPCMDataPtr, NumOfFramesToCopy * NumOfChannels * sizeof(float));
 		}
+	}
+	const int32 NumOfSamplesToCopy = static_cast<int32>(NumOfFramesToCopy * NumOfChannels);
 
-		// Retrieving a part of PCM data
-		float* RetrievedPCMDataPtr = PCMBufferInfo->PCMData.GetView().GetData() + (GetNumOfPlayedFrames_Internal() * NumChannels);
-		const int32 RetrievedPCMDataSize = NumSamples * sizeof(float);
+	// Advancing the playhead, unless it has been rewound in the meantime
+	PlayedNumOfFrames.compare_exchange_strong(NumOfPlayedFrames, NumOfPlayedFrames + NumOfFramesToCopy, std::memory_order_acq_rel);
 
-		// Ensure we got a valid PCM data
-		if (RetrievedPCMDataSize <= 0 || !RetrievedPCMDataPtr)
+	if (bHasPCMDataListeners.load(std::memory_order_acquire))
+	{
+		const int32 NumOfTappedSamples = PCMDataTap->Push(OutAudioPtr, NumOfSamplesToCopy);
+		if (NumOfTappedSamples < NumOfSamplesToCopy)
 		{
-			UE_LOG(AudioLog, Error, TEXT("Unable to get PCM audio from imported sound wave since the retrieved PCM data is invalid"));
-			return 0;
+			NumOfGlitches.fetch_add(1, std::memory_order_relaxed);
 		}
+	}
 
-		// Filling in OutAudio array with the retrieved PCM data
-		OutAudio.Reset();
-		OutAudio.Append(reinterpret_cast<uint8*>(RetrievedPCMDataPtr), RetrievedPCMDataSize);
+	return NumOfSamplesToCopy;
+}
 
-		// Increasing the number of frames played
-		SetNumOfPlayedFrames_Internal(GetNumOfPlayedFrames_Internal() + (NumSamples / NumChannels));
+bool UImportedSoundWave::TickAllRenderSupport(float DeltaTime)
+{
+	FRenderSupportRegistry& Registry = GetRenderSupportRegistry();
+	{
+		FScopeLock Lock(&Registry.Guard);
+		Registry.TickedSoundWaves = Registry.SoundWaves;
+	}
 
-		PCMData = TArray<float>(RetrievedPCMDataPtr, NumSamples);
+	for (int32 Index = 0; Index < Registry.TickedSoundWaves.Num(); ++Index)
+	{
+		if (UImportedSoundWave* SoundWave = Registry.TickedSoundWaves[Index])
+		{
+			SoundWave->TickRenderSupport();
+		}
 	}
 
-	const bool IsBound = [this] ()
+	FScopeLock Lock(&Registry.Guard);
+	Registry.TickedSoundWaves.Reset();
+	return true;
+}
+
+void UImportedSoundWave::TickRenderSupport()
+{
+	DrainPCMDataTap();
+}
+
+void UImportedSoundWave::DrainPCMDataTap()
+{
+	const bool bIsBound = [this] ()
 		{
 			FRAIScopeLock Lock(&OnGeneratePCMData_DataGuard);
 			return OnGeneratePCMDataNative.IsBound() || OnGeneratePCMData.IsBound();
 		}();
-		
-	if (IsBound)
+	if (bIsBound && !PCMDataTap.IsValid())
+	{
+		PCMDataTap = MakeUnique<Audio::TCircularAudioBuffer<float>>();
+		PCMDataTap->SetCapacity(PCM_DATA_TAP_CAPACITY);
+	}
+	// Published after the allocation, which the render thread acquires
+	bHasPCMDataListeners.store(bIsBound, std::memory_order_release);
+
+	const uint32 NumOfTappedSamples = PCMDataTap.IsValid() ? PCMDataTap->Num() : 0;
+	if (NumOfTappedSamples == 0)
+	{
+		return;
+	}
+
+	PCMDataTapDrainBuffer.SetNumUninitialized(NumOfTappedSamples, EAllowShrinking::No);
+	PCMDataTap->Pop(PCMDataTapDrainBuffer.GetData(), NumOfTappedSamples);
+
+	if (bIsBound)
 	{
-		AsyncTask(ENamedThreads::GameThread, [WeakThis = MakeWeakObjectPtr(this), PCMData = MoveTemp(PCMData)] () mutable
+		FRAIScopeLock Lock(&OnGeneratePCMData_DataGuard);
+		if (OnGeneratePCMDataNative.IsBound())
 		{
-			if (WeakThis.IsValid())
-			{
-				FRAIScopeLock Lock(&WeakThis->OnGeneratePCMData_DataGuard);
-				if (WeakThis->OnGeneratePCMDataNative.IsBound())
-				{
-					WeakThis->OnGeneratePCMDataNative.Broadcast(PCMData);
-				}
+			OnGeneratePCMDataNative.Broadcast(PCMDataTapDrainBuffer);
+		}
 
-				if (WeakThis->OnGeneratePCMData.IsBound())
-				{
-					WeakThis->OnGeneratePCMData.Broadcast(PCMData);
-				}
-			}
-		});
+		if (OnGeneratePCMData.IsBound())
+		{
+			OnGeneratePCMData.Broadcast(PCMDataTapDrainBuffer);
+		}
 	}
+}
+
+void UImportedSoundWave::SuspendRendering()
+{
+	bIsPCMDataRenderable.store(false);
+
+	// Render callbacks are short, so spinning here is cheaper than making the render thread take a lock
+	while (NumOfRenderCallbacksInFlight.load() > 0)
+	{
+		FPlatformProcess::Yield();
+	}
+}
 
-	return NumSamples;
+void UImportedSoundWave::ResumeRendering()
+{
+	bIsPCMDataRenderable.store(true);
+}
+
+int64 UImportedSoundWave::GetNumOfUnderruns() const
+{
+	return NumOfUnderruns.load(std::memory_order_relaxed);
+}
+
+int64 UImportedSoundWave::GetNumOfGlitches() const
+{
+	return NumOfGlitches.load(std::memory_order_relaxed);
+}
+
+int64 UImportedSoundWave::GetAllocatedPCMSize() const
+{
+	FScopeLock Lock(&*DataGuard);
+	if (LazyPCMSource.IsValid())
+	{
+		return LazyPCMSource->GetAllocatedSize();
+	}
+	return PCMBufferInfo.IsValid() ? PCMBufferInfo->GetAllocatedSize() : 0;
+}
+
+int64 UImportedSoundWave::GetAllocatedEncodedSize() const
+{
+	FScopeLock Lock(&*DataGuard);
+	return LazyPCMSource.IsValid() ? LazyPCMSource->GetEncodedSize() : 0;
 }
 
 void UImportedSoundWave::BeginDestroy()
 {
 	UE_LOG(AudioLog, Warning, TEXT("Imported sound wave ('%s') data will be cleared because it is being unloaded"), *GetName());
 
+	if (!HasAnyFlags(RF_ClassDefaultObject))
+	{
+		FRenderSupportRegistry& Registry = GetRenderSupportRegistry();
+		FScopeLock Lock(&Registry.Guard);
+		Registry.SoundWaves.RemoveSingleSwap(this);
+		const int32 TickedIndex = Registry.TickedSoundWaves.Find(this);
+		if (TickedIndex != INDEX_NONE)
+		{
+			Registry.TickedSoundWaves[TickedIndex] = nullptr;
+		}
+		if (Registry.SoundWaves.Num() == 0 && Registry.TickerHandle.IsValid())
+		{
+			FTSTicker::GetCoreTicker().RemoveTicker(Registry.TickerHandle);
+			Registry.TickerHandle.Reset();
+		}
+	}
+	SuspendRendering();
+
 	Super::BeginDestroy();
 }
 
@@ -137,15 +327,22 @@ void UImportedSoundWave::Parse(FAudioDevice* AudioDevice, const UPTRINT NodeWave
 		RewindPlaybackTime_Internal(ParseParams.StartTime);
 	}
 
-	// Stopping all other active sounds that are using the same sound wave, so that only one sound wave can be played at a time
-	const TArray<FActiveSound*>& ActiveSounds = AudioDevice->GetActiveSounds();
-	for (FActiveSound* ActiveSoundPtr : ActiveSounds)
+	// Stopping the previous owner if another active sound starts using the same sound wave, so that only one sound wave can be played at a time
+	// The owner is remembered when it changes, which avoids scanning all active sounds of the device on every parse
+	if (!OwningActiveSoundPlayOrder.IsSet() || OwningActiveSoundPlayOrder.GetValue() != ActiveSound.GetPlayOrder())
 	{
-		if (ActiveSoundPtr->GetSound() == this && ActiveSoundPtr->IsPlayingAudio() && &ActiveSound != ActiveSoundPtr)
+		if (OwningActiveSoundPlayOrder.IsSet() && OwningAudioComponentID != 0)
 		{
-			UE_LOG(AudioLog, Warning, TEXT("Stopping the active sound '%s' because it is using the same sound wave '%s' (only one imported sound wave can be played at a time)"), *ActiveSoundPtr->GetOwnerName(), *GetName());
-			AudioDevice->StopActiveSound(ActiveSoundPtr);
+			FActiveSound* PreviousOwner = AudioDevice->FindActiveSound(OwningAudioComponentID);
+			if (PreviousOwner && PreviousOwner != &ActiveSound && PreviousOwner->GetSound() == this && PreviousOwner->IsPlayingAudio())
+			{
+				UE_LOG(AudioLog, Warning, TEXT("Stopping the active sound '%s' because it is using the same sound wave '%s' (only one imported sound wave can be played at a time)"), *PreviousOwner->GetOwnerName(), *GetName());
+				AudioDevice->StopActiveSound(PreviousOwner);
+			}
 		}
+
+		OwningActiveSoundPlayOrder = ActiveSound.GetPlayOrder();
+		OwningAudioComponentID = ActiveSound.GetAudioComponentID();
 	}
 
 	ActiveSound.PlaybackTime = GetPlaybackTime_Internal();
@@ -197,6 +394,11 @@ void UImportedSoundWave::Parse(FAudioDevice* AudioDevice, const UPTRINT NodeWave
 void UImportedSoundWave::PopulateAudioDataFromDecodedInfo(FDecodedAudioStruct&& DecodedAudioInfo)
 {
 	FRAIScopeLock Lock(&*DataGuard);
+	SuspendRendering();
+	ON_SCOPE_EXIT
+	{
+		ResumeRendering();
+	};
 
 	// If the sound wave has not yet been filled in with audio data and the initial desired sample rate and the number of channels are set, resample and mix the channels
 	if (InitialDesiredSampleRate.IsSet() || InitialDesiredNumOfChannels.IsSet())
@@ -214,7 +416,9 @@ void UImportedSoundWave::PopulateAudioDataFromDecodedInfo(FDecodedAudioStruct&&
 	NumChannels = DecodedAudioInfo.SoundWaveBasicInfo.NumOfChannels;
 	ImportedAudioFormat = DecodedAudioInfo.SoundWaveBasicInfo.AudioFormat;
 
+	LazyPCMSource.Reset();
 	PCMBufferInfo->PCMData = MoveTemp(DecodedAudioInfo.PCMInfo.PCMData);
+	PCMBufferInfo->PCMDataInt16 = MoveTemp(DecodedAudioInfo.PCMInfo.PCMDataInt16);
 	PCMBufferInfo->PCMNumOfFrames = DecodedAudioInfo.PCMInfo.PCMNumOfFrames;
 
 	{
@@ -225,7 +429,7 @@ void UImportedSoundWave::PopulateAudioDataFromDecodedInfo(FDecodedAudioStruct&&
 			}();
 			if (IsBound)
 			{
-				TArray<float> PCMData(PCMBufferInfo->PCMData.GetView().GetData(), PCMBufferInfo->PCMData.GetView().Num());
+				TArray<float> PCMData = GetPCMBufferCopy_Internal();
 				AsyncTask(ENamedThreads::GameThread, [WeakThis = MakeWeakObjectPtr(this), PCMData = MoveTemp(PCMData)] () mutable
 				{
 					if (WeakThis.IsValid())
@@ -275,15 +479,155 @@ void UImportedSoundWave::PopulateAudioDataFromDecodedInfo(FDecodedAudioStruct&&
 	UE_LOG(AudioLog, Log, TEXT("The audio data has been populated successfully. Information about audio data:\n%s"), *DecodedAudioInfoString);
 }
 
+void UImportedSoundWave::PopulateAudioDataFromLazySource(TSharedRef<FLazyPCMSource, ESPMode::ThreadSafe> InLazyPCMSource, ERuntimeAudioFormat AudioFormat)
+{
+	const uint32 SourceSampleRate = InLazyPCMSource->GetSampleRate();
+	const uint32 SourceNumOfChannels = InLazyPCMSource->GetNumOfChannels();
+
+	// Conversion needs all PCM data at once, so the lazy path is only taken if the audio can be played as it is
+	const bool bNeedsConversion = (InitialDesiredSampleRate.IsSet() && InitialDesiredSampleRate.GetValue() != SourceSampleRate)
+		|| (InitialDesiredNumOfChannels.IsSet() && InitialDesiredNumOfChannels.GetValue() != SourceNumOfChannels);
+	const bool bHasPopulateDataListeners = [this] ()
+		{
+			FRAIScopeLock Lock(&OnPopulateAudioData_DataGuard);
+			return OnPopulateAudioDataNative.IsBound() || OnPopulateAudioData.IsBound();
+		}();
+	if (bNeedsConversion)
+	{
+		TArray<float> PCMData;
+		if (!InLazyPCMSource->DecodeAll(PCMData))
+		{
+			UE_LOG(AudioLog, Error, TEXT("Unable to populate the sound wave '%s' because the audio data could not be decoded"), *GetName());
+			return;
+		}
+
+		FDecodedAudioStruct DecodedAudioInfo;
+		DecodedAudioInfo.PCMInfo.PCMData = FRuntimeBulkDataBuffer<float>(PCMData);
+		DecodedAudioInfo.PCMInfo.PCMNumOfFrames = static_cast<uint32>(InLazyPCMSource->GetNumOfFrames());
+		DecodedAudioInfo.SoundWaveBasicInfo.NumOfChannels = SourceNumOfChannels;
+		DecodedAudioInfo.SoundWaveBasicInfo.SampleRate = SourceSampleRate;
+		DecodedAudioInfo.SoundWaveBasicInfo.Duration = static_cast<float>(InLazyPCMSource->GetNumOfFrames()) / SourceSampleRate;
+		DecodedAudioInfo.SoundWaveBasicInfo.AudioFormat = AudioFormat;
+		PopulateAudioDataFromDecodedInfo(MoveTemp(DecodedAudioInfo));
+		return;
+	}
+
+	{
+		FRAIScopeLock Lock(&*DataGuard);
+		SuspendRendering();
+		ON_SCOPE_EXIT
+		{
+			ResumeRendering();
+		};
+
+		Duration = static_cast<float>(InLazyPCMSource->GetNumOfFrames()) / SourceSampleRate;
+		SetImportedSampleRate(0);
+		SetSampleRate(SourceSampleRate);
+		NumChannels = SourceNumOfChannels;
+		ImportedAudioFormat = AudioFormat;
+
+		PCMBufferInfo->Empty();
+		PCMBufferInfo->PCMNumOfFrames = static_cast<uint32>(InLazyPCMSource->GetNumOfFrames());
+		LazyPCMSource = InLazyPCMSource;
+
+		// Decoding follows the playhead from its own thread, a game-thread hitch must not starve the render thread
+		LazyPCMSource->StartDecodingAhead();
+	}
+
+	// Listeners asking for all populated data defeat the purpose of lazy decoding, but they still get what they asked for
+	if (bHasPopulateDataListeners)
+	{
+		TArray<float> PCMData;
+		if (InLazyPCMSource->DecodeAll(PCMData))
+		{
+			AsyncTask(ENamedThreads::GameThread, [WeakThis = MakeWeakObjectPtr(this), PCMData = MoveTemp(PCMData)] () mutable
+			{
+				if (WeakThis.IsValid())
+				{
+					FRAIScopeLock Lock(&WeakThis->OnPopulateAudioData_DataGuard);
+					WeakThis->OnPopulateAudioDataNative.Broadcast(PCMData);
+					WeakThis->OnPopulateAudioData.Broadcast(PCMData);
+				}
+			});
+		}
+	}
+
+	AsyncTask(ENamedThreads::GameThread, [WeakThis = MakeWeakObjectPtr(this)] ()
+	{
+		if (WeakThis.IsValid())
+		{
+			FRAIScopeLock Lock(&WeakThis->OnPopulateAudioData_DataGuard);
+			WeakThis->OnPopulateAudioStateNative.Broadcast();
+			WeakThis->OnPopulateAudioState.Broadcast();
+		}
+	});
+
+	UE_LOG(AudioLog, Log, TEXT("The audio data has been populated for lazy decoding (%lld frames, %u Hz, %u channels, format '%s')"),
+		InLazyPCMSource->GetNumOfFrames(), SourceSampleRate, SourceNumOfChannels, *UEnum::GetValueAsString(AudioFormat));
+}
+
 void UImportedSoundWave::ReleaseMemory()
 {
 	FRAIScopeLock Lock(&*DataGuard);
 	UE_LOG(AudioLog, Warning, TEXT("Releasing memory for the sound wave '%s'"), *GetName());
-	PCMBufferInfo->PCMData.Empty();
-	PCMBufferInfo->PCMNumOfFrames = 0;
+	SuspendRendering();
+	LazyPCMSource.Reset();
+	PCMBufferInfo->Empty();
 	Duration = 0;
 }
 
+void UImportedSoundWave::ResetForReuse()
+{
+	{
+		FRAIScopeLock Lock(&*DataGuard);
+		SuspendRendering();
+		LazyPCMSource.Reset();
+		PCMBufferInfo->Empty();
+		// Rendering is suspended, so the tap can be freed. The next user allocates it again if it binds a listener
+		bHasPCMDataListeners.store(false, std::memory_order_relaxed);
+		PCMDataTap.Reset();
+		PCMDataTapDrainBuffer.Empty();
+
+		PlayedNumOfFrames.store(0);
+		PlaybackFinishedBroadcast = false;
+		NumOfUnderruns.store(0, std::memory_order_relaxed);
+		NumOfGlitches.store(0, std::memory_order_relaxed);
+		OwningActiveSoundPlayOrder.Reset();
+		OwningAudioComponentID = 0;
+		bStopSoundOnPlaybackFinish = true;
+		ImportedAudioFormat = ERuntimeAudioFormat::Invalid;
+		InitialDesiredSampleRate.Reset();
+		InitialDesiredNumOfChannels.Reset();
+
+		SetImportedSampleRate(0);
+		SetSampleRate(0);
+		NumChannels = 0;
+		Duration = 0;
+		bLooping = false;
+		Volume = 1;
+		Pitch = 1;
+		Subtitles.Empty();
+	}
+
+	{
+		FRAIScopeLock Lock(&OnGeneratePCMData_DataGuard);
+		OnGeneratePCMDataNative.Clear();
+		OnGeneratePCMData.Clear();
+	}
+
+	{
+		FRAIScopeLock Lock(&OnPopulateAudioData_DataGuard);
+		OnPopulateAudioDataNative.Clear();
+		OnPopulateAudioData.Clear();
+		OnPopulateAudioStateNative.Clear();
+		OnPopulateAudioState.Clear();
+	}
+	OnAudioPlaybackFinishedNative.Clear();
+	OnAudioPlaybackFinished.Clear();
+
+	UE_LOG(AudioLog, Log, TEXT("The sound wave '%s' has been reset for reuse"), *GetName());
+}
+
 void UImportedSoundWave::SetLooping(bool bLoop)
 {
 	bLooping = bLoop;
@@ -334,7 +678,7 @@ bool UImportedSoundWave::RewindPlaybackTime_Internal(float PlaybackTime)
 
 bool UImportedSoundWave::SetInitialDesiredSampleRate(int32 DesiredSampleRate)
 {
-	if (PCMBufferInfo->PCMData.GetView().Num() > 0)
+	if (PCMBufferInfo->GetNumOfSamples() > 0)
 	{
 		UE_LOG(AudioLog, Error, TEXT("Unable to set the initial desired sample rate for the imported sound wave '%s' to '%d' because the PCM data has already been populated"), *GetName(), DesiredSampleRate);
 		return false;
@@ -354,7 +698,7 @@ bool UImportedSoundWave::SetInitialDesiredSampleRate(int32 DesiredSampleRate)
 
 bool UImportedSoundWave::SetInitialDesiredNumOfChannels(int32 DesiredNumOfChannels)
 {
-	if (PCMBufferInfo->PCMData.GetView().Num() > 0)
+	if (PCMBufferInfo->GetNumOfSamples() > 0)
 	{
 		UE_LOG(AudioLog, Error, TEXT("Unable to set the initial desired number of channels for the imported sound wave '%s' to '%d' because the PCM data has already been populated"), *GetName(), DesiredNumOfChannels);
 		return false;
@@ -449,7 +793,11 @@ bool UImportedSoundWave::SetNumOfPlayedFrames_Internal(uint32 NumOfFrames)
 		return false;
 	}
 
-	PlayedNumOfFrames = NumOfFrames;
+	PlayedNumOfFrames.store(NumOfFrames, std::memory_order_release);
+	if (LazyPCMSource.IsValid())
+	{
+		LazyPCMSource->SeekTo(NumOfFrames);
+	}
 
 	ResetPlaybackFinish();
 
@@ -458,13 +806,13 @@ bool UImportedSoundWave::SetNumOfPlayedFrames_Internal(uint32 NumOfFrames)
 
 uint32 UImportedSoundWave::GetNumOfPlayedFrames() const
 {
-	FRAIScopeLock Lock(&*DataGuard);
+	// The playhead is atomic, so no lock is needed to read it
 	return GetNumOfPlayedFrames_Internal();
 }
 
 uint32 UImportedSoundWave::GetNumOfPlayedFrames_Internal() const
 {
-	return PlayedNumOfFrames;
+	return PlayedNumOfFrames.load(std::memory_order_acquire);
 }
 
 float UImportedSoundWave::GetPlaybackTime() const
@@ -475,12 +823,13 @@ float UImportedSoundWave::GetPlaybackTime() const
 
 float UImportedSoundWave::GetPlaybackTime_Internal() const
 {
-	if (GetNumOfPlayedFrames() == 0 || SampleRate <= 0)
+	const uint32 NumOfPlayedFrames = GetNumOfPlayedFrames_Internal();
+	if (NumOfPlayedFrames == 0 || SampleRate <= 0)
 	{
 		return 0;
 	}
 
-	return static_cast<float>(GetNumOfPlayedFrames()) / SampleRate;
+	return static_cast<float>(NumOfPlayedFrames) / SampleRate;
 }
 
 float UImportedSoundWave::GetDurationConst() const
@@ -614,7 +963,9 @@ bool UImportedSoundWave::GetAudioHeaderInfo(FRuntimeAudioHeaderInfo& HeaderInfo)
 		HeaderInfo.AudioFormat = GetAudioFormat();
 		HeaderInfo.SampleRate = GetSampleRate();
 		HeaderInfo.NumOfChannels = GetNumOfChannels();
-		HeaderInfo.PCMDataSize = PCMBufferInfo->PCMData.GetView().Num();
+		HeaderInfo.PCMDataSize = LazyPCMSource.IsValid()
+			? static_cast<int64>(PCMBufferInfo->PCMNumOfFrames) * GetNumOfChannels()
+			: PCMBufferInfo->GetNumOfSamples();
 	}
 
 	return true;
@@ -628,7 +979,28 @@ void UImportedSoundWave::ResetPlaybackFinish()
 TArray<float> UImportedSoundWave::GetPCMBufferCopy()
 {
 	FRAIScopeLock Lock(&*DataGuard);
-	return TArray<float>(PCMBufferInfo.Get()->PCMData.GetView().GetData(), PCMBufferInfo.Get()->PCMData.GetView().Num());
+	return GetPCMBufferCopy_Internal();
+}
+
+TArray<float> UImportedSoundWave::GetPCMBufferCopy_Internal() const
+{
+	if (LazyPCMSource.IsValid())
+	{
+		TArray<float> PCMData;
+		LazyPCMSource->DecodeAll(PCMData);
+		return PCMData;
+	}
+
+	if (PCMBufferInfo->IsInt16())
+	{
+		const FRuntimeBulkDataBuffer<int16>::ViewType& Int16View = PCMBufferInfo->PCMDataInt16.GetView();
+		TArray<float> PCMData;
+		PCMData.SetNumUninitialized(Int16View.Num());
+		FRAW_TranscodeKernels::ConvertInt16ToFloat(Int16View.GetData(), PCMData.GetData(), Int16View.Num());
+		return PCMData;
+	}
+
+	return TArray<float>(PCMBufferInfo->PCMData.GetView().GetData(), PCMBufferInfo->PCMData.GetView().Num());
 }
 
 const FPCMStruct& UImportedSoundWave::GetPCMBuffer() const
@@ -0,0 +1,288 @@
+// Georgy Treshchev 2024.
+
+#include "LazyPCMSource.h"
+#include "BaseRuntimeCodec.h"
+#include "Async/Async.h"
+#include "AudioStructs.h"
+#include "HAL/Event.h"
+#include "HAL/Runnable.h"
+#include "HAL/RunnableThread.h"
+#include "Misc/CoreDelegates.h"
+#include "Misc/ScopeLock.h"
+
+namespace
+{
+	/** How often the decoding thread checks the read-ahead windows, a small fraction of the ~85 ms a 48kHz block lasts */
+	constexpr uint32 DECODE_AHEAD_INTERVAL_MS = 10;
+
+	/**
+	 * Process-wide thread that keeps the read-ahead windows of all playing lazy sources decoded.
+	 * The render thread only moves the windows, as it must not schedule tasks, and the game thread can hitch for longer
+	 * than a window lasts. The thread sleeps while there are no sources and stops before the engine exits.
+	 */
+	class FLazyPCMDecodeThread : public FRunnable
+	{
+	public:
+		static FLazyPCMDecodeThread& Get()
+		{
+			static FLazyPCMDecodeThread Instance;
+			return Instance;
+		}
+
+		void Register(TWeakPtr<FLazyPCMSource, ESPMode::ThreadSafe>&& Source)
+		{
+			FScopeLock Lock(&Guard);
+			if (bIsShutDown)
+			{
+				return;
+			}
+
+			Sources.Add(MoveTemp(Source));
+			if (!Thread)
+			{
+				WakeUpEvent = FPlatformProcess::GetSynchEventFromPool(false);
+				Thread = FRunnableThread::Create(this, TEXT("VoxtaLazyPCMDecodeThread"), 0, EThreadPriority::TPri_AboveNormal);
+				if (!Thread)
+				{
+					UE_LOG(AudioLog, Error, TEXT("Failed to start the lazy PCM decoding thread, lazily decoded audio will underrun"));
+					FPlatformProcess::ReturnSynchEventToPool(WakeUpEvent);
+					WakeUpEvent = nullptr;
+					bIsShutDown = true;
+					return;
+				}
+				PreExitHandle = FCoreDelegates::OnPreExit.AddRaw(this, &FLazyPCMDecodeThread::Shutdown);
+			}
+			WakeUpEvent->Trigger();
+		}
+
+		virtual uint32 Run() override
+		{
+			TArray<TSharedPtr<FLazyPCMSource, ESPMode::ThreadSafe>> ActiveSources;
+			while (!bIsStopped.load())
+			{
+				{
+					FScopeLock Lock(&Guard);
+					Sources.RemoveAllSwap([&ActiveSources] (const TWeakPtr<FLazyPCMSource, ESPMode::ThreadSafe>& WeakSource)
+						{
+							TSharedPtr<FLazyPCMSource, ESPMode::ThreadSafe> Source = WeakSource.Pin();
+							if (!Source.IsValid())
+							{
+								return true;
+							}
+							ActiveSources.Add(MoveTemp(Source));
+							return false;
+						});
+				}
+
+				for (const TSharedPtr<FLazyPCMSource, ESPMode::ThreadSafe>& Source : ActiveSources)
+				{
+					Source->DecodeAhead();
+				}
+
+				const bool bHasSources = ActiveSources.Num() > 0;
+				ActiveSources.Reset();
+				WakeUpEvent->Wait(bHasSources ? DECODE_AHEAD_INTERVAL_MS : MAX_uint32);
+			}
+			return 0;
+		}
+
+		virtual void Stop() override
+		{
+			bIsStopped.store(true);
+			WakeUpEvent->Trigger();
+		}
+
+	private:
+		/** Stop the thread before the engine (and the codecs it uses) shut down. */
+		void Shutdown()
+		{
+			FRunnableThread* StoppedThread = nullptr;
+			{
+				FScopeLock Lock(&Guard);
+				bIsShutDown = true;
+				FCoreDelegates::OnPreExit.Remove(PreExitHandle);
+				StoppedThread = Thread;
+				Thread = nullptr;
+				Sources.Empty();
+			}
+
+			if (StoppedThread)
+			{
+				StoppedThread->Kill(true);
+				delete StoppedThread;
+				FPlatformProcess::ReturnSynchEventToPool(WakeUpEvent);
+				WakeUpEvent = nullptr;
+			}
+		}
+
+		FCriticalSection Guard;
+		TArray<TWeakPtr<FLazyPCMSource, ESPMode::ThreadSafe>> Sources;
+		FRunnableThread* Thread = nullptr;
+		/** Auto-reset, signalled when a source is registered or the thread is stopped */
+		FEvent* WakeUpEvent = nullptr;
+		std::atomic<bool> bIsStopped{false};
+		bool bIsShutDown = false;
+		FDelegateHandle PreExitHandle;
+	};
+}
+
+FLazyPCMSource::FLazyPCMSource(TUniquePtr<FBaseRuntimeBlockDecoder>&& InDecoder)
+	: Decoder(MoveTemp(InDecoder))
+	, NumOfFrames(Decoder->GetNumOfFrames())
+	, NumOfBlocks((Decoder->GetNumOfFrames() + BlockFrames - 1) / BlockFrames)
+	, EncodedSize(Decoder->GetEncodedSize())
+	, SampleRate(Decoder->GetSampleRate())
+	, NumOfChannels(Decoder->GetNumOfChannels())
+{}
+
+FLazyPCMSource::~FLazyPCMSource() = default;
+
+int32 FLazyPCMSource::ReadFrames(int64 FirstFrame, int32 NumOfRequestedFrames, float* OutPCMData)
+{
+	int32 NumOfReadFrames = 0;
+	while (NumOfReadFrames < NumOfRequestedFrames && FirstFrame + NumOfReadFrames < NumOfFrames)
+	{
+		const int64 Frame = FirstFrame + NumOfReadFrames;
+		const int64 BlockIndex = Frame / BlockFrames;
+		const int32 FrameOffsetInBlock = static_cast<int32>(Frame - BlockIndex * BlockFrames);
+		const int32 NumOfBlockFrames = static_cast<int32>(FMath::Min<int64>(FMath::Min(BlockFrames - FrameOffsetInBlock, NumOfRequestedFrames - NumOfReadFrames), NumOfFrames - Frame));
+
+		// The slot can be overwritten by the decoding thread while copying, the index is checked again afterwards to detect that (seqlock)
+		const FBlockSlot& Slot = GetSlot(BlockIndex);
+		if (Slot.BlockIndex.load(std::memory_order_acquire) != BlockIndex)
+		{
+			break;
+		}
+		FMemory::Memcpy(OutPCMData + static_cast<int64>(NumOfReadFrames) * NumOfChannels,
+			Slot.Samples.GetData() + static_cast<int64>(FrameOffsetInBlock) * NumOfChannels,
+			static_cast<int64>(NumOfBlockFrames) * NumOfChannels * sizeof(float));
+		std::atomic_thread_fence(std::memory_order_acquire);
+		if (Slot.BlockIndex.load(std::memory_order_relaxed) != BlockIndex)
+		{
+			break;
+		}
+
+		NumOfReadFrames += NumOfBlockFrames;
+	}
+
+	RequestedBlockIndex.store((FirstFrame + NumOfReadFrames) / BlockFrames, std::memory_order_relaxed);
+	return NumOfReadFrames;
+}
+
+void FLazyPCMSource::SeekTo(int64 FirstFrame)
+{
+	RequestedBlockIndex.store(FMath::Clamp<int64>(FirstFrame, 0, NumOfFrames) / BlockFrames, std::memory_order_relaxed);
+	ScheduleDecodeAhead();
+}
+
+bool FLazyPCMSource::NeedsDecode() const
+{
+	if (bFailed.load(std::memory_order_relaxed))
+	{
+		return false;
+	}
+
+	const int64 FirstBlockIndex = RequestedBlockIndex.load(std::memory_order_relaxed);
+	const int64 EndBlockIndex = FMath::Min<int64>(FirstBlockIndex + NumOfCacheSlots - 1, NumOfBlocks);
+	for (int64 BlockIndex = FirstBlockIndex; BlockIndex < EndBlockIndex; ++BlockIndex)
+	{
+		if (GetSlot(BlockIndex).BlockIndex.load(std::memory_order_relaxed) != BlockIndex)
+		{
+			return true;
+		}
+	}
+	return false;
+}
+
+void FLazyPCMSource::ScheduleDecodeAhead()
+{
+	if (!NeedsDecode() || bDecodeInFlight.exchange(true))
+	{
+		return;
+	}
+
+	AsyncTask(ENamedThreads::AnyBackgroundHiPriTask, [WeakThis = AsWeak()] ()
+	{
+		if (TSharedPtr<FLazyPCMSource, ESPMode::ThreadSafe> This = WeakThis.Pin())
+		{
+			{
+				FScopeLock Lock(&This->DecoderGuard);
+				This->DecodeAhead_Internal();
+			}
+			This->bDecodeInFlight.store(false);
+		}
+	});
+}
+
+void FLazyPCMSource::DecodeAhead()
+{
+	if (!NeedsDecode() || bDecodeInFlight.exchange(true))
+	{
+		return;
+	}
+
+	{
+		FScopeLock Lock(&DecoderGuard);
+		DecodeAhead_Internal();
+	}
+	bDecodeInFlight.store(false);
+}
+
+void FLazyPCMSource::StartDecodingAhead()
+{
+	FLazyPCMDecodeThread::Get().Register(AsWeak());
+}
+
+bool FLazyPCMSource::Prime()
+{
+	FScopeLock Lock(&DecoderGuard);
+	return DecodeAhead_Internal();
+}
+
+bool FLazyPCMSource::DecodeAhead_Internal()
+{
+	const int64 FirstBlockIndex = RequestedBlockIndex.load(std::memory_order_relaxed);
+	const int64 EndBlockIndex = FMath::Min<int64>(FirstBlockIndex + NumOfCacheSlots - 1, NumOfBlocks);
+	for (int64 BlockIndex = FirstBlockIndex; BlockIndex < EndBlockIndex; ++BlockIndex)
+	{
+		FBlockSlot& Slot = GetSlot(BlockIndex);
+		if (Slot.BlockIndex.load(std::memory_order_relaxed) == BlockIndex)
+		{
+			continue;
+		}
+
+		// Invalidating the slot before writing to it, so a concurrent ReadFrames notices the change
+		Slot.BlockIndex.store(INDEX_NONE, std::memory_order_relaxed);
+		std::atomic_thread_fence(std::memory_order_release);
+
+		Slot.Samples.SetNumUninitialized(BlockFrames * NumOfChannels, EAllowShrinking::No);
+		const int32 NumOfBlockFrames = static_cast<int32>(FMath::Min<int64>(BlockFrames, NumOfFrames - BlockIndex * BlockFrames));
+		if (!Decoder->DecodeFrames(BlockIndex * BlockFrames, NumOfBlockFrames, Slot.Samples.GetData()))
+		{
+			UE_LOG(AudioLog, Error, TEXT("Failed to decode block %lld of the lazily decoded audio data"), BlockIndex);
+			bFailed.store(true);
+			return false;
+		}
+
+		Slot.BlockIndex.store(BlockIndex, std::memory_order_release);
+	}
+	return true;
+}
+
+bool FLazyPCMSource::DecodeAll(TArray<float>& OutPCMData)
+{
+	FScopeLock Lock(&DecoderGuard);
+
+	OutPCMData.SetNumUninitialized(NumOfFrames * NumOfChannels);
+	for (int64 FirstFrame = 0; FirstFrame < NumOfFrames; FirstFrame += BlockFrames)
+	{
+		const int32 NumOfBlockFrames = static_cast<int32>(FMath::Min<int64>(BlockFrames, NumOfFrames - FirstFrame));
+		if (!Decoder->DecodeFrames(FirstFrame, NumOfBlockFrames, OutPCMData.GetData() + FirstFrame * NumOfChannels))
+		{
+			UE_LOG(AudioLog, Error, TEXT("Failed to decode the lazily decoded audio data at frame %lld"), FirstFrame);
+			OutPCMData.Reset();
+			return false;
+		}
+	}
+	return true;
+}
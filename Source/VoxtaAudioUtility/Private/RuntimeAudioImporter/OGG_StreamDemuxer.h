@@ -0,0 +1,186 @@
+// Georgy Treshchev 2024.
+
+#pragma once
+
+#include "CoreMinimal.h"
+
+THIRD_PARTY_INCLUDES_START
+#include "ogg/ogg.h"
+THIRD_PARTY_INCLUDES_END
+
+/**
+ * Incremental Ogg demuxer shared by the Ogg based codecs (Opus, Vorbis).
+ * Encoded bytes can be appended in arbitrary parts, complete packets are handed out as soon as their page arrived.
+ * Only the first logical bitstream is demuxed, voice audio is never chained or multiplexed.
+ */
+class FOGG_StreamDemuxer
+{
+public:
+	FOGG_StreamDemuxer()
+	{
+		ogg_sync_init(&SyncState);
+	}
+
+	~FOGG_StreamDemuxer()
+	{
+		if (bStreamInitialized)
+		{
+			ogg_stream_clear(&StreamState);
+		}
+		ogg_sync_clear(&SyncState);
+	}
+
+	FOGG_StreamDemuxer(const FOGG_StreamDemuxer&) = delete;
+	FOGG_StreamDemuxer& operator=(const FOGG_StreamDemuxer&) = delete;
+
+	/**
+	 * Append the next part of the encoded stream.
+	 *
+	 * @param Data Pointer to the encoded bytes.
+	 * @param Size Number of encoded bytes.
+	 *
+	 * @return False if libogg failed to allocate its buffer.
+	 */
+	bool Append(const uint8* Data, int64 Size)
+	{
+		// libogg takes the size as a long, larger inputs are fed in parts
+		constexpr int64 MaxPartSize = 1 << 20;
+		while (Size > 0)
+		{
+			const long PartSize = static_cast<long>(FMath::Min(Size, MaxPartSize));
+			char* Buffer = ogg_sync_buffer(&SyncState, PartSize);
+			if (!Buffer)
+			{
+				return false;
+			}
+			FMemory::Memcpy(Buffer, Data, PartSize);
+			if (ogg_sync_wrote(&SyncState, PartSize) != 0)
+			{
+				return false;
+			}
+			Data += PartSize;
+			Size -= PartSize;
+		}
+		return true;
+	}
+
+	/**
+	 * Get the next complete packet.
+	 *
+	 * @param OutPacket The packet, its data is only valid until the next call.
+	 *
+	 * @return True if a packet was available, false if more data needs to be appended first.
+	 */
+	bool NextPacket(ogg_packet& OutPacket)
+	{
+		while (true)
+		{
+			if (bStreamInitialized)
+			{
+				const int32 PacketResult = ogg_stream_packetout(&StreamState, &OutPacket);
+				if (PacketResult > 0)
+				{
+					return true;
+				}
+				if (PacketResult < 0)
+				{
+					// Gap in the data, the damaged packet is skipped
+					continue;
+				}
+			}
+
+			ogg_page Page;
+			const int32 PageResult = ogg_sync_pageout(&SyncState, &Page);
+			if (PageResult == 0)
+			{
+				return false;
+			}
+			if (PageResult < 0)
+			{
+				// Skipped garbage while resynchronizing
+				continue;
+			}
+
+			if (!bStreamInitialized)
+			{
+				ogg_stream_init(&StreamState, ogg_page_serialno(&Page));
+				bStreamInitialized = true;
+			}
+			if (ogg_page_serialno(&Page) == StreamState.serialno)
+			{
+				ogg_stream_pagein(&StreamState, &Page);
+			}
+		}
+	}
+
+	/**
+	 * Locate the payload of the first page, which holds the identification header of the codec.
+	 *
+	 * @param Data Pointer to the start of the encoded data.
+	 * @param Size Size of the encoded data.
+	 *
+	 * @return Offset of the first packet, or INDEX_NONE if the data is not an Ogg stream.
+	 */
+	static int64 GetFirstPacketOffset(const uint8* Data, int64 Size)
+	{
+		// The first page has a 27 byte header, followed by the segment table and then the payload
+		constexpr int64 PageHeaderSize = 27;
+		if (Data == nullptr || Size < PageHeaderSize || FMemory::Memcmp(Data, "OggS", 4) != 0)
+		{
+			return INDEX_NONE;
+		}
+		return PageHeaderSize + Data[26];
+	}
+
+	/**
+	 * Check whether the buffer is an Ogg stream whose first packet starts with the given identification bytes.
+	 *
+	 * @param Data Pointer to the start of the encoded data.
+	 * @param Size Size of the encoded data.
+	 * @param Magic The identification bytes of the codec (e.g. "OpusHead").
+	 * @param MagicLength Number of identification bytes.
+	 *
+	 * @return True if the first packet matches.
+	 */
+	static bool IsFirstPacket(const uint8* Data, int64 Size, const char* Magic, int32 MagicLength)
+	{
+		const int64 PayloadOffset = GetFirstPacketOffset(Data, Size);
+		return PayloadOffset != INDEX_NONE && Size >= PayloadOffset + MagicLength && FMemory::Memcmp(Data + PayloadOffset, Magic, MagicLength) == 0;
+	}
+
+	/**
+	 * Find the granule position of the last page, which tells the length of the stream without decoding it.
+	 *
+	 * @param Data Pointer to the start of the encoded data.
+	 * @param Size Size of the encoded data.
+	 *
+	 * @return The granule position, or INDEX_NONE if no complete page header was found.
+	 */
+	static int64 FindLastGranulePosition(const uint8* Data, int64 Size)
+	{
+		// Pages are at most ~64kB, so the last capture pattern is found well within that distance of the end
+		constexpr int64 PageHeaderSize = 27;
+		const int64 SearchStart = FMath::Max<int64>(0, Size - 65536 - PageHeaderSize);
+		for (int64 Offset = Size - PageHeaderSize; Offset >= SearchStart; --Offset)
+		{
+			if (FMemory::Memcmp(Data + Offset, "OggS", 4) == 0)
+			{
+				int64 GranulePosition = 0;
+				for (int32 ByteIndex = 7; ByteIndex >= 0; --ByteIndex)
+				{
+					GranulePosition = (GranulePosition << 8) | Data[Offset + 6 + ByteIndex];
+				}
+				if (GranulePosition >= 0)
+				{
+					return GranulePosition;
+				}
+			}
+		}
+		return INDEX_NONE;
+	}
+
+private:
+	ogg_sync_state SyncState;
+	ogg_stream_state StreamState;
+	bool bStreamInitialized = false;
+};
@@ -0,0 +1,263 @@
+// Georgy Treshchev 2024.
+
+#include "OPUS_RuntimeCodec.h"
+#include "AudioStructs.h"
+#include "OGG_StreamDemuxer.h"
+
+THIRD_PARTY_INCLUDES_START
+#include "opus.h"
+THIRD_PARTY_INCLUDES_END
+
+namespace
+{
+	/** Opus timestamps (pre-skip, granule positions) are always expressed at 48 kHz */
+	constexpr uint32 OpusTimestampRate = 48000;
+
+	/** The longest Opus packet holds 120 ms of audio */
+	constexpr uint32 MaxPacketDurationMs = 120;
+
+	/** OpusHead: magic (8), version (1), channels (1), pre-skip (2), input rate (4), output gain (2), mapping family (1) */
+	constexpr int32 OpusHeadSize = 19;
+
+	uint32 ChooseDecodeSampleRate(uint32 PreferredSampleRate)
+	{
+		for (const uint32 SupportedSampleRate : {8000u, 12000u, 16000u, 24000u, 48000u})
+		{
+			if (PreferredSampleRate == SupportedSampleRate)
+			{
+				return PreferredSampleRate;
+			}
+		}
+		return OpusTimestampRate;
+	}
+
+	class FOPUS_StreamingDecoder : public FBaseRuntimeStreamingDecoder
+	{
+	public:
+		explicit FOPUS_StreamingDecoder(uint32 InPreferredSampleRate)
+			: PreferredSampleRate(InPreferredSampleRate)
+		{}
+
+		virtual ~FOPUS_StreamingDecoder() override
+		{
+			if (Decoder)
+			{
+				opus_decoder_destroy(Decoder);
+			}
+		}
+
+		//~ Begin FBaseRuntimeStreamingDecoder Interface
+		virtual bool AppendEncodedData(const uint8* Data, int64 Size) override
+		{
+			if (bFailed || !Demuxer.Append(Data, Size))
+			{
+				bFailed = true;
+				return false;
+			}
+
+			ogg_packet Packet;
+			while (!bFinished && Demuxer.NextPacket(Packet))
+			{
+				if (!HandlePacket(Packet))
+				{
+					bFailed = true;
+					return false;
+				}
+			}
+			return true;
+		}
+
+		virtual int64 ConsumeDecodedData(TArray64<float>& OutPCMData) override
+		{
+			const int64 NumOfFrames = NumOfChannels > 0 ? PendingPCMData.Num() / NumOfChannels : 0;
+			OutPCMData.Append(PendingPCMData);
+			PendingPCMData.Reset();
+			return NumOfFrames;
+		}
+
+		virtual bool IsHeaderParsed() const override { return Decoder != nullptr; }
+		virtual bool IsFinished() const override { return bFinished; }
+		virtual uint32 GetSampleRate() const override { return SampleRate; }
+		virtual uint32 GetNumOfChannels() const override { return NumOfChannels; }
+		//~ End FBaseRuntimeStreamingDecoder Interface
+
+	private:
+		bool HandlePacket(const ogg_packet& Packet)
+		{
+			if (!Decoder)
+			{
+				return ParseIdentificationHeader(Packet);
+			}
+
+			if (!bCommentHeaderSkipped)
+			{
+				// OpusTags, the metadata is not used
+				bCommentHeaderSkipped = true;
+				return true;
+			}
+
+			const int32 MaxFramesPerPacket = SampleRate * MaxPacketDurationMs / 1000;
+			PacketPCMData.SetNumUninitialized(MaxFramesPerPacket * NumOfChannels, EAllowShrinking::No);
+
+			const int32 NumOfFrames = opus_decode_float(Decoder, Packet.packet, Packet.bytes, PacketPCMData.GetData(), MaxFramesPerPacket, 0);
+			if (NumOfFrames < 0)
+			{
+				UE_LOG(AudioLog, Warning, TEXT("Skipping corrupt Opus packet: %hs"), opus_strerror(NumOfFrames));
+				return true;
+			}
+
+			// The first decoded frames are encoder priming and have to be discarded
+			const int32 NumOfSkippedFrames = FMath::Min(PreSkipRemaining, NumOfFrames);
+			PreSkipRemaining -= NumOfSkippedFrames;
+			const int32 NumOfKeptFrames = NumOfFrames - NumOfSkippedFrames;
+			PendingPCMData.Append(PacketPCMData.GetData() + NumOfSkippedFrames * NumOfChannels, NumOfKeptFrames * NumOfChannels);
+			NumOfDecodedFrames += NumOfKeptFrames;
+
+			if (Packet.e_o_s)
+			{
+				bFinished = true;
+				TrimEndPadding(Packet.granulepos);
+			}
+			return true;
+		}
+
+		bool ParseIdentificationHeader(const ogg_packet& Packet)
+		{
+			const uint8* Header = Packet.packet;
+			if (Packet.bytes < OpusHeadSize || FMemory::Memcmp(Header, "OpusHead", 8) != 0)
+			{
+				UE_LOG(AudioLog, Error, TEXT("Failed to parse the Opus identification header"));
+				return false;
+			}
+
+			// Only the major version (upper 4 bits) breaks compatibility
+			const uint8 Version = Header[8];
+			const uint8 ChannelMappingFamily = Header[18];
+			NumOfChannels = Header[9];
+			if ((Version >> 4) != 0 || ChannelMappingFamily != 0 || NumOfChannels < 1 || NumOfChannels > 2)
+			{
+				UE_LOG(AudioLog, Error, TEXT("Unsupported Opus stream (version %d, mapping family %d, %d channels)"), Version, ChannelMappingFamily, NumOfChannels);
+				return false;
+			}
+
+			PreSkip = Header[10] | (Header[11] << 8);
+			const int16 OutputGain = static_cast<int16>(Header[16] | (Header[17] << 8));
+
+			SampleRate = ChooseDecodeSampleRate(PreferredSampleRate);
+			PreSkipRemaining = static_cast<int32>(static_cast<int64>(PreSkip) * SampleRate / OpusTimestampRate);
+
+			int32 Error = OPUS_OK;
+			Decoder = opus_decoder_create(SampleRate, NumOfChannels, &Error);
+			if (Error != OPUS_OK || !Decoder)
+			{
+				UE_LOG(AudioLog, Error, TEXT("Unable to initialize Opus Decoder: %hs"), opus_strerror(Error));
+				Decoder = nullptr;
+				return false;
+			}
+
+			if (OutputGain != 0)
+			{
+				opus_decoder_ctl(Decoder, OPUS_SET_GAIN(OutputGain));
+			}
+			return true;
+		}
+
+		/** The last packet is padded to a full frame, the granule position of the last page tells the real length */
+		void TrimEndPadding(int64 FinalGranulePosition)
+		{
+			if (FinalGranulePosition < PreSkip)
+			{
+				return;
+			}
+
+			const int64 ExpectedNumOfFrames = (FinalGranulePosition - PreSkip) * SampleRate / OpusTimestampRate;
+			const int64 NumOfExcessFrames = FMath::Min(NumOfDecodedFrames - ExpectedNumOfFrames, PendingPCMData.Num() / NumOfChannels);
+			if (NumOfExcessFrames > 0)
+			{
+				PendingPCMData.SetNum(PendingPCMData.Num() - NumOfExcessFrames * NumOfChannels, EAllowShrinking::No);
+				NumOfDecodedFrames -= NumOfExcessFrames;
+			}
+		}
+
+		FOGG_StreamDemuxer Demuxer;
+		OpusDecoder* Decoder = nullptr;
+
+		uint32 PreferredSampleRate = 0;
+		uint32 SampleRate = 0;
+		uint32 NumOfChannels = 0;
+
+		/** Pre-skip in 48 kHz samples, as stored in the header */
+		int64 PreSkip = 0;
+
+		/** Frames at the decode rate that still have to be discarded */
+		int32 PreSkipRemaining = 0;
+
+		int64 NumOfDecodedFrames = 0;
+		bool bCommentHeaderSkipped = false;
+		bool bFinished = false;
+		bool bFailed = false;
+
+		TArray<float> PacketPCMData;
+		TArray64<float> PendingPCMData;
+	};
+}
+
+bool FOPUS_RuntimeCodec::CheckAndFixAudioFormat(FRuntimeBulkDataBuffer<uint8>& AudioData)
+{
+	return FOGG_StreamDemuxer::IsFirstPacket(AudioData.GetView().GetData(), AudioData.GetView().Num(), "OpusHead", 8);
+}
+
+bool FOPUS_RuntimeCodec::Decode(FEncodedAudioStruct EncodedData, FDecodedAudioStruct& DecodedData)
+{
+	UE_LOG(AudioLog, Log, TEXT("Decoding Opus audio data to uncompressed audio format.\nEncoded audio info: %s"), *EncodedData.ToString());
+
+	ensureAlwaysMsgf(EncodedData.AudioFormat == GetAudioFormat(), TEXT("Attempting to decode audio data using the '%s' codec, but the data format is encoded in '%s'"),
+					 *UEnum::GetValueAsString(GetAudioFormat()), *UEnum::GetValueAsString(EncodedData.AudioFormat));
+
+	if (!DecodeWithStreamingDecoder(EncodedData, DecodedData))
+	{
+		UE_LOG(AudioLog, Error, TEXT("Failed to decode Opus audio data"));
+		return false;
+	}
+
+	UE_LOG(AudioLog, Log, TEXT("Successfully decoded Opus audio data to uncompressed audio format.\nDecoded audio info: %s"), *DecodedData.ToString());
+	return true;
+}
+
+TUniquePtr<FBaseRuntimeStreamingDecoder> FOPUS_RuntimeCodec::CreateStreamingDecoder(uint32 PreferredSampleRate) const
+{
+	return MakeUnique<FOPUS_StreamingDecoder>(PreferredSampleRate);
+}
+
+TUniquePtr<FBaseRuntimeBlockDecoder> FOPUS_RuntimeCodec::CreateBlockDecoder(const FSharedAudioBytes& AudioData, uint32 PreferredSampleRate) const
+{
+	if (!AudioData.IsValid())
+	{
+		return nullptr;
+	}
+
+	// The length is known up front from the granule position of the last page, so nothing has to be decoded here
+	const uint8* Data = AudioData->GetData();
+	const int64 Size = AudioData->Num();
+	const int64 HeaderOffset = FOGG_StreamDemuxer::GetFirstPacketOffset(Data, Size);
+	if (HeaderOffset == INDEX_NONE || Size < HeaderOffset + OpusHeadSize || FMemory::Memcmp(Data + HeaderOffset, "OpusHead", 8) != 0)
+	{
+		return nullptr;
+	}
+
+	const uint8* Header = Data + HeaderOffset;
+	const uint32 NumOfChannels = Header[9];
+	const int64 PreSkip = Header[10] | (Header[11] << 8);
+	const int64 FinalGranulePosition = FOGG_StreamDemuxer::FindLastGranulePosition(Data, Size);
+	if (NumOfChannels < 1 || NumOfChannels > 2 || Header[18] != 0 || FinalGranulePosition <= PreSkip)
+	{
+		return nullptr;
+	}
+
+	const uint32 SampleRate = ChooseDecodeSampleRate(PreferredSampleRate);
+	const int64 NumOfFrames = (FinalGranulePosition - PreSkip) * SampleRate / OpusTimestampRate;
+	return MakeUnique<FStreamedBlockDecoder>(AudioData, [PreferredSampleRate]() -> TUniquePtr<FBaseRuntimeStreamingDecoder>
+	{
+		return MakeUnique<FOPUS_StreamingDecoder>(PreferredSampleRate);
+	}, NumOfFrames, SampleRate, NumOfChannels);
+}
@@ -0,0 +1,24 @@
+// Georgy Treshchev 2024.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "BaseRuntimeCodec.h"
+
+/**
+ * Ogg Opus format codec implementation for runtime audio importing.
+ * Opus can decode to any of its supported rates directly, so it decodes to the preferred (mixer) rate where possible
+ * to avoid resampling afterwards. Only mono & stereo streams (channel mapping family 0) are supported.
+ */
+class FOPUS_RuntimeCodec : public FBaseRuntimeCodec
+{
+public:
+	//~ Begin FBaseRuntimeCodec Interface
+	virtual bool CheckAndFixAudioFormat(FRuntimeBulkDataBuffer<uint8>& AudioData) override;
+	virtual bool Decode(FEncodedAudioStruct EncodedData, FDecodedAudioStruct& DecodedData) override;
+	virtual ERuntimeAudioFormat GetAudioFormat() const override { return ERuntimeAudioFormat::OggOpus; }
+	virtual TArray<FString> GetContentTypes() const override { return { TEXT("audio/ogg; codecs=opus"), TEXT("audio/opus") }; }
+	virtual TUniquePtr<FBaseRuntimeStreamingDecoder> CreateStreamingDecoder(uint32 PreferredSampleRate) const override;
+	virtual TUniquePtr<FBaseRuntimeBlockDecoder> CreateBlockDecoder(const FSharedAudioBytes& AudioData, uint32 PreferredSampleRate) const override;
+	//~ End FBaseRuntimeCodec Interface
+};
@@ -7,9 +7,8 @@
 #include "HAL/UnrealMemory.h"
 #include "AudioStructs.h"
 #include "SampleBuffer.h"
-#include "AudioResampler.h"
-#include <type_traits>
-#include <limits>
+#include "RAW_TranscodeKernels.h"
+#include "RAW_StreamingResampler.h"
 
 /**
  * RAW format codec implementation for runtime audio importing.
@@ -29,50 +28,7 @@ public:
 	template <typename IntegralType>
 	static TTuple<long long, long long> GetRawMinAndMaxValues()
 	{
-		// Signed 8-bit integer
-		if (std::is_same<IntegralType, int8>::value)
-		{
-			return TTuple<long long, long long>((std::numeric_limits<int8>::min)(), (std::numeric_limits<int8>::max)());
-		}
-
-		// Unsigned 8-bit integer
-		if (std::is_same<IntegralType, uint8>::value)
-		{
-			return TTuple<long long, long long>((std::numeric_limits<uint8>::min)(), (std::numeric_limits<uint8>::max)());
-		}
-
-		// Signed 16-bit integer
-		if (std::is_same<IntegralType, int16>::value)
-		{
-			return TTuple<long long, long long>((std::numeric_limits<int16>::min)(), (std::numeric_limits<int16>::max)());
-		}
-
-		// Unsigned 16-bit integer
-		if (std::is_same<IntegralType, uint16>::value)
-		{
-			return TTuple<long long, long long>((std::numeric_limits<uint16>::min)(), (std::numeric_limits<uint16>::max)());
-		}
-
-		// Signed 32-bit integer
-		if (std::is_same<IntegralType, int32>::value)
-		{
-			return TTuple<long long, long long>((std::numeric_limits<int32>::min)(), (std::numeric_limits<int32>::max)());
-		}
-
-		// Unsigned 32-bit integer
-		if (std::is_same<IntegralType, uint32>::value)
-		{
-			return TTuple<long long, long long>((std::numeric_limits<uint32>::min)(), (std::numeric_limits<uint32>::max)());
-		}
-
-		// Floating point 32-bit
-		if (std::is_same<IntegralType, float>::value)
-		{
-			return TTuple<long long, long long>(-1, 1);
-		}
-
-		ensureMsgf(false, TEXT("Unsupported RAW format"));
-		return TTuple<long long, long long>(0, 0);
+		return TTuple<long long, long long>(static_cast<long long>(TRAWSampleRange<IntegralType>::Min), static_cast<long long>(TRAWSampleRange<IntegralType>::Max));
 	}
 
 	/**
@@ -109,17 +65,12 @@ public:
 		/** Creating an empty PCM buffer */
 		RAWDataTo = static_cast<IntegralTypeTo*>(FMemory::Malloc(NumOfSamples * sizeof(IntegralTypeTo)));
 
-		const TTuple<long long, long long> MinAndMaxValuesFrom{ GetRawMinAndMaxValues<IntegralTypeFrom>() };
-		const TTuple<long long, long long> MinAndMaxValuesTo{ GetRawMinAndMaxValues<IntegralTypeTo>() };
-
-		/** Iterating through the RAW Data to transcode values using a divisor */
-		for (int64 SampleIndex = 0; SampleIndex < NumOfSamples; ++SampleIndex)
-		{
-			RAWDataTo[SampleIndex] = static_cast<IntegralTypeTo>(FMath::GetMappedRangeValueClamped(FVector2D(MinAndMaxValuesFrom.Key, MinAndMaxValuesFrom.Value), FVector2D(MinAndMaxValuesTo.Key, MinAndMaxValuesTo.Value), RAWDataFrom[SampleIndex]));
-		}
+		/** Transcoding with the kernel specialized for this pair of formats */
+		TRAWTranscoder<IntegralTypeFrom, IntegralTypeTo>::Transcode(RAWDataFrom, NumOfSamples, RAWDataTo);
 
-		UE_LOG(AudioLog, Log, TEXT("Transcoding RAW data of size '%llu' (min: %lld, max: %lld) to size '%llu' (min: %lld, max: %lld)"),
-			   static_cast<uint64>(sizeof(IntegralTypeFrom)), MinAndMaxValuesFrom.Key, MinAndMaxValuesFrom.Value, static_cast<uint64>(sizeof(IntegralTypeTo)), MinAndMaxValuesTo.Key, MinAndMaxValuesTo.Value);
+		UE_LOG(AudioLog, Log, TEXT("Transcoding RAW data of size '%llu' (min: %f, max: %f) to size '%llu' (min: %f, max: %f)"),
+			   static_cast<uint64>(sizeof(IntegralTypeFrom)), TRAWSampleRange<IntegralTypeFrom>::Min, TRAWSampleRange<IntegralTypeFrom>::Max,
+			   static_cast<uint64>(sizeof(IntegralTypeTo)), TRAWSampleRange<IntegralTypeTo>::Min, TRAWSampleRange<IntegralTypeTo>::Max);
 	}
 
 	/**
@@ -130,10 +81,12 @@ public:
 	 * @param SourceSampleRate The original sample rate of the audio data.
 	 * @param DestinationSampleRate The desired sample rate after resampling.
 	 * @param ResampledRAWData Output buffer to receive the resampled audio data.
+	 * @param Quality Quality tier of the resampler.
 	 *
 	 * @return True if resampling was successful, false otherwise.
 	 */
-	static bool ResampleRAWData(Audio::FAlignedFloatBuffer& RAWData, uint32 NumOfChannels, uint32 SourceSampleRate, uint32 DestinationSampleRate, Audio::FAlignedFloatBuffer& ResampledRAWData)
+	static bool ResampleRAWData(Audio::FAlignedFloatBuffer& RAWData, uint32 NumOfChannels, uint32 SourceSampleRate, uint32 DestinationSampleRate, Audio::FAlignedFloatBuffer& ResampledRAWData,
+		ERAW_ResamplerQuality Quality = ERAW_ResamplerQuality::Best)
 	{
 		if (NumOfChannels <= 0)
 		{
@@ -158,25 +111,20 @@ public:
 			return true;
 		}
 
-		const Audio::FResamplingParameters ResampleParameters = {
-			Audio::EResamplingMethod::BestSinc,
-			static_cast<int32>(NumOfChannels),
-			static_cast<float>(SourceSampleRate),
-			static_cast<float>(DestinationSampleRate),
-			RAWData
-		};
-
-		ResampledRAWData.Reset();
-		ResampledRAWData.AddUninitialized(Audio::GetOutputBufferSize(ResampleParameters));
-		Audio::FResamplerResults ResampleResults;
-		ResampleResults.OutBuffer = &ResampledRAWData;
-
-		if (!Audio::Resample(ResampleParameters, ResampleResults))
+		FRAW_StreamingResampler Resampler(Quality, NumOfChannels, SourceSampleRate, DestinationSampleRate);
+		if (!Resampler.IsValid())
 		{
 			UE_LOG(AudioLog, Error, TEXT("Unable to resample audio data from %d to %d"), SourceSampleRate, DestinationSampleRate);
 			return false;
 		}
 
+		const int64 NumOfInputFrames = RAWData.Num() / NumOfChannels;
+		ResampledRAWData.Reset();
+		ResampledRAWData.AddUninitialized((Resampler.GetMaxNumOfOutputFrames(NumOfInputFrames) + Resampler.GetMaxNumOfFlushFrames()) * NumOfChannels);
+
+		int64 NumOfOutputFrames = Resampler.Process(RAWData.GetData(), NumOfInputFrames, ResampledRAWData.GetData());
+		NumOfOutputFrames += Resampler.Flush(ResampledRAWData.GetData() + NumOfOutputFrames * NumOfChannels);
+		ResampledRAWData.SetNum(NumOfOutputFrames * NumOfChannels, EAllowShrinking::No);
 		return true;
 	}
 
@@ -4,6 +4,33 @@
 #include "RuntimeCodecFactory.h"
 #include "ImportedSoundWave.h"
 #include "RAW_RuntimeCodec.h"
+#include "RAW_TranscodeKernels.h"
+#include "RAW_StreamingResampler.h"
+#include "LazyPCMSource.h"
+#include "HAL/IConsoleManager.h"
+#include "VoxtaObjectPool.h"
+#include "Audio.h"
+#include "AudioDevice.h"
+#include "Engine/Engine.h"
+
+namespace
+{
+	TAutoConsoleVariable<int32> CVarResamplerQuality(
+		TEXT("voxta.Audio.ResamplerQuality"),
+		1,
+		TEXT("Quality tier used when decoded audio has to be resampled. 0: Fast (8 taps), 1: Balanced (16 taps), 2: Best (32 taps)."));
+
+	TAutoConsoleVariable<bool> CVarLazyDecode(
+		TEXT("voxta.Audio.LazyDecode"),
+		false,
+		TEXT("Keep imported voicelines encoded and decode them block by block while they play, instead of decoding them fully on import. Only applies when no decoded copy is requested, so voicelines ignore it while voxta.Audio.VoiceLineCache.Enabled is on."));
+
+	/** Number of frames that are widened from int16 per resampler call, keeps the temporary float block small */
+	constexpr int64 ResampleBlockFrames = 4096;
+
+	/** Last mixer rate seen on the game thread, so background decodes don't need to touch the audio device */
+	std::atomic<uint32> MixerSampleRate{0};
+}
 
 void URuntimeAudioImporterLibrary::ImportAudioFromBuffer(TArray64<uint8> AudioData, TFunction<void(UImportedSoundWave*)> callback)
 {
@@ -28,8 +55,103 @@ void URuntimeAudioImporterLibrary::ImportAudioFromBuffer(TArray64<uint8> AudioDa
 	ImportAudioFromDecodedInfo(MoveTemp(DecodedAudioInfo), callback);
 }
 
+void URuntimeAudioImporterLibrary::ImportAudioFromBuffer(FSharedAudioBytes audioData, ERuntimeAudioFormat audioFormat,
+	TFunction<void(UImportedSoundWave*)> callback, TFunction<void(const FDecodedAudioStruct&)> onDecoded)
+{
+	if (!audioData.IsValid())
+	{
+		UE_LOG(AudioLog, Error, TEXT("Unable to import audio data because the shared buffer is null"));
+		return;
+	}
+
+	if (IsInGameThread())
+	{
+		// Refreshes the mixer rate while we're on the game thread, the decode itself happens in the background
+		GetMixerSampleRate();
+		AsyncTask(ENamedThreads::AnyBackgroundHiPriTask, [AudioData = MoveTemp(audioData), audioFormat, Callback = callback, OnDecoded = onDecoded] () mutable
+		{
+			ImportAudioFromBuffer(MoveTemp(AudioData), audioFormat, Callback, OnDecoded);
+		});
+		return;
+	}
+
+	FEncodedAudioStruct EncodedAudioInfo(audioData, audioFormat);
+
+	// Nobody needs the decoded audio up front, so only the parts that are being played have to be decoded
+	if (!onDecoded && IsLazyDecodeEnabled())
+	{
+		if (TSharedPtr<FLazyPCMSource, ESPMode::ThreadSafe> LazyPCMSource = CreateLazyPCMSource(EncodedAudioInfo))
+		{
+			ImportAudioFromLazySource(LazyPCMSource.ToSharedRef(), EncodedAudioInfo.AudioFormat, callback);
+			return;
+		}
+		UE_LOG(AudioLog, Log, TEXT("The audio data can't be decoded lazily, decoding it up front instead"));
+	}
+
+	FDecodedAudioStruct DecodedAudioInfo;
+	if (!DecodeAudioData(MoveTemp(EncodedAudioInfo), DecodedAudioInfo))
+	{
+		UE_LOG(AudioLog, Error, TEXT("Failed to decode audiodata: FailedToReadAudioDataArray"));
+		return;
+	}
+
+	if (onDecoded)
+	{
+		onDecoded(DecodedAudioInfo);
+	}
+
+	ImportAudioFromDecodedInfo(MoveTemp(DecodedAudioInfo), callback);
+}
+
+TSharedPtr<FLazyPCMSource, ESPMode::ThreadSafe> URuntimeAudioImporterLibrary::CreateLazyPCMSource(FEncodedAudioStruct& EncodedAudioInfo)
+{
+	FRuntimeCodecFactory CodecFactory;
+	TArray<FBaseRuntimeCodec*> RuntimeCodecs = EncodedAudioInfo.AudioFormat == ERuntimeAudioFormat::Auto
+		? CodecFactory.GetCodecs(EncodedAudioInfo.AudioData)
+		: CodecFactory.GetCodecs(EncodedAudioInfo.AudioFormat);
+
+	for (FBaseRuntimeCodec* RuntimeCodec : RuntimeCodecs)
+	{
+		TUniquePtr<FBaseRuntimeBlockDecoder> BlockDecoder = RuntimeCodec->CreateBlockDecoder(EncodedAudioInfo.SharedAudioData, GetMixerSampleRate());
+		if (!BlockDecoder.IsValid() || BlockDecoder->GetNumOfFrames() <= 0 || BlockDecoder->GetNumOfFrames() > MAX_uint32)
+		{
+			continue;
+		}
+
+		// The first blocks are decoded right away, so playback can start without waiting for the decoding thread
+		TSharedRef<FLazyPCMSource, ESPMode::ThreadSafe> LazyPCMSource = MakeShared<FLazyPCMSource, ESPMode::ThreadSafe>(MoveTemp(BlockDecoder));
+		if (!LazyPCMSource->Prime())
+		{
+			continue;
+		}
+
+		EncodedAudioInfo.AudioFormat = RuntimeCodec->GetAudioFormat();
+		return LazyPCMSource;
+	}
+	return nullptr;
+}
+
+void URuntimeAudioImporterLibrary::ImportAudioFromLazySource(TSharedRef<FLazyPCMSource, ESPMode::ThreadSafe> LazyPCMSource, ERuntimeAudioFormat AudioFormat,
+	TFunction<void(UImportedSoundWave*)> callback)
+{
+	AsyncTask(ENamedThreads::GameThread, [LazyPCMSource, AudioFormat, Callback = MoveTemp(callback)] ()
+	{
+		// Pooled sound waves are already rooted
+		UImportedSoundWave* ImportedSoundWave = VoxtaObjectPool::Get().Acquire<UImportedSoundWave>();
+		ImportedSoundWave->PopulateAudioDataFromLazySource(LazyPCMSource, AudioFormat);
+
+		UE_LOG(AudioLog, Log, TEXT("The audio data was successfully imported for lazy decoding"));
+		Callback(ImportedSoundWave);
+	});
+}
+
 bool URuntimeAudioImporterLibrary::DecodeAudioData(FEncodedAudioStruct&& EncodedAudioInfo, FDecodedAudioStruct& DecodedAudioInfo)
 {
+	if (EncodedAudioInfo.PreferredSampleRate == 0)
+	{
+		EncodedAudioInfo.PreferredSampleRate = GetMixerSampleRate();
+	}
+
 	FRuntimeCodecFactory CodecFactory;
 	TArray<FBaseRuntimeCodec*> RuntimeCodecs = [&EncodedAudioInfo, &CodecFactory] ()
 		{
@@ -67,14 +189,8 @@ void URuntimeAudioImporterLibrary::ImportAudioFromDecodedInfo(FDecodedAudioStruc
 		return;
 	}
 
-	UImportedSoundWave* ImportedSoundWave = NewObject<UImportedSoundWave>();
-	if (!ImportedSoundWave)
-	{
-		UE_LOG(AudioLog, Error, TEXT("Something went wrong while creating the imported sound wave"));
-		return;
-	}
-
-	ImportedSoundWave->AddToRoot();
+	// Pooled sound waves are already rooted
+	UImportedSoundWave* ImportedSoundWave = VoxtaObjectPool::Get().Acquire<UImportedSoundWave>();
 	ImportedSoundWave->PopulateAudioDataFromDecodedInfo(MoveTemp(DecodedAudioInfo));
 
 	UE_LOG(AudioLog, Log, TEXT("The audio data was successfully imported"));
@@ -101,24 +217,73 @@ bool URuntimeAudioImporterLibrary::ResampleAndMixChannelsInDecodedInfo(FDecodedA
 		return true;
 	}
 
-	Audio::FAlignedFloatBuffer WaveData(DecodedAudioInfo.PCMInfo.PCMData.GetView().GetData(), DecodedAudioInfo.PCMInfo.PCMData.GetView().Num());
-
-	// Resampling if needed
+	// Resampling if needed, streamed block by block straight from the stored samples into the final buffer
 	if (NewSampleRate != DecodedAudioInfo.SoundWaveBasicInfo.SampleRate)
 	{
-		Audio::FAlignedFloatBuffer ResamplerOutputData;
-		if (!FRAW_RuntimeCodec::ResampleRAWData(WaveData, DecodedAudioInfo.SoundWaveBasicInfo.NumOfChannels, DecodedAudioInfo.SoundWaveBasicInfo.SampleRate, NewSampleRate, ResamplerOutputData))
+		const uint32 NumOfChannels = DecodedAudioInfo.SoundWaveBasicInfo.NumOfChannels;
+		const ERAW_ResamplerQuality Quality = static_cast<ERAW_ResamplerQuality>(FMath::Clamp(CVarResamplerQuality.GetValueOnAnyThread(), 0, 2));
+		FRAW_StreamingResampler Resampler(Quality, NumOfChannels, DecodedAudioInfo.SoundWaveBasicInfo.SampleRate, NewSampleRate);
+		if (!Resampler.IsValid())
 		{
 			UE_LOG(AudioLog, Error, TEXT("Unable to resample audio data to the sound wave's sample rate. Resampling failed"));
 			return false;
 		}
-		WaveData = MoveTemp(ResamplerOutputData);
+
+		const int64 NumOfInputFrames = DecodedAudioInfo.PCMInfo.PCMNumOfFrames;
+		const int64 OutputCapacity = (Resampler.GetMaxNumOfOutputFrames(NumOfInputFrames) + Resampler.GetMaxNumOfFlushFrames()) * NumOfChannels;
+		float* ResampledData = static_cast<float*>(FMemory::Malloc(OutputCapacity * sizeof(float)));
+		if (!ResampledData)
+		{
+			UE_LOG(AudioLog, Error, TEXT("Failed to allocate memory for resampling"));
+			return false;
+		}
+
+		int64 NumOfOutputFrames = 0;
+		if (DecodedAudioInfo.PCMInfo.IsInt16())
+		{
+			// Compact int16 data is widened one block at a time instead of converting the whole clip up front
+			const int16* Int16Data = DecodedAudioInfo.PCMInfo.PCMDataInt16.GetView().GetData();
+			TArray<float> FloatBlock;
+			FloatBlock.SetNumUninitialized(ResampleBlockFrames * NumOfChannels);
+			for (int64 FrameOffset = 0; FrameOffset < NumOfInputFrames; FrameOffset += ResampleBlockFrames)
+			{
+				const int64 NumOfBlockFrames = FMath::Min(ResampleBlockFrames, NumOfInputFrames - FrameOffset);
+				FRAW_TranscodeKernels::ConvertInt16ToFloat(Int16Data + FrameOffset * NumOfChannels, FloatBlock.GetData(), NumOfBlockFrames * NumOfChannels);
+				NumOfOutputFrames += Resampler.Process(FloatBlock.GetData(), NumOfBlockFrames, ResampledData + NumOfOutputFrames * NumOfChannels);
+			}
+		}
+		else
+		{
+			NumOfOutputFrames += Resampler.Process(DecodedAudioInfo.PCMInfo.PCMData.GetView().GetData(), NumOfInputFrames, ResampledData);
+		}
+		NumOfOutputFrames += Resampler.Flush(ResampledData + NumOfOutputFrames * NumOfChannels);
+
+		DecodedAudioInfo.PCMInfo.PCMData = FRuntimeBulkDataBuffer<float>(ResampledData, NumOfOutputFrames * NumOfChannels);
+		DecodedAudioInfo.PCMInfo.PCMDataInt16.Empty();
+		DecodedAudioInfo.PCMInfo.PCMNumOfFrames = static_cast<uint32>(NumOfOutputFrames);
 		DecodedAudioInfo.SoundWaveBasicInfo.SampleRate = NewSampleRate;
 		UE_LOG(AudioLog, Log, TEXT("Audio data has been resampled to the desired sample rate '%d'"), NewSampleRate);
 	}
 
-	// Mixing the channels if needed
-	if (NewNumOfChannels != DecodedAudioInfo.SoundWaveBasicInfo.NumOfChannels)
+	if (NewNumOfChannels == DecodedAudioInfo.SoundWaveBasicInfo.NumOfChannels)
+	{
+		return true;
+	}
+
+	Audio::FAlignedFloatBuffer WaveData;
+	if (DecodedAudioInfo.PCMInfo.IsInt16())
+	{
+		// Mixing operates on floats, so compact int16 data is widened first
+		const FRuntimeBulkDataBuffer<int16>::ViewType& Int16View = DecodedAudioInfo.PCMInfo.PCMDataInt16.GetView();
+		WaveData.SetNumUninitialized(Int16View.Num());
+		FRAW_TranscodeKernels::ConvertInt16ToFloat(Int16View.GetData(), WaveData.GetData(), Int16View.Num());
+	}
+	else
+	{
+		WaveData = Audio::FAlignedFloatBuffer(DecodedAudioInfo.PCMInfo.PCMData.GetView().GetData(), DecodedAudioInfo.PCMInfo.PCMData.GetView().Num());
+	}
+
+	// Mixing the channels
 	{
 		Audio::FAlignedFloatBuffer WaveDataTemp;
 		if (!FRAW_RuntimeCodec::MixChannelsRAWData(WaveData, NewSampleRate, DecodedAudioInfo.SoundWaveBasicInfo.NumOfChannels, NewNumOfChannels, WaveDataTemp))
@@ -132,5 +297,106 @@ bool URuntimeAudioImporterLibrary::ResampleAndMixChannelsInDecodedInfo(FDecodedA
 	}
 
 	DecodedAudioInfo.PCMInfo.PCMData = FRuntimeBulkDataBuffer<float>(WaveData);
+	DecodedAudioInfo.PCMInfo.PCMDataInt16.Empty();
+	DecodedAudioInfo.PCMInfo.PCMNumOfFrames = WaveData.Num() / DecodedAudioInfo.SoundWaveBasicInfo.NumOfChannels;
 	return true;
-}
\ No newline at end of file
+}
+
+TArray<FString> URuntimeAudioImporterLibrary::GetSupportedContentTypes()
+{
+	FRuntimeCodecFactory CodecFactory;
+	TArray<FString> ContentTypes;
+	for (const FBaseRuntimeCodec* RuntimeCodec : CodecFactory.GetCodecs())
+	{
+		for (const FString& ContentType : RuntimeCodec->GetContentTypes())
+		{
+			ContentTypes.AddUnique(ContentType);
+		}
+	}
+	return ContentTypes;
+}
+
+ERuntimeAudioFormat URuntimeAudioImporterLibrary::GetAudioFormatFromContentType(const FString& contentType)
+{
+	// e.g. 'audio/ogg; codecs="opus"', the media type and its parameters are compared without whitespace, quotes or casing
+	const FString Normalized = contentType.Replace(TEXT(" "), TEXT("")).Replace(TEXT("\""), TEXT("")).ToLower();
+	FString MediaType;
+	FString Parameters;
+	if (!Normalized.Split(TEXT(";"), &MediaType, &Parameters))
+	{
+		MediaType = Normalized;
+	}
+
+	if (MediaType == TEXT("audio/opus") || (MediaType == TEXT("audio/ogg") && Parameters.Contains(TEXT("codecs=opus"))))
+	{
+		return ERuntimeAudioFormat::OggOpus;
+	}
+	if (MediaType == TEXT("audio/vorbis") || (MediaType == TEXT("audio/ogg") && Parameters.Contains(TEXT("codecs=vorbis"))))
+	{
+		return ERuntimeAudioFormat::OggVorbis;
+	}
+	if (MediaType == TEXT("audio/wav") || MediaType == TEXT("audio/x-wav") || MediaType == TEXT("audio/wave"))
+	{
+		return ERuntimeAudioFormat::Wav;
+	}
+	return ERuntimeAudioFormat::Auto;
+}
+
+bool URuntimeAudioImporterLibrary::EncodeWavPCM16(const FDecodedAudioStruct& DecodedAudioInfo, TArray<uint8>& OutWavData)
+{
+	const FPCMStruct& PCMInfo = DecodedAudioInfo.PCMInfo;
+	if (!PCMInfo.IsValid())
+	{
+		UE_LOG(AudioLog, Error, TEXT("Unable to encode WAV data because the decoded audio data is invalid"));
+		return false;
+	}
+
+	TArray<int16> Int16Data;
+	if (PCMInfo.IsInt16())
+	{
+		Int16Data.Append(PCMInfo.PCMDataInt16.GetView().GetData(), PCMInfo.PCMDataInt16.GetView().Num());
+	}
+	else
+	{
+		Int16Data.SetNumUninitialized(PCMInfo.PCMData.GetView().Num());
+		TRAWTranscoder<float, int16>::Transcode(PCMInfo.PCMData.GetView().GetData(), Int16Data.Num(), Int16Data.GetData());
+	}
+
+	OutWavData.Reset();
+	SerializeWaveFile(OutWavData, reinterpret_cast<const uint8*>(Int16Data.GetData()), Int16Data.Num() * sizeof(int16),
+		DecodedAudioInfo.SoundWaveBasicInfo.NumOfChannels, DecodedAudioInfo.SoundWaveBasicInfo.SampleRate);
+	return OutWavData.Num() > 0;
+}
+
+bool URuntimeAudioImporterLibrary::IsLazyDecodeEnabled()
+{
+	return CVarLazyDecode.GetValueOnAnyThread();
+}
+
+void URuntimeAudioImporterLibrary::RecycleImportedSoundWave(UImportedSoundWave* ImportedSoundWave)
+{
+	if (!ImportedSoundWave)
+	{
+		return;
+	}
+
+	ImportedSoundWave->ResetForReuse();
+	VoxtaObjectPool::Get().Release(ImportedSoundWave);
+}
+
+void URuntimeAudioImporterLibrary::PrewarmImportedSoundWaves(int32 NumOfSoundWaves)
+{
+	VoxtaObjectPool::Get().Prewarm(UImportedSoundWave::StaticClass(), NumOfSoundWaves);
+}
+
+uint32 URuntimeAudioImporterLibrary::GetMixerSampleRate()
+{
+	if (IsInGameThread() && GEngine)
+	{
+		if (const FAudioDevice* AudioDevice = GEngine->GetMainAudioDeviceRaw())
+		{
+			MixerSampleRate = static_cast<uint32>(AudioDevice->GetSampleRate());
+		}
+	}
+	return MixerSampleRate;
+}
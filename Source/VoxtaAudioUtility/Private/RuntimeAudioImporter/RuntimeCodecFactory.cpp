@@ -2,6 +2,8 @@
 
 #include "RuntimeCodecFactory.h"
 #include "BaseRuntimeCodec.h"
+#include "OPUS_RuntimeCodec.h"
+#include "VORBIS_RuntimeCodec.h"
 #include "WAV_RuntimeCodec.h"
 #include "Misc/Paths.h"
 #include "AudioStructs.h"
@@ -18,6 +20,9 @@ TArray<FBaseRuntimeCodec*> FRuntimeCodecFactory::GetCodecs()
 		FScopeLock Lock(&CachedCodecsLock);
 		if (Cached.Num() == 0)
 		{
+			// Registered in order of preference, this is also the order in which content types are advertised
+			Cached.Emplace(MakeUnique<FOPUS_RuntimeCodec>());
+			Cached.Emplace(MakeUnique<FVORBIS_RuntimeCodec>());
 			Cached.Emplace(MakeUnique<FWAV_RuntimeCodec>());
 		}
 
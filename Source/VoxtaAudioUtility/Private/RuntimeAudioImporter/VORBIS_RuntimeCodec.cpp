@@ -0,0 +1,222 @@
+// Georgy Treshchev 2024.
+
+#include "VORBIS_RuntimeCodec.h"
+#include "AudioStructs.h"
+#include "OGG_StreamDemuxer.h"
+
+THIRD_PARTY_INCLUDES_START
+#include "vorbis/codec.h"
+THIRD_PARTY_INCLUDES_END
+
+namespace
+{
+	/** Vorbis streams start with the identification, comment and setup headers */
+	constexpr int32 NumOfVorbisHeaders = 3;
+
+	/** Identification header: packet type & magic (7), version (4), channels (1), sample rate (4), bitrates & block sizes (13) */
+	constexpr int32 VorbisIdentificationHeaderSize = 30;
+
+	class FVORBIS_StreamingDecoder : public FBaseRuntimeStreamingDecoder
+	{
+	public:
+		FVORBIS_StreamingDecoder()
+		{
+			vorbis_info_init(&Info);
+			vorbis_comment_init(&Comment);
+		}
+
+		virtual ~FVORBIS_StreamingDecoder() override
+		{
+			if (bSynthesisInitialized)
+			{
+				vorbis_block_clear(&Block);
+				vorbis_dsp_clear(&DspState);
+			}
+			vorbis_comment_clear(&Comment);
+			vorbis_info_clear(&Info);
+		}
+
+		//~ Begin FBaseRuntimeStreamingDecoder Interface
+		virtual bool AppendEncodedData(const uint8* Data, int64 Size) override
+		{
+			if (bFailed || !Demuxer.Append(Data, Size))
+			{
+				bFailed = true;
+				return false;
+			}
+
+			ogg_packet Packet;
+			while (!bFinished && Demuxer.NextPacket(Packet))
+			{
+				if (!HandlePacket(Packet))
+				{
+					bFailed = true;
+					return false;
+				}
+			}
+			return true;
+		}
+
+		virtual int64 ConsumeDecodedData(TArray64<float>& OutPCMData) override
+		{
+			const int64 NumOfFrames = Info.channels > 0 ? PendingPCMData.Num() / Info.channels : 0;
+			OutPCMData.Append(PendingPCMData);
+			PendingPCMData.Reset();
+			return NumOfFrames;
+		}
+
+		virtual bool IsHeaderParsed() const override { return bSynthesisInitialized; }
+		virtual bool IsFinished() const override { return bFinished; }
+		virtual uint32 GetSampleRate() const override { return static_cast<uint32>(Info.rate); }
+		virtual uint32 GetNumOfChannels() const override { return static_cast<uint32>(Info.channels); }
+		//~ End FBaseRuntimeStreamingDecoder Interface
+
+	private:
+		bool HandlePacket(ogg_packet& Packet)
+		{
+			if (NumOfParsedHeaders < NumOfVorbisHeaders)
+			{
+				if (vorbis_synthesis_headerin(&Info, &Comment, &Packet) != 0)
+				{
+					UE_LOG(AudioLog, Error, TEXT("Failed to parse Vorbis header %d"), NumOfParsedHeaders);
+					return false;
+				}
+				if (++NumOfParsedHeaders == NumOfVorbisHeaders)
+				{
+					if (vorbis_synthesis_init(&DspState, &Info) != 0)
+					{
+						UE_LOG(AudioLog, Error, TEXT("Unable to initialize Vorbis Decoder"));
+						return false;
+					}
+					vorbis_block_init(&DspState, &Block);
+					bSynthesisInitialized = true;
+				}
+				return true;
+			}
+
+			if (vorbis_synthesis(&Block, &Packet) == 0)
+			{
+				vorbis_synthesis_blockin(&DspState, &Block);
+			}
+			else
+			{
+				UE_LOG(AudioLog, Warning, TEXT("Skipping corrupt Vorbis packet"));
+			}
+
+			// Vorbis hands out planar samples, they are interleaved here
+			float** PlanarPCMData = nullptr;
+			int32 NumOfFrames;
+			while ((NumOfFrames = vorbis_synthesis_pcmout(&DspState, &PlanarPCMData)) > 0)
+			{
+				const int32 NumOfChannels = Info.channels;
+				const int64 WriteOffset = PendingPCMData.Num();
+				PendingPCMData.AddUninitialized(static_cast<int64>(NumOfFrames) * NumOfChannels);
+				float* Interleaved = PendingPCMData.GetData() + WriteOffset;
+				for (int32 FrameIndex = 0; FrameIndex < NumOfFrames; ++FrameIndex)
+				{
+					for (int32 ChannelIndex = 0; ChannelIndex < NumOfChannels; ++ChannelIndex)
+					{
+						*Interleaved++ = PlanarPCMData[ChannelIndex][FrameIndex];
+					}
+				}
+				vorbis_synthesis_read(&DspState, NumOfFrames);
+				NumOfDecodedFrames += NumOfFrames;
+			}
+
+			if (Packet.e_o_s)
+			{
+				bFinished = true;
+				TrimEndPadding(Packet.granulepos);
+			}
+			return true;
+		}
+
+		/** The last block can decode past the end of the stream, the granule position of the last page tells the real length */
+		void TrimEndPadding(int64 FinalGranulePosition)
+		{
+			if (FinalGranulePosition < 0 || Info.channels <= 0)
+			{
+				return;
+			}
+
+			const int64 NumOfExcessFrames = FMath::Min(NumOfDecodedFrames - FinalGranulePosition, PendingPCMData.Num() / Info.channels);
+			if (NumOfExcessFrames > 0)
+			{
+				PendingPCMData.SetNum(PendingPCMData.Num() - NumOfExcessFrames * Info.channels, EAllowShrinking::No);
+				NumOfDecodedFrames -= NumOfExcessFrames;
+			}
+		}
+
+		FOGG_StreamDemuxer Demuxer;
+		vorbis_info Info;
+		vorbis_comment Comment;
+		vorbis_dsp_state DspState;
+		vorbis_block Block;
+
+		int32 NumOfParsedHeaders = 0;
+		int64 NumOfDecodedFrames = 0;
+		bool bSynthesisInitialized = false;
+		bool bFinished = false;
+		bool bFailed = false;
+
+		TArray64<float> PendingPCMData;
+	};
+}
+
+bool FVORBIS_RuntimeCodec::CheckAndFixAudioFormat(FRuntimeBulkDataBuffer<uint8>& AudioData)
+{
+	return FOGG_StreamDemuxer::IsFirstPacket(AudioData.GetView().GetData(), AudioData.GetView().Num(), "\x01vorbis", 7);
+}
+
+bool FVORBIS_RuntimeCodec::Decode(FEncodedAudioStruct EncodedData, FDecodedAudioStruct& DecodedData)
+{
+	UE_LOG(AudioLog, Log, TEXT("Decoding Vorbis audio data to uncompressed audio format.\nEncoded audio info: %s"), *EncodedData.ToString());
+
+	ensureAlwaysMsgf(EncodedData.AudioFormat == GetAudioFormat(), TEXT("Attempting to decode audio data using the '%s' codec, but the data format is encoded in '%s'"),
+					 *UEnum::GetValueAsString(GetAudioFormat()), *UEnum::GetValueAsString(EncodedData.AudioFormat));
+
+	if (!DecodeWithStreamingDecoder(EncodedData, DecodedData))
+	{
+		UE_LOG(AudioLog, Error, TEXT("Failed to decode Vorbis audio data"));
+		return false;
+	}
+
+	UE_LOG(AudioLog, Log, TEXT("Successfully decoded Vorbis audio data to uncompressed audio format.\nDecoded audio info: %s"), *DecodedData.ToString());
+	return true;
+}
+
+TUniquePtr<FBaseRuntimeStreamingDecoder> FVORBIS_RuntimeCodec::CreateStreamingDecoder(uint32 PreferredSampleRate) const
+{
+	return MakeUnique<FVORBIS_StreamingDecoder>();
+}
+
+TUniquePtr<FBaseRuntimeBlockDecoder> FVORBIS_RuntimeCodec::CreateBlockDecoder(const FSharedAudioBytes& AudioData, uint32 PreferredSampleRate) const
+{
+	if (!AudioData.IsValid())
+	{
+		return nullptr;
+	}
+
+	// For Vorbis the granule position of the last page is the total number of frames
+	const uint8* Data = AudioData->GetData();
+	const int64 Size = AudioData->Num();
+	const int64 HeaderOffset = FOGG_StreamDemuxer::GetFirstPacketOffset(Data, Size);
+	if (HeaderOffset == INDEX_NONE || Size < HeaderOffset + VorbisIdentificationHeaderSize || FMemory::Memcmp(Data + HeaderOffset, "\x01vorbis", 7) != 0)
+	{
+		return nullptr;
+	}
+
+	const uint8* Header = Data + HeaderOffset;
+	const uint32 NumOfChannels = Header[11];
+	const uint32 SampleRate = Header[12] | (Header[13] << 8) | (Header[14] << 16) | (static_cast<uint32>(Header[15]) << 24);
+	const int64 NumOfFrames = FOGG_StreamDemuxer::FindLastGranulePosition(Data, Size);
+	if (NumOfChannels == 0 || SampleRate == 0 || NumOfFrames <= 0)
+	{
+		return nullptr;
+	}
+
+	return MakeUnique<FStreamedBlockDecoder>(AudioData, []() -> TUniquePtr<FBaseRuntimeStreamingDecoder>
+	{
+		return MakeUnique<FVORBIS_StreamingDecoder>();
+	}, NumOfFrames, SampleRate, NumOfChannels);
+}
@@ -0,0 +1,23 @@
+// Georgy Treshchev 2024.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "BaseRuntimeCodec.h"
+
+/**
+ * Ogg Vorbis format codec implementation for runtime audio importing.
+ * Vorbis always decodes at the rate it was encoded with.
+ */
+class FVORBIS_RuntimeCodec : public FBaseRuntimeCodec
+{
+public:
+	//~ Begin FBaseRuntimeCodec Interface
+	virtual bool CheckAndFixAudioFormat(FRuntimeBulkDataBuffer<uint8>& AudioData) override;
+	virtual bool Decode(FEncodedAudioStruct EncodedData, FDecodedAudioStruct& DecodedData) override;
+	virtual ERuntimeAudioFormat GetAudioFormat() const override { return ERuntimeAudioFormat::OggVorbis; }
+	virtual TArray<FString> GetContentTypes() const override { return { TEXT("audio/ogg; codecs=vorbis"), TEXT("audio/ogg") }; }
+	virtual TUniquePtr<FBaseRuntimeStreamingDecoder> CreateStreamingDecoder(uint32 PreferredSampleRate) const override;
+	virtual TUniquePtr<FBaseRuntimeBlockDecoder> CreateBlockDecoder(const FSharedAudioBytes& AudioData, uint32 PreferredSampleRate) const override;
+	//~ End FBaseRuntimeCodec Interface
+};
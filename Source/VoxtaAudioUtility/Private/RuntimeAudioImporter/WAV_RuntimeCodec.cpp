@@ -3,6 +3,8 @@
 #include "WAV_RuntimeCodec.h"
 #include "AudioStructs.h"
 #include "HAL/UnrealMemory.h"
+#include "HAL/IConsoleManager.h"
+#include "WavChunkWalker.h"
 
 #define DR_WAV_IMPLEMENTATION
 #define INCLUDE_WAV
@@ -12,69 +14,100 @@
 
 namespace
 {
+	TAutoConsoleVariable<bool> CVarStoreInt16PCM(
+		TEXT("voxta.Audio.StoreInt16PCM"),
+		true,
+		TEXT("Keep decoded 16-bit PCM WAV data as int16 instead of float, halving resident memory. Conversion to float happens per render block."));
+
 	/**
 	 * Check and fix the WAV audio data with the correct byte size in the RIFF container
-	 * Made by https://github.com/kass-kass
+	 * Based on the approach by https://github.com/kass-kass, the chunks are now walked directly instead of searched
 	 */
 	bool CheckAndFixWavDurationErrors(FRuntimeBulkDataBuffer<uint8>& WavData)
 	{
-		drwav WAV;
-
-		// Initializing WAV codec
-		if (!drwav_init_memory(&WAV, WavData.GetView().GetData(), WavData.GetView().Num(), nullptr))
+		// Non-RIFF containers (e.g. Wave64) don't use these placeholders, nothing to fix there
+		if (WavData.GetView().Num() < 4 || FMemory::Memcmp(WavData.GetView().GetData(), "RIFF", 4) != 0)
 		{
-			UE_LOG(AudioLog, Error, TEXT("Unable to initialize WAV Decoder"));
-			return false;
+			return true;
 		}
 
-		// Check if the container is RIFF (not Wave64 or any other containers)
-		if (WAV.container != drwav_container_riff)
+		// Shared bytes are immutable and read by others (e.g. the lipsync generators) at the same time, so a shared buffer
+		// that still needs fixing is fixed in a private copy instead
+		if (!WavData.OwnsData() && WavChunkWalker::HasStreamingPlaceholders(WavData.GetView().GetData(), WavData.GetView().Num()))
 		{
-			drwav_uninit(&WAV);
-			return true;
+			UE_LOG(AudioLog, Log, TEXT("Copying shared WAV audio data to fix its placeholder sizes"));
+			WavData = FRuntimeBulkDataBuffer<uint8>(WavData);
 		}
 
-		// Get 4-byte field at byte 4, which is the overall file size as uint32, according to RIFF specification.
-		// If the field is set to nothing (hex FFFFFFFF), replace the incorrectly set field with the actual size.
-		// The field should be (size of file - 8 bytes), as the chunk identifier for the whole file (4 bytes spelling out RIFF at the start of the file), and the chunk length (4 bytes that we're replacing) are excluded.
-		if (BytesToHex(WavData.GetView().GetData() + 4, 4) == "FFFFFFFF")
+		// If the RIFF size or the data chunk size is set to nothing (hex FFFFFFFF), the incorrectly set field is replaced with the actual size.
+		// Buffers that are already correct (e.g. fixed on download) are not written to
+		return WavChunkWalker::FixStreamingSizes(WavData.GetView().GetData(), WavData.GetView().Num());
+	}
+
+	/**
+	 * Reads frame ranges straight from the shared WAV bytes. Only used for formats that dr_wav can seek in without
+	 * decoding from the start (PCM, float, A-law and mu-law), which covers everything TTS backends produce.
+	 */
+	class FWAV_BlockDecoder : public FBaseRuntimeBlockDecoder
+	{
+	public:
+		explicit FWAV_BlockDecoder(const FSharedAudioBytes& InAudioData)
+			: AudioData(InAudioData)
 		{
-			const int32 ActualFileSize = WavData.GetView().Num() - 8;
-			FMemory::Memcpy(WavData.GetView().GetData() + 4, &ActualFileSize, 4);
+			bInitialized = drwav_init_memory(&WAV_Decoder, AudioData->GetData(), AudioData->Num(), nullptr) != DRWAV_FALSE;
 		}
 
-		// Search for the place in the file after the chunk id "data", which is where the data length is stored.
-		// First 36 bytes are skipped, as they're always "RIFF", 4 bytes filesize, "WAVE", "fmt ", and 20 bytes of format data.
-		uint32 DataSizeLocation = INDEX_NONE;
-		for (uint32 Index = 36; Index < static_cast<uint32>(WavData.GetView().Num()) - 4; ++Index)
+		virtual ~FWAV_BlockDecoder() override
 		{
-			// "64617461" - hex for string "data"
-			if (BytesToHex(WavData.GetView().GetData() + Index, 4) == "64617461")
+			if (bInitialized)
 			{
-				DataSizeLocation = Index + 4;
-				break;
+				drwav_uninit(&WAV_Decoder);
 			}
 		}
 
-		// Should never happen, but just in case
-		if (DataSizeLocation == INDEX_NONE)
+		bool IsSeekable() const
 		{
-			drwav_uninit(&WAV);
-			return false;
+			if (!bInitialized || WAV_Decoder.totalPCMFrameCount == 0)
+			{
+				return false;
+			}
+			const uint16 FormatTag = WAV_Decoder.translatedFormatTag;
+			return FormatTag == DR_WAVE_FORMAT_PCM || FormatTag == DR_WAVE_FORMAT_IEEE_FLOAT || FormatTag == DR_WAVE_FORMAT_ALAW || FormatTag == DR_WAVE_FORMAT_MULAW;
 		}
 
-		// Same process as replacing full file size, except DataSize counts bytes from end of DataSize int to end of file.
-		if (BytesToHex(WavData.GetView().GetData() + DataSizeLocation, 4) == "FFFFFFFF")
+		//~ Begin FBaseRuntimeBlockDecoder Interface
+		virtual bool DecodeFrames(int64 FirstFrame, int32 NumOfFrames, float* OutPCMData) override
 		{
-			// -4 to not include the DataSize int itself
-			const uint32 ActualDataSize = WavData.GetView().Num() - DataSizeLocation - 4;
+			if (FirstFrame != NextFrame)
+			{
+				if (!drwav_seek_to_pcm_frame(&WAV_Decoder, static_cast<drwav_uint64>(FirstFrame)))
+				{
+					return false;
+				}
+			}
 
-			FMemory::Memcpy(WavData.GetView().GetData() + DataSizeLocation, &ActualDataSize, 4);
+			const int64 NumOfReadFrames = static_cast<int64>(drwav_read_pcm_frames_f32(&WAV_Decoder, NumOfFrames, OutPCMData));
+			NextFrame = FirstFrame + NumOfReadFrames;
+			if (NumOfReadFrames < NumOfFrames)
+			{
+				FMemory::Memzero(OutPCMData + NumOfReadFrames * WAV_Decoder.channels, (NumOfFrames - NumOfReadFrames) * WAV_Decoder.channels * sizeof(float));
+			}
+			return true;
 		}
 
-		drwav_uninit(&WAV);
-		return true;
-	}
+		virtual int64 GetNumOfFrames() const override { return static_cast<int64>(WAV_Decoder.totalPCMFrameCount); }
+		virtual uint32 GetSampleRate() const override { return WAV_Decoder.sampleRate; }
+		virtual uint32 GetNumOfChannels() const override { return WAV_Decoder.channels; }
+		virtual int64 GetEncodedSize() const override { return AudioData.IsValid() ? AudioData->Num() : 0; }
+		//~ End FBaseRuntimeBlockDecoder Interface
+
+	private:
+		/** Keeps the bytes alive, dr_wav reads them in place */
+		FSharedAudioBytes AudioData;
+		drwav WAV_Decoder;
+		bool bInitialized = false;
+		int64 NextFrame = 0;
+	};
 }
 
 bool FWAV_RuntimeCodec::CheckAndFixAudioFormat(FRuntimeBulkDataBuffer<uint8>& AudioData)
@@ -114,22 +147,44 @@ bool FWAV_RuntimeCodec::Decode(FEncodedAudioStruct EncodedData, FDecodedAudioStr
 		return false;
 	}
 
-	// Allocating memory for PCM data
-	float* TempPCMData = static_cast<float*>(FMemory::Malloc(WAV_Decoder.totalPCMFrameCount * WAV_Decoder.channels * sizeof(float)));
-	if (!TempPCMData)
+	const bool bStoreAsInt16 = CVarStoreInt16PCM.GetValueOnAnyThread()
+		&& WAV_Decoder.translatedFormatTag == DR_WAVE_FORMAT_PCM && WAV_Decoder.bitsPerSample == 16;
+
+	if (bStoreAsInt16)
 	{
-		UE_LOG(AudioLog, Error, TEXT("Failed to allocate memory for WAV Decoder"));
-		drwav_uninit(&WAV_Decoder);
-		return false;
-	}
+		// Allocating memory for PCM data
+		int16* TempPCMData = static_cast<int16*>(FMemory::Malloc(WAV_Decoder.totalPCMFrameCount * WAV_Decoder.channels * sizeof(int16)));
+		if (!TempPCMData)
+		{
+			UE_LOG(AudioLog, Error, TEXT("Failed to allocate memory for WAV Decoder"));
+			drwav_uninit(&WAV_Decoder);
+			return false;
+		}
+
+		// Filling PCM data and getting the number of frames
+		DecodedData.PCMInfo.PCMNumOfFrames = drwav_read_pcm_frames_s16(&WAV_Decoder, WAV_Decoder.totalPCMFrameCount, TempPCMData);
 
-	// Filling PCM data and getting the number of frames
-	DecodedData.PCMInfo.PCMNumOfFrames = drwav_read_pcm_frames_f32(&WAV_Decoder, WAV_Decoder.totalPCMFrameCount, TempPCMData);
+		const int64 TempPCMDataSize = static_cast<int64>(DecodedData.PCMInfo.PCMNumOfFrames * WAV_Decoder.channels);
+		DecodedData.PCMInfo.PCMDataInt16 = FRuntimeBulkDataBuffer<int16>(TempPCMData, TempPCMDataSize);
+	}
+	else
+	{
+		// Allocating memory for PCM data
+		float* TempPCMData = static_cast<float*>(FMemory::Malloc(WAV_Decoder.totalPCMFrameCount * WAV_Decoder.channels * sizeof(float)));
+		if (!TempPCMData)
+		{
+			UE_LOG(AudioLog, Error, TEXT("Failed to allocate memory for WAV Decoder"));
+			drwav_uninit(&WAV_Decoder);
+			return false;
+		}
 
-	// Getting PCM data size
-	const int64 TempPCMDataSize = static_cast<int64>(DecodedData.PCMInfo.PCMNumOfFrames * WAV_Decoder.channels);
+		// Filling PCM data and getting the number of frames
+		DecodedData.PCMInfo.PCMNumOfFrames = drwav_read_pcm_frames_f32(&WAV_Decoder, WAV_Decoder.totalPCMFrameCount, TempPCMData);
 
-	DecodedData.PCMInfo.PCMData = FRuntimeBulkDataBuffer<float>(TempPCMData, TempPCMDataSize);
+		// Getting PCM data size
+		const int64 TempPCMDataSize = static_cast<int64>(DecodedData.PCMInfo.PCMNumOfFrames * WAV_Decoder.channels);
+		DecodedData.PCMInfo.PCMData = FRuntimeBulkDataBuffer<float>(TempPCMData, TempPCMDataSize);
+	}
 
 	// Getting basic audio information
 	{
@@ -142,4 +197,19 @@ bool FWAV_RuntimeCodec::Decode(FEncodedAudioStruct EncodedData, FDecodedAudioStr
 	drwav_uninit(&WAV_Decoder);
 	UE_LOG(AudioLog, Log, TEXT("Successfully decoded WAV audio data to uncompressed audio format.\nDecoded audio info: %s"), *DecodedData.ToString());
 	return true;
-}
\ No newline at end of file
+}
+
+TUniquePtr<FBaseRuntimeBlockDecoder> FWAV_RuntimeCodec::CreateBlockDecoder(const FSharedAudioBytes& AudioData, uint32 PreferredSampleRate) const
+{
+	if (!AudioData.IsValid())
+	{
+		return nullptr;
+	}
+
+	TUniquePtr<FWAV_BlockDecoder> Decoder = MakeUnique<FWAV_BlockDecoder>(AudioData);
+	if (!Decoder->IsSeekable())
+	{
+		return nullptr;
+	}
+	return Decoder;
+}
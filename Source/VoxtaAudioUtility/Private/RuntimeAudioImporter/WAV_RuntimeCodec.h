@@ -16,5 +16,7 @@ public:
 	virtual bool CheckAndFixAudioFormat(FRuntimeBulkDataBuffer<uint8>& AudioData) override;
 	virtual bool Decode(FEncodedAudioStruct EncodedData, FDecodedAudioStruct& DecodedData) override;
 	virtual ERuntimeAudioFormat GetAudioFormat() const override { return ERuntimeAudioFormat::Wav; }
+	virtual TArray<FString> GetContentTypes() const override { return { TEXT("audio/x-wav"), TEXT("audio/wav"), TEXT("audio/wave") }; }
+	virtual TUniquePtr<FBaseRuntimeBlockDecoder> CreateBlockDecoder(const FSharedAudioBytes& AudioData, uint32 PreferredSampleRate) const override;
 	//~ End FBaseRuntimeCodec Interface
 };
@@ -0,0 +1,752 @@
+// Copyright(c) 2024 grrimgrriefer & DZnnah, see LICENSE for details.
+
+#include "VoiceLineCache.h"
+#include "VoxtaDefines.h"
+#include "Logging/StructuredLog.h"
+#include "HAL/IConsoleManager.h"
+#include "HAL/FileManager.h"
+#include "HAL/PlatformFileManager.h"
+#include "Async/Async.h"
+#include "Hash/xxhash.h"
+#include "Misc/Paths.h"
+#include "Misc/ScopeLock.h"
+
+namespace
+{
+	TAutoConsoleVariable<bool> CVarVoiceLineCacheEnabled(
+		TEXT("voxta.Audio.VoiceLineCache.Enabled"),
+		true,
+		TEXT("Reuse decoded audio & lipsync data of voicelines that were downloaded before."));
+
+	TAutoConsoleVariable<int32> CVarVoiceLineCacheMemoryBudgetMB(
+		TEXT("voxta.Audio.VoiceLineCache.MemoryBudgetMB"),
+		64,
+		TEXT("Maximum size of the in-memory voiceline cache, least recently used entries are spilled to disk."));
+
+	TAutoConsoleVariable<int32> CVarVoiceLineCacheDiskBudgetMB(
+		TEXT("voxta.Audio.VoiceLineCache.DiskBudgetMB"),
+		512,
+		TEXT("Maximum size of the on-disk voiceline cache, 0 disables the disk store."));
+
+	FAutoConsoleCommand VoiceLineCacheDumpCommand(
+		TEXT("voxta.Audio.VoiceLineCache.Dump"),
+		TEXT("Log the stats and all entries of the voiceline cache."),
+		FConsoleCommandDelegate::CreateLambda([] ()
+		{
+			VoiceLineCache::Get().DumpToLog();
+		}));
+
+	FAutoConsoleCommand VoiceLineCacheClearCommand(
+		TEXT("voxta.Audio.VoiceLineCache.Clear"),
+		TEXT("Empty the voiceline cache. Pass 'disk' to also delete the on-disk store."),
+		FConsoleCommandWithArgsDelegate::CreateLambda([] (const TArray<FString>& args)
+		{
+			VoiceLineCache::Get().Clear(args.Contains(TEXT("disk")));
+		}));
+
+	constexpr uint32 FILE_MAGIC = 0x4C565856; // "VXVL"
+	// 2: A2F lipsync payloads store their curves as one flat frame-major array.
+	constexpr uint32 FILE_VERSION = 2;
+	const TCHAR* FILE_EXTENSION = TEXT(".vxvl");
+
+	/** Fixed-size header of a disk store file, followed by the PCM data and then the lipsync payloads. */
+	struct FVoiceLineFileHeader
+	{
+		uint32 Magic = FILE_MAGIC;
+		uint32 Version = FILE_VERSION;
+		uint64 ContentHash = 0;
+		uint32 SampleRate = 0;
+		uint32 NumOfChannels = 0;
+		uint32 NumOfFrames = 0;
+		float Duration = 0.f;
+		uint8 AudioFormat = 0;
+		uint8 bIsInt16 = 0;
+		uint8 bHasAudio = 0;
+		uint8 NumOfLipSyncPayloads = 0;
+		uint32 Padding = 0;
+		int64 PCMBytes = 0;
+	};
+	static_assert(sizeof(FVoiceLineFileHeader) == 48, "Changing the header layout requires bumping FILE_VERSION.");
+
+	/** Precedes every lipsync payload in a disk store file. */
+	struct FVoiceLinePayloadHeader
+	{
+		uint8 LipSyncKind = 0;
+		uint8 Padding[7] = {};
+		int64 Size = 0;
+	};
+	static_assert(sizeof(FVoiceLinePayloadHeader) == 16, "Changing the header layout requires bumping FILE_VERSION.");
+
+	int64 MegabytesToBytes(int32 megabytes)
+	{
+		return static_cast<int64>(FMath::Max(megabytes, 0)) * 1024 * 1024;
+	}
+
+	/** Read samples from the file into a new buffer, which is handed to the PCM data as is. */
+	template <typename SampleType>
+	bool ReadSamples(IFileHandle& fileHandle, int64 numOfSamples, FRuntimeBulkDataBuffer<SampleType>& outSamples)
+	{
+		SampleType* samples = static_cast<SampleType*>(FMemory::Malloc(numOfSamples * sizeof(SampleType)));
+		if (samples == nullptr || !fileHandle.Read(reinterpret_cast<uint8*>(samples), numOfSamples * sizeof(SampleType)))
+		{
+			FMemory::Free(samples);
+			return false;
+		}
+		outSamples = FRuntimeBulkDataBuffer<SampleType>(samples, numOfSamples);
+		return true;
+	}
+}
+
+int64 FVoiceLineCacheEntry::GetAllocatedSize() const
+{
+	int64 size = DecodedAudio.IsValid() ? DecodedAudio->PCMInfo.GetAllocatedSize() : 0;
+	for (const TPair<uint8, FSharedAudioBytes>& payload : LipSyncPayloads)
+	{
+		size += payload.Value.IsValid() ? payload.Value->Num() : 0;
+	}
+	return size;
+}
+
+VoiceLineCache& VoiceLineCache::Get()
+{
+	static VoiceLineCache instance;
+	return instance;
+}
+
+uint64 VoiceLineCache::HashContent(const TArray<uint8>& audioData)
+{
+	const uint64 hash = FXxHash64::HashBuffer(audioData.GetData(), audioData.Num()).Hash;
+	// 0 is used as 'not hashed' by callers.
+	return hash != 0 ? hash : 1;
+}
+
+bool VoiceLineCache::IsEnabled()
+{
+	return CVarVoiceLineCacheEnabled.GetValueOnAnyThread();
+}
+
+bool VoiceLineCache::TryFindByUrl(const FString& url, uint8 lipSyncKind, FVoiceLineCacheEntry& outEntry)
+{
+	uint64 contentHash = 0;
+	{
+		FScopeLock lock(&m_lock);
+		const uint64* aliasHash = m_urlAliases.Find(url);
+		if (aliasHash == nullptr)
+		{
+			m_stats.Misses++;
+			return false;
+		}
+		contentHash = *aliasHash;
+	}
+
+	bool wasOnDisk = false;
+	TSharedPtr<FVoiceLineCacheEntry, ESPMode::ThreadSafe> entry = FindAndTouch(contentHash, wasOnDisk);
+	const bool isHit = entry.IsValid() && entry->DecodedAudio.IsValid() && entry->HasLipSync(lipSyncKind);
+	RecordLookup(isHit, wasOnDisk);
+	if (!isHit)
+	{
+		return false;
+	}
+	outEntry = *entry;
+	return true;
+}
+
+bool VoiceLineCache::TryFindByContentHash(uint64 contentHash, FVoiceLineCacheEntry& outEntry)
+{
+	bool wasOnDisk = false;
+	TSharedPtr<FVoiceLineCacheEntry, ESPMode::ThreadSafe> entry = FindAndTouch(contentHash, wasOnDisk);
+	RecordLookup(entry.IsValid(), wasOnDisk);
+	if (!entry.IsValid())
+	{
+		return false;
+	}
+	outEntry = *entry;
+	return true;
+}
+
+void VoiceLineCache::AddUrlAlias(const FString& url, uint64 contentHash)
+{
+	if (!url.IsEmpty())
+	{
+		FScopeLock lock(&m_lock);
+		m_urlAliases.Add(url, contentHash);
+	}
+}
+
+void VoiceLineCache::StoreDecodedAudio(const FString& url, uint64 contentHash, const FDecodedAudioStruct& decodedAudio)
+{
+	if (!IsEnabled() || !decodedAudio.IsValid())
+	{
+		return;
+	}
+	// Copy outside of the lock, this is the only part that scales with the size of the voiceline.
+	TSharedPtr<const FDecodedAudioStruct, ESPMode::ThreadSafe> audioCopy =
+		MakeShared<const FDecodedAudioStruct, ESPMode::ThreadSafe>(decodedAudio);
+
+	bool wasOnDisk = false;
+	TSharedPtr<FVoiceLineCacheEntry, ESPMode::ThreadSafe> existing = FindAndTouch(contentHash, wasOnDisk);
+
+	FScopeLock lock(&m_lock);
+	// Another store can have replaced the entry while the lock wasn't held.
+	if (const FMemoryEntry* memoryEntry = m_memoryEntries.Find(contentHash))
+	{
+		existing = memoryEntry->Data;
+	}
+	TSharedPtr<FVoiceLineCacheEntry, ESPMode::ThreadSafe> entry = existing.IsValid()
+		? MakeShared<FVoiceLineCacheEntry, ESPMode::ThreadSafe>(*existing)
+		: MakeShared<FVoiceLineCacheEntry, ESPMode::ThreadSafe>();
+	entry->ContentHash = contentHash;
+	entry->DecodedAudio = audioCopy;
+
+	if (!url.IsEmpty())
+	{
+		m_urlAliases.Add(url, contentHash);
+	}
+	InsertMemoryEntry(entry, false);
+}
+
+void VoiceLineCache::StoreLipSync(uint64 contentHash, uint8 lipSyncKind, TArray<uint8>&& payload)
+{
+	if (!IsEnabled() || lipSyncKind == 0 || payload.Num() == 0)
+	{
+		return;
+	}
+	FSharedAudioBytes sharedPayload = MakeShared<const TArray<uint8>, ESPMode::ThreadSafe>(MoveTemp(payload));
+
+	bool wasOnDisk = false;
+	TSharedPtr<FVoiceLineCacheEntry, ESPMode::ThreadSafe> existing = FindAndTouch(contentHash, wasOnDisk);
+
+	FScopeLock lock(&m_lock);
+	// Another store can have replaced the entry while the lock wasn't held.
+	if (const FMemoryEntry* memoryEntry = m_memoryEntries.Find(contentHash))
+	{
+		existing = memoryEntry->Data;
+	}
+	TSharedPtr<FVoiceLineCacheEntry, ESPMode::ThreadSafe> entry = existing.IsValid()
+		? MakeShared<FVoiceLineCacheEntry, ESPMode::ThreadSafe>(*existing)
+		: MakeShared<FVoiceLineCacheEntry, ESPMode::ThreadSafe>();
+	entry->ContentHash = contentHash;
+	entry->LipSyncPayloads.Add(lipSyncKind, sharedPayload);
+	InsertMemoryEntry(entry, false);
+}
+
+FVoiceLineCacheStats VoiceLineCache::GetStats() const
+{
+	FScopeLock lock(&m_lock);
+	FVoiceLineCacheStats stats = m_stats;
+	stats.MemoryBytes = m_memoryBytes;
+	stats.DiskBytes = m_diskBytes;
+	stats.MemoryEntries = m_memoryEntries.Num();
+	stats.DiskEntries = m_diskEntries.Num();
+	stats.UrlAliases = m_urlAliases.Num();
+	return stats;
+}
+
+void VoiceLineCache::Clear(bool removeDiskEntries)
+{
+	FScopeLock lock(&m_lock);
+	m_memoryEntries.Empty();
+	m_memoryLruOrder.Empty();
+	m_memoryBytes = 0;
+	m_urlAliases.Empty();
+	m_stats = FVoiceLineCacheStats();
+
+	if (removeDiskEntries)
+	{
+		IFileManager::Get().DeleteDirectory(*GetDiskFolder(), false, true);
+		m_diskEntries.Empty();
+		m_diskBytes = 0;
+		m_diskIndexBuilt = false;
+	}
+	UE_LOGFMT(VoxtaLog, Log, "Cleared the voiceline cache (disk store included: {0}).", removeDiskEntries);
+}
+
+void VoiceLineCache::DumpToLog() const
+{
+	const FVoiceLineCacheStats stats = GetStats();
+	UE_LOGFMT(VoxtaLog, Log, "VoiceLineCache: {0} memory hits, {1} disk hits, {2} misses, {3} memory evictions, "
+		"{4} disk evictions.", stats.MemoryHits, stats.DiskHits, stats.Misses, stats.MemoryEvictions,
+		stats.DiskEvictions);
+	UE_LOGFMT(VoxtaLog, Log, "VoiceLineCache: memory {0} entries ({1} KiB), disk {2} entries ({3} KiB), {4} url aliases.",
+		stats.MemoryEntries, stats.MemoryBytes / 1024, stats.DiskEntries, stats.DiskBytes / 1024, stats.UrlAliases);
+
+	FScopeLock lock(&m_lock);
+	for (const FLruList::TDoubleLinkedListNode* node = m_memoryLruOrder.GetTail(); node; node = node->GetPrevNode())
+	{
+		const FMemoryEntry& memoryEntry = m_memoryEntries.FindChecked(node->GetValue());
+		const FVoiceLineCacheEntry& entry = *memoryEntry.Data;
+		TArray<FString> payloadKinds;
+		for (const TPair<uint8, FSharedAudioBytes>& payload : entry.LipSyncPayloads)
+		{
+			payloadKinds.Add(FString::FromInt(payload.Key));
+		}
+		UE_LOGFMT(VoxtaLog, Log, "  [memory] {0}: {1} KiB, {2}s audio, lipsync kinds [{3}]{4}",
+			FString::Printf(TEXT("%016llx"), entry.ContentHash),
+			memoryEntry.AllocatedSize / 1024,
+			entry.DecodedAudio.IsValid() ? entry.DecodedAudio->SoundWaveBasicInfo.Duration : 0.f,
+			FString::Join(payloadKinds, TEXT(", ")), memoryEntry.bPersisted ? TEXT(", on disk") : TEXT(""));
+	}
+	for (const TPair<uint64, FDiskEntry>& diskEntry : m_diskEntries)
+	{
+		if (!m_memoryEntries.Contains(diskEntry.Key))
+		{
+			UE_LOGFMT(VoxtaLog, Log, "  [disk] {0}: {1} KiB, last used {2}",
+				FString::Printf(TEXT("%016llx"), diskEntry.Key),
+				diskEntry.Value.FileSize / 1024, diskEntry.Value.LastAccess.ToString());
+		}
+	}
+}
+
+FString VoiceLineCache::GetDiskFolder()
+{
+	return FPaths::Combine(FPaths::ProjectSavedDir(), TEXT("Voxta"), TEXT("VoiceLineCache"));
+}
+
+FString VoiceLineCache::GetDiskFilePath(uint64 contentHash)
+{
+	return FPaths::Combine(GetDiskFolder(), FString::Printf(TEXT("%016llx%s"), contentHash, FILE_EXTENSION));
+}
+
+void VoiceLineCache::EnsureDiskIndex()
+{
+	{
+		FScopeLock lock(&m_lock);
+		if (m_diskIndexBuilt)
+		{
+			return;
+		}
+	}
+
+	// Scanned without the lock, lookups that race with it merely miss the disk store until it's done.
+	TMap<uint64, FDiskEntry> diskEntries;
+	IFileManager::Get().IterateDirectoryStat(*GetDiskFolder(),
+		[&diskEntries] (const TCHAR* path, const FFileStatData& statData)
+		{
+			const FString fileName = FPaths::GetBaseFilename(path);
+			if (!statData.bIsDirectory && FPaths::GetExtension(path, true) == FILE_EXTENSION && fileName.Len() == 16)
+			{
+				FDiskEntry& diskEntry = diskEntries.Add(FParse::HexNumber64(*fileName));
+				diskEntry.FileSize = statData.FileSize;
+				diskEntry.LastAccess = statData.ModificationTime;
+			}
+			return true;
+		});
+
+	FScopeLock lock(&m_lock);
+	if (m_diskIndexBuilt)
+	{
+		return;
+	}
+	m_diskIndexBuilt = true;
+	for (const TPair<uint64, FDiskEntry>& diskEntry : diskEntries)
+	{
+		// Entries written during the scan are already known, with their current size.
+		if (!m_diskEntries.Contains(diskEntry.Key))
+		{
+			m_diskEntries.Add(diskEntry.Key, diskEntry.Value);
+			m_diskBytes += diskEntry.Value.FileSize;
+		}
+	}
+	UE_LOGFMT(VoxtaLog, Log, "Found {0} voicelines ({1} KiB) in the on-disk voiceline cache.",
+		m_diskEntries.Num(), m_diskBytes / 1024);
+}
+
+TSharedPtr<FVoiceLineCacheEntry, ESPMode::ThreadSafe> VoiceLineCache::FindAndTouch(uint64 contentHash,
+	bool& outWasOnDisk)
+{
+	outWasOnDisk = false;
+	EnsureDiskIndex();
+
+	// Only set up by the thread that does the read, a promise must not be dropped without a value.
+	TOptional<TPromise<TSharedPtr<FVoiceLineCacheEntry, ESPMode::ThreadSafe>>> readPromise;
+	TSharedFuture<TSharedPtr<FVoiceLineCacheEntry, ESPMode::ThreadSafe>> otherRead;
+	{
+		FScopeLock lock(&m_lock);
+		if (FMemoryEntry* memoryEntry = m_memoryEntries.Find(contentHash))
+		{
+			m_memoryLruOrder.RemoveNode(memoryEntry->LruNode, false);
+			m_memoryLruOrder.AddTail(memoryEntry->LruNode);
+			return memoryEntry->Data;
+		}
+
+		if (TSharedPtr<FVoiceLineCacheEntry, ESPMode::ThreadSafe>* pendingEntry = m_pendingDiskWrites.Find(contentHash))
+		{
+			TSharedPtr<FVoiceLineCacheEntry, ESPMode::ThreadSafe> entry = *pendingEntry;
+			outWasOnDisk = true;
+			InsertMemoryEntry(entry, false);
+			return entry;
+		}
+
+		if (const TSharedFuture<TSharedPtr<FVoiceLineCacheEntry, ESPMode::ThreadSafe>>* pendingRead =
+			m_pendingDiskReads.Find(contentHash))
+		{
+			otherRead = *pendingRead;
+		}
+		else if (!m_diskEntries.Contains(contentHash))
+		{
+			return nullptr;
+		}
+		else
+		{
+			readPromise.Emplace();
+			m_pendingDiskReads.Add(contentHash, readPromise->GetFuture().Share());
+		}
+	}
+
+	if (otherRead.IsValid())
+	{
+		// The thread that is reading it promotes it to memory.
+		TSharedPtr<FVoiceLineCacheEntry, ESPMode::ThreadSafe> entry = otherRead.Get();
+		outWasOnDisk = entry.IsValid();
+		return entry;
+	}
+
+	const FString filePath = GetDiskFilePath(contentHash);
+	TSharedPtr<FVoiceLineCacheEntry, ESPMode::ThreadSafe> entry = ReadEntryFromFile(contentHash, filePath);
+	{
+		FScopeLock lock(&m_lock);
+		m_pendingDiskReads.Remove(contentHash);
+		FDiskEntry* diskEntry = m_diskEntries.Find(contentHash);
+		if (!entry.IsValid())
+		{
+			// Corrupted or deleted externally, drop it so it's rewritten next time.
+			if (diskEntry != nullptr)
+			{
+				m_diskBytes -= diskEntry->FileSize;
+				m_diskEntries.Remove(contentHash);
+			}
+			// Under the lock, so it can't remove a file that a spill of the same hash just wrote.
+			IFileManager::Get().Delete(*filePath, false, false, true);
+		}
+		else
+		{
+			if (diskEntry != nullptr)
+			{
+				diskEntry->LastAccess = FDateTime::UtcNow();
+			}
+			// A store during the read already put a newer version in memory, that one is kept.
+			if (FMemoryEntry* memoryEntry = m_memoryEntries.Find(contentHash))
+			{
+				entry = memoryEntry->Data;
+			}
+			else
+			{
+				InsertMemoryEntry(entry, diskEntry != nullptr);
+			}
+		}
+	}
+
+	if (entry.IsValid())
+	{
+		// The timestamp keeps the LRU order across sessions, access times are not reliably updated by all filesystems.
+		IFileManager::Get().SetTimeStamp(*filePath, FDateTime::UtcNow());
+	}
+	readPromise->SetValue(entry);
+	outWasOnDisk = entry.IsValid();
+	return entry;
+}
+
+void VoiceLineCache::RecordLookup(bool isHit, bool wasOnDisk)
+{
+	FScopeLock lock(&m_lock);
+	if (!isHit)
+	{
+		m_stats.Misses++;
+	}
+	else
+	{
+		(wasOnDisk ? m_stats.DiskHits : m_stats.MemoryHits)++;
+	}
+}
+
+void VoiceLineCache::InsertMemoryEntry(const TSharedPtr<FVoiceLineCacheEntry, ESPMode::ThreadSafe>& entry,
+	bool isPersisted)
+{
+	FMemoryEntry& memoryEntry = m_memoryEntries.FindOrAdd(entry->ContentHash);
+	if (memoryEntry.LruNode != nullptr)
+	{
+		m_memoryBytes -= memoryEntry.AllocatedSize;
+		m_memoryLruOrder.RemoveNode(memoryEntry.LruNode, false);
+		m_memoryLruOrder.AddTail(memoryEntry.LruNode);
+	}
+	else
+	{
+		m_memoryLruOrder.AddTail(entry->ContentHash);
+		memoryEntry.LruNode = m_memoryLruOrder.GetTail();
+	}
+
+	memoryEntry.Data = entry;
+	memoryEntry.AllocatedSize = entry->GetAllocatedSize();
+	memoryEntry.bPersisted = isPersisted;
+	m_memoryBytes += memoryEntry.AllocatedSize;
+
+	EnforceMemoryBudget();
+}
+
+void VoiceLineCache::EnforceMemoryBudget()
+{
+	const int64 budget = MegabytesToBytes(CVarVoiceLineCacheMemoryBudgetMB.GetValueOnAnyThread());
+	// Always keep the most recent entry, even if it's larger than the whole budget; it's about to be used.
+	while (m_memoryBytes > budget && m_memoryLruOrder.Num() > 1)
+	{
+		const uint64 evictedHash = m_memoryLruOrder.GetHead()->GetValue();
+		m_memoryLruOrder.RemoveNode(m_memoryLruOrder.GetHead());
+
+		FMemoryEntry evicted;
+		m_memoryEntries.RemoveAndCopyValue(evictedHash, evicted);
+		m_memoryBytes -= evicted.AllocatedSize;
+		m_stats.MemoryEvictions++;
+
+		if (!evicted.bPersisted)
+		{
+			SpillToDisk(evicted.Data);
+		}
+		else if (!m_diskEntries.Contains(evictedHash))
+		{
+			RemoveUrlAliases(evictedHash);
+		}
+	}
+}
+
+void VoiceLineCache::EnforceDiskBudget()
+{
+	const int64 budget = MegabytesToBytes(CVarVoiceLineCacheDiskBudgetMB.GetValueOnAnyThread());
+	if (m_diskBytes <= budget)
+	{
+		return;
+	}
+
+	TArray<TPair<uint64, FDiskEntry>> byAccessTime = m_diskEntries.Array();
+	byAccessTime.Sort([] (const TPair<uint64, FDiskEntry>& a, const TPair<uint64, FDiskEntry>& b)
+	{
+		return a.Value.LastAccess < b.Value.LastAccess;
+	});
+
+	for (const TPair<uint64, FDiskEntry>& diskEntry : byAccessTime)
+	{
+		if (m_diskBytes <= budget)
+		{
+			break;
+		}
+		IFileManager::Get().Delete(*GetDiskFilePath(diskEntry.Key), false, false, true);
+		m_diskBytes -= diskEntry.Value.FileSize;
+		m_diskEntries.Remove(diskEntry.Key);
+		m_stats.DiskEvictions++;
+
+		if (FMemoryEntry* memoryEntry = m_memoryEntries.Find(diskEntry.Key))
+		{
+			memoryEntry->bPersisted = false;
+		}
+		else
+		{
+			RemoveUrlAliases(diskEntry.Key);
+		}
+	}
+}
+
+void VoiceLineCache::SpillToDisk(const TSharedPtr<FVoiceLineCacheEntry, ESPMode::ThreadSafe>& entry)
+{
+	const uint64 contentHash = entry->ContentHash;
+	if (CVarVoiceLineCacheDiskBudgetMB.GetValueOnAnyThread() <= 0 || !entry->DecodedAudio.IsValid())
+	{
+		RemoveUrlAliases(contentHash);
+		return;
+	}
+
+	if (TSharedPtr<FVoiceLineCacheEntry, ESPMode::ThreadSafe>* pendingEntry = m_pendingDiskWrites.Find(contentHash))
+	{
+		// Two writes of one hash would race on the same file, this one is written once the running one is done.
+		*pendingEntry = entry;
+		return;
+	}
+	m_pendingDiskWrites.Add(contentHash, entry);
+	WriteToDiskAsync(entry);
+}
+
+void VoiceLineCache::WriteToDiskAsync(const TSharedPtr<FVoiceLineCacheEntry, ESPMode::ThreadSafe>& entry)
+{
+	Async(EAsyncExecution::ThreadPool, [this, entry, contentHash = entry->ContentHash] ()
+	{
+		int64 fileSize = 0;
+		const bool success = WriteEntryToFile(*entry, GetDiskFilePath(contentHash), fileSize);
+		EnsureDiskIndex();
+
+		FScopeLock lock(&m_lock);
+		TSharedPtr<FVoiceLineCacheEntry, ESPMode::ThreadSafe> newerEntry;
+		const TSharedPtr<FVoiceLineCacheEntry, ESPMode::ThreadSafe>* pendingEntry = m_pendingDiskWrites.Find(contentHash);
+		if (pendingEntry != nullptr && *pendingEntry != entry)
+		{
+			newerEntry = *pendingEntry;
+			WriteToDiskAsync(newerEntry);
+		}
+		else
+		{
+			m_pendingDiskWrites.Remove(contentHash);
+		}
+
+		if (!success)
+		{
+			UE_LOGFMT(VoxtaLog, Warning, "Failed to write a voiceline to the on-disk cache, it will be dropped.");
+			if (!newerEntry.IsValid() && !m_memoryEntries.Contains(contentHash))
+			{
+				RemoveUrlAliases(contentHash);
+			}
+			return;
+		}
+
+		FDiskEntry& diskEntry = m_diskEntries.FindOrAdd(contentHash);
+		m_diskBytes += fileSize - diskEntry.FileSize;
+		diskEntry.FileSize = fileSize;
+		diskEntry.LastAccess = FDateTime::UtcNow();
+		if (FMemoryEntry* memoryEntry = m_memoryEntries.Find(contentHash))
+		{
+			// Promoted back while writing, only counts as persisted if nothing was added to it in the meantime.
+			memoryEntry->bPersisted = memoryEntry->Data == entry;
+		}
+		EnforceDiskBudget();
+	});
+}
+
+void VoiceLineCache::RemoveUrlAliases(uint64 contentHash)
+{
+	for (auto it = m_urlAliases.CreateIterator(); it; ++it)
+	{
+		if (it->Value == contentHash)
+		{
+			it.RemoveCurrent();
+		}
+	}
+}
+
+bool VoiceLineCache::WriteEntryToFile(const FVoiceLineCacheEntry& entry, const FString& filePath, int64& outFileSize)
+{
+	IPlatformFile& platformFile = FPlatformFileManager::Get().GetPlatformFile();
+	if (!platformFile.CreateDirectoryTree(*GetDiskFolder()))
+	{
+		return false;
+	}
+
+	const FDecodedAudioStruct& decodedAudio = *entry.DecodedAudio;
+	FVoiceLineFileHeader header;
+	header.ContentHash = entry.ContentHash;
+	header.SampleRate = decodedAudio.SoundWaveBasicInfo.SampleRate;
+	header.NumOfChannels = decodedAudio.SoundWaveBasicInfo.NumOfChannels;
+	header.NumOfFrames = decodedAudio.PCMInfo.PCMNumOfFrames;
+	header.Duration = decodedAudio.SoundWaveBasicInfo.Duration;
+	header.AudioFormat = static_cast<uint8>(decodedAudio.SoundWaveBasicInfo.AudioFormat);
+	header.bIsInt16 = decodedAudio.PCMInfo.IsInt16();
+	header.bHasAudio = 1;
+	header.NumOfLipSyncPayloads = static_cast<uint8>(entry.LipSyncPayloads.Num());
+	header.PCMBytes = decodedAudio.PCMInfo.GetAllocatedSize();
+
+	// Written to a temporary file first, so a crash or a concurrent read never sees a half-written entry.
+	const FString tempPath = FString::Printf(TEXT("%s.%s.tmp"), *filePath, *FGuid::NewGuid().ToString());
+	{
+		TUniquePtr<IFileHandle> fileHandle(platformFile.OpenWrite(*tempPath));
+		if (!fileHandle.IsValid())
+		{
+			return false;
+		}
+
+		const uint8* pcmData = header.bIsInt16
+			? reinterpret_cast<const uint8*>(decodedAudio.PCMInfo.PCMDataInt16.GetView().GetData())
+			: reinterpret_cast<const uint8*>(decodedAudio.PCMInfo.PCMData.GetView().GetData());
+		bool success = fileHandle->Write(reinterpret_cast<const uint8*>(&header), sizeof(header))
+			&& fileHandle->Write(pcmData, header.PCMBytes);
+
+		for (const TPair<uint8, FSharedAudioBytes>& payload : entry.LipSyncPayloads)
+		{
+			FVoiceLinePayloadHeader payloadHeader;
+			payloadHeader.LipSyncKind = payload.Key;
+			payloadHeader.Size = payload.Value->Num();
+			success = success && fileHandle->Write(reinterpret_cast<const uint8*>(&payloadHeader), sizeof(payloadHeader))
+				&& fileHandle->Write(payload.Value->GetData(), payloadHeader.Size);
+		}
+		outFileSize = fileHandle->Tell();
+
+		if (!success)
+		{
+			fileHandle.Reset();
+			platformFile.DeleteFile(*tempPath);
+			return false;
+		}
+	}
+
+	platformFile.DeleteFile(*filePath);
+	return platformFile.MoveFile(*filePath, *tempPath);
+}
+
+TSharedPtr<FVoiceLineCacheEntry, ESPMode::ThreadSafe> VoiceLineCache::ReadEntryFromFile(uint64 contentHash,
+	const FString& filePath)
+{
+	IPlatformFile& platformFile = FPlatformFileManager::Get().GetPlatformFile();
+	TUniquePtr<IFileHandle> fileHandle(platformFile.OpenRead(*filePath));
+	if (!fileHandle.IsValid())
+	{
+		return nullptr;
+	}
+	const int64 fileSize = fileHandle->Size();
+
+	FVoiceLineFileHeader header;
+	if (fileSize < static_cast<int64>(sizeof(header)) ||
+		!fileHandle->Read(reinterpret_cast<uint8*>(&header), sizeof(header)))
+	{
+		return nullptr;
+	}
+
+	const int64 sampleSize = header.bIsInt16 ? sizeof(int16) : sizeof(float);
+	if (header.Magic != FILE_MAGIC || header.Version != FILE_VERSION || header.ContentHash != contentHash ||
+		header.PCMBytes < 0 || header.PCMBytes % sampleSize != 0 ||
+		static_cast<int64>(sizeof(header)) + header.PCMBytes > fileSize)
+	{
+		return nullptr;
+	}
+
+	TSharedPtr<FVoiceLineCacheEntry, ESPMode::ThreadSafe> entry = MakeShared<FVoiceLineCacheEntry, ESPMode::ThreadSafe>();
+	entry->ContentHash = contentHash;
+
+	// Read straight into the buffers that are kept, the file is never held in memory as a whole.
+	if (header.bHasAudio)
+	{
+		TSharedPtr<FDecodedAudioStruct, ESPMode::ThreadSafe> decodedAudio = MakeShared<FDecodedAudioStruct, ESPMode::ThreadSafe>();
+		decodedAudio->SoundWaveBasicInfo.SampleRate = header.SampleRate;
+		decodedAudio->SoundWaveBasicInfo.NumOfChannels = header.NumOfChannels;
+		decodedAudio->SoundWaveBasicInfo.Duration = header.Duration;
+		decodedAudio->SoundWaveBasicInfo.AudioFormat = static_cast<ERuntimeAudioFormat>(header.AudioFormat);
+		decodedAudio->PCMInfo.PCMNumOfFrames = header.NumOfFrames;
+
+		const int64 numOfSamples = header.PCMBytes / sampleSize;
+		const bool success = header.bIsInt16
+			? ReadSamples(*fileHandle, numOfSamples, decodedAudio->PCMInfo.PCMDataInt16)
+			: ReadSamples(*fileHandle, numOfSamples, decodedAudio->PCMInfo.PCMData);
+		if (!success)
+		{
+			return nullptr;
+		}
+		entry->DecodedAudio = decodedAudio;
+	}
+
+	for (int i = 0; i < header.NumOfLipSyncPayloads; i++)
+	{
+		FVoiceLinePayloadHeader payloadHeader;
+		if (fileSize - fileHandle->Tell() < static_cast<int64>(sizeof(payloadHeader)) ||
+			!fileHandle->Read(reinterpret_cast<uint8*>(&payloadHeader), sizeof(payloadHeader)))
+		{
+			return nullptr;
+		}
+		if (payloadHeader.Size < 0 || payloadHeader.Size > MAX_int32 || fileSize - fileHandle->Tell() < payloadHeader.Size)
+		{
+			return nullptr;
+		}
+
+		TArray<uint8> payload;
+		payload.SetNumUninitialized(static_cast<int32>(payloadHeader.Size));
+		if (!fileHandle->Read(payload.GetData(), payloadHeader.Size))
+		{
+			return nullptr;
+		}
+		entry->LipSyncPayloads.Add(payloadHeader.LipSyncKind,
+			MakeShared<const TArray<uint8>, ESPMode::ThreadSafe>(MoveTemp(payload)));
+	}
+	return entry;
+}
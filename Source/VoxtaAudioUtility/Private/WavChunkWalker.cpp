@@ -0,0 +1,141 @@
+// Copyright(c) 2024 grrimgrriefer & DZnnah, see LICENSE for details.
+
+#include "WavChunkWalker.h"
+
+namespace
+{
+	constexpr int64 RIFF_HEADER_SIZE = 12;
+	constexpr int64 CHUNK_HEADER_SIZE = 8;
+	constexpr uint32 SIZE_PLACEHOLDER = 0xFFFFFFFF;
+
+	uint16 ReadUInt16(const uint8* data)
+	{
+		return static_cast<uint16>(data[0] | (data[1] << 8));
+	}
+
+	uint32 ReadUInt32(const uint8* data)
+	{
+		return static_cast<uint32>(data[0]) | (static_cast<uint32>(data[1]) << 8) |
+			(static_cast<uint32>(data[2]) << 16) | (static_cast<uint32>(data[3]) << 24);
+	}
+
+	void WriteUInt32(uint8* data, uint32 value)
+	{
+		data[0] = static_cast<uint8>(value);
+		data[1] = static_cast<uint8>(value >> 8);
+		data[2] = static_cast<uint8>(value >> 16);
+		data[3] = static_cast<uint8>(value >> 24);
+	}
+
+	bool IsChunkId(const uint8* data, const char* id)
+	{
+		return FMemory::Memcmp(data, id, 4) == 0;
+	}
+
+	bool IsRiffWave(const uint8* data, int64 size)
+	{
+		return data != nullptr && size >= RIFF_HEADER_SIZE && IsChunkId(data, "RIFF") && IsChunkId(data + 8, "WAVE");
+	}
+}
+
+bool WavChunkWalker::TryParse(const uint8* data, int64 size, FWavLayout& outLayout)
+{
+	if (!IsRiffWave(data, size))
+	{
+		return false;
+	}
+
+	bool foundFormat = false;
+	int64 offset = RIFF_HEADER_SIZE;
+	while (offset + CHUNK_HEADER_SIZE <= size)
+	{
+		const uint8* chunk = data + offset;
+		const int64 chunkBodyOffset = offset + CHUNK_HEADER_SIZE;
+		const int64 remaining = size - chunkBodyOffset;
+		int64 chunkSize = ReadUInt32(chunk + 4);
+
+		if (IsChunkId(chunk, "fmt "))
+		{
+			if (chunkSize < 16 || chunkSize > remaining)
+			{
+				return false;
+			}
+			const uint8* format = data + chunkBodyOffset;
+			outLayout.FormatTag = ReadUInt16(format);
+			outLayout.NumChannels = ReadUInt16(format + 2);
+			outLayout.SampleRate = ReadUInt32(format + 4);
+			outLayout.BitsPerSample = ReadUInt16(format + 14);
+			foundFormat = true;
+		}
+		else if (IsChunkId(chunk, "data"))
+		{
+			// Streaming writers may leave the size as a placeholder or overshoot, the data then runs until the end.
+			outLayout.DataOffset = chunkBodyOffset;
+			outLayout.DataSize = FMath::Min(chunkSize, remaining);
+			return foundFormat && outLayout.NumChannels > 0 && outLayout.SampleRate > 0;
+		}
+
+		// Chunks are word-aligned, odd sizes are followed by a padding byte.
+		offset = chunkBodyOffset + chunkSize + (chunkSize & 1);
+	}
+	return false;
+}
+
+bool WavChunkWalker::FixStreamingSizes(uint8* data, int64 size)
+{
+	if (!IsRiffWave(data, size))
+	{
+		return false;
+	}
+
+	if (ReadUInt32(data + 4) == SIZE_PLACEHOLDER)
+	{
+		WriteUInt32(data + 4, static_cast<uint32>(size - 8));
+	}
+
+	int64 offset = RIFF_HEADER_SIZE;
+	while (offset + CHUNK_HEADER_SIZE <= size)
+	{
+		uint8* chunk = data + offset;
+		const int64 chunkBodyOffset = offset + CHUNK_HEADER_SIZE;
+		const uint32 chunkSize = ReadUInt32(chunk + 4);
+
+		if (IsChunkId(chunk, "data"))
+		{
+			if (chunkSize == SIZE_PLACEHOLDER)
+			{
+				WriteUInt32(chunk + 4, static_cast<uint32>(size - chunkBodyOffset));
+			}
+			return true;
+		}
+
+		offset = chunkBodyOffset + chunkSize + (chunkSize & 1);
+	}
+	return false;
+}
+
+bool WavChunkWalker::HasStreamingPlaceholders(const uint8* data, int64 size)
+{
+	if (!IsRiffWave(data, size))
+	{
+		return false;
+	}
+	if (ReadUInt32(data + 4) == SIZE_PLACEHOLDER)
+	{
+		return true;
+	}
+
+	int64 offset = RIFF_HEADER_SIZE;
+	while (offset + CHUNK_HEADER_SIZE <= size)
+	{
+		const uint8* chunk = data + offset;
+		const uint32 chunkSize = ReadUInt32(chunk + 4);
+		if (IsChunkId(chunk, "data"))
+		{
+			return chunkSize == SIZE_PLACEHOLDER;
+		}
+
+		offset += CHUNK_HEADER_SIZE + chunkSize + (chunkSize & 1);
+	}
+	return false;
+}
@@ -6,6 +6,7 @@
 #include "AudioCaptureDeviceInterface.h"
 #include "Logging/LogMacros.h"
 #include "VoxtaDefines.h"
+#include "WavChunkWalker.h"
 
 #include "AudioStructs.generated.h"
 
@@ -24,6 +25,7 @@ enum class ERuntimeAudioFormat : uint8
 	Wav UMETA(DisplayName = "wav"),
 	Flac UMETA(DisplayName = "flac"),
 	OggVorbis UMETA(DisplayName = "ogg vorbis"),
+	OggOpus UMETA(DisplayName = "ogg opus"),
 	Bink UMETA(DisplayName = "bink"),
 	Custom UMETA(DisplayName = "custom"),
 	Invalid UMETA(DisplayName = "invalid", Hidden)
@@ -102,6 +104,7 @@ public:
 
 		ReservedCapacity = NewCapacity;
 		View = ViewType(NewBuffer, 0);
+		bOwnsData = true;
 		UE_LOG(AudioLog, Log, TEXT("Reserving memory for buffer (new capacity: %lld, %lld bytes)"), NewCapacity, NewCapacity * sizeof(DataType));
 
 		return true;
@@ -171,6 +174,7 @@ public:
 
 			FreeBuffer();
 			View = ViewType(NewBuffer, NewCapacity);
+			bOwnsData = true;
 			UE_LOG(AudioLog, Log, TEXT("Reallocating buffer to append data (new capacity: %lld)"), NewCapacity);
 		}
 	}
@@ -186,12 +190,30 @@ public:
 		Other.View = ViewType();
 		ReservedCapacity = Other.ReservedCapacity;
 		Other.ReservedCapacity = 0;
+		bOwnsData = Other.bOwnsData;
+		Other.bOwnsData = true;
 	}
 
 	FRuntimeBulkDataBuffer(DataType* InBuffer, int64 InNumberOfElements)
 		: View(InBuffer, InNumberOfElements)
 	{}
 
+	/**
+	 * Create a buffer that references memory owned by someone else. The memory is never freed by the buffer,
+	 * so the caller must keep it alive for as long as the buffer (or anything moved from it) is in use.
+	 * Appending to or copying such a buffer allocates an owned copy.
+	 *
+	 * @param InBuffer The externally owned memory.
+	 * @param InNumberOfElements Number of elements in the memory.
+	 * @return Non-owning buffer.
+	 */
+	static FRuntimeBulkDataBuffer MakeNonOwning(DataType* InBuffer, int64 InNumberOfElements)
+	{
+		FRuntimeBulkDataBuffer Buffer(InBuffer, InNumberOfElements);
+		Buffer.bOwnsData = false;
+		return Buffer;
+	}
+
 	template <typename Allocator>
 	explicit FRuntimeBulkDataBuffer(const TArray<DataType, Allocator>& Other)
 	{
@@ -231,6 +253,7 @@ public:
 
 			View = ViewType(BufferCopy, BufferSize);
 			ReservedCapacity = Other.ReservedCapacity;
+			bOwnsData = true;
 		}
 
 		return *this;
@@ -245,6 +268,8 @@ public:
 			Other.View = ViewType();
 			ReservedCapacity = Other.ReservedCapacity;
 			Other.ReservedCapacity = 0;
+			bOwnsData = Other.bOwnsData;
+			Other.bOwnsData = true;
 		}
 
 		return *this;
@@ -260,6 +285,7 @@ public:
 	{
 		FreeBuffer();
 		View = ViewType(InBuffer, InNumberOfElements);
+		bOwnsData = true;
 	}
 
 	const ViewType& GetView() const
@@ -267,19 +293,34 @@ public:
 		return View;
 	}
 
+	/**
+	 * @return False if the memory is owned by someone else (see MakeNonOwning), it must then not be written to.
+	 */
+	bool OwnsData() const
+	{
+		return bOwnsData;
+	}
+
 protected:
 	void FreeBuffer()
 	{
 		if (View.GetData() != nullptr)
 		{
-			FMemory::Free(View.GetData());
+			if (bOwnsData)
+			{
+				FMemory::Free(View.GetData());
+			}
 			View = ViewType();
 			ReservedCapacity = 0;
+			bOwnsData = true;
 		}
 	}
 
 	ViewType View;
 	int64 ReservedCapacity = 0;
+
+	/** Whether the memory behind View was allocated by this buffer and has to be freed by it */
+	bool bOwnsData = true;
 };
 
 /**
@@ -312,6 +353,18 @@ struct FEncodedAudioStruct
 		, AudioFormat(AudioFormat)
 	{}
 
+	/**
+	 * Construct from shared audio bytes without copying them.
+	 * The struct keeps its own reference to the bytes, so they stay alive for as long as the struct does.
+	 * @param SharedAudioBytes The shared audio data.
+	 * @param AudioFormat The audio format.
+	 */
+	FEncodedAudioStruct(const FSharedAudioBytes& SharedAudioBytes, ERuntimeAudioFormat AudioFormat)
+		: AudioData(FRuntimeBulkDataBuffer<uint8>::MakeNonOwning(const_cast<uint8*>(SharedAudioBytes->GetData()), SharedAudioBytes->Num()))
+		, AudioFormat(AudioFormat)
+		, SharedAudioData(SharedAudioBytes)
+	{}
+
 	/**
 	 * Converts Encoded Audio Struct to a readable format.
 	 * @return String representation of the Encoded Audio Struct.
@@ -328,6 +381,15 @@ struct FEncodedAudioStruct
 
 	/** Format of the audio data (e.g. mp3, flac, etc) */
 	ERuntimeAudioFormat AudioFormat;
+
+	/** Keeps shared audio bytes alive while AudioData references them, null if AudioData owns its memory */
+	FSharedAudioBytes SharedAudioData;
+
+	/**
+	 * Sample rate the decoder should output if the codec can choose it freely (e.g. Opus), 0 to use the native rate.
+	 * Usually the rate of the audio mixer, so the voice doesn't need to be resampled during playback.
+	 */
+	uint32 PreferredSampleRate = 0;
 };
 
 /**
@@ -375,7 +437,9 @@ struct FSoundWaveBasicStruct
 };
 
 /**
- * PCM data buffer structure with 32-bit float samples.
+ * PCM data buffer structure.
+ * Samples are stored either as 32-bit float or, to halve the resident memory of 16-bit sources, as signed 16-bit integers.
+ * Only one of the two buffers is populated at a time.
  */
 struct FPCMStruct
 {
@@ -389,7 +453,42 @@ struct FPCMStruct
 	 */
 	bool IsValid() const
 	{
-		return PCMData.GetView().GetData() && PCMNumOfFrames > 0 && PCMData.GetView().Num() > 0;
+		return PCMNumOfFrames > 0 && GetNumOfSamples() > 0;
+	}
+
+	/**
+	 * Whether the samples are stored as signed 16-bit integers (PCMDataInt16) instead of floats (PCMData).
+	 * @return True if the int16 buffer is in use, false otherwise.
+	 */
+	bool IsInt16() const
+	{
+		return PCMDataInt16.GetView().Num() > 0;
+	}
+
+	/**
+	 * Get the number of interleaved samples, regardless of the storage format.
+	 * @return Number of samples.
+	 */
+	int64 GetNumOfSamples() const
+	{
+		return IsInt16() ? PCMDataInt16.GetView().Num() : PCMData.GetView().Num();
+	}
+
+	/**
+	 * Get the number of bytes used by the samples, regardless of the storage format.
+	 * @return Size of the sample data in bytes.
+	 */
+	int64 GetAllocatedSize() const
+	{
+		return PCMData.GetView().Num() * sizeof(float) + PCMDataInt16.GetView().Num() * sizeof(int16);
+	}
+
+	/** Release the samples of both storage formats. */
+	void Empty()
+	{
+		PCMData.Empty();
+		PCMDataInt16.Empty();
+		PCMNumOfFrames = 0;
 	}
 
 	/**
@@ -398,13 +497,16 @@ struct FPCMStruct
 	 */
 	FString ToString() const
 	{
-		return FString::Printf(TEXT("Validity of PCM data in memory: %s, number of PCM frames: %d, PCM data size: %lld"),
-			PCMData.GetView().IsValidIndex(0) ? TEXT("Valid") : TEXT("Invalid"), PCMNumOfFrames, static_cast<int64>(PCMData.GetView().Num()));
+		return FString::Printf(TEXT("Validity of PCM data in memory: %s, number of PCM frames: %d, PCM data size: %lld, storage: %s"),
+			IsValid() ? TEXT("Valid") : TEXT("Invalid"), PCMNumOfFrames, GetNumOfSamples(), IsInt16() ? TEXT("int16") : TEXT("float"));
 	}
 
 	/** 32-bit float PCM data */
 	FRuntimeBulkDataBuffer<float> PCMData;
 
+	/** Signed 16-bit PCM data, converted to float per render block during playback */
+	FRuntimeBulkDataBuffer<int16> PCMDataInt16;
+
 	/** Number of PCM frames */
 	uint32 PCMNumOfFrames;
 };
@@ -5,9 +5,12 @@
 #include "AudioStructs.h"
 #include "Sound/SoundWaveProcedural.h"
 #include "Misc/Optional.h"
+#include "DSP/Dsp.h"
+#include <atomic>
 #include "ImportedSoundWave.generated.h"
 
 class UImportedSoundWave;
+class FLazyPCMSource;
 
 /** Static delegate broadcast to track the end of audio playback */
 DECLARE_MULTICAST_DELEGATE(FOnAudioPlaybackFinishedNative);
@@ -95,12 +98,28 @@ public:
 	 */
 	virtual void PopulateAudioDataFromDecodedInfo(FDecodedAudioStruct&& DecodedAudioInfo);
 
+	/**
+	 * Populate audio data from a lazy PCM source, which decodes the encoded data while it is being played
+	 * Falls back to decoding everything up front if an initial desired sample rate or number of channels requires conversion
+	 *
+	 * @param InLazyPCMSource Lazy PCM source, already primed for the start of playback
+	 * @param AudioFormat Format of the encoded data
+	 */
+	void PopulateAudioDataFromLazySource(TSharedRef<FLazyPCMSource, ESPMode::ThreadSafe> InLazyPCMSource, ERuntimeAudioFormat AudioFormat);
+
 	/**
 	 * Release sound wave data. Call it manually only if you are sure of it
 	 */
 	UFUNCTION(BlueprintCallable, Category = "Imported Sound Wave|Miscellaneous")
 	virtual void ReleaseMemory();
 
+	/**
+	 * Release sound wave data like ReleaseMemory, and also reset the playback state, the properties and the delegates
+	 * to those of a newly created sound wave, so it can be populated again instead of creating a new one
+	 * Should only be called once the sound wave is no longer played
+	 */
+	void ResetForReuse();
+
 	/**
 	 * Set whether the sound should loop or not
 	 *
@@ -300,12 +319,70 @@ public:
 	UFUNCTION(BlueprintCallable, Category = "Imported Sound Wave|Info")
 	bool GetAudioHeaderInfo(FRuntimeAudioHeaderInfo& HeaderInfo) const;
 
+	/**
+	 * Get the number of render callbacks that were requested while no PCM data was available
+	 * Safe to call from any thread
+	 */
+	UFUNCTION(BlueprintCallable, Category = "Imported Sound Wave|Info")
+	int64 GetNumOfUnderruns() const;
+
+	/**
+	 * Get the number of render callbacks that could not deliver their audio cleanly, e.g. because the PCM listener tap overflowed
+	 * Safe to call from any thread
+	 */
+	UFUNCTION(BlueprintCallable, Category = "Imported Sound Wave|Info")
+	int64 GetNumOfGlitches() const;
+
+	/**
+	 * Get the number of bytes held for playback: the decoded PCM data, or the cached blocks when decoding lazily
+	 * Safe to call from any thread
+	 */
+	UFUNCTION(BlueprintCallable, Category = "Imported Sound Wave|Info")
+	int64 GetAllocatedPCMSize() const;
+
+	/**
+	 * Get the number of encoded bytes held for playback, only non-zero when decoding lazily
+	 * Safe to call from any thread
+	 */
+	UFUNCTION(BlueprintCallable, Category = "Imported Sound Wave|Info")
+	int64 GetAllocatedEncodedSize() const;
+
 protected:
 	/**
 	 * Makes it possible to broadcast OnAudioPlaybackFinished again
 	 */
 	void ResetPlaybackFinish();
 
+	/**
+	 * Mark the PCM data as unavailable for the render thread and wait until no render callback is reading it anymore
+	 * Must be called before the PCM data is modified or released
+	 */
+	void SuspendRendering();
+
+	/**
+	 * Mark the PCM data as available for the render thread again
+	 */
+	void ResumeRendering();
+
+	/**
+	 * Game-thread tick that services the render thread: drains the PCM tap
+	 */
+	void TickRenderSupport();
+
+	/**
+	 * Core ticker shared by all imported sound waves, instead of one ticker per sound wave. Calls TickRenderSupport on each of them
+	 *
+	 * @param DeltaTime Time since the last tick
+	 * @return Always true, the ticker is removed once the last sound wave is destroyed
+	 */
+	static bool TickAllRenderSupport(float DeltaTime);
+
+	/**
+	 * Drain the PCM listener tap on the game thread and broadcast its content to OnGeneratePCMData listeners.
+	 * The tap is allocated here once the first listener is bound
+	 */
+	void DrainPCMDataTap();
+
 public:
 	/** Bind to this delegate to know when the audio playback is finished. Suitable for use in C++ */
 	FOnAudioPlaybackFinishedNative OnAudioPlaybackFinishedNative;
@@ -353,11 +430,17 @@ public:
 	UFUNCTION(BlueprintCallable, Category = "Imported Sound Wave|Info", meta = (DisplayName = "Get PCM Buffer"))
 	TArray<float> GetPCMBufferCopy();
 
+	/**
+	 * Thread-unsafe equivalent of GetPCMBufferCopy
+	 * Should only be used if DataGuard is locked
+	 */
+	TArray<float> GetPCMBufferCopy_Internal() const;
+
 	/**
 	 * Get immutable PCM buffer. Use DataGuard to make it thread safe
 	 * Use PopulateAudioDataFromDecodedInfo to populate it
 	 *
-	 * @return PCM buffer in 32-bit float format
+	 * @return PCM buffer, either in 32-bit float or in signed 16-bit format (see FPCMStruct::IsInt16)
 	 */
 	const FPCMStruct& GetPCMBuffer() const;
 
@@ -375,12 +458,45 @@ protected:
 	/** Bool to control the behaviour of the OnAudioPlaybackFinished delegate */
 	bool PlaybackFinishedBroadcast;
 
-	/** The number of frames played. Increments during playback, should not be > PCMBufferInfo.PCMNumOfFrames */
-	uint32 PlayedNumOfFrames;
+	/** The number of frames played (the playhead). Advanced by the render thread, should not be > PCMBufferInfo.PCMNumOfFrames */
+	std::atomic<uint32> PlayedNumOfFrames;
+
+	/** Whether the render thread is allowed to read PCMBufferInfo */
+	std::atomic<bool> bIsPCMDataRenderable;
+
+	/** The number of render callbacks currently reading PCMBufferInfo */
+	std::atomic<int32> NumOfRenderCallbacksInFlight;
+
+	/** Number of render callbacks without available PCM data */
+	std::atomic<int64> NumOfUnderruns;
+
+	/** Number of render callbacks that could not deliver their audio cleanly */
+	std::atomic<int64> NumOfGlitches;
+
+	/** Whether any OnGeneratePCMData listener is bound. Refreshed on the game thread, read by the render thread */
+	std::atomic<bool> bHasPCMDataListeners;
 
-	/** Contains PCM data for sound wave playback */
+	/**
+	 * Single-producer single-consumer tap, filled by the render thread and drained by the game thread.
+	 * Only allocated for sound waves that get PCM listeners, the render thread only touches it while bHasPCMDataListeners is set
+	 */
+	TUniquePtr<Audio::TCircularAudioBuffer<float>> PCMDataTap;
+
+	/** Game-thread scratch buffer the PCM tap is drained into, reused between ticks */
+	TArray<float> PCMDataTapDrainBuffer;
+
+	/** Play order of the active sound that currently owns the sound wave. Only accessed on the audio thread */
+	TOptional<uint32> OwningActiveSoundPlayOrder;
+
+	/** Audio component ID of the active sound that currently owns the sound wave. Only accessed on the audio thread */
+	uint64 OwningAudioComponentID;
+
+	/** Contains PCM data for sound wave playback. In lazy mode only PCMNumOfFrames is set and the samples come from LazyPCMSource */
 	TSharedPtr<FPCMStruct> PCMBufferInfo;
 
+	/** Decodes the encoded audio data on demand while playing, only set in lazy mode */
+	TSharedPtr<FLazyPCMSource, ESPMode::ThreadSafe> LazyPCMSource;
+
 	/** Whether to stop the sound at the end of playback or not. Sound wave will not be garbage collected if playback was completed while this parameter is set to false */
 	bool bStopSoundOnPlaybackFinish;
 
@@ -0,0 +1,130 @@
+// Georgy Treshchev 2024.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include <atomic>
+
+class FBaseRuntimeBlockDecoder;
+
+/**
+ * PCM source for sound waves that keep only their encoded bytes.
+ * Blocks of frames are decoded on a worker thread slightly ahead of the playhead and kept in a small ring of cached blocks,
+ * the render thread only copies from blocks that are already decoded. Once StartDecodingAhead was called, a process-wide
+ * decoding thread follows the playhead, so neither the render thread nor the game thread have to schedule the decoding.
+ *
+ * Thread Safety: ReadFrames may be called from the render thread while the decoding functions run on another thread.
+ * The decoding functions serialize among themselves.
+ */
+class VOXTAAUDIOUTILITY_API FLazyPCMSource : public TSharedFromThis<FLazyPCMSource, ESPMode::ThreadSafe>
+{
+public:
+	/** Number of frames per decoded block */
+	static constexpr int32 BlockFrames = 4096;
+
+	/** Number of cached blocks. One slot is kept out of the read-ahead window, so the block behind the playhead is never overwritten */
+	static constexpr int32 NumOfCacheSlots = 8;
+
+	explicit FLazyPCMSource(TUniquePtr<FBaseRuntimeBlockDecoder>&& InDecoder);
+	~FLazyPCMSource();
+
+	/**
+	 * Copy decoded frames without blocking. Stops at the first block that is not decoded yet and requests decoding from there.
+	 * Safe to call from the render thread, it neither locks nor allocates.
+	 *
+	 * @param FirstFrame Index of the first frame to read.
+	 * @param NumOfFrames Number of frames to read.
+	 * @param OutPCMData Interleaved output samples, must be able to hold NumOfFrames frames.
+	 *
+	 * @return Number of frames that were read.
+	 */
+	int32 ReadFrames(int64 FirstFrame, int32 NumOfFrames, float* OutPCMData);
+
+	/**
+	 * Move the read-ahead window, e.g. after the playhead was rewound, and schedule decoding for it.
+	 *
+	 * @param FirstFrame Index of the frame that will be read next.
+	 */
+	void SeekTo(int64 FirstFrame);
+
+	/**
+	 * Decode the blocks of the read-ahead window on a background thread, if any of them are missing.
+	 * Does nothing while a previous decode is still in flight.
+	 */
+	void ScheduleDecodeAhead();
+
+	/**
+	 * Decode the blocks of the read-ahead window on the calling thread, if any of them are missing.
+	 * Does nothing while another thread is decoding.
+	 */
+	void DecodeAhead();
+
+	/**
+	 * Keep the read-ahead window decoded from the shared decoding thread, for as long as this source is alive.
+	 * Call once playback can start, e.g. when a sound wave takes the source.
+	 */
+	void StartDecodingAhead();
+
+	/**
+	 * Decode the blocks of the read-ahead window on the calling thread, so playback can start without underruns.
+	 *
+	 * @return False if the encoded data turned out to be corrupt.
+	 */
+	bool Prime();
+
+	/**
+	 * Decode the complete audio, for consumers that need all PCM data at once.
+	 *
+	 * @param OutPCMData Interleaved output samples.
+	 *
+	 * @return False if the encoded data turned out to be corrupt.
+	 */
+	bool DecodeAll(TArray<float>& OutPCMData);
+
+	int64 GetNumOfFrames() const { return NumOfFrames; }
+	uint32 GetSampleRate() const { return SampleRate; }
+	uint32 GetNumOfChannels() const { return NumOfChannels; }
+
+	/** Get the number of bytes used by the cached blocks once all slots are in use */
+	int64 GetAllocatedSize() const { return static_cast<int64>(NumOfCacheSlots) * BlockFrames * NumOfChannels * sizeof(float); }
+
+	/** Get the number of encoded bytes that are kept for decoding */
+	int64 GetEncodedSize() const { return EncodedSize; }
+
+private:
+	struct FBlockSlot
+	{
+		/** Index of the block held by this slot, INDEX_NONE while the slot is empty or being written */
+		std::atomic<int64> BlockIndex{INDEX_NONE};
+
+		/** Allocated by the decoding thread the first time the slot is used */
+		TArray<float> Samples;
+	};
+
+	/** Whether any block of the read-ahead window still has to be decoded */
+	bool NeedsDecode() const;
+
+	/** Decode the missing blocks of the read-ahead window. DecoderGuard must be locked */
+	bool DecodeAhead_Internal();
+
+	FBlockSlot& GetSlot(int64 BlockIndex) { return Slots[BlockIndex % NumOfCacheSlots]; }
+	const FBlockSlot& GetSlot(int64 BlockIndex) const { return Slots[BlockIndex % NumOfCacheSlots]; }
+
+	FBlockSlot Slots[NumOfCacheSlots];
+
+	/** Guards the decoder, which can only be used by one thread at a time */
+	FCriticalSection DecoderGuard;
+	TUniquePtr<FBaseRuntimeBlockDecoder> Decoder;
+
+	const int64 NumOfFrames;
+	const int64 NumOfBlocks;
+	const int64 EncodedSize;
+	const uint32 SampleRate;
+	const uint32 NumOfChannels;
+
+	/** First block of the read-ahead window, updated by the render thread */
+	std::atomic<int64> RequestedBlockIndex{0};
+
+	std::atomic<bool> bDecodeInFlight{false};
+	std::atomic<bool> bFailed{false};
+};
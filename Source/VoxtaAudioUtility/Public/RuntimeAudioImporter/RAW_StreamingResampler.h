@@ -0,0 +1,371 @@
+// Georgy Treshchev 2024.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "RAW_TranscodeKernels.h"
+
+/**
+ * Quality tiers of the streaming resampler, trading filter length for speed
+ */
+enum class ERAW_ResamplerQuality : uint8
+{
+	/** 8 taps, suitable for previews and voice chat */
+	Fast,
+	/** 16 taps, transparent for speech */
+	Balanced,
+	/** 32 taps, for music or heavy downsampling */
+	Best
+};
+
+/**
+ * Stateful polyphase windowed-sinc resampler for interleaved float samples.
+ * Audio can be fed in blocks of any size (e.g. per decoded chunk): output frame N always corresponds to input time
+ * N * SourceSampleRate / DestinationSampleRate, so resampling a stream in parts gives the same result as in one go.
+ * The ratio is tracked with integers, so there is no drift on long streams.
+ *
+ * The filter is a Kaiser windowed sinc, tabulated per phase and linearly interpolated between neighbouring phases.
+ * The dot products run on SSE2/NEON where available.
+ *
+ * Thread Safety: An instance must only be used by one thread at a time.
+ */
+class FRAW_StreamingResampler
+{
+public:
+	/**
+	 * @param Quality The quality tier to use.
+	 * @param InNumOfChannels Number of interleaved channels.
+	 * @param SourceSampleRate Sample rate of the input.
+	 * @param DestinationSampleRate Sample rate of the output.
+	 */
+	FRAW_StreamingResampler(ERAW_ResamplerQuality Quality, uint32 InNumOfChannels, uint32 SourceSampleRate, uint32 DestinationSampleRate)
+		: NumOfChannels(InNumOfChannels)
+	{
+		if (InNumOfChannels == 0 || SourceSampleRate == 0 || DestinationSampleRate == 0)
+		{
+			return;
+		}
+
+		const uint32 Divisor = GreatestCommonDivisor(SourceSampleRate, DestinationSampleRate);
+		SourceStep = SourceSampleRate / Divisor;
+		DestinationStep = DestinationSampleRate / Divisor;
+
+		int32 BaseNumOfTaps;
+		double RollOff;
+		double KaiserBeta;
+		switch (Quality)
+		{
+		case ERAW_ResamplerQuality::Fast:
+			BaseNumOfTaps = 8; NumOfPhases = 64; RollOff = 0.85; KaiserBeta = 5.;
+			break;
+		case ERAW_ResamplerQuality::Best:
+			BaseNumOfTaps = 32; NumOfPhases = 256; RollOff = 0.94; KaiserBeta = 9.;
+			break;
+		case ERAW_ResamplerQuality::Balanced:
+		default:
+			BaseNumOfTaps = 16; NumOfPhases = 128; RollOff = 0.9; KaiserBeta = 7.;
+			break;
+		}
+
+		// When downsampling, the cutoff moves down and the filter has to get proportionally longer to keep its steepness
+		const double Ratio = FMath::Min(1., static_cast<double>(DestinationStep) / SourceStep);
+		NumOfTaps = Align(FMath::CeilToInt32(BaseNumOfTaps / Ratio), 4);
+		BuildFilterTable(Ratio * RollOff, KaiserBeta);
+
+		PhaseCoefficients.SetNumZeroed(NumOfTaps);
+		PlanarBuffers.SetNum(NumOfChannels);
+		Reset();
+	}
+
+	/** @return True if the resampler was created with valid parameters. */
+	bool IsValid() const
+	{
+		return NumOfTaps > 0;
+	}
+
+	/**
+	 * @param NumOfInputFrames Total number of input frames of a stream.
+	 * @return Total number of frames the stream resamples to, including the frames returned by Flush.
+	 */
+	int64 GetNumOfOutputFrames(int64 NumOfInputFrames) const
+	{
+		return (NumOfInputFrames * DestinationStep + SourceStep - 1) / SourceStep;
+	}
+
+	/**
+	 * @param NumOfInputFrames Number of input frames passed to a single Process call.
+	 * @return The maximum number of frames that Process call can output.
+	 */
+	int64 GetMaxNumOfOutputFrames(int64 NumOfInputFrames) const
+	{
+		return NumOfInputFrames * DestinationStep / SourceStep + 2;
+	}
+
+	/** @return The maximum number of frames Flush can output. */
+	int64 GetMaxNumOfFlushFrames() const
+	{
+		return static_cast<int64>(NumOfTaps) * DestinationStep / SourceStep + 2;
+	}
+
+	/**
+	 * Resample the next block of the stream. The last few input frames are kept until more input (or Flush) arrives.
+	 *
+	 * @param In Interleaved input samples.
+	 * @param NumOfInputFrames Number of input frames.
+	 * @param Out Interleaved output samples, must be able to hold GetMaxNumOfOutputFrames(NumOfInputFrames) frames.
+	 *
+	 * @return Number of frames written to Out.
+	 */
+	int64 Process(const float* In, int64 NumOfInputFrames, float* Out)
+	{
+		int64 NumOfWrittenFrames = 0;
+		while (NumOfInputFrames > 0)
+		{
+			// Working in bounded blocks keeps the planar buffers small regardless of the input size
+			const int32 NumOfBlockFrames = static_cast<int32>(FMath::Min<int64>(NumOfInputFrames, MaxBlockFrames));
+			AppendInterleaved(In, NumOfBlockFrames);
+			NumOfWrittenFrames += Produce(Out + NumOfWrittenFrames * NumOfChannels, TNumericLimits<int64>::Max());
+
+			In += static_cast<int64>(NumOfBlockFrames) * NumOfChannels;
+			NumOfInputFrames -= NumOfBlockFrames;
+			NumOfInputFramesTotal += NumOfBlockFrames;
+		}
+		return NumOfWrittenFrames;
+	}
+
+	/**
+	 * Output the frames that are still held back, as if the stream was followed by silence. Reset before reusing.
+	 *
+	 * @param Out Interleaved output samples, must be able to hold GetMaxNumOfFlushFrames() frames.
+	 *
+	 * @return Number of frames written to Out.
+	 */
+	int64 Flush(float* Out)
+	{
+		for (TArray<float>& PlanarBuffer : PlanarBuffers)
+		{
+			PlanarBuffer.AddZeroed(NumOfTaps);
+		}
+		NumOfBufferedFrames += NumOfTaps;
+		return Produce(Out, GetNumOfOutputFrames(NumOfInputFramesTotal) - NumOfOutputFramesTotal);
+	}
+
+	/** Forget the stream, so a new one can be resampled with the same filter. */
+	void Reset()
+	{
+		// The first output frame is centered on the first input frame, the taps before it see silence
+		const int32 NumOfLeadingFrames = NumOfTaps / 2 - 1;
+		for (TArray<float>& PlanarBuffer : PlanarBuffers)
+		{
+			PlanarBuffer.Reset();
+			PlanarBuffer.AddZeroed(NumOfLeadingFrames);
+		}
+		NumOfBufferedFrames = NumOfLeadingFrames;
+		InputPosition = 0;
+		PhaseAccumulator = 0;
+		NumOfInputFramesTotal = 0;
+		NumOfOutputFramesTotal = 0;
+	}
+
+private:
+	static constexpr int32 MaxBlockFrames = 4096;
+
+	static uint32 GreatestCommonDivisor(uint32 A, uint32 B)
+	{
+		while (B != 0)
+		{
+			const uint32 Remainder = A % B;
+			A = B;
+			B = Remainder;
+		}
+		return A;
+	}
+
+	/** Zeroth order modified Bessel function of the first kind, used by the Kaiser window */
+	static double BesselI0(double X)
+	{
+		double Sum = 1.;
+		double Term = 1.;
+		const double HalfXSquared = X * X * 0.25;
+		for (int32 Index = 1; Index < 64 && Term > Sum * 1e-12; ++Index)
+		{
+			Term *= HalfXSquared / (static_cast<double>(Index) * Index);
+			Sum += Term;
+		}
+		return Sum;
+	}
+
+	/** Tabulate the filter for NumOfPhases + 1 fractional positions, each row holds the taps for one position */
+	void BuildFilterTable(double Cutoff, double KaiserBeta)
+	{
+		const double HalfLength = NumOfTaps / 2;
+		const double WindowNormalization = 1. / BesselI0(KaiserBeta);
+
+		FilterTable.SetNumUninitialized((NumOfPhases + 1) * NumOfTaps);
+		for (int32 PhaseIndex = 0; PhaseIndex <= NumOfPhases; ++PhaseIndex)
+		{
+			const double Fraction = static_cast<double>(PhaseIndex) / NumOfPhases;
+			float* Row = FilterTable.GetData() + PhaseIndex * NumOfTaps;
+
+			double RowSum = 0.;
+			for (int32 TapIndex = 0; TapIndex < NumOfTaps; ++TapIndex)
+			{
+				// Distance between the output time and the input frame this tap is applied to
+				const double Distance = Fraction + HalfLength - 1. - TapIndex;
+				const double WindowPosition = Distance / HalfLength;
+				double Coefficient = 0.;
+				if (FMath::Abs(WindowPosition) < 1.)
+				{
+					const double SincArgument = UE_DOUBLE_PI * Cutoff * Distance;
+					const double Sinc = FMath::Abs(SincArgument) < 1e-9 ? 1. : FMath::Sin(SincArgument) / SincArgument;
+					const double Window = BesselI0(KaiserBeta * FMath::Sqrt(1. - WindowPosition * WindowPosition)) * WindowNormalization;
+					Coefficient = Cutoff * Sinc * Window;
+				}
+				Row[TapIndex] = static_cast<float>(Coefficient);
+				RowSum += Coefficient;
+			}
+
+			// Unity gain at DC for every phase, otherwise the phase pattern shows up as a low level tone
+			const float RowScale = RowSum != 0. ? static_cast<float>(1. / RowSum) : 1.f;
+			for (int32 TapIndex = 0; TapIndex < NumOfTaps; ++TapIndex)
+			{
+				Row[TapIndex] *= RowScale;
+			}
+		}
+	}
+
+	void AppendInterleaved(const float* In, int32 NumOfFrames)
+	{
+		for (uint32 ChannelIndex = 0; ChannelIndex < NumOfChannels; ++ChannelIndex)
+		{
+			TArray<float>& PlanarBuffer = PlanarBuffers[ChannelIndex];
+			const int32 WriteOffset = PlanarBuffer.Num();
+			PlanarBuffer.AddUninitialized(NumOfFrames);
+			float* Destination = PlanarBuffer.GetData() + WriteOffset;
+			const float* Source = In + ChannelIndex;
+			for (int32 FrameIndex = 0; FrameIndex < NumOfFrames; ++FrameIndex)
+			{
+				Destination[FrameIndex] = *Source;
+				Source += NumOfChannels;
+			}
+		}
+		NumOfBufferedFrames += NumOfFrames;
+	}
+
+	/** Output every frame whose taps are all buffered (up to MaxNumOfFrames), then drop the input that isn't needed anymore */
+	int64 Produce(float* Out, int64 MaxNumOfFrames)
+	{
+		int64 NumOfWrittenFrames = 0;
+		while (NumOfWrittenFrames < MaxNumOfFrames && InputPosition + NumOfTaps <= NumOfBufferedFrames)
+		{
+			InterpolatePhase();
+			for (uint32 ChannelIndex = 0; ChannelIndex < NumOfChannels; ++ChannelIndex)
+			{
+				*Out++ = DotProduct(PlanarBuffers[ChannelIndex].GetData() + InputPosition, PhaseCoefficients.GetData(), NumOfTaps);
+			}
+			++NumOfWrittenFrames;
+
+			PhaseAccumulator += SourceStep;
+			InputPosition += PhaseAccumulator / DestinationStep;
+			PhaseAccumulator %= DestinationStep;
+		}
+		NumOfOutputFramesTotal += NumOfWrittenFrames;
+
+		const int32 NumOfConsumedFrames = static_cast<int32>(FMath::Min<int64>(InputPosition, NumOfBufferedFrames));
+		if (NumOfConsumedFrames > 0)
+		{
+			for (TArray<float>& PlanarBuffer : PlanarBuffers)
+			{
+				PlanarBuffer.RemoveAt(0, NumOfConsumedFrames, EAllowShrinking::No);
+			}
+			NumOfBufferedFrames -= NumOfConsumedFrames;
+			InputPosition -= NumOfConsumedFrames;
+		}
+		return NumOfWrittenFrames;
+	}
+
+	/** Blend the two tabulated phases around the current fractional position into PhaseCoefficients */
+	void InterpolatePhase()
+	{
+		const double PhasePosition = static_cast<double>(PhaseAccumulator) * NumOfPhases / DestinationStep;
+		const int32 PhaseIndex = FMath::Min(static_cast<int32>(PhasePosition), NumOfPhases - 1);
+		const float Alpha = static_cast<float>(PhasePosition - PhaseIndex);
+		const float* Lower = FilterTable.GetData() + PhaseIndex * NumOfTaps;
+		const float* Upper = Lower + NumOfTaps;
+		float* Destination = PhaseCoefficients.GetData();
+
+		int32 TapIndex = 0;
+#if RAI_TRANSCODE_SSE
+		const __m128 AlphaVector = _mm_set1_ps(Alpha);
+		for (; TapIndex < NumOfTaps; TapIndex += 4)
+		{
+			const __m128 LowerVector = _mm_loadu_ps(Lower + TapIndex);
+			const __m128 UpperVector = _mm_loadu_ps(Upper + TapIndex);
+			_mm_storeu_ps(Destination + TapIndex, _mm_add_ps(LowerVector, _mm_mul_ps(AlphaVector, _mm_sub_ps(UpperVector, LowerVector))));
+		}
+#elif RAI_TRANSCODE_NEON
+		for (; TapIndex < NumOfTaps; TapIndex += 4)
+		{
+			const float32x4_t LowerVector = vld1q_f32(Lower + TapIndex);
+			const float32x4_t UpperVector = vld1q_f32(Upper + TapIndex);
+			vst1q_f32(Destination + TapIndex, vmlaq_n_f32(LowerVector, vsubq_f32(UpperVector, LowerVector), Alpha));
+		}
+#endif
+		for (; TapIndex < NumOfTaps; ++TapIndex)
+		{
+			Destination[TapIndex] = Lower[TapIndex] + Alpha * (Upper[TapIndex] - Lower[TapIndex]);
+		}
+	}
+
+	/** Dot product of two unaligned arrays, Num must be a multiple of 4 */
+	static float DotProduct(const float* A, const float* B, int32 Num)
+	{
+#if RAI_TRANSCODE_SSE
+		__m128 Sum = _mm_setzero_ps();
+		for (int32 Index = 0; Index < Num; Index += 4)
+		{
+			Sum = _mm_add_ps(Sum, _mm_mul_ps(_mm_loadu_ps(A + Index), _mm_loadu_ps(B + Index)));
+		}
+		Sum = _mm_add_ps(Sum, _mm_movehl_ps(Sum, Sum));
+		Sum = _mm_add_ss(Sum, _mm_shuffle_ps(Sum, Sum, 1));
+		return _mm_cvtss_f32(Sum);
+#elif RAI_TRANSCODE_NEON
+		float32x4_t Sum = vdupq_n_f32(0.f);
+		for (int32 Index = 0; Index < Num; Index += 4)
+		{
+			Sum = vmlaq_f32(Sum, vld1q_f32(A + Index), vld1q_f32(B + Index));
+		}
+		return vaddvq_f32(Sum);
+#else
+		float Sum = 0.f;
+		for (int32 Index = 0; Index < Num; ++Index)
+		{
+			Sum += A[Index] * B[Index];
+		}
+		return Sum;
+#endif
+	}
+
+	uint32 NumOfChannels = 0;
+	uint32 SourceStep = 1;
+	uint32 DestinationStep = 1;
+	int32 NumOfTaps = 0;
+	int32 NumOfPhases = 0;
+
+	/** (NumOfPhases + 1) rows of NumOfTaps coefficients */
+	TArray<float> FilterTable;
+	TArray<float> PhaseCoefficients;
+
+	/** Deinterleaved input that is still needed, one buffer per channel */
+	TArray<TArray<float>> PlanarBuffers;
+	int32 NumOfBufferedFrames = 0;
+
+	/** Index in the planar buffers of the first tap of the next output frame */
+	int64 InputPosition = 0;
+
+	/** Fractional part of the input position, in units of 1 / DestinationStep */
+	uint32 PhaseAccumulator = 0;
+
+	int64 NumOfInputFramesTotal = 0;
+	int64 NumOfOutputFramesTotal = 0;
+};
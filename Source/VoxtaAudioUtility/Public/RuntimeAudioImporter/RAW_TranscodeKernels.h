@@ -0,0 +1,363 @@
+// Georgy Treshchev 2024.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include <type_traits>
+#include <limits>
+
+#if PLATFORM_ENABLE_VECTORINTRINSICS_NEON && PLATFORM_CPU_ARM_FAMILY && PLATFORM_64BITS
+	#define RAI_TRANSCODE_NEON 1
+	#define RAI_TRANSCODE_SSE 0
+	#include <arm_neon.h>
+#elif PLATFORM_ENABLE_VECTORINTRINSICS && PLATFORM_CPU_X86_FAMILY
+	#define RAI_TRANSCODE_NEON 0
+	#define RAI_TRANSCODE_SSE 1
+	#include <emmintrin.h>
+#else
+	#define RAI_TRANSCODE_NEON 0
+	#define RAI_TRANSCODE_SSE 0
+#endif
+
+/**
+ * Representable range of a RAW sample type, resolved at compile time
+ * Integer types use their full numeric range, floating point samples are normalized to [-1, 1]
+ */
+template <typename SampleType>
+struct TRAWSampleRange
+{
+	static_assert(std::is_integral_v<SampleType>, "Unsupported RAW format");
+	static constexpr double Min = static_cast<double>((std::numeric_limits<SampleType>::min)());
+	static constexpr double Max = static_cast<double>((std::numeric_limits<SampleType>::max)());
+};
+
+template <>
+struct TRAWSampleRange<float>
+{
+	static constexpr double Min = -1.;
+	static constexpr double Max = 1.;
+};
+
+namespace RAWTranscodeSIMD
+{
+	/** Whether a sample type can be widened into 32-bit integer or float lanes without loss */
+	template <typename SampleType>
+	constexpr bool IsVectorizable()
+	{
+		return std::is_same_v<SampleType, int8> || std::is_same_v<SampleType, uint8>
+			|| std::is_same_v<SampleType, int16> || std::is_same_v<SampleType, uint16>
+			|| std::is_same_v<SampleType, int32> || std::is_same_v<SampleType, float>;
+	}
+
+#if RAI_TRANSCODE_SSE
+	using FDoubleVector = __m128d;
+
+	FORCEINLINE FDoubleVector Splat(double Value) { return _mm_set1_pd(Value); }
+	FORCEINLINE FDoubleVector Add(FDoubleVector A, FDoubleVector B) { return _mm_add_pd(A, B); }
+	FORCEINLINE FDoubleVector Sub(FDoubleVector A, FDoubleVector B) { return _mm_sub_pd(A, B); }
+	FORCEINLINE FDoubleVector Mul(FDoubleVector A, FDoubleVector B) { return _mm_mul_pd(A, B); }
+	FORCEINLINE FDoubleVector Div(FDoubleVector A, FDoubleVector B) { return _mm_div_pd(A, B); }
+
+	/** Same as FMath::Clamp, so NaN ends up at MaxValue like in the scalar path (a plain min/max would give MinValue) */
+	FORCEINLINE FDoubleVector Clamp(FDoubleVector Value, FDoubleVector MinValue, FDoubleVector MaxValue)
+	{
+		const __m128d BelowMin = _mm_cmplt_pd(Value, MinValue);
+		const __m128d BelowMax = _mm_cmplt_pd(Value, MaxValue);
+		const __m128d Upper = _mm_or_pd(_mm_and_pd(BelowMax, Value), _mm_andnot_pd(BelowMax, MaxValue));
+		return _mm_or_pd(_mm_and_pd(BelowMin, MinValue), _mm_andnot_pd(BelowMin, Upper));
+	}
+
+	/** Load 4 integer samples and sign- or zero-extend them into 32-bit lanes */
+	template <typename SampleType>
+	FORCEINLINE __m128i LoadWidened4(const SampleType* In)
+	{
+		if constexpr (std::is_same_v<SampleType, int32>)
+		{
+			return _mm_loadu_si128(reinterpret_cast<const __m128i*>(In));
+		}
+		else if constexpr (sizeof(SampleType) == 2)
+		{
+			const __m128i Samples = _mm_loadl_epi64(reinterpret_cast<const __m128i*>(In));
+			// Signed samples are placed in the upper half and shifted back arithmetically (SSE2 has no cvtepi16)
+			return std::is_signed_v<SampleType>
+				? _mm_srai_epi32(_mm_unpacklo_epi16(Samples, Samples), 16)
+				: _mm_unpacklo_epi16(Samples, _mm_setzero_si128());
+		}
+		else
+		{
+			const __m128i Samples = _mm_cvtsi32_si128(FPlatformMemory::ReadUnaligned<int32>(In));
+			return std::is_signed_v<SampleType>
+				? _mm_srai_epi32(_mm_unpacklo_epi16(_mm_unpacklo_epi8(Samples, Samples), _mm_unpacklo_epi8(Samples, Samples)), 24)
+				: _mm_unpacklo_epi16(_mm_unpacklo_epi8(Samples, _mm_setzero_si128()), _mm_setzero_si128());
+		}
+	}
+
+	/** Load 4 samples and widen them into two vectors of 2 doubles each */
+	template <typename SampleType>
+	FORCEINLINE void Load4(const SampleType* In, FDoubleVector& OutLow, FDoubleVector& OutHigh)
+	{
+		if constexpr (std::is_same_v<SampleType, float>)
+		{
+			const __m128 Samples = _mm_loadu_ps(In);
+			OutLow = _mm_cvtps_pd(Samples);
+			OutHigh = _mm_cvtps_pd(_mm_movehl_ps(Samples, Samples));
+		}
+		else
+		{
+			const __m128i Samples = LoadWidened4(In);
+			OutLow = _mm_cvtepi32_pd(Samples);
+			OutHigh = _mm_cvtepi32_pd(_mm_shuffle_epi32(Samples, _MM_SHUFFLE(1, 0, 3, 2)));
+		}
+	}
+
+	/** Narrow two vectors of 2 doubles into 4 samples. Integer targets are truncated toward zero like static_cast */
+	template <typename SampleType>
+	FORCEINLINE void Store4(FDoubleVector Low, FDoubleVector High, SampleType* Out)
+	{
+		if constexpr (std::is_same_v<SampleType, float>)
+		{
+			_mm_storeu_ps(Out, _mm_movelh_ps(_mm_cvtpd_ps(Low), _mm_cvtpd_ps(High)));
+		}
+		else
+		{
+			const __m128i Samples = _mm_unpacklo_epi64(_mm_cvttpd_epi32(Low), _mm_cvttpd_epi32(High));
+			if constexpr (std::is_same_v<SampleType, int32>)
+			{
+				_mm_storeu_si128(reinterpret_cast<__m128i*>(Out), Samples);
+			}
+			else
+			{
+				alignas(16) int32 Widened[4];
+				_mm_store_si128(reinterpret_cast<__m128i*>(Widened), Samples);
+				Out[0] = static_cast<SampleType>(Widened[0]);
+				Out[1] = static_cast<SampleType>(Widened[1]);
+				Out[2] = static_cast<SampleType>(Widened[2]);
+				Out[3] = static_cast<SampleType>(Widened[3]);
+			}
+		}
+	}
+#elif RAI_TRANSCODE_NEON
+	using FDoubleVector = float64x2_t;
+
+	FORCEINLINE FDoubleVector Splat(double Value) { return vdupq_n_f64(Value); }
+	FORCEINLINE FDoubleVector Add(FDoubleVector A, FDoubleVector B) { return vaddq_f64(A, B); }
+	FORCEINLINE FDoubleVector Sub(FDoubleVector A, FDoubleVector B) { return vsubq_f64(A, B); }
+	FORCEINLINE FDoubleVector Mul(FDoubleVector A, FDoubleVector B) { return vmulq_f64(A, B); }
+	FORCEINLINE FDoubleVector Div(FDoubleVector A, FDoubleVector B) { return vdivq_f64(A, B); }
+
+	/** Same as FMath::Clamp, so NaN ends up at MaxValue like in the scalar path (a plain min/max would give MinValue) */
+	FORCEINLINE FDoubleVector Clamp(FDoubleVector Value, FDoubleVector MinValue, FDoubleVector MaxValue)
+	{
+		const FDoubleVector Upper = vbslq_f64(vcltq_f64(Value, MaxValue), Value, MaxValue);
+		return vbslq_f64(vcltq_f64(Value, MinValue), MinValue, Upper);
+	}
+
+	/** Load 4 integer samples and sign- or zero-extend them into 32-bit lanes */
+	template <typename SampleType>
+	FORCEINLINE int32x4_t LoadWidened4(const SampleType* In)
+	{
+		if constexpr (std::is_same_v<SampleType, int32>)
+		{
+			return vld1q_s32(In);
+		}
+		else if constexpr (std::is_same_v<SampleType, int16>)
+		{
+			return vmovl_s16(vld1_s16(In));
+		}
+		else if constexpr (std::is_same_v<SampleType, uint16>)
+		{
+			return vreinterpretq_s32_u32(vmovl_u16(vld1_u16(In)));
+		}
+		else if constexpr (std::is_same_v<SampleType, int8>)
+		{
+			// Only 4 bytes are loaded, a full 8-byte vld1 could read past the end of the buffer
+			const int8x8_t Samples = vcreate_s8(FPlatformMemory::ReadUnaligned<uint32>(In));
+			return vmovl_s16(vget_low_s16(vmovl_s8(Samples)));
+		}
+		else
+		{
+			const uint8x8_t Samples = vcreate_u8(FPlatformMemory::ReadUnaligned<uint32>(In));
+			return vreinterpretq_s32_u32(vmovl_u16(vget_low_u16(vmovl_u8(Samples))));
+		}
+	}
+
+	/** Load 4 samples and widen them into two vectors of 2 doubles each */
+	template <typename SampleType>
+	FORCEINLINE void Load4(const SampleType* In, FDoubleVector& OutLow, FDoubleVector& OutHigh)
+	{
+		if constexpr (std::is_same_v<SampleType, float>)
+		{
+			const float32x4_t Samples = vld1q_f32(In);
+			OutLow = vcvt_f64_f32(vget_low_f32(Samples));
+			OutHigh = vcvt_high_f64_f32(Samples);
+		}
+		else
+		{
+			const int32x4_t Samples = LoadWidened4(In);
+			OutLow = vcvtq_f64_s64(vmovl_s32(vget_low_s32(Samples)));
+			OutHigh = vcvtq_f64_s64(vmovl_high_s32(Samples));
+		}
+	}
+
+	/** Narrow two vectors of 2 doubles into 4 samples. Integer targets are truncated toward zero like static_cast */
+	template <typename SampleType>
+	FORCEINLINE void Store4(FDoubleVector Low, FDoubleVector High, SampleType* Out)
+	{
+		if constexpr (std::is_same_v<SampleType, float>)
+		{
+			vst1q_f32(Out, vcombine_f32(vcvt_f32_f64(Low), vcvt_f32_f64(High)));
+		}
+		else
+		{
+			const int32x4_t Samples = vcombine_s32(vmovn_s64(vcvtq_s64_f64(Low)), vmovn_s64(vcvtq_s64_f64(High)));
+			if constexpr (std::is_same_v<SampleType, int32>)
+			{
+				vst1q_s32(Out, Samples);
+			}
+			else
+			{
+				int32 Widened[4];
+				vst1q_s32(Widened, Samples);
+				Out[0] = static_cast<SampleType>(Widened[0]);
+				Out[1] = static_cast<SampleType>(Widened[1]);
+				Out[2] = static_cast<SampleType>(Widened[2]);
+				Out[3] = static_cast<SampleType>(Widened[3]);
+			}
+		}
+	}
+#endif
+}
+
+/**
+ * Compile-time specialized transcoder between two RAW sample types
+ *
+ * The mapping is the one FMath::GetMappedRangeValueClamped applies with double precision: the source sample is mapped
+ * linearly from the source range onto the destination range, clamped to it, and converted with static_cast semantics
+ * (round-to-nearest for float targets, truncation toward zero for integer targets).
+ * The SIMD kernels follow the exact same sequence of IEEE operations and clamp the same way, so their output is
+ * bit-identical to the scalar path, also for NaN and infinite float samples.
+ *
+ * @tparam FromType The source sample type
+ * @tparam ToType The destination sample type
+ */
+template <typename FromType, typename ToType>
+struct TRAWTranscoder
+{
+	static constexpr double FromMin = TRAWSampleRange<FromType>::Min;
+	static constexpr double FromRange = TRAWSampleRange<FromType>::Max - TRAWSampleRange<FromType>::Min;
+	static constexpr double ToMin = TRAWSampleRange<ToType>::Min;
+	static constexpr double ToRange = TRAWSampleRange<ToType>::Max - TRAWSampleRange<ToType>::Min;
+
+	/**
+	 * Transcode a single sample
+	 */
+	static FORCEINLINE ToType TranscodeSample(FromType Sample)
+	{
+		const double Alpha = FMath::Clamp((static_cast<double>(Sample) - FromMin) / FromRange, 0., 1.);
+		return static_cast<ToType>(ToMin + Alpha * ToRange);
+	}
+
+	/**
+	 * Transcode a buffer of samples
+	 *
+	 * @param In Source samples
+	 * @param NumOfSamples Number of samples to transcode
+	 * @param Out Destination samples, must be able to hold NumOfSamples elements. Does not have to be aligned
+	 */
+	static void Transcode(const FromType* In, int64 NumOfSamples, ToType* Out)
+	{
+		if constexpr (std::is_same_v<FromType, ToType>)
+		{
+			FMemory::Memcpy(Out, In, NumOfSamples * sizeof(FromType));
+			return;
+		}
+
+		int64 SampleIndex = 0;
+
+#if RAI_TRANSCODE_SSE || RAI_TRANSCODE_NEON
+		if constexpr (RAWTranscodeSIMD::IsVectorizable<FromType>() && RAWTranscodeSIMD::IsVectorizable<ToType>())
+		{
+			using namespace RAWTranscodeSIMD;
+			const FDoubleVector FromMinVector = Splat(FromMin);
+			const FDoubleVector FromRangeVector = Splat(FromRange);
+			const FDoubleVector ToMinVector = Splat(ToMin);
+			const FDoubleVector ToRangeVector = Splat(ToRange);
+			const FDoubleVector Zero = Splat(0.);
+			const FDoubleVector One = Splat(1.);
+
+			auto Map = [&] (FDoubleVector Samples)
+				{
+					const FDoubleVector Alpha = Clamp(Div(Sub(Samples, FromMinVector), FromRangeVector), Zero, One);
+					return Add(ToMinVector, Mul(Alpha, ToRangeVector));
+				};
+
+			for (; SampleIndex + 4 <= NumOfSamples; SampleIndex += 4)
+			{
+				FDoubleVector Low, High;
+				Load4(In + SampleIndex, Low, High);
+				Store4(Map(Low), Map(High), Out + SampleIndex);
+			}
+		}
+#endif
+
+		for (; SampleIndex < NumOfSamples; ++SampleIndex)
+		{
+			Out[SampleIndex] = TranscodeSample(In[SampleIndex]);
+		}
+	}
+};
+
+/**
+ * Low-level sample conversion kernels used on hot paths (e.g. the render callback of the imported sound wave).
+ * Every kernel has a SIMD implementation (SSE2 or NEON) and a scalar fallback producing bit-identical results.
+ */
+class FRAW_TranscodeKernels
+{
+public:
+	/** Scale used to convert signed 16-bit samples to float, identical to the one used by dr_wav */
+	static constexpr float Int16ToFloatScale = 1.f / 32768.f;
+
+	/**
+	 * Convert signed 16-bit samples to 32-bit float samples in the [-1, 1) range
+	 *
+	 * @note This is the decoder convention (x / 32768), not the range mapping of TRAWTranscoder
+	 * @param In Source samples
+	 * @param Out Destination samples, must be able to hold NumOfSamples elements. Does not have to be aligned
+	 * @param NumOfSamples Number of samples to convert
+	 */
+	static void ConvertInt16ToFloat(const int16* In, float* Out, int64 NumOfSamples)
+	{
+		int64 SampleIndex = 0;
+
+#if RAI_TRANSCODE_SSE
+		const __m128 Scale = _mm_set1_ps(Int16ToFloatScale);
+		for (; SampleIndex + 8 <= NumOfSamples; SampleIndex += 8)
+		{
+			const __m128i Samples = _mm_loadu_si128(reinterpret_cast<const __m128i*>(In + SampleIndex));
+
+			// Sign-extending to 32 bits by placing each sample in the upper half and shifting it back arithmetically
+			const __m128i Low = _mm_srai_epi32(_mm_unpacklo_epi16(Samples, Samples), 16);
+			const __m128i High = _mm_srai_epi32(_mm_unpackhi_epi16(Samples, Samples), 16);
+
+			_mm_storeu_ps(Out + SampleIndex, _mm_mul_ps(_mm_cvtepi32_ps(Low), Scale));
+			_mm_storeu_ps(Out + SampleIndex + 4, _mm_mul_ps(_mm_cvtepi32_ps(High), Scale));
+		}
+#elif RAI_TRANSCODE_NEON
+		for (; SampleIndex + 8 <= NumOfSamples; SampleIndex += 8)
+		{
+			const int16x8_t Samples = vld1q_s16(In + SampleIndex);
+
+			const float32x4_t Low = vcvtq_f32_s32(vmovl_s16(vget_low_s16(Samples)));
+			const float32x4_t High = vcvtq_f32_s32(vmovl_s16(vget_high_s16(Samples)));
+
+			vst1q_f32(Out + SampleIndex, vmulq_n_f32(Low, Int16ToFloatScale));
+			vst1q_f32(Out + SampleIndex + 4, vmulq_n_f32(High, Int16ToFloatScale));
+		}
+#endif
+
+		for (; SampleIndex < NumOfSamples; ++SampleIndex)
+		{
+			Out[SampleIndex] = static_cast<float>(In[SampleIndex]) * Int16ToFloatScale;
+		}
+	}
+};
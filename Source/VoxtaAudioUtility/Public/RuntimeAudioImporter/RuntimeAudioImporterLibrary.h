@@ -6,6 +6,7 @@
 #include "AudioStructs.h"
 
 class UImportedSoundWave;
+class FLazyPCMSource;
 
 /**
  * Utility class for importing, decoding, resampling, and mixing audio data at runtime.
@@ -24,28 +25,40 @@ public:
 	static void ImportAudioFromBuffer(TArray64<uint8> buffer, TFunction<void(UImportedSoundWave*)> callback);
 
 	/**
-	 * Resamples and mixes the channels of decoded audio data.
+	 * Imports audio data from shared bytes asynchronously, without copying them.
+	 * The decoder reads the bytes in place while holding its own reference, other consumers can keep using them.
 	 *
-	 * @param DecodedAudioInfo The decoded audio information to process.
-	 * @param NewSampleRate The desired sample rate.
-	 * @param NewNumOfChannels The desired number of channels.
-	 * 
-	 * @return True if successful, false otherwise.
+	 * @param audioData The shared audio data to import. Must not be null.
+	 * @param audioFormat The format of the audio data, or Auto to detect it from the data itself.
+	 * @param callback Callback function to invoke with the resulting `UImportedSoundWave*` on the game thread.
+	 * @param onDecoded Optional callback invoked on the background thread with the decoded audio, before it is moved
+	 * into the sound wave (e.g. to cache it). Without it, the audio is decoded lazily while playing if voxta.Audio.LazyDecode is enabled.
 	 */
-	static bool ResampleAndMixChannelsInDecodedInfo(FDecodedAudioStruct& DecodedAudioInfo, uint32 NewSampleRate, uint32 NewNumOfChannels);
+	static void ImportAudioFromBuffer(FSharedAudioBytes audioData, ERuntimeAudioFormat audioFormat,
+		TFunction<void(UImportedSoundWave*)> callback, TFunction<void(const FDecodedAudioStruct&)> onDecoded = nullptr);
 
-private:
 	/**
 	 * Imports audio from decoded audio information on the game thread.
 	 *
 	 * @param DecodedAudioInfo The decoded audio information. Ownership is transferred via move semantics; must be passed as an rvalue (`MoveTemp`).
 	 * @param callback Callback function to invoke with the resulting `UImportedSoundWave*` on the game thread.
 	 */
-
 	static void ImportAudioFromDecodedInfo(FDecodedAudioStruct&& DecodedAudioInfo, TFunction<void(UImportedSoundWave*)> callback);
 
+	/**
+	 * Resamples and mixes the channels of decoded audio data.
+	 *
+	 * @param DecodedAudioInfo The decoded audio information to process.
+	 * @param NewSampleRate The desired sample rate.
+	 * @param NewNumOfChannels The desired number of channels.
+	 * 
+	 * @return True if successful, false otherwise.
+	 */
+	static bool ResampleAndMixChannelsInDecodedInfo(FDecodedAudioStruct& DecodedAudioInfo, uint32 NewSampleRate, uint32 NewNumOfChannels);
+
 	/**
 	 * Decodes encoded audio data into a decoded audio structure.
+	 * If no preferred sample rate is set, codecs that can decode to any rate use the rate of the audio mixer.
 	 *
 	 * @param EncodedAudioInfo The encoded audio information.
 	 * @param DecodedAudioInfo The output decoded audio information.
@@ -53,4 +66,80 @@ private:
 	 * @return True if decoding was successful, false otherwise.
 	 */
 	static bool DecodeAudioData(FEncodedAudioStruct&& EncodedAudioInfo, FDecodedAudioStruct& DecodedAudioInfo);
+
+	/**
+	 * Retrieves the MIME content types of all available codecs, in order of preference.
+	 *
+	 * @return The content types, e.g. to advertise which audio formats are accepted.
+	 */
+	static TArray<FString> GetSupportedContentTypes();
+
+	/**
+	 * Maps a MIME content type (e.g. of a http response) to the matching audio format.
+	 *
+	 * @param contentType The content type, parameters such as 'codecs' are taken into account.
+	 * 
+	 * @return The audio format, or Auto if the content type is unknown or ambiguous (e.g. plain 'audio/ogg').
+	 */
+	static ERuntimeAudioFormat GetAudioFormatFromContentType(const FString& contentType);
+
+	/**
+	 * Encodes decoded audio as a 16-bit PCM WAV file, for consumers that only understand WAV (e.g. lipsync generators).
+	 *
+	 * @param DecodedAudioInfo The decoded audio information.
+	 * @param OutWavData The resulting WAV file bytes.
+	 * 
+	 * @return True if successful, false otherwise.
+	 */
+	static bool EncodeWavPCM16(const FDecodedAudioStruct& DecodedAudioInfo, TArray<uint8>& OutWavData);
+
+	/**
+	 * Whether imported audio is decoded lazily while playing (voxta.Audio.LazyDecode) when no decoded copy is requested.
+	 *
+	 * @return True if lazy decoding is enabled.
+	 */
+	static bool IsLazyDecodeEnabled();
+
+	/**
+	 * Resets a sound wave that was imported by this library and returns it to the VoxtaObjectPool, the next import
+	 * reuses it instead of creating a new sound wave. Must be called on the game thread, once the sound wave is no
+	 * longer played.
+	 *
+	 * @param ImportedSoundWave The sound wave to recycle, it must not be used anymore afterwards.
+	 */
+	static void RecycleImportedSoundWave(UImportedSoundWave* ImportedSoundWave);
+
+	/**
+	 * Creates pooled sound waves up front, so the first imports don't pay for creating them. Game thread only.
+	 *
+	 * @param NumOfSoundWaves The number of free sound waves the pool should have afterwards.
+	 */
+	static void PrewarmImportedSoundWaves(int32 NumOfSoundWaves);
+
+private:
+	/**
+	 * Retrieves the sample rate of the audio mixer. Queried on the game thread, the last known value is used elsewhere.
+	 *
+	 * @return The sample rate, or 0 if it is not known (yet).
+	 */
+	static uint32 GetMixerSampleRate();
+
+	/**
+	 * Creates a primed lazy PCM source for the encoded audio, if its codec supports decoding on demand.
+	 *
+	 * @param EncodedAudioInfo The encoded audio information, the format is updated if it was detected from the data.
+	 *
+	 * @return The lazy PCM source, or nullptr if the audio has to be decoded up front.
+	 */
+	static TSharedPtr<FLazyPCMSource, ESPMode::ThreadSafe> CreateLazyPCMSource(FEncodedAudioStruct& EncodedAudioInfo);
+
+	/**
+	 * Creates a sound wave that decodes its audio from the lazy PCM source while playing, on the game thread.
+	 *
+	 * @param LazyPCMSource The primed lazy PCM source.
+	 * @param AudioFormat The format of the encoded audio.
+	 * @param callback Callback function to invoke with the resulting `UImportedSoundWave*` on the game thread.
+	 */
+	static void ImportAudioFromLazySource(TSharedRef<FLazyPCMSource, ESPMode::ThreadSafe> LazyPCMSource, ERuntimeAudioFormat AudioFormat,
+		TFunction<void(UImportedSoundWave*)> callback);
 };
@@ -0,0 +1,260 @@
+// Copyright(c) 2024 grrimgrriefer & DZnnah, see LICENSE for details.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Async/Future.h"
+#include "Containers/List.h"
+#include "RuntimeAudioImporter/AudioStructs.h"
+#include "WavChunkWalker.h"
+
+/**
+ * FVoiceLineCacheEntry
+ * Immutable snapshot of a cached voiceline: the decoded PCM plus any lipsync data that was generated for it.
+ * Copying an entry only copies references, the PCM and payloads themselves are shared.
+ */
+struct FVoiceLineCacheEntry
+{
+	/** Hash of the encoded audio bytes (see VoiceLineCache::HashContent). */
+	uint64 ContentHash = 0;
+
+	/** The decoded audio, null if only lipsync data has been stored so far. */
+	TSharedPtr<const FDecodedAudioStruct, ESPMode::ThreadSafe> DecodedAudio;
+
+	/**
+	 * Serialized lipsync data, keyed by lipsync kind (the value of the LipSyncType of the generator).
+	 * The cache doesn't interpret the bytes, the generators own the format.
+	 */
+	TMap<uint8, FSharedAudioBytes> LipSyncPayloads;
+
+	/**
+	 * @param lipSyncKind The lipsync kind to check, 0 (LipSyncType::None) never needs a payload.
+	 * @return True if the entry has everything needed to play back with the given lipsync kind.
+	 */
+	bool HasLipSync(uint8 lipSyncKind) const
+	{
+		return lipSyncKind == 0 || LipSyncPayloads.Contains(lipSyncKind);
+	}
+
+	/** @return The payload for the given lipsync kind, or null if none was stored. */
+	FSharedAudioBytes GetLipSyncPayload(uint8 lipSyncKind) const
+	{
+		const FSharedAudioBytes* payload = LipSyncPayloads.Find(lipSyncKind);
+		return payload ? *payload : nullptr;
+	}
+
+	/** @return The number of bytes held by the PCM data and the lipsync payloads. */
+	int64 GetAllocatedSize() const;
+};
+
+/**
+ * FVoiceLineCacheStats
+ * Counters of the VoiceLineCache since startup (or the last Clear), for profiling and the dump console command.
+ */
+struct FVoiceLineCacheStats
+{
+	int64 MemoryHits = 0;
+	int64 DiskHits = 0;
+	int64 Misses = 0;
+	int64 MemoryEvictions = 0;
+	int64 DiskEvictions = 0;
+	int64 MemoryBytes = 0;
+	int64 DiskBytes = 0;
+	int32 MemoryEntries = 0;
+	int32 DiskEntries = 0;
+	int32 UrlAliases = 0;
+};
+
+/**
+ * VoiceLineCache
+ * Process-wide two-tier cache of decoded voicelines, so greetings, barks and repeated lines don't need to be
+ * downloaded, decoded or lipsynced again.
+ *
+ * Tier 1 is an in-memory LRU under a byte budget (voxta.Audio.VoiceLineCache.MemoryBudgetMB). Entries that fall
+ * out of it are spilled on a background thread to a disk store under Saved/Voxta/VoiceLineCache, with its own budget
+ * (voxta.Audio.VoiceLineCache.DiskBudgetMB). Disk entries are read straight into their PCM buffers and promoted to
+ * memory again.
+ *
+ * Entries are keyed by the hash of the encoded audio bytes. Download URLs are registered as aliases of that hash,
+ * so a repeated URL can skip the download as well; aliases only live in memory as URLs are not stable across sessions.
+ *
+ * Use 'voxta.Audio.VoiceLineCache.Dump' to log the contents & stats, 'voxta.Audio.VoiceLineCache.Clear' to empty it.
+ *
+ * Note: All functions are thread-safe. Disk reads happen on the calling thread, but without holding the cache lock.
+ */
+class VOXTAAUDIOUTILITY_API VoiceLineCache
+{
+#pragma region public API
+public:
+	/** @return The process-wide cache instance. */
+	static VoiceLineCache& Get();
+
+	/** @return The key used for the given encoded audio bytes. */
+	static uint64 HashContent(const TArray<uint8>& audioData);
+
+	/** @return True if the cache is enabled (voxta.Audio.VoiceLineCache.Enabled). */
+	static bool IsEnabled();
+
+	/**
+	 * Find a voiceline by the url it was downloaded from. Only counts as a hit if both the decoded audio and the
+	 * requested lipsync data are available, as the encoded audio will not be downloaded anymore after this.
+	 *
+	 * @param url The download url of the voiceline.
+	 * @param lipSyncKind The lipsync kind that is required, 0 if none.
+	 * @param outEntry The cached entry, only valid if true was returned.
+	 *
+	 * @return True if a complete entry was found.
+	 */
+	bool TryFindByUrl(const FString& url, uint8 lipSyncKind, FVoiceLineCacheEntry& outEntry);
+
+	/**
+	 * Find a voiceline by the hash of its encoded bytes. Partial entries are returned too, the caller decides what
+	 * can be skipped.
+	 *
+	 * @param contentHash The hash of the encoded audio bytes.
+	 * @param outEntry The cached entry, only valid if true was returned.
+	 *
+	 * @return True if an entry was found.
+	 */
+	bool TryFindByContentHash(uint64 contentHash, FVoiceLineCacheEntry& outEntry);
+
+	/**
+	 * Register an additional url for an already known content hash.
+	 *
+	 * @param url The download url.
+	 * @param contentHash The hash of the bytes that were downloaded from that url.
+	 */
+	void AddUrlAlias(const FString& url, uint64 contentHash);
+
+	/**
+	 * Store the decoded audio of a voiceline. A copy of the PCM data is kept, the caller keeps ownership of its own.
+	 *
+	 * @param url The download url, can be empty.
+	 * @param contentHash The hash of the encoded audio bytes.
+	 * @param decodedAudio The decoded audio.
+	 */
+	void StoreDecodedAudio(const FString& url, uint64 contentHash, const FDecodedAudioStruct& decodedAudio);
+
+	/**
+	 * Store the serialized lipsync data of a voiceline.
+	 *
+	 * @param contentHash The hash of the encoded audio bytes.
+	 * @param lipSyncKind The lipsync kind of the payload, must not be 0.
+	 * @param payload The serialized lipsync data.
+	 */
+	void StoreLipSync(uint64 contentHash, uint8 lipSyncKind, TArray<uint8>&& payload);
+
+	/** @return A snapshot of the counters. */
+	FVoiceLineCacheStats GetStats() const;
+
+	/**
+	 * Drop all entries and reset the counters.
+	 *
+	 * @param removeDiskEntries Also delete the files of the disk store.
+	 */
+	void Clear(bool removeDiskEntries);
+
+	/** Log the stats and every entry of both tiers. */
+	void DumpToLog() const;
+#pragma endregion
+
+#pragma region data
+private:
+	struct FDiskEntry
+	{
+		int64 FileSize = 0;
+		FDateTime LastAccess;
+	};
+
+	using FLruList = TDoubleLinkedList<uint64>;
+
+	struct FMemoryEntry
+	{
+		TSharedPtr<FVoiceLineCacheEntry, ESPMode::ThreadSafe> Data;
+		/** The node of this entry in m_memoryLruOrder, so it can be moved without searching. */
+		FLruList::TDoubleLinkedListNode* LruNode = nullptr;
+		int64 AllocatedSize = 0;
+		bool bPersisted = false;
+	};
+
+	mutable FCriticalSection m_lock;
+
+	/** Memory tier. */
+	TMap<uint64, FMemoryEntry> m_memoryEntries;
+	/** Hashes of the memory tier, ordered from least to most recently used. */
+	FLruList m_memoryLruOrder;
+	int64 m_memoryBytes = 0;
+
+	TMap<uint64, FDiskEntry> m_diskEntries;
+	/**
+	 * Entries that left the memory tier but are still being written, they can still be promoted back. Only one write
+	 * per hash runs at a time, an entry spilled again meanwhile replaces the value and is written once that one is done.
+	 */
+	TMap<uint64, TSharedPtr<FVoiceLineCacheEntry, ESPMode::ThreadSafe>> m_pendingDiskWrites;
+	/** Entries that are being read from disk, other lookups of the same hash wait for that read instead of repeating it. */
+	TMap<uint64, TSharedFuture<TSharedPtr<FVoiceLineCacheEntry, ESPMode::ThreadSafe>>> m_pendingDiskReads;
+	int64 m_diskBytes = 0;
+	bool m_diskIndexBuilt = false;
+
+	TMap<FString, uint64> m_urlAliases;
+	FVoiceLineCacheStats m_stats;
+#pragma endregion
+
+#pragma region private API
+private:
+	VoiceLineCache() = default;
+
+	/** @return The folder of the disk store. */
+	static FString GetDiskFolder();
+
+	/** @return The file of the disk store that belongs to the given hash. */
+	static FString GetDiskFilePath(uint64 contentHash);
+
+	/** Scan the disk store once, so entries of previous sessions can be found. Must not hold m_lock. */
+	void EnsureDiskIndex();
+
+	/**
+	 * Find an entry in either tier, promoting it to memory if it was only on disk. Must not hold m_lock, the file is
+	 * read without it.
+	 * @return The entry, or null if it's not cached.
+	 */
+	TSharedPtr<FVoiceLineCacheEntry, ESPMode::ThreadSafe> FindAndTouch(uint64 contentHash, bool& outWasOnDisk);
+
+	/** Count a lookup as a memory hit, disk hit or miss. */
+	void RecordLookup(bool isHit, bool wasOnDisk);
+
+	/**
+	 * Insert or replace an entry in memory as most recently used and enforce the memory budget. Must hold m_lock.
+	 * Entries are never modified after insertion, updates insert a modified copy instead.
+	 */
+	void InsertMemoryEntry(const TSharedPtr<FVoiceLineCacheEntry, ESPMode::ThreadSafe>& entry, bool isPersisted);
+
+	/** Evict least recently used memory entries until the budget is met, spilling them to disk. Must hold m_lock. */
+	void EnforceMemoryBudget();
+
+	/** Delete the least recently accessed disk entries until the budget is met. Must hold m_lock. */
+	void EnforceDiskBudget();
+
+	/** Write the entry to the disk store on a background thread. Must hold m_lock. */
+	void SpillToDisk(const TSharedPtr<FVoiceLineCacheEntry, ESPMode::ThreadSafe>& entry);
+
+	/** Start the background write of an entry that was added to m_pendingDiskWrites. */
+	void WriteToDiskAsync(const TSharedPtr<FVoiceLineCacheEntry, ESPMode::ThreadSafe>& entry);
+
+	/** Remove the url aliases that point to the given hash. Must hold m_lock. */
+	void RemoveUrlAliases(uint64 contentHash);
+
+	/**
+	 * Serialize an entry into a single file.
+	 * @return True if the file was written.
+	 */
+	static bool WriteEntryToFile(const FVoiceLineCacheEntry& entry, const FString& filePath, int64& outFileSize);
+
+	/**
+	 * Read an entry from a file, the PCM data and payloads are read straight into their own buffers.
+	 * @return The entry, or null if the file is missing or invalid.
+	 */
+	static TSharedPtr<FVoiceLineCacheEntry, ESPMode::ThreadSafe> ReadEntryFromFile(uint64 contentHash,
+		const FString& filePath);
+#pragma endregion
+};
@@ -0,0 +1,69 @@
+// Copyright(c) 2024 grrimgrriefer & DZnnah, see LICENSE for details.
+
+#pragma once
+
+#include "CoreMinimal.h"
+
+/**
+ * Immutable, refcounted audio bytes that are shared between the downloader, the decoder and the lipsync generators.
+ * Consumers that outlive the caller keep the bytes alive by holding on to their own reference, so nothing is copied.
+ */
+using FSharedAudioBytes = TSharedPtr<const TArray<uint8>, ESPMode::ThreadSafe>;
+
+/**
+ * FWavLayout
+ * Location and format of the sample data inside a RIFF/WAVE buffer, as found by WavChunkWalker.
+ * All offsets are relative to the start of the buffer.
+ */
+struct FWavLayout
+{
+	uint16 FormatTag = 0;
+	uint16 NumChannels = 0;
+	uint32 SampleRate = 0;
+	uint16 BitsPerSample = 0;
+	int64 DataOffset = 0;
+	int64 DataSize = 0;
+};
+
+/**
+ * WavChunkWalker
+ * Stateless helper that walks the chunk list of a RIFF/WAVE buffer directly, in O(#chunks), instead of
+ * scanning byte-by-byte for chunk ids.
+ */
+class VOXTAAUDIOUTILITY_API WavChunkWalker
+{
+#pragma region public API
+public:
+	/**
+	 * Parse the 'fmt ' and 'data' chunks of a RIFF/WAVE buffer.
+	 *
+	 * @param data Pointer to the start of the buffer.
+	 * @param size Size of the buffer in bytes.
+	 * @param outLayout The parsed layout, only valid if true was returned.
+	 *
+	 * @return True if both the 'fmt ' and 'data' chunks were found and are within bounds.
+	 */
+	static bool TryParse(const uint8* data, int64 size, FWavLayout& outLayout);
+
+	/**
+	 * Replace the placeholder sizes (0xFFFFFFFF) that streaming TTS backends write in the RIFF header and the
+	 * 'data' chunk with the actual sizes. Buffers without placeholders are left untouched.
+	 *
+	 * @param data Pointer to the start of the buffer.
+	 * @param size Size of the buffer in bytes.
+	 *
+	 * @return False if the buffer is not a RIFF/WAVE buffer or has no 'data' chunk.
+	 */
+	static bool FixStreamingSizes(uint8* data, int64 size);
+
+	/**
+	 * Check for the placeholder sizes that FixStreamingSizes replaces, without writing to the buffer.
+	 *
+	 * @param data Pointer to the start of the buffer.
+	 * @param size Size of the buffer in bytes.
+	 *
+	 * @return True if the RIFF header or the 'data' chunk still holds a placeholder size.
+	 */
+	static bool HasStreamingPlaceholders(const uint8* data, int64 size);
+#pragma endregion
+};
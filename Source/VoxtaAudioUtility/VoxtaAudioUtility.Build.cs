@@ -5,7 +5,7 @@ using System.IO;
 
 /// <summary>
 /// Specifies all the requirements to compile the Audio specific code of the plugin.
-/// Encapsulates microphone input, audio playback, and WAV file decoding.
+/// Encapsulates microphone input, audio playback, and WAV, Ogg Opus & Ogg Vorbis decoding.
 /// </summary>
 public class VoxtaAudioUtility : ModuleRules
 {
@@ -20,10 +20,13 @@ public class VoxtaAudioUtility : ModuleRules
 			Path.Combine(ModuleDirectory, "Public", "RuntimeAudioImporter"),
 		});
 
-		PublicDependencyModuleNames.AddRange(new [] { "Core", "CoreUObject", "WebSockets", "AudioCaptureCore" });
+		PublicDependencyModuleNames.AddRange(new [] { "Core", "CoreUObject", "WebSockets", "AudioCaptureCore", "SignalProcessing" });
 
 		PrivateDependencyModuleNames.AddRange(new [] { "Engine", "Voice", "LogUtility", "VoxtaData", "AudioPlatformConfiguration", "AudioExtensions" });
 
+		// The engine ships these for its own Ogg & Opus support, so no extra third party code is bundled with the plugin.
+		AddEngineThirdPartyPrivateStaticDependencies(Target, "UEOgg", "Vorbis", "libOpus");
+
 		if (Target.Platform.IsInGroup(UnrealPlatformGroup.Windows) ||
 			Target.Platform == UnrealTargetPlatform.Mac)
 		{
@@ -0,0 +1,133 @@
+// Copyright(c) 2024 grrimgrriefer & DZnnah, see LICENSE for details.
+
+#include "VoxtaObjectPool.h"
+#include "VoxtaDefines.h"
+#include "Logging/StructuredLog.h"
+#include "HAL/IConsoleManager.h"
+#include "UObject/Package.h"
+
+namespace
+{
+	TAutoConsoleVariable<int32> CVarPoolMaxFreePerClass(
+		TEXT("voxta.Pool.MaxFreePerClass"),
+		32,
+		TEXT("Maximum number of released voiceline objects that are kept per class for reuse, 0 disables the pool."));
+
+	FAutoConsoleCommand PoolDumpCommand(
+		TEXT("voxta.Pool.Dump"),
+		TEXT("Log the hit-rate of the voiceline object pool per class."),
+		FConsoleCommandDelegate::CreateLambda([] ()
+		{
+			VoxtaObjectPool::Get().DumpToLog();
+		}));
+}
+
+VoxtaObjectPool& VoxtaObjectPool::Get()
+{
+	static VoxtaObjectPool instance;
+	return instance;
+}
+
+UObject* VoxtaObjectPool::Acquire(UClass* objectClass)
+{
+	check(IsInGameThread());
+
+	FClassPool& pool = m_pools.FindOrAdd(objectClass);
+	const double now = FPlatformTime::Seconds();
+	// Oldest first, those are the most likely to be past the reuse delay.
+	for (int i = 0; i < pool.FreeObjects.Num(); i++)
+	{
+		const FFreeObject& freeObject = pool.FreeObjects[i];
+		if (now - freeObject.ReleaseTime < REUSE_DELAY_SECONDS)
+		{
+			break;
+		}
+		UObject* object = freeObject.Object;
+		pool.FreeObjects.RemoveAt(i);
+		pool.Stats.NumOfHits++;
+		pool.Stats.NumOfFree = pool.FreeObjects.Num();
+		return object;
+	}
+
+	pool.Stats.NumOfMisses++;
+	return CreateInstance(objectClass);
+}
+
+void VoxtaObjectPool::Release(UObject* object)
+{
+	check(IsInGameThread());
+	if (object == nullptr)
+	{
+		return;
+	}
+
+	FClassPool& pool = m_pools.FindOrAdd(object->GetClass());
+	const bool isAlreadyFree = pool.FreeObjects.ContainsByPredicate([object] (const FFreeObject& freeObject)
+		{
+			return freeObject.Object == object;
+		});
+	if (!ensureMsgf(!isAlreadyFree, TEXT("Released an object that was already in the pool.")))
+	{
+		return;
+	}
+
+	pool.Stats.NumOfReleased++;
+	if (pool.FreeObjects.Num() >= FMath::Max(CVarPoolMaxFreePerClass.GetValueOnGameThread(), 0))
+	{
+		pool.Stats.NumOfDiscarded++;
+		object->RemoveFromRoot();
+		return;
+	}
+
+	// Still rooted, a pooled instance must never be collected while the pool refers to it.
+	object->AddToRoot();
+	pool.FreeObjects.Add({ object, FPlatformTime::Seconds() });
+	pool.Stats.NumOfFree = pool.FreeObjects.Num();
+}
+
+void VoxtaObjectPool::Prewarm(UClass* objectClass, int32 numOfInstances)
+{
+	check(IsInGameThread());
+
+	FClassPool& pool = m_pools.FindOrAdd(objectClass);
+	const int32 numOfNewInstances = FMath::Min(numOfInstances, FMath::Max(CVarPoolMaxFreePerClass.GetValueOnGameThread(), 0))
+		- pool.FreeObjects.Num();
+	for (int i = 0; i < numOfNewInstances; i++)
+	{
+		// Released 'long ago', they have never been used.
+		pool.FreeObjects.Add({ CreateInstance(objectClass), 0.0 });
+	}
+	pool.Stats.NumOfFree = pool.FreeObjects.Num();
+
+	if (numOfNewInstances > 0)
+	{
+		UE_LOGFMT(VoxtaLog, Log, "Prewarmed the object pool with {0} instances of {1}.", numOfNewInstances,
+			objectClass->GetName());
+	}
+}
+
+FVoxtaObjectPoolStats VoxtaObjectPool::GetStats(const UClass* objectClass) const
+{
+	const FClassPool* pool = m_pools.Find(objectClass);
+	return pool != nullptr ? pool->Stats : FVoxtaObjectPoolStats();
+}
+
+void VoxtaObjectPool::DumpToLog() const
+{
+	UE_LOGFMT(VoxtaLog, Log, "ObjectPool: {0} classes, at most {1} free instances per class.", m_pools.Num(),
+		CVarPoolMaxFreePerClass.GetValueOnGameThread());
+	for (const TPair<TWeakObjectPtr<const UClass>, FClassPool>& entry : m_pools)
+	{
+		const FVoxtaObjectPoolStats& stats = entry.Value.Stats;
+		UE_LOGFMT(VoxtaLog, Log, "  {0}: {1}% hit-rate ({2} hits, {3} misses), {4} released, {5} discarded, {6} free.",
+			entry.Key.IsValid() ? entry.Key->GetName() : TEXT("<unloaded>"), FMath::RoundToInt(stats.GetHitRate()),
+			stats.NumOfHits, stats.NumOfMisses, stats.NumOfReleased, stats.NumOfDiscarded, stats.NumOfFree);
+	}
+}
+
+UObject* VoxtaObjectPool::CreateInstance(UClass* objectClass)
+{
+	UObject* object = NewObject<UObject>(GetTransientPackage(), objectClass);
+	object->AddToRoot();
+	return object;
+}
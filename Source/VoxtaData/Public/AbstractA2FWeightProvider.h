@@ -29,7 +29,10 @@ public:
 	/**
 	 * Retrieve the A2F curveWeights for the upcoming update tick.
 	 *
-	 * @param targetArrayRef The array that will be used to fill the new curves. Old values will be overwritten.
+	 * @param outCurves The buffer to write the ARKit curve weights into, at least 52 values.
+	 *
+	 * @return False if the source is neutral (not talking), outCurves is left untouched and the anim node keeps the
+	 * curves of its source pose as they are.
 	 */
-	virtual void GetA2FCurveWeightsPreUpdate(TArray<float>& targetArrayRef) {}
+	virtual bool GetA2FCurveWeightsPreUpdate(TArrayView<float> outCurves) { return false; }
 };
@@ -38,9 +38,20 @@ public:
 	/**
 	 * Clean up the data that was made / kept that was directly tied to the playback of one voiceline.
 	 * Once this is called all memory will be cleaned and the playback can no longer be done.
+	 * The instance is returned to the VoxtaObjectPool, so it must not be used anymore afterwards.
 	 */
 	virtual void ReleaseData() = 0;
 
+	/**
+	 * Used for the audio memory accounting, an estimate is fine.
+	 *
+	 * @return The number of bytes held by the lipsync data of this voiceline.
+	 */
+	virtual int64 GetAllocatedSize() const
+	{
+		return 0;
+	}
+
 	/**
 	 * Retrieves the unique GUID (FGuid) assigned to this instance.
 	 * 
@@ -52,6 +63,15 @@ public:
 	}
 #pragma endregion
 
+#pragma region protected API
+protected:
+	/** Assign a new GUID, so a reused instance can't be mistaken for the voiceline it was used for before. */
+	void RenewGuid()
+	{
+		m_id = FGuid::NewGuid();
+	}
+#pragma endregion
+
 #pragma region data
 private:
 	/** Unique identifier for this lipsync data instance. */
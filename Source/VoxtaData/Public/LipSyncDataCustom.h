@@ -4,6 +4,7 @@
 
 #include "CoreMinimal.h"
 #include "LipSyncBaseData.h"
+#include "VoxtaObjectPool.h"
 #include "LipSyncDataCustom.generated.h"
 
 /**
@@ -22,12 +23,13 @@ class VOXTADATA_API ULipSyncDataCustom : public UObject, public ILipSyncBaseData
 public:
 	/**
 	 * Clean up the data that was made / kept that was directly tied to the playback of one voiceline.
-	 * Removes this object from the root set, allowing it to be garbage collected.
+	 * Returns this object to the VoxtaObjectPool, which unroots it if the pool is full.
 	 * Should be called when playback is finished and the data is no longer needed.
 	 */
 	virtual void ReleaseData() override
 	{
-		RemoveFromRoot();
+		RenewGuid();
+		VoxtaObjectPool::Get().Release(this);
 	}
 #pragma endregion
 
@@ -10,14 +10,16 @@
  *
  * Used for communication between an instance of MessageChunkAudioContainer and the VoxtaAudioPlayback that manages it.
  * Can be fetched via GetCurrentState of the MessageChunkAudioContainer instance
+ *
+ * A chunk goes Idle -> Busy (download, decoding and lipsync run in the background) -> ReadyForPlayback -> CleanedUp.
+ * If the download or processing fails for good, Busy goes to Failed instead, and playback skips the chunk.
  */
 UENUM()
 enum class MessageChunkState : uint8
 {
 	Idle,
-	Idle_Downloaded,
-	Idle_Processed,
 	Busy,
 	ReadyForPlayback,
+	Failed,
 	CleanedUp
 };
\ No newline at end of file
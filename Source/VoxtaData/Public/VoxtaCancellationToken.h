@@ -0,0 +1,76 @@
+// Copyright(c) 2024 grrimgrriefer & DZnnah, see LICENSE for details.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Misc/ScopeLock.h"
+#include <atomic>
+
+/**
+ * FVoxtaCancellationToken
+ * Shared flag that lets the owner of a background job stop all of its stages early, e.g. when the message a voiceline
+ * belongs to is cancelled or preempted before it was played.
+ *
+ * Worker loops poll IsCancelled between units of work. Work that cannot poll (like an outstanding http request)
+ * registers a callback via OnCancelled that aborts it instead.
+ *
+ * Thread Safety: All functions can be called from any thread.
+ */
+class FVoxtaCancellationToken
+{
+#pragma region public API
+public:
+	/** Mark the job as cancelled and run all registered callbacks. Only the first call has any effect. */
+	void Cancel()
+	{
+		TArray<TFunction<void()>> callbacks;
+		{
+			FScopeLock lock(&m_callbacksGuard);
+			if (m_isCancelled.exchange(true))
+			{
+				return;
+			}
+			callbacks = MoveTemp(m_onCancelledCallbacks);
+		}
+		for (const TFunction<void()>& callback : callbacks)
+		{
+			callback();
+		}
+	}
+
+	/** @return True once the job was cancelled. */
+	bool IsCancelled() const
+	{
+		return m_isCancelled.load(std::memory_order_relaxed);
+	}
+
+	/**
+	 * Register a callback that aborts a part of the job, it is invoked right away if the job was already cancelled.
+	 *
+	 * Note: Callbacks run on the thread that cancels the job and are kept alive until then, so only capture weak references.
+	 *
+	 * @param callback The callback that aborts the work.
+	 */
+	void OnCancelled(TFunction<void()> callback)
+	{
+		{
+			FScopeLock lock(&m_callbacksGuard);
+			if (!m_isCancelled.load())
+			{
+				m_onCancelledCallbacks.Add(MoveTemp(callback));
+				return;
+			}
+		}
+		callback();
+	}
+#pragma endregion
+
+#pragma region data
+private:
+	FCriticalSection m_callbacksGuard;
+	std::atomic<bool> m_isCancelled = false;
+	TArray<TFunction<void()>> m_onCancelledCallbacks;
+#pragma endregion
+};
+
+using FVoxtaCancellationTokenPtr = TSharedPtr<FVoxtaCancellationToken, ESPMode::ThreadSafe>;
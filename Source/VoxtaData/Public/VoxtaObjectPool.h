@@ -0,0 +1,129 @@
+// Copyright(c) 2024 grrimgrriefer & DZnnah, see LICENSE for details.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "UObject/Object.h"
+
+/**
+ * FVoxtaObjectPoolStats
+ * Counters of the free list of one class in the VoxtaObjectPool since startup.
+ */
+struct FVoxtaObjectPoolStats
+{
+	/** Acquires that reused a released instance. */
+	int64 NumOfHits = 0;
+	/** Acquires that had to create a new instance. */
+	int64 NumOfMisses = 0;
+	int64 NumOfReleased = 0;
+	/** Released instances that were left to the garbage collector, as the free list was full. */
+	int64 NumOfDiscarded = 0;
+	int32 NumOfFree = 0;
+
+	/** @return The percentage of acquires that reused an instance. */
+	float GetHitRate() const
+	{
+		const int64 numOfAcquires = NumOfHits + NumOfMisses;
+		return numOfAcquires > 0 ? 100.f * NumOfHits / numOfAcquires : 0.f;
+	}
+};
+
+/**
+ * VoxtaObjectPool
+ * Process-wide free lists of the UObjects that are created for every voiceline (sound waves & lipsync data), so long
+ * conversations don't keep adding rooted objects for the garbage collector to walk through.
+ *
+ * Instances are rooted for as long as they are handed out and while they are in a free list. The owner resets an
+ * instance before releasing it, the pool itself doesn't know how. Each free list keeps at most
+ * voxta.Pool.MaxFreePerClass instances, anything beyond that is unrooted and left to the garbage collector.
+ *
+ * Use 'voxta.Pool.Dump' to log the hit-rate per class.
+ *
+ * Note: Game thread only, like creating and rooting UObjects.
+ */
+class VOXTADATA_API VoxtaObjectPool
+{
+#pragma region public API
+public:
+	/** @return The process-wide pool instance. */
+	static VoxtaObjectPool& Get();
+
+	/**
+	 * Take an instance from the free list of the class, or create a new one if it is empty.
+	 *
+	 * @tparam T The class of the instance.
+	 *
+	 * @return The rooted instance.
+	 */
+	template <typename T>
+	T* Acquire()
+	{
+		return CastChecked<T>(Acquire(T::StaticClass()));
+	}
+
+	/**
+	 * Take an instance from the free list of the class, or create a new one if it is empty.
+	 *
+	 * @param objectClass The class of the instance.
+	 *
+	 * @return The rooted instance.
+	 */
+	UObject* Acquire(UClass* objectClass);
+
+	/**
+	 * Add an instance to the free list of its class. It must already be reset, and it must not be used anymore.
+	 *
+	 * @param object The instance to release.
+	 */
+	void Release(UObject* object);
+
+	/**
+	 * Fill the free list of a class up front, so the first voicelines don't pay for creating the instances.
+	 *
+	 * @param objectClass The class to create instances of.
+	 * @param numOfInstances The number of free instances the list should have afterwards.
+	 */
+	void Prewarm(UClass* objectClass, int32 numOfInstances);
+
+	/** @return A snapshot of the counters of the given class. */
+	FVoxtaObjectPoolStats GetStats(const UClass* objectClass) const;
+
+	/** Log the counters of all classes. */
+	void DumpToLog() const;
+#pragma endregion
+
+#pragma region data
+private:
+	struct FFreeObject
+	{
+		UObject* Object = nullptr;
+		double ReleaseTime = 0.0;
+	};
+
+	struct FClassPool
+	{
+		TArray<FFreeObject> FreeObjects;
+		FVoxtaObjectPoolStats Stats;
+	};
+
+	/**
+	 * Released instances can still be referenced for a moment, e.g. a sound wave by the active sound on the audio
+	 * thread that is being stopped. So they are only handed out again after this delay.
+	 */
+	static constexpr double REUSE_DELAY_SECONDS = 1.0;
+
+	TMap<TWeakObjectPtr<const UClass>, FClassPool> m_pools;
+#pragma endregion
+
+#pragma region private API
+private:
+	VoxtaObjectPool() = default;
+
+	/**
+	 * @param objectClass The class to create an instance of.
+	 *
+	 * @return A new rooted instance.
+	 */
+	static UObject* CreateInstance(UClass* objectClass);
+#pragma endregion
+};
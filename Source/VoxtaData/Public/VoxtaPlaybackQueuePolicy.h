@@ -0,0 +1,23 @@
+// Copyright(c) 2024 grrimgrriefer & DZnnah, see LICENSE for details.
+
+#pragma once
+
+#include "CoreMinimal.h"
+
+/**
+ * VoxtaPlaybackQueuePolicy
+ * What a VoxtaAudioPlayback does when a new message for its character arrives while it is still playing another one.
+ *
+ * Used to expose the setting to the UE interface inspector, so the developer can define on a per-character basis
+ * whether replies interrupt each other (conversations) or play back-to-back (scripted multi-line scenes).
+ */
+UENUM(BlueprintType, Category = "Voxta")
+enum class VoxtaPlaybackQueuePolicy : uint8
+{
+	/** Stop the current message and play the new one right away. */
+	Preempt				UMETA(DisplayName = "Preempt"),
+	/** Play the new message once all messages before it are finished. */
+	Enqueue				UMETA(DisplayName = "Enqueue"),
+	/** Enqueue, but discard the oldest waiting message once the queue is full. */
+	DropOldest			UMETA(DisplayName = "Drop Oldest")
+};
@@ -0,0 +1,388 @@
+// Copyright(c) 2024 grrimgrriefer & DZnnah, see LICENSE for details.
+
+#include "A2FBlendshapeParser.h"
+#include "LipSyncDataA2F.h"
+#include "Misc/StringBuilder.h"
+
+namespace
+{
+	/** Powers of ten that are exactly representable as a double, see FJsonCursor::ParseNumber. */
+	constexpr double EXACT_POWERS_OF_TEN[] = {
+		1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+		1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+	};
+	constexpr int MAX_EXACT_EXPONENT = UE_ARRAY_COUNT(EXACT_POWERS_OF_TEN) - 1;
+	constexpr uint64 MAX_EXACT_MANTISSA = 1ull << 53;
+	constexpr int MAX_MANTISSA_DIGITS = 19;
+	constexpr int MAX_SKIP_DEPTH = 64;
+
+	bool IsDigit(uint8 character)
+	{
+		return character >= '0' && character <= '9';
+	}
+
+	/**
+	 * FJsonCursor
+	 * Forward-only reader over the raw UTF-8 bytes. Every Parse/Skip function leaves the cursor right after the
+	 * consumed token and returns false (with Error set) on malformed input.
+	 */
+	struct FJsonCursor
+	{
+		const uint8* Begin = nullptr;
+		const uint8* Current = nullptr;
+		const uint8* End = nullptr;
+		FString Error;
+
+		bool Fail(const TCHAR* reason)
+		{
+			if (Error.IsEmpty())
+			{
+				Error = FString::Printf(TEXT("%s at byte %lld."), reason, static_cast<int64>(Current - Begin));
+			}
+			return false;
+		}
+
+		void SkipWhitespace()
+		{
+			while (Current < End && (*Current == ' ' || *Current == '\n' || *Current == '\r' || *Current == '\t'))
+			{
+				Current++;
+			}
+		}
+
+		/** Skip whitespace and consume the given character if it is next. */
+		bool TryConsume(uint8 character)
+		{
+			SkipWhitespace();
+			if (Current < End && *Current == character)
+			{
+				Current++;
+				return true;
+			}
+			return false;
+		}
+
+		bool Expect(uint8 character, const TCHAR* reason)
+		{
+			return TryConsume(character) || Fail(reason);
+		}
+
+		/**
+		 * Consume a string, escapes are skipped but not decoded as only the field names are ever looked at.
+		 *
+		 * @param outContents The raw bytes between the quotes.
+		 */
+		bool ParseString(FAnsiStringView& outContents)
+		{
+			if (!Expect('"', TEXT("Expected a string")))
+			{
+				return false;
+			}
+			const uint8* start = Current;
+			while (Current < End && *Current != '"')
+			{
+				Current += *Current == '\\' ? 2 : 1;
+			}
+			if (Current >= End)
+			{
+				return Fail(TEXT("Unterminated string"));
+			}
+			outContents = FAnsiStringView(reinterpret_cast<const ANSICHAR*>(start), static_cast<int32>(Current - start));
+			Current++;
+			return true;
+		}
+
+		/**
+		 * Consume a number. Mantissas of up to 2^53 with a decimal exponent of at most 22 are converted with a single
+		 * exact multiplication or division (Clinger's fast path), which covers every weight A2F writes. Anything
+		 * else falls back to the C runtime.
+		 */
+		bool ParseNumber(double& outValue)
+		{
+			SkipWhitespace();
+			const uint8* start = Current;
+			const bool isNegative = Current < End && *Current == '-';
+			Current += isNegative ? 1 : 0;
+
+			uint64 mantissa = 0;
+			int numOfDigits = 0;
+			int exponent = 0;
+			bool hasIntegerDigits = false;
+			while (Current < End && IsDigit(*Current))
+			{
+				if (numOfDigits < MAX_MANTISSA_DIGITS)
+				{
+					mantissa = mantissa * 10 + (*Current - '0');
+					numOfDigits += (mantissa != 0) ? 1 : 0;
+				}
+				else
+				{
+					exponent++;
+					numOfDigits++;
+				}
+				hasIntegerDigits = true;
+				Current++;
+			}
+			if (!hasIntegerDigits)
+			{
+				return Fail(TEXT("Expected a number"));
+			}
+			if (Current < End && *Current == '.')
+			{
+				Current++;
+				const uint8* fractionStart = Current;
+				while (Current < End && IsDigit(*Current))
+				{
+					if (numOfDigits < MAX_MANTISSA_DIGITS)
+					{
+						mantissa = mantissa * 10 + (*Current - '0');
+						numOfDigits += (mantissa != 0) ? 1 : 0;
+						exponent--;
+					}
+					else
+					{
+						numOfDigits++;
+					}
+					Current++;
+				}
+				if (Current == fractionStart)
+				{
+					return Fail(TEXT("Expected digits after the decimal point"));
+				}
+			}
+			if (Current < End && (*Current == 'e' || *Current == 'E'))
+			{
+				Current++;
+				const bool isExponentNegative = Current < End && *Current == '-';
+				Current += (Current < End && (*Current == '-' || *Current == '+')) ? 1 : 0;
+				const uint8* exponentStart = Current;
+				int explicitExponent = 0;
+				while (Current < End && IsDigit(*Current))
+				{
+					explicitExponent = FMath::Min(explicitExponent * 10 + (*Current - '0'), 100000);
+					Current++;
+				}
+				if (Current == exponentStart)
+				{
+					return Fail(TEXT("Expected digits in the exponent"));
+				}
+				exponent += isExponentNegative ? -explicitExponent : explicitExponent;
+			}
+
+			if (numOfDigits <= MAX_MANTISSA_DIGITS && mantissa <= MAX_EXACT_MANTISSA &&
+				FMath::Abs(exponent) <= MAX_EXACT_EXPONENT)
+			{
+				const double value = static_cast<double>(mantissa);
+				outValue = exponent < 0 ? value / EXACT_POWERS_OF_TEN[-exponent] : value * EXACT_POWERS_OF_TEN[exponent];
+				outValue = isNegative ? -outValue : outValue;
+				return true;
+			}
+
+			TAnsiStringBuilder<64> token;
+			token.Append(reinterpret_cast<const ANSICHAR*>(start), static_cast<int32>(Current - start));
+			outValue = FCStringAnsi::Atod(*token);
+			return true;
+		}
+
+		bool SkipLiteral(const ANSICHAR* literal)
+		{
+			for (; *literal != '\0'; literal++, Current++)
+			{
+				if (Current >= End || *Current != static_cast<uint8>(*literal))
+				{
+					return Fail(TEXT("Unexpected character"));
+				}
+			}
+			return true;
+		}
+
+		/** Consume any value without storing it. */
+		bool SkipValue(int depth = 0)
+		{
+			if (depth > MAX_SKIP_DEPTH)
+			{
+				return Fail(TEXT("Nested too deep"));
+			}
+			SkipWhitespace();
+			if (Current >= End)
+			{
+				return Fail(TEXT("Unexpected end of file"));
+			}
+
+			switch (*Current)
+			{
+				case '"':
+				{
+					FAnsiStringView ignored;
+					return ParseString(ignored);
+				}
+				case '{':
+				{
+					Current++;
+					if (TryConsume('}'))
+					{
+						return true;
+					}
+					do
+					{
+						FAnsiStringView ignored;
+						if (!ParseString(ignored) || !Expect(':', TEXT("Expected ':'")) || !SkipValue(depth + 1))
+						{
+							return false;
+						}
+					}
+					while (TryConsume(','));
+					return Expect('}', TEXT("Expected ',' or '}'"));
+				}
+				case '[':
+				{
+					Current++;
+					if (TryConsume(']'))
+					{
+						return true;
+					}
+					do
+					{
+						if (!SkipValue(depth + 1))
+						{
+							return false;
+						}
+					}
+					while (TryConsume(','));
+					return Expect(']', TEXT("Expected ',' or ']'"));
+				}
+				case 't':
+					return SkipLiteral("true");
+				case 'f':
+					return SkipLiteral("false");
+				case 'n':
+					return SkipLiteral("null");
+				default:
+				{
+					double ignored;
+					return ParseNumber(ignored);
+				}
+			}
+		}
+
+		/** Consume the 'weightMat' array of rows, appending every row as exactly CURVE_COUNT floats. */
+		bool ParseWeightMat(FA2FBlendshapeResult& outResult)
+		{
+			constexpr int curveCount = ULipSyncDataA2F::CURVE_COUNT;
+			if (!Expect('[', TEXT("Expected the 'weightMat' array")))
+			{
+				return false;
+			}
+			if (TryConsume(']'))
+			{
+				return true;
+			}
+			do
+			{
+				if (!Expect('[', TEXT("Expected a 'weightMat' row")))
+				{
+					return false;
+				}
+				const int32 rowStart = outResult.CurveWeights.AddZeroed(curveCount);
+				int32 numOfValues = 0;
+				if (!TryConsume(']'))
+				{
+					do
+					{
+						double value;
+						if (!ParseNumber(value))
+						{
+							return false;
+						}
+						if (numOfValues < curveCount)
+						{
+							outResult.CurveWeights[rowStart + numOfValues] = static_cast<float>(value);
+						}
+						numOfValues++;
+					}
+					while (TryConsume(','));
+					if (!Expect(']', TEXT("Expected ',' or ']' in a 'weightMat' row")))
+					{
+						return false;
+					}
+				}
+				if (rowStart == 0)
+				{
+					outResult.NumOfCurvesPerFrame = numOfValues;
+				}
+			}
+			while (TryConsume(','));
+			return Expect(']', TEXT("Expected ',' or ']' after a 'weightMat' row"));
+		}
+	};
+}
+
+bool A2FBlendshapeParser::TryParse(const uint8* data, int64 size, FA2FBlendshapeResult& outResult, FString& outError)
+{
+	outResult = FA2FBlendshapeResult();
+	FJsonCursor cursor;
+	cursor.Begin = data;
+	cursor.Current = data;
+	cursor.End = data + size;
+	if (size >= 3 && data[0] == 0xEF && data[1] == 0xBB && data[2] == 0xBF)
+	{
+		cursor.Current += 3;
+	}
+
+	bool hasWeightMat = false;
+	bool isValid = cursor.Expect('{', TEXT("Expected the root object"));
+	if (isValid && !cursor.TryConsume('}'))
+	{
+		do
+		{
+			FAnsiStringView key;
+			isValid = cursor.ParseString(key) && cursor.Expect(':', TEXT("Expected ':'"));
+			if (!isValid)
+			{
+				break;
+			}
+
+			double number;
+			if (key.Equals(ANSITEXTVIEW("exportFps"), ESearchCase::CaseSensitive))
+			{
+				isValid = cursor.ParseNumber(number);
+				outResult.Fps = static_cast<int32>(number);
+			}
+			else if (key.Equals(ANSITEXTVIEW("numFrames"), ESearchCase::CaseSensitive))
+			{
+				isValid = cursor.ParseNumber(number);
+				// Only a hint, the rows that are actually in 'weightMat' are what counts.
+				outResult.CurveWeights.Reserve(FMath::Clamp(static_cast<int32>(number), 0, 1 << 20) *
+					ULipSyncDataA2F::CURVE_COUNT);
+			}
+			else if (key.Equals(ANSITEXTVIEW("weightMat"), ESearchCase::CaseSensitive))
+			{
+				isValid = cursor.ParseWeightMat(outResult);
+				hasWeightMat = true;
+			}
+			else
+			{
+				isValid = cursor.SkipValue();
+			}
+		}
+		while (isValid && cursor.TryConsume(','));
+		isValid = isValid && cursor.Expect('}', TEXT("Expected ',' or '}'"));
+	}
+
+	if (isValid && !hasWeightMat)
+	{
+		isValid = cursor.Fail(TEXT("Missing the 'weightMat' array"));
+	}
+	if (isValid && outResult.Fps <= 0)
+	{
+		isValid = cursor.Fail(TEXT("Missing or invalid 'exportFps'"));
+	}
+	if (!isValid)
+	{
+		outError = MoveTemp(cursor.Error);
+		return false;
+	}
+
+	outResult.NumOfFrames = outResult.CurveWeights.Num() / ULipSyncDataA2F::CURVE_COUNT;
+	return true;
+}
@@ -0,0 +1,359 @@
+// Copyright(c) 2024 grrimgrriefer & DZnnah, see LICENSE for details.
+
+#include "A2FCompactCurves.h"
+#include "HAL/IConsoleManager.h"
+#include "Math/VectorRegister.h"
+#include "Algo/BinarySearch.h"
+
+static_assert(A2FCompactCurves::CURVE_COUNT % 4 == 0, "A padded block of curves must fit in CURVE_COUNT floats.");
+static_assert(A2FCompactCurves::CURVE_COUNT <= MAX_uint8 + 1, "Curve indices are stored as bytes.");
+
+namespace
+{
+	TAutoConsoleVariable<bool> CVarA2FCompactEnabled(
+		TEXT("voxta.A2F.Compact.Enabled"),
+		true,
+		TEXT("Store new A2F lipsync as quantized keyframes instead of raw floats, in memory & in the voiceline cache."));
+
+	TAutoConsoleVariable<float> CVarA2FCompactTolerance(
+		TEXT("voxta.A2F.Compact.Tolerance"),
+		0.005f,
+		TEXT("Maximum error of a compacted A2F curve weight (0-1), higher values drop more keyframes & bits."));
+
+	constexpr uint8 FORMAT_VERSION = 1;
+	/** Bounds the cost of the keyframe reduction, which checks every frame of a segment each time it grows. */
+	constexpr int32 MAX_KEYFRAME_GAP = 64;
+
+	/** How a quantized value is loaded into a vector register, and the range it is quantized to. */
+	template<typename QuantizedType>
+	struct TQuantization;
+
+	template<>
+	struct TQuantization<uint8>
+	{
+		static constexpr float MAX_VALUE = MAX_uint8;
+
+		static FORCEINLINE VectorRegister4Float Load(const uint8* values)
+		{
+			return VectorLoadByte4(values);
+		}
+	};
+
+	/** Only used for tolerances below 1/255 of a curve's range, so the scalar conversion is fine. */
+	template<>
+	struct TQuantization<uint16>
+	{
+		static constexpr float MAX_VALUE = MAX_uint16;
+
+		static FORCEINLINE VectorRegister4Float Load(const uint16* values)
+		{
+			return MakeVectorRegisterFloat(static_cast<float>(values[0]), static_cast<float>(values[1]),
+				static_cast<float>(values[2]), static_cast<float>(values[3]));
+		}
+	};
+
+	/** @return True if every frame between both keyframes is within the tolerance of the line between them. */
+	bool IsSegmentWithinTolerance(const float* curveWeights, TConstArrayView<int32> curveIndices, int32 fromFrame,
+		int32 toFrame, float tolerance)
+	{
+		constexpr int CURVE_COUNT = A2FCompactCurves::CURVE_COUNT;
+		const float* fromCurves = curveWeights + fromFrame * CURVE_COUNT;
+		const float* toCurves = curveWeights + toFrame * CURVE_COUNT;
+		for (int32 frame = fromFrame + 1; frame < toFrame; frame++)
+		{
+			const float alpha = static_cast<float>(frame - fromFrame) / (toFrame - fromFrame);
+			const float* frameCurves = curveWeights + frame * CURVE_COUNT;
+			for (int32 curve : curveIndices)
+			{
+				const float interpolated = fromCurves[curve] + (toCurves[curve] - fromCurves[curve]) * alpha;
+				if (FMath::Abs(interpolated - frameCurves[curve]) > tolerance)
+				{
+					return false;
+				}
+			}
+		}
+		return true;
+	}
+}
+
+bool A2FCompactCurves::IsEnabled()
+{
+	return CVarA2FCompactEnabled.GetValueOnAnyThread();
+}
+
+float A2FCompactCurves::GetTolerance()
+{
+	return FMath::Max(CVarA2FCompactTolerance.GetValueOnAnyThread(), 0.f);
+}
+
+A2FCompactCurves A2FCompactCurves::Encode(TConstArrayView<float> curveWeights, int32 framesPerSecond, float tolerance)
+{
+	A2FCompactCurves compactCurves;
+	compactCurves.m_framesPerSecond = framesPerSecond;
+	compactCurves.m_numOfFrames = curveWeights.Num() / CURVE_COUNT;
+	const int32 numOfFrames = compactCurves.m_numOfFrames;
+	const float* weights = curveWeights.GetData();
+	tolerance = FMath::Max(tolerance, 0.f);
+
+	// The midpoint of a curve is within half its range of every value.
+	TArray<int32, TInlineAllocator<CURVE_COUNT>> animatedCurves;
+	for (int32 curve = 0; curve < CURVE_COUNT && numOfFrames > 0; curve++)
+	{
+		float minWeight = weights[curve];
+		float maxWeight = weights[curve];
+		for (int32 frame = 1; frame < numOfFrames; frame++)
+		{
+			minWeight = FMath::Min(minWeight, weights[frame * CURVE_COUNT + curve]);
+			maxWeight = FMath::Max(maxWeight, weights[frame * CURVE_COUNT + curve]);
+		}
+
+		if (maxWeight - minWeight <= 2.f * tolerance)
+		{
+			compactCurves.m_constantCurves[curve] = (minWeight + maxWeight) * 0.5f;
+		}
+		else
+		{
+			animatedCurves.Add(curve);
+		}
+	}
+	if (animatedCurves.IsEmpty())
+	{
+		return compactCurves;
+	}
+
+	// Half of the tolerance goes to dropping keyframes, the other half to quantizing the ones that are kept.
+	const float halfTolerance = tolerance * 0.5f;
+	compactCurves.m_keyFrames.Add(0);
+	int32 fromFrame = 0;
+	while (fromFrame < numOfFrames - 1)
+	{
+		int32 toFrame = fromFrame + 1;
+		while (toFrame + 1 < numOfFrames && toFrame + 1 - fromFrame <= MAX_KEYFRAME_GAP &&
+			IsSegmentWithinTolerance(weights, animatedCurves, fromFrame, toFrame + 1, halfTolerance))
+		{
+			toFrame++;
+		}
+		compactCurves.m_keyFrames.Add(toFrame);
+		fromFrame = toFrame;
+	}
+	compactCurves.m_keyFrames.Shrink();
+
+	// Rounding is off by at most half a step, so 8 bits are enough while a step is within the tolerance.
+	TArray<int32, TInlineAllocator<CURVE_COUNT>> curves8;
+	TArray<int32, TInlineAllocator<CURVE_COUNT>> curves16;
+	for (int32 curve : animatedCurves)
+	{
+		float minWeight = weights[curve];
+		float maxWeight = weights[curve];
+		for (int32 keyFrame : compactCurves.m_keyFrames)
+		{
+			minWeight = FMath::Min(minWeight, weights[keyFrame * CURVE_COUNT + curve]);
+			maxWeight = FMath::Max(maxWeight, weights[keyFrame * CURVE_COUNT + curve]);
+		}
+		if ((maxWeight - minWeight) / TQuantization<uint8>::MAX_VALUE <= tolerance)
+		{
+			curves8.Add(curve);
+		}
+		else
+		{
+			curves16.Add(curve);
+		}
+	}
+	compactCurves.QuantizeCurves(weights, curves8, compactCurves.m_curves8);
+	compactCurves.QuantizeCurves(weights, curves16, compactCurves.m_curves16);
+	return compactCurves;
+}
+
+bool A2FCompactCurves::Sample(float frame, float* outCurves) const
+{
+	if (m_numOfFrames == 0)
+	{
+		return false;
+	}
+
+	FMemory::Memcpy(outCurves, m_constantCurves, sizeof(m_constantCurves));
+	if (m_keyFrames.Num() < 2)
+	{
+		return true;
+	}
+
+	const float clampedFrame = FMath::Clamp(frame, 0.f, static_cast<float>(m_numOfFrames - 1));
+	// The last keyframe at or before the frame, but never the very last one so there always is a next keyframe.
+	const int32 fromKey = FMath::Clamp(Algo::UpperBound(m_keyFrames, FMath::FloorToInt(clampedFrame)) - 1, 0,
+		m_keyFrames.Num() - 2);
+	const int32 fromFrame = m_keyFrames[fromKey];
+	const float alpha = (clampedFrame - fromFrame) / (m_keyFrames[fromKey + 1] - fromFrame);
+	SampleQuantized(m_curves8, fromKey, fromKey + 1, alpha, outCurves);
+	SampleQuantized(m_curves16, fromKey, fromKey + 1, alpha, outCurves);
+	return true;
+}
+
+void A2FCompactCurves::Decode(TArray<float>& outCurveWeights) const
+{
+	outCurveWeights.SetNumUninitialized(m_numOfFrames * CURVE_COUNT);
+	for (int32 frame = 0; frame < m_numOfFrames; frame++)
+	{
+		Sample(static_cast<float>(frame), outCurveWeights.GetData() + frame * CURVE_COUNT);
+	}
+}
+
+int64 A2FCompactCurves::GetAllocatedSize() const
+{
+	return m_keyFrames.GetAllocatedSize() +
+		m_curves8.CurveIndices.GetAllocatedSize() + m_curves8.Scales.GetAllocatedSize() +
+		m_curves8.Offsets.GetAllocatedSize() + m_curves8.Values.GetAllocatedSize() +
+		m_curves16.CurveIndices.GetAllocatedSize() + m_curves16.Scales.GetAllocatedSize() +
+		m_curves16.Offsets.GetAllocatedSize() + m_curves16.Values.GetAllocatedSize();
+}
+
+FArchive& operator<<(FArchive& archive, A2FCompactCurves& curves)
+{
+	uint8 version = FORMAT_VERSION;
+	archive << version;
+	if (version != FORMAT_VERSION)
+	{
+		archive.SetError();
+		return archive;
+	}
+
+	archive << curves.m_framesPerSecond << curves.m_numOfFrames;
+	for (float& constantCurve : curves.m_constantCurves)
+	{
+		archive << constantCurve;
+	}
+	archive << curves.m_keyFrames;
+	A2FCompactCurves::SerializeQuantized(archive, curves.m_curves8);
+	A2FCompactCurves::SerializeQuantized(archive, curves.m_curves16);
+
+	if (archive.IsLoading() && (archive.IsError() || !curves.IsValid()))
+	{
+		archive.SetError();
+		curves = A2FCompactCurves();
+	}
+	return archive;
+}
+
+bool A2FCompactCurves::IsValid() const
+{
+	if (m_framesPerSecond <= 0 || m_numOfFrames < 0)
+	{
+		return false;
+	}
+
+	const int32 numOfKeyFrames = m_keyFrames.Num();
+	if (GetNumOfAnimatedCurves() == 0)
+	{
+		return numOfKeyFrames == 0 && m_curves8.Values.IsEmpty() && m_curves16.Values.IsEmpty();
+	}
+	if (numOfKeyFrames < 2 || m_keyFrames[0] != 0 || m_keyFrames.Last() != m_numOfFrames - 1)
+	{
+		return false;
+	}
+	for (int32 i = 1; i < numOfKeyFrames; i++)
+	{
+		if (m_keyFrames[i] <= m_keyFrames[i - 1])
+		{
+			return false;
+		}
+	}
+	return IsValidQuantized(m_curves8, numOfKeyFrames) && IsValidQuantized(m_curves16, numOfKeyFrames) &&
+		GetNumOfAnimatedCurves() <= CURVE_COUNT;
+}
+
+template<typename QuantizedType>
+void A2FCompactCurves::QuantizeCurves(const float* curveWeights, TConstArrayView<int32> curveIndices,
+	TQuantizedCurves<QuantizedType>& outCurves) const
+{
+	using FQuantization = TQuantization<QuantizedType>;
+
+	outCurves.NumOfCurves = curveIndices.Num();
+	const int32 stride = outCurves.GetStride();
+	outCurves.CurveIndices.Reserve(curveIndices.Num());
+	outCurves.Scales.SetNumZeroed(stride);
+	outCurves.Offsets.SetNumZeroed(stride);
+	outCurves.Values.SetNumZeroed(stride * m_keyFrames.Num());
+
+	for (int32 i = 0; i < curveIndices.Num(); i++)
+	{
+		const int32 curve = curveIndices[i];
+		float minWeight = curveWeights[curve];
+		float maxWeight = curveWeights[curve];
+		for (int32 keyFrame : m_keyFrames)
+		{
+			minWeight = FMath::Min(minWeight, curveWeights[keyFrame * CURVE_COUNT + curve]);
+			maxWeight = FMath::Max(maxWeight, curveWeights[keyFrame * CURVE_COUNT + curve]);
+		}
+
+		const float range = maxWeight - minWeight;
+		outCurves.CurveIndices.Add(static_cast<uint8>(curve));
+		outCurves.Offsets[i] = minWeight;
+		outCurves.Scales[i] = range / FQuantization::MAX_VALUE;
+		if (range <= 0.f)
+		{
+			continue;
+		}
+		for (int32 key = 0; key < m_keyFrames.Num(); key++)
+		{
+			const float normalized = (curveWeights[m_keyFrames[key] * CURVE_COUNT + curve] - minWeight) / range;
+			outCurves.Values[key * stride + i] = static_cast<QuantizedType>(
+				FMath::Clamp(FMath::RoundToInt(normalized * FQuantization::MAX_VALUE), 0,
+					static_cast<int32>(FQuantization::MAX_VALUE)));
+		}
+	}
+}
+
+template<typename QuantizedType>
+void A2FCompactCurves::SampleQuantized(const TQuantizedCurves<QuantizedType>& curves, int32 fromKey, int32 toKey,
+	float alpha, float* outCurves)
+{
+	if (curves.NumOfCurves == 0)
+	{
+		return;
+	}
+
+	// Interpolating the quantized values before scaling is exact, as scale & offset are the same for both keyframes.
+	const int32 stride = curves.GetStride();
+	const QuantizedType* fromValues = curves.Values.GetData() + fromKey * stride;
+	const QuantizedType* toValues = curves.Values.GetData() + toKey * stride;
+	const VectorRegister4Float alphaVector = VectorSetFloat1(alpha);
+	float decodedCurves[CURVE_COUNT];
+	for (int32 i = 0; i < stride; i += 4)
+	{
+		const VectorRegister4Float fromVector = TQuantization<QuantizedType>::Load(fromValues + i);
+		const VectorRegister4Float toVector = TQuantization<QuantizedType>::Load(toValues + i);
+		const VectorRegister4Float quantized = VectorMultiplyAdd(VectorSubtract(toVector, fromVector), alphaVector,
+			fromVector);
+		VectorStore(VectorMultiplyAdd(quantized, VectorLoad(curves.Scales.GetData() + i),
+			VectorLoad(curves.Offsets.GetData() + i)), decodedCurves + i);
+	}
+
+	for (int32 i = 0; i < curves.NumOfCurves; i++)
+	{
+		outCurves[curves.CurveIndices[i]] = decodedCurves[i];
+	}
+}
+
+template<typename QuantizedType>
+void A2FCompactCurves::SerializeQuantized(FArchive& archive, TQuantizedCurves<QuantizedType>& curves)
+{
+	archive << curves.NumOfCurves << curves.CurveIndices << curves.Scales << curves.Offsets << curves.Values;
+}
+
+template<typename QuantizedType>
+bool A2FCompactCurves::IsValidQuantized(const TQuantizedCurves<QuantizedType>& curves, int32 numOfKeyFrames)
+{
+	if (curves.NumOfCurves < 0 || curves.NumOfCurves > CURVE_COUNT || curves.CurveIndices.Num() != curves.NumOfCurves)
+	{
+		return false;
+	}
+	const int32 stride = curves.GetStride();
+	if (curves.Scales.Num() != stride || curves.Offsets.Num() != stride ||
+		curves.Values.Num() != static_cast<int64>(stride) * numOfKeyFrames)
+	{
+		return false;
+	}
+	return !curves.CurveIndices.ContainsByPredicate([] (uint8 curve)
+		{
+			return curve >= CURVE_COUNT;
+		});
+}
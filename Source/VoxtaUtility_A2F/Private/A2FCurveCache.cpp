@@ -0,0 +1,344 @@
+// Copyright(c) 2024 grrimgrriefer & DZnnah, see LICENSE for details.
+
+#include "A2FCurveCache.h"
+#include "LipSyncDataA2F.h"
+#include "VoxtaDefines.h"
+#include "Logging/StructuredLog.h"
+#include "HAL/IConsoleManager.h"
+#include "HAL/FileManager.h"
+#include "HAL/PlatformFileManager.h"
+#include "Hash/xxhash.h"
+#include "Misc/Paths.h"
+#include "Misc/FileHelper.h"
+#include "Misc/ScopeLock.h"
+
+namespace
+{
+	TAutoConsoleVariable<bool> CVarA2FCurveCacheEnabled(
+		TEXT("voxta.A2F.CurveCache.Enabled"),
+		true,
+		TEXT("Reuse the A2F lipsync of audio that was sent to Audio2Face before, also across sessions."));
+
+	TAutoConsoleVariable<int32> CVarA2FCurveCacheDiskBudgetMB(
+		TEXT("voxta.A2F.CurveCache.DiskBudgetMB"),
+		64,
+		TEXT("Maximum size of the on-disk A2F curve cache, least recently used results are deleted first."));
+
+	FAutoConsoleCommand A2FCurveCacheDumpCommand(
+		TEXT("voxta.A2F.CurveCache.Dump"),
+		TEXT("Log the stats of the A2F curve cache."),
+		FConsoleCommandDelegate::CreateLambda([] ()
+		{
+			A2FCurveCache::Get().DumpToLog();
+		}));
+
+	FAutoConsoleCommand A2FCurveCacheClearCommand(
+		TEXT("voxta.A2F.CurveCache.Clear"),
+		TEXT("Delete all cached A2F lipsync results."),
+		FConsoleCommandDelegate::CreateLambda([] ()
+		{
+			A2FCurveCache::Get().Clear();
+		}));
+
+	constexpr uint32 FILE_MAGIC = 0x32415856; // "VXA2"
+	constexpr uint32 FILE_VERSION = 1;
+	const TCHAR* FILE_EXTENSION = TEXT(".vxa2f");
+	constexpr float QUANTIZATION_STEPS = 65535.f;
+
+	/** Fixed-size header of a cache file, followed by one FCurveRange per curve and then the quantized weights. */
+	struct FA2FCurveFileHeader
+	{
+		uint32 Magic = FILE_MAGIC;
+		uint32 Version = FILE_VERSION;
+		uint64 PCMHash = 0;
+		uint32 Fps = 0;
+		uint32 NumOfFrames = 0;
+		uint32 NumOfCurves = 0;
+		uint32 Padding = 0;
+	};
+	static_assert(sizeof(FA2FCurveFileHeader) == 32, "Changing the header layout requires bumping FILE_VERSION.");
+
+	/** A weight is stored as Min + quantized * Step. */
+	struct FCurveRange
+	{
+		float Min = 0.f;
+		float Step = 0.f;
+	};
+	static_assert(sizeof(FCurveRange) == 8, "Changing the range layout requires bumping FILE_VERSION.");
+
+	/** @return The file contents of the given curves, quantized per curve to 16 bits. */
+	TArray<uint8> QuantizeCurves(uint64 pcmHash, TConstArrayView<float> curveWeights, int32 fps)
+	{
+		constexpr int curveCount = ULipSyncDataA2F::CURVE_COUNT;
+		FA2FCurveFileHeader header;
+		header.PCMHash = pcmHash;
+		header.Fps = fps;
+		header.NumOfFrames = curveWeights.Num() / curveCount;
+		header.NumOfCurves = curveCount;
+
+		FCurveRange ranges[curveCount];
+		for (int curve = 0; curve < curveCount; curve++)
+		{
+			float min = TNumericLimits<float>::Max();
+			float max = TNumericLimits<float>::Lowest();
+			for (uint32 frame = 0; frame < header.NumOfFrames; frame++)
+			{
+				min = FMath::Min(min, curveWeights[frame * curveCount + curve]);
+				max = FMath::Max(max, curveWeights[frame * curveCount + curve]);
+			}
+			ranges[curve].Min = min;
+			ranges[curve].Step = (max - min) / QUANTIZATION_STEPS;
+		}
+
+		TArray<uint8> fileData;
+		fileData.SetNumUninitialized(sizeof(header) + sizeof(ranges) + curveWeights.Num() * sizeof(uint16));
+		FMemory::Memcpy(fileData.GetData(), &header, sizeof(header));
+		FMemory::Memcpy(fileData.GetData() + sizeof(header), ranges, sizeof(ranges));
+		uint16* quantized = reinterpret_cast<uint16*>(fileData.GetData() + sizeof(header) + sizeof(ranges));
+		for (int i = 0; i < curveWeights.Num(); i++)
+		{
+			const FCurveRange& range = ranges[i % curveCount];
+			quantized[i] = range.Step > 0.f ? static_cast<uint16>(FMath::Clamp(
+				FMath::RoundToInt((curveWeights[i] - range.Min) / range.Step), 0, 65535)) : 0;
+		}
+		return fileData;
+	}
+
+	/** @return True if the file contents are a valid result for the hash, with the dequantized weights. */
+	bool DequantizeCurves(const TArray<uint8>& fileData, uint64 pcmHash, TArray<float>& outCurveWeights, int32& outFps)
+	{
+		constexpr int curveCount = ULipSyncDataA2F::CURVE_COUNT;
+		FA2FCurveFileHeader header;
+		if (fileData.Num() < static_cast<int64>(sizeof(header)))
+		{
+			return false;
+		}
+		FMemory::Memcpy(&header, fileData.GetData(), sizeof(header));
+
+		const int64 numOfWeights = static_cast<int64>(header.NumOfFrames) * curveCount;
+		if (header.Magic != FILE_MAGIC || header.Version != FILE_VERSION || header.PCMHash != pcmHash ||
+			header.NumOfCurves != curveCount || header.Fps == 0 || header.NumOfFrames == 0 ||
+			fileData.Num() != static_cast<int64>(sizeof(header) + curveCount * sizeof(FCurveRange)) +
+			numOfWeights * static_cast<int64>(sizeof(uint16)))
+		{
+			return false;
+		}
+
+		FCurveRange ranges[curveCount];
+		FMemory::Memcpy(ranges, fileData.GetData() + sizeof(header), sizeof(ranges));
+		const uint16* quantized = reinterpret_cast<const uint16*>(fileData.GetData() + sizeof(header) + sizeof(ranges));
+		outCurveWeights.SetNumUninitialized(static_cast<int32>(numOfWeights));
+		for (int i = 0; i < numOfWeights; i++)
+		{
+			const FCurveRange& range = ranges[i % curveCount];
+			outCurveWeights[i] = range.Min + quantized[i] * range.Step;
+		}
+		outFps = header.Fps;
+		return true;
+	}
+}
+
+A2FCurveCache& A2FCurveCache::Get()
+{
+	static A2FCurveCache instance;
+	return instance;
+}
+
+bool A2FCurveCache::IsEnabled()
+{
+	return CVarA2FCurveCacheEnabled.GetValueOnAnyThread();
+}
+
+uint64 A2FCurveCache::HashSamples(const uint8* sampleData, int64 size, uint32 sampleRate, uint16 numOfChannels,
+	uint16 bitsPerSample)
+{
+	FXxHash64Builder builder;
+	builder.Update(&sampleRate, sizeof(sampleRate));
+	builder.Update(&numOfChannels, sizeof(numOfChannels));
+	builder.Update(&bitsPerSample, sizeof(bitsPerSample));
+	builder.Update(sampleData, size);
+	const uint64 hash = builder.Finalize().Hash;
+	// 0 is used as 'not hashed' by callers.
+	return hash != 0 ? hash : 1;
+}
+
+bool A2FCurveCache::TryLoad(uint64 pcmHash, TArray<float>& outCurveWeights, int32& outFps)
+{
+	if (!IsEnabled())
+	{
+		return false;
+	}
+	{
+		FScopeLock lock(&m_lock);
+		EnsureDiskIndex();
+		if (!m_diskEntries.Contains(pcmHash))
+		{
+			m_stats.Misses++;
+			return false;
+		}
+	}
+
+	const FString filePath = GetDiskFilePath(pcmHash);
+	TArray<uint8> fileData;
+	const bool isValid = FFileHelper::LoadFileToArray(fileData, *filePath, FILEREAD_Silent) &&
+		DequantizeCurves(fileData, pcmHash, outCurveWeights, outFps);
+
+	FScopeLock lock(&m_lock);
+	if (!isValid)
+	{
+		// Corrupted, outdated or deleted externally, drop it so it's regenerated & rewritten.
+		UE_LOGFMT(VoxtaLog, Warning, "Discarding invalid cached A2F lipsync {0}.", FPaths::GetCleanFilename(filePath));
+		RemoveDiskEntry(pcmHash);
+		m_stats.Misses++;
+		return false;
+	}
+
+	const FDateTime now = FDateTime::UtcNow();
+	if (FDiskEntry* diskEntry = m_diskEntries.Find(pcmHash))
+	{
+		diskEntry->LastAccess = now;
+	}
+	// The timestamp keeps the LRU order across sessions, access times are not reliably updated by all filesystems.
+	IFileManager::Get().SetTimeStamp(*filePath, now);
+	m_stats.Hits++;
+	return true;
+}
+
+void A2FCurveCache::Store(uint64 pcmHash, TConstArrayView<float> curveWeights, int32 fps)
+{
+	if (!IsEnabled() || fps <= 0 || curveWeights.Num() == 0 || curveWeights.Num() % ULipSyncDataA2F::CURVE_COUNT != 0)
+	{
+		return;
+	}
+
+	// Quantized and written to a temporary file outside of the lock, so a concurrent read never sees half a file.
+	IPlatformFile& platformFile = FPlatformFileManager::Get().GetPlatformFile();
+	const FString filePath = GetDiskFilePath(pcmHash);
+	const FString tempPath = FString::Printf(TEXT("%s.%s.tmp"), *filePath, *FGuid::NewGuid().ToString());
+	const TArray<uint8> fileData = QuantizeCurves(pcmHash, curveWeights, fps);
+	if (!platformFile.CreateDirectoryTree(*GetDiskFolder()) || !FFileHelper::SaveArrayToFile(fileData, *tempPath))
+	{
+		UE_LOGFMT(VoxtaLog, Warning, "Failed to write A2F lipsync to the curve cache, it will be regenerated next time.");
+		platformFile.DeleteFile(*tempPath);
+		return;
+	}
+
+	FScopeLock lock(&m_lock);
+	EnsureDiskIndex();
+	platformFile.DeleteFile(*filePath);
+	if (!platformFile.MoveFile(*filePath, *tempPath))
+	{
+		platformFile.DeleteFile(*tempPath);
+		RemoveDiskEntry(pcmHash);
+		return;
+	}
+
+	FDiskEntry& diskEntry = m_diskEntries.FindOrAdd(pcmHash);
+	m_diskBytes += fileData.Num() - diskEntry.FileSize;
+	diskEntry.FileSize = fileData.Num();
+	diskEntry.LastAccess = FDateTime::UtcNow();
+	m_stats.Stores++;
+	EnforceDiskBudget();
+}
+
+FA2FCurveCacheStats A2FCurveCache::GetStats() const
+{
+	FScopeLock lock(&m_lock);
+	FA2FCurveCacheStats stats = m_stats;
+	stats.DiskBytes = m_diskBytes;
+	stats.DiskEntries = m_diskEntries.Num();
+	return stats;
+}
+
+void A2FCurveCache::Clear()
+{
+	FScopeLock lock(&m_lock);
+	IFileManager::Get().DeleteDirectory(*GetDiskFolder(), false, true);
+	m_diskEntries.Empty();
+	m_diskBytes = 0;
+	m_diskIndexBuilt = false;
+	m_stats = FA2FCurveCacheStats();
+	UE_LOGFMT(VoxtaLog, Log, "Cleared the A2F curve cache.");
+}
+
+void A2FCurveCache::DumpToLog() const
+{
+	const FA2FCurveCacheStats stats = GetStats();
+	const int64 numOfLookups = stats.Hits + stats.Misses;
+	UE_LOGFMT(VoxtaLog, Log, "A2FCurveCache: {0}% hit-rate ({1} hits, {2} misses), {3} stores, {4} evictions, "
+		"{5} results on disk ({6} KiB of {7} MiB).", numOfLookups > 0 ? 100 * stats.Hits / numOfLookups : 0,
+		stats.Hits, stats.Misses, stats.Stores, stats.Evictions, stats.DiskEntries, stats.DiskBytes / 1024,
+		CVarA2FCurveCacheDiskBudgetMB.GetValueOnAnyThread());
+}
+
+FString A2FCurveCache::GetDiskFolder()
+{
+	return FPaths::Combine(FPaths::ProjectSavedDir(), TEXT("Voxta"), TEXT("A2FCurveCache"));
+}
+
+FString A2FCurveCache::GetDiskFilePath(uint64 pcmHash)
+{
+	return FPaths::Combine(GetDiskFolder(), FString::Printf(TEXT("%016llx%s"), pcmHash, FILE_EXTENSION));
+}
+
+void A2FCurveCache::EnsureDiskIndex()
+{
+	if (m_diskIndexBuilt)
+	{
+		return;
+	}
+	m_diskIndexBuilt = true;
+
+	IFileManager::Get().IterateDirectoryStat(*GetDiskFolder(),
+		[this] (const TCHAR* path, const FFileStatData& statData)
+		{
+			const FString fileName = FPaths::GetBaseFilename(path);
+			if (!statData.bIsDirectory && FPaths::GetExtension(path, true) == FILE_EXTENSION && fileName.Len() == 16)
+			{
+				FDiskEntry& diskEntry = m_diskEntries.Add(FParse::HexNumber64(*fileName));
+				diskEntry.FileSize = statData.FileSize;
+				diskEntry.LastAccess = statData.ModificationTime;
+				m_diskBytes += statData.FileSize;
+			}
+			return true;
+		});
+	UE_LOGFMT(VoxtaLog, Log, "Found {0} A2F lipsync results ({1} KiB) in the curve cache.",
+		m_diskEntries.Num(), m_diskBytes / 1024);
+	EnforceDiskBudget();
+}
+
+void A2FCurveCache::EnforceDiskBudget()
+{
+	const int64 budget = static_cast<int64>(FMath::Max(CVarA2FCurveCacheDiskBudgetMB.GetValueOnAnyThread(), 0)) *
+		1024 * 1024;
+	if (m_diskBytes <= budget)
+	{
+		return;
+	}
+
+	TArray<TPair<uint64, FDiskEntry>> byAccessTime = m_diskEntries.Array();
+	byAccessTime.Sort([] (const TPair<uint64, FDiskEntry>& a, const TPair<uint64, FDiskEntry>& b)
+	{
+		return a.Value.LastAccess < b.Value.LastAccess;
+	});
+
+	for (const TPair<uint64, FDiskEntry>& diskEntry : byAccessTime)
+	{
+		if (m_diskBytes <= budget)
+		{
+			break;
+		}
+		RemoveDiskEntry(diskEntry.Key);
+		m_stats.Evictions++;
+	}
+}
+
+void A2FCurveCache::RemoveDiskEntry(uint64 pcmHash)
+{
+	FDiskEntry diskEntry;
+	if (m_diskEntries.RemoveAndCopyValue(pcmHash, diskEntry))
+	{
+		m_diskBytes -= diskEntry.FileSize;
+	}
+	IFileManager::Get().Delete(*GetDiskFilePath(pcmHash), false, false, true);
+}
@@ -7,11 +7,49 @@
 #include "Logging/StructuredLog.h"
 #include "VoxtaDefines.h"
 #include "Components/AudioComponent.h"
+#include "Animation/AnimCurveUtils.h"
+
+namespace
+{
+	/** @return The group of an ARKit curve, by its index in UAudio2FacePlaybackHandler::CURVE_NAMES. */
+	EA2FCurveGroup GetCurveGroup(int curveIndex)
+	{
+		if (curveIndex <= 13)
+		{
+			return EA2FCurveGroup::Eyes;
+		}
+		if (curveIndex <= 17)
+		{
+			return EA2FCurveGroup::Jaw;
+		}
+		if (curveIndex <= 40)
+		{
+			return EA2FCurveGroup::Mouth;
+		}
+		if (curveIndex <= 45)
+		{
+			return EA2FCurveGroup::Brows;
+		}
+		if (curveIndex <= 48)
+		{
+			return EA2FCurveGroup::Cheeks;
+		}
+		if (curveIndex <= 50)
+		{
+			return EA2FCurveGroup::Nose;
+		}
+		return EA2FCurveGroup::Tongue;
+	}
+}
 
 void FAnimNode_ApplyCustomCurves::Update_AnyThread(const FAnimationUpdateContext& Context)
 {
 	GetEvaluateGraphExposedInputs().Execute(Context);
 	m_source.Update(Context);
+
+	// Hand the snapshot of PreUpdate to the evaluation, the next PreUpdate writes into the other buffer.
+	m_readIndex = m_writeIndex;
+	m_writeIndex = 1 - m_readIndex;
 }
 
 void FAnimNode_ApplyCustomCurves::PreUpdate(const UAnimInstance* AnimInstance)
@@ -22,7 +60,11 @@ void FAnimNode_ApplyCustomCurves::PreUpdate(const UAnimInstance* AnimInstance)
 		// Check if we're playing, otherwise this will trigger in blueprint editor when previewing
 		return;
 	}
-	m_cachedWeights.Init(0.f, UE_ARRAY_COUNT(UAudio2FacePlaybackHandler::CURVE_NAMES));
+	m_hasWeights[m_writeIndex] = false;
+	if (m_builtCurveMask != m_curveMask)
+	{
+		BuildCurveLookup();
+	}
 
 	if (m_curveSource == nullptr)
 	{
@@ -49,8 +91,8 @@ void FAnimNode_ApplyCustomCurves::PreUpdate(const UAnimInstance* AnimInstance)
 
 	if (m_curveSource != nullptr)
 	{
-		m_cachedWeights.Reset();
-		m_curveSource->GetA2FCurveWeightsPreUpdate(m_cachedWeights);
+		m_hasWeights[m_writeIndex] = m_curveSource->GetA2FCurveWeightsPreUpdate(
+			MakeArrayView(m_weightBuffers[m_writeIndex], CURVE_COUNT));
 	}
 }
 
@@ -58,23 +100,65 @@ void FAnimNode_ApplyCustomCurves::Evaluate_AnyThread(FPoseContext& Output)
 {
 	m_source.Evaluate(Output);
 
-	if (m_cachedWeights.Num() > 0)
+	// Neutral or fully masked, the source pose already has the curves it should have.
+	if (!m_hasWeights[m_readIndex] || m_sortedCurveIndices.IsEmpty())
 	{
-		if (m_cachedWeights.Num() != UAudio2FacePlaybackHandler::CURVE_COUNT)
-		{
-			UE_LOGFMT(VoxtaLog, Error, "A2F curve count was different then ARKIT curve count, this is not supported.");
-			return;
-		}
+		return;
+	}
 
-		for (int i = 0; i < m_cachedWeights.Num(); ++i)
+	const float* weights = m_weightBuffers[m_readIndex];
+	UE::Anim::FCurveUtils::BuildSorted(m_lipSyncCurve, m_sortedCurveIndices.Num(),
+		[this] (int32 index)
 		{
-			Output.Curve.Set(UAudio2FacePlaybackHandler::CURVE_NAMES[i], m_cachedWeights[i]);
-		}
-	}
+			return UAudio2FacePlaybackHandler::CURVE_NAMES[m_sortedCurveIndices[index]];
+		},
+		[this, weights] (int32 index)
+		{
+			return weights[m_sortedCurveIndices[index]];
+		});
+	Output.Curve.Combine(m_lipSyncCurve);
 }
 
 void FAnimNode_ApplyCustomCurves::GatherDebugData(FNodeDebugData& DebugData)
 {
 	FAnimNode_Base::GatherDebugData(DebugData);
 	m_source.GatherDebugData(DebugData);
+}
+
+void FAnimNode_ApplyCustomCurves::BuildCurveLookup()
+{
+	TArray<uint8, TFixedAllocator<CURVE_COUNT>> maskedCurveIndices;
+	for (int i = 0; i < CURVE_COUNT; i++)
+	{
+		if (EnumHasAnyFlags(static_cast<EA2FCurveGroup>(m_curveMask), GetCurveGroup(i)))
+		{
+			maskedCurveIndices.Add(static_cast<uint8>(i));
+		}
+	}
+
+	// Let the engine sort the names once, so every evaluation can write them in that order with BuildSorted.
+	FBlendedCurve sortedCurve;
+	UE::Anim::FCurveUtils::BuildUnsorted(sortedCurve, maskedCurveIndices.Num(),
+		[&maskedCurveIndices] (int32 index)
+		{
+			return UAudio2FacePlaybackHandler::CURVE_NAMES[maskedCurveIndices[index]];
+		},
+		[] (int32)
+		{
+			return 0.f;
+		});
+
+	m_sortedCurveIndices.Reset();
+	sortedCurve.ForEachElement([this] (const UE::Anim::FCurveElement& element)
+		{
+			for (uint8 i = 0; i < CURVE_COUNT; i++)
+			{
+				if (UAudio2FacePlaybackHandler::CURVE_NAMES[i] == element.Name)
+				{
+					m_sortedCurveIndices.Add(i);
+					break;
+				}
+			}
+		});
+	m_builtCurveMask = m_curveMask;
 }
\ No newline at end of file
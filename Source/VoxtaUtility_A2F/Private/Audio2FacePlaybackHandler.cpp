@@ -3,7 +3,9 @@
 #include "Audio2FacePlaybackHandler.h"
 #include "VoxtaDefines.h"
 #include "Logging/StructuredLog.h"
+#include "LipSyncSamplingSubsystem.h"
 #include "Components/AudioComponent.h"
+#include "RuntimeAudioImporter/ImportedSoundWave.h"
 
 // ArkitNames https://developer.apple.com/documentation/arkit/arfaceanchor/blendshapelocation
 const FName UAudio2FacePlaybackHandler::CURVE_NAMES[UAudio2FacePlaybackHandler::CURVE_COUNT] =
@@ -73,38 +75,57 @@ void UAudio2FacePlaybackHandler::Initialize(UAudioComponent* audioComponent)
 	m_audioComponent = audioComponent;
 }
 
-void UAudio2FacePlaybackHandler::GetA2FCurveWeights(TArray<float>& targetArrayRef)
+bool UAudio2FacePlaybackHandler::GetA2FCurveWeights(TArrayView<float> outCurves) const
 {
-	if (m_forcedNeutral)
+	if (m_forcedNeutral.load(std::memory_order_acquire) || outCurves.Num() < CURVE_COUNT)
 	{
-		targetArrayRef.Init(0.f, UAudio2FacePlaybackHandler::CURVE_COUNT);
+		return false;
 	}
-	else
+
+	// The writer only reuses the published buffer after publishing the other one, so an unchanged sequence means the
+	// copy is complete. A torn copy after the last attempt only mixes two consecutive samples.
+	constexpr int MAX_READ_ATTEMPTS = 4;
+	for (int attempt = 0; attempt < MAX_READ_ATTEMPTS; attempt++)
 	{
-		FScopeLock Lock(&m_curvesGuard);
-		targetArrayRef = m_currentCurves;
+		const uint32 sequence = m_curveSequence.load(std::memory_order_acquire);
+		FMemory::Memcpy(outCurves.GetData(), m_curveBuffers[sequence & 1], sizeof(m_curveBuffers[0]));
+		std::atomic_thread_fence(std::memory_order_acquire);
+		if (m_curveSequence.load(std::memory_order_relaxed) == sequence)
+		{
+			break;
+		}
 	}
+	return true;
 }
 
 void UAudio2FacePlaybackHandler::Play(const ULipSyncDataA2F* lipsyncData)
 {
 	if (!m_audioComponent)
 	{
-		UE_LOGFMT(VoxtaLog, Error, "Play() called before Initialise() or after Stop(); aborting to avoid crash.");
+		UE_LOGFMT(VoxtaLog, Error, "Play() called before Initialise(); aborting to avoid crash.");
 		return;
 	}
 
 	m_lipsyncData = lipsyncData;
-	m_forcedNeutral = false;
+	PublishCurves(INDEX_NONE);
+	m_forcedNeutral.store(false, std::memory_order_release);
 
+	UE_LOGFMT(VoxtaLog, Log, "Starting playback of audio, along with A2F lip syncing.");
+	UnregisterTimeline();
+	m_importedSoundWave = Cast<UImportedSoundWave>(m_audioComponent->Sound);
+	UWorld* world = m_audioComponent->GetWorld();
+	ULipSyncSamplingSubsystem* samplingSubsystem = world != nullptr ?
+		world->GetSubsystem<ULipSyncSamplingSubsystem>() : nullptr;
+	if (samplingSubsystem != nullptr && m_importedSoundWave.IsValid())
 	{
-		FScopeLock Lock(&m_curvesGuard);
-		m_currentCurves.Init(0.f, UAudio2FacePlaybackHandler::CURVE_COUNT);
+		samplingSubsystem->Register(this);
+		m_samplingSubsystem = samplingSubsystem;
+	}
+	else
+	{
+		m_playbackPercentHandle = m_audioComponent->OnAudioPlaybackPercentNative.AddUObject(
+			this, &UAudio2FacePlaybackHandler::OnAudioPlaybackPercent);
 	}
-
-	UE_LOGFMT(VoxtaLog, Log, "Starting playback of audio, along with A2F lip syncing.");
-	m_playbackPercentHandle = m_audioComponent->OnAudioPlaybackPercentNative.AddUObject(
-		this, &UAudio2FacePlaybackHandler::OnAudioPlaybackPercent);
 	m_playbackFinishedHandle = m_audioComponent->OnAudioFinishedNative.AddUObject(
 		this, &UAudio2FacePlaybackHandler::OnAudioPlaybackFinished);
 	m_audioComponent->Play();
@@ -117,15 +138,32 @@ void UAudio2FacePlaybackHandler::Stop()
 		return;
 	}
 
+	// The component is kept, the handler plays every chunk of the owning playback component.
+	UnregisterTimeline();
 	m_audioComponent->Stop();
 	m_audioComponent->OnAudioPlaybackPercentNative.Remove(m_playbackPercentHandle);
 	m_audioComponent->OnAudioFinishedNative.Remove(m_playbackFinishedHandle);
-	m_audioComponent = nullptr;
+	m_playbackPercentHandle.Reset();
+	m_playbackFinishedHandle.Reset();
+	// The data goes back to the VoxtaObjectPool once its chunk is cleaned up.
+	m_lipsyncData = nullptr;
 	InitNeutralPose();
 }
 
+void UAudio2FacePlaybackHandler::SampleTimeline()
+{
+	const UImportedSoundWave* soundWave = m_importedSoundWave.Get();
+	if (m_lipsyncData == nullptr || soundWave == nullptr)
+	{
+		return;
+	}
+	// Past the last frame is clamped on it, like the percent-driven fallback.
+	PublishCurves(soundWave->GetPlaybackTime() * m_lipsyncData->GetFramePerSecond());
+}
+
 void UAudio2FacePlaybackHandler::BeginDestroy()
 {
+	UnregisterTimeline();
 	if (m_audioComponent)
 	{
 		if (m_playbackPercentHandle.IsValid())
@@ -155,50 +193,49 @@ void UAudio2FacePlaybackHandler::OnAudioPlaybackPercent(const UAudioComponent*,
 		InitNeutralPose();
 		return;
 	}
-	float currentFrame = soundWave->Duration * m_lipsyncData->GetFramePerSecond() * Percent;
-	float totalFrameCount = m_lipsyncData->GetA2FCurveWeights().Num();
-	int closestFrame = FMath::RoundToInt(currentFrame);
-	if (closestFrame >= totalFrameCount)
-	{
-		closestFrame = totalFrameCount - 1;
-		UE_LOGFMT(VoxtaLog, Warning, "The closest frame was outside of bounds, this should be impossible.");
-	}
-	FScopeLock Lock(&m_curvesGuard);
-
-	if (FMath::IsNearlyEqual(currentFrame, closestFrame))
-	{
-		m_currentCurves = m_lipsyncData->GetA2FCurveWeights()[closestFrame];
-		return;
-	}
-	int ceilingFrame = FMath::CeilToInt(currentFrame);
-	int floorFrame = FMath::FloorToInt(currentFrame);
-	if (ceilingFrame < totalFrameCount)
-	{
-		float normalizedBlend = currentFrame - floorFrame;
-		const TArray<float>& floor = m_lipsyncData->GetA2FCurveWeights()[floorFrame];
-		const TArray<float>& ceiling = m_lipsyncData->GetA2FCurveWeights()[ceilingFrame];
-
-		const int32 NumCurves = floor.Num();
-		m_currentCurves.SetNum(NumCurves);
-		for (int32 i = 0; i < NumCurves; ++i)
-		{
-			m_currentCurves[i] = (floor[i] * (1.f - normalizedBlend)) + (ceiling[i] * normalizedBlend);
-		}
-	}
-	else
+	const float currentFrame = soundWave->Duration * m_lipsyncData->GetFramePerSecond() * Percent;
+	if (currentFrame > m_lipsyncData->GetNumOfFrames() - 1)
 	{
 		UE_LOGFMT(VoxtaLog, Warning, "Requesting more frames than rendered by A2F, clamping on last frame.");
-		m_currentCurves = m_lipsyncData->GetA2FCurveWeights()[totalFrameCount - 1];
 	}
+
+	PublishCurves(currentFrame);
 }
 
 void UAudio2FacePlaybackHandler::OnAudioPlaybackFinished(UAudioComponent* audioComponent)
 {
+	// A stopped sound reports finished late, possibly after the next voiceline already started playing.
+	const UImportedSoundWave* soundWave = m_importedSoundWave.Get();
+	if (soundWave != nullptr && !soundWave->IsPlaybackFinished() && audioComponent->IsPlaying())
+	{
+		return;
+	}
 	Stop();
 }
 
 void UAudio2FacePlaybackHandler::InitNeutralPose()
 {
 	UE_LOGFMT(VoxtaLog, Log, "Defaulting A2F lipsync pose back to neutral.");
-	m_forcedNeutral = true;
+	m_forcedNeutral.store(true, std::memory_order_release);
+}
+
+void UAudio2FacePlaybackHandler::UnregisterTimeline()
+{
+	if (ULipSyncSamplingSubsystem* samplingSubsystem = m_samplingSubsystem.Get())
+	{
+		samplingSubsystem->Unregister(this);
+	}
+	m_samplingSubsystem.Reset();
+	m_importedSoundWave.Reset();
+}
+
+void UAudio2FacePlaybackHandler::PublishCurves(float frame)
+{
+	const uint32 sequence = m_curveSequence.load(std::memory_order_relaxed);
+	float* backBuffer = m_curveBuffers[(sequence + 1) & 1];
+	if (frame == INDEX_NONE || m_lipsyncData == nullptr || !m_lipsyncData->SampleCurves(frame, backBuffer))
+	{
+		FMemory::Memzero(backBuffer, sizeof(m_curveBuffers[0]));
+	}
+	m_curveSequence.store(sequence + 1, std::memory_order_release);
 }
\ No newline at end of file
@@ -12,292 +12,680 @@
 #include "Serialization/JsonSerializer.h"
 #include "Serialization/JsonWriter.h"
 #include "Misc/Paths.h"
+#include "Misc/ScopeLock.h"
+#include "HAL/IConsoleManager.h"
+#include "Async/Async.h"
+#include "LogUtility/Public/Defines.h"
+
+namespace
+{
+	TAutoConsoleVariable<FString> CVarA2FEndpoints(
+		TEXT("voxta.A2F.Endpoints"),
+		TEXT("http://localhost:8011"),
+		TEXT("Comma-separated base urls of the A2F headless instances that solve blendshape jobs, one job per instance "
+			"at a time. Read when A2F is initialized."));
+
+	/** The handler that the dump command reports on, the most recently initialized one. */
+	TWeakPtr<Audio2FaceRESTHandler> dumpTarget;
+
+	FAutoConsoleCommand A2FDumpCommand(
+		TEXT("voxta.A2F.Dump"),
+		TEXT("Log the state of the A2F endpoints and the queue wait & solve times of the blendshape jobs."),
+		FConsoleCommandDelegate::CreateLambda([] ()
+		{
+			if (TSharedPtr<Audio2FaceRESTHandler> handler = dumpTarget.Pin())
+			{
+				handler->DumpToLog();
+			}
+			else
+			{
+				UE_LOGFMT(VoxtaLog, Log, "A2F has not been initialized.");
+			}
+		}));
+
+	bool IsCancelled(const FVoxtaCancellationTokenPtr& token)
+	{
+		return token.IsValid() && token->IsCancelled();
+	}
+}
+
+Audio2FaceRESTHandler::Audio2FaceRESTHandler(const TArray<FString>& endpointUrls) :
+	m_configuredEndpointUrls(endpointUrls),
+	m_contentDir(IPluginManager::Get().FindPlugin("UnrealVoxta")->GetContentDir())
+{}
 
 void Audio2FaceRESTHandler::TryInitialize()
 {
-	if (m_currentState != CurrentA2FState::NotConnected)
+	TArray<TPair<int32, FString>> endpointsToInitialize;
 	{
-		return;
+		FScopeLock lock(&m_lock);
+		if (m_endpoints.IsEmpty())
+		{
+			TArray<FString> endpointUrls = m_configuredEndpointUrls;
+			if (endpointUrls.IsEmpty())
+			{
+				CVarA2FEndpoints.GetValueOnAnyThread().ParseIntoArray(endpointUrls, TEXT(","));
+			}
+			for (FString& endpointUrl : endpointUrls)
+			{
+				endpointUrl.TrimStartAndEndInline();
+				endpointUrl.RemoveFromEnd(TEXT("/"));
+				if (!endpointUrl.IsEmpty())
+				{
+					m_endpoints.AddDefaulted_GetRef().BaseUrl = endpointUrl;
+				}
+			}
+		}
+
+		for (int i = 0; i < m_endpoints.Num(); i++)
+		{
+			if (m_endpoints[i].State == CurrentA2FState::NotConnected)
+			{
+				m_endpoints[i].State = CurrentA2FState::Initializing;
+				endpointsToInitialize.Emplace(i, m_endpoints[i].BaseUrl);
+			}
+		}
 	}
+	dumpTarget = AsShared();
 
-	m_currentState = CurrentA2FState::Initializing;
-	AsyncTask(ENamedThreads::AnyThread, [Self = TWeakPtr<Audio2FaceRESTHandler>(AsShared())] ()
+	for (const TPair<int32, FString>& endpoint : endpointsToInitialize)
 	{
-		if (TSharedPtr<Audio2FaceRESTHandler> SharedSelf = Self.Pin())
+		InitializeEndpoint(endpoint.Key, endpoint.Value);
+	}
+}
+
+void Audio2FaceRESTHandler::InitializeEndpoint(int32 endpointIndex, const FString& baseUrl)
+{
+	GetStatus(baseUrl, [Self = TWeakPtr<Audio2FaceRESTHandler>(AsShared()), endpointIndex, baseUrl]
+		(FHttpRequestPtr req, FHttpResponsePtr resp, bool success)
 		{
-			SharedSelf->GetStatus(
-				[Self2 = TWeakPtr<Audio2FaceRESTHandler>(SharedSelf->AsShared())]
-				(FHttpRequestPtr req, FHttpResponsePtr resp, bool success)
+			TSharedPtr<Audio2FaceRESTHandler> sharedSelf = Self.Pin();
+			if (!sharedSelf.IsValid())
+			{
+				UE_LOGFMT(VoxtaLog, Error, "Audio2FaceRESTHandler was destroyed before the response of the "
+					"GetStatus request was able to be handled. Aborting initialization...");
+				return;
+			}
+			if (!success || !resp.IsValid() || resp->GetContentAsString() != TEXT("\"OK\""))
+			{
+				SENSITIVE_LOG1(VoxtaLog, Warning, "Audio2FaceRESTHandler status request to {0} was not completed "
+					"successfully, assuming we don't want A2F there, Aborting initialization...", baseUrl);
+				sharedSelf->OnEndpointInitialized(endpointIndex, false);
+				return;
+			}
+
+			sharedSelf->LoadUsdFile(baseUrl, [Self, endpointIndex, baseUrl]
+				(FHttpRequestPtr req2, FHttpResponsePtr resp2, bool success2)
 				{
-					if (TSharedPtr<Audio2FaceRESTHandler> SharedSelf2 = Self2.Pin())
+					TSharedPtr<Audio2FaceRESTHandler> sharedSelf2 = Self.Pin();
+					if (!sharedSelf2.IsValid())
 					{
-						if (success)
-						{
-							UE_LOGFMT(VoxtaLog, Log, "{0}", resp->GetContentAsString());
-							success = success && resp->GetContentAsString() == TEXT("\"OK\"");
-
-							SharedSelf2->LoadUsdFile(
-								[Self3 = TWeakPtr<Audio2FaceRESTHandler>(SharedSelf2->AsShared())]
-								(FHttpRequestPtr req2, FHttpResponsePtr resp2, bool success2)
-								{
-									if (TSharedPtr<Audio2FaceRESTHandler> SharedSelf3 = Self3.Pin())
-									{
-										UE_LOGFMT(VoxtaLog, Log, "{0}", resp2->GetContentAsString());
-										if (success2)
-										{
-											SharedSelf3->SetPlayerRootPath(
-												[Self4 = TWeakPtr<Audio2FaceRESTHandler>(SharedSelf3->AsShared())]
-												(FHttpRequestPtr req3, FHttpResponsePtr resp3, bool success3)
-												{
-													if (TSharedPtr<Audio2FaceRESTHandler> SharedSelf4 = Self4.Pin())
-													{
-														UE_LOGFMT(VoxtaLog, Log, "{0}", resp3->GetContentAsString());
-														if (success3)
-														{
-															SharedSelf4->m_currentState = CurrentA2FState::Idle;
-														}
-														else
-														{
-															UE_LOGFMT(VoxtaLog, Error, "Audio2FaceRESTHandler SetPlayerRootPath request was not completed successfully, "
-																"this should never happen, A2F will not be able to find our audio files, Aborting initialization...");
-															SharedSelf4->m_currentState = CurrentA2FState::NotConnected;
-														}
-													}
-													else
-													{
-														UE_LOGFMT(VoxtaLog, Error, "Audio2FaceRESTHandler was destroyed before the response of the "
-															"SetPlayerRootPath request was able to be handled. Aborting initialization...");
-													}
-												});
-										}
-										else
-										{
-											UE_LOGFMT(VoxtaLog, Error, "Audio2FaceRESTHandler loadUSD request was not completed successfully, "
-												"this should never happen, but either way, we can use A2F without this, Aborting initialization...");
-											SharedSelf3->m_currentState = CurrentA2FState::NotConnected;
-										}
-									}
-									else
-									{
-										UE_LOGFMT(VoxtaLog, Error, "Audio2FaceRESTHandler was destroyed before the response of the "
-											"LoadUsdFile request was able to be handled. Aborting initialization...");
-									}
-								});
-						}
-						else
-						{
-							UE_LOGFMT(VoxtaLog, Warning, "Audio2FaceRESTHandler status request was not completed successfully, "
-								"assuming we don't want A2F, Aborting initialization...");
-							SharedSelf2->m_currentState = CurrentA2FState::NotConnected;
-						}
+						UE_LOGFMT(VoxtaLog, Error, "Audio2FaceRESTHandler was destroyed before the response of the "
+							"LoadUsdFile request was able to be handled. Aborting initialization...");
+						return;
 					}
-					else
+					if (!success2)
 					{
-						UE_LOGFMT(VoxtaLog, Error, "Audio2FaceRESTHandler was destroyed before the response of the "
-							"GetStatus request was able to be handled. Aborting initialization...");
+						UE_LOGFMT(VoxtaLog, Error, "Audio2FaceRESTHandler loadUSD request was not completed successfully, "
+							"this should never happen, but either way, we can use A2F without this, Aborting initialization...");
+						sharedSelf2->OnEndpointInitialized(endpointIndex, false);
+						return;
 					}
+					UE_LOGFMT(VoxtaLog, Log, "{0}", resp2->GetContentAsString());
+
+					sharedSelf2->SetPlayerRootPath(baseUrl, [Self, endpointIndex]
+						(FHttpRequestPtr req3, FHttpResponsePtr resp3, bool success3)
+						{
+							TSharedPtr<Audio2FaceRESTHandler> sharedSelf3 = Self.Pin();
+							if (!sharedSelf3.IsValid())
+							{
+								UE_LOGFMT(VoxtaLog, Error, "Audio2FaceRESTHandler was destroyed before the response of the "
+									"SetPlayerRootPath request was able to be handled. Aborting initialization...");
+								return;
+							}
+							if (!success3)
+							{
+								UE_LOGFMT(VoxtaLog, Error, "Audio2FaceRESTHandler SetPlayerRootPath request was not completed successfully, "
+									"this should never happen, A2F will not be able to find our audio files, Aborting initialization...");
+							}
+							sharedSelf3->OnEndpointInitialized(endpointIndex, success3);
+						});
 				});
+		});
+}
+
+void Audio2FaceRESTHandler::OnEndpointInitialized(int32 endpointIndex, bool success)
+{
+	TArray<TSharedRef<FBlendshapeJob, ESPMode::ThreadSafe>> orphanedJobs;
+	{
+		FScopeLock lock(&m_lock);
+		FEndpoint& endpoint = m_endpoints[endpointIndex];
+		endpoint.State = success ? CurrentA2FState::Idle : CurrentA2FState::NotConnected;
+		// The initialization ends with SetRootPath, so the first job doesn't have to send it again.
+		endpoint.HasRootPath = success;
+		endpoint.LoadedTrack.Reset();
+		if (success)
+		{
+			SENSITIVE_LOG1(VoxtaLog, Log, "A2F endpoint {0} is ready to solve blendshapes.", endpoint.BaseUrl);
 		}
-		else
+
+		const bool canSolveJobs = m_endpoints.ContainsByPredicate([] (const FEndpoint& other)
+			{
+				return other.State != CurrentA2FState::NotConnected;
+			});
+		if (!canSolveJobs)
 		{
-			UE_LOGFMT(VoxtaLog, Error, "Audio2FaceRESTHandler was destroyed before the background thread was able "
-					"to start. Aborting initialization...");
+			orphanedJobs = MoveTemp(m_queue);
+			m_queue.Reset();
+			for (const TSharedRef<FBlendshapeJob, ESPMode::ThreadSafe>& job : orphanedJobs)
+			{
+				m_stats[static_cast<uint8>(job->Priority)].NumOfFailures++;
+			}
 		}
-	});
+	}
+
+	for (const TSharedRef<FBlendshapeJob, ESPMode::ThreadSafe>& job : orphanedJobs)
+	{
+		UE_LOGFMT(VoxtaLog, Warning, "No A2F endpoint could be initialized, dropping queued blendshape job {0}.", job->Id);
+		NotifyJob(job, false);
+	}
+	Pump();
 }
 
-void Audio2FaceRESTHandler::GetBlendshapes(const FString& wavFileName, const FString& shapesFilePath, const FString& shapesFileName,
+uint64 Audio2FaceRESTHandler::GetBlendshapes(const FString& wavFileName, const FString& shapesFilePath,
+	const FString& shapesFileName, A2FJobPriority priority, FVoxtaCancellationTokenPtr cancellationToken,
 	TFunction<void(const FString&, bool /*success*/)> callback)
 {
-	if (m_currentState != CurrentA2FState::Idle)
+	TSharedRef<FBlendshapeJob, ESPMode::ThreadSafe> job = MakeShared<FBlendshapeJob, ESPMode::ThreadSafe>();
+	job->WavFileName = wavFileName;
+	job->ShapesFilePath = shapesFilePath;
+	job->ShapesFileName = shapesFileName;
+	job->Priority = priority;
+	job->CancellationToken = cancellationToken;
+	job->Callback = MoveTemp(callback);
 	{
-		UE_LOGFMT(VoxtaLog, Error, "RESTHandler busy, GetBlendshapes request rejected; "
-			"always check if the RESTHandler is busy before trying to request A2F blendshape generation, skipping request");
-		AsyncTask(ENamedThreads::GameThread, [Callback = callback] () { Callback(FString(), false); });
-		return;
+		FScopeLock lock(&m_lock);
+		const bool canSolveJobs = m_endpoints.ContainsByPredicate([] (const FEndpoint& endpoint)
+			{
+				return endpoint.State != CurrentA2FState::NotConnected;
+			});
+		if (!canSolveJobs)
+		{
+			UE_LOGFMT(VoxtaLog, Error, "No A2F endpoint is connected or initializing, GetBlendshapes request rejected; "
+				"make sure A2F headless is running and initialized before requesting blendshape generation.");
+			NotifyJob(job, false);
+			return 0;
+		}
+
+		job->Id = m_nextJobId++;
+		job->QueuedTime = FPlatformTime::Seconds();
+		m_stats[static_cast<uint8>(priority)].NumOfJobs++;
+		m_queue.Add(job);
+		// Stable, so each class stays in the order it was queued.
+		m_queue.StableSort([] (const TSharedRef<FBlendshapeJob, ESPMode::ThreadSafe>& a,
+			const TSharedRef<FBlendshapeJob, ESPMode::ThreadSafe>& b)
+			{
+				return a->Priority < b->Priority;
+			});
 	}
-	m_currentState = CurrentA2FState::Busy;
 
-	AsyncTask(ENamedThreads::AnyThread,
-		[Self = TWeakPtr<Audio2FaceRESTHandler>(AsShared()), WavFileName0 = wavFileName, ShapesFilePath0 = shapesFilePath,
-		ShapesFileName0 = shapesFileName, Callback0 = callback]()
+	// Registered after queueing, so a token that is already cancelled removes the job right away.
+	if (cancellationToken.IsValid())
+	{
+		cancellationToken->OnCancelled([Self = TWeakPtr<Audio2FaceRESTHandler>(AsShared()), JobId = job->Id] ()
 		{
-			if (TSharedPtr<Audio2FaceRESTHandler> SharedSelf = Self.Pin())
-			{
-				SharedSelf->SetPlayerRootPath(
-					[Self2 = TWeakPtr<Audio2FaceRESTHandler>(SharedSelf->AsShared()), ShapesFilePath1 = ShapesFilePath0, ShapesFileName1 = ShapesFileName0, Callback1 = Callback0, WavFileName1 = WavFileName0] (FHttpRequestPtr req, FHttpResponsePtr resp, bool success)
-					{
-						if (TSharedPtr<Audio2FaceRESTHandler> SharedSelf2 = Self2.Pin())
-						{
-							if (!success)
-							{
-								UE_LOGFMT(VoxtaLog, Warning, "SetPlayerRootPath failed, aborting GetBlendshapes");
-								SharedSelf2->m_currentState = CurrentA2FState::Idle;
-								AsyncTask(ENamedThreads::GameThread, [Callback1] () { Callback1(FString(), false); });
-								return;
-							}
-							SharedSelf2->SetPlayerTrack(WavFileName1,
-								[Self3 = TWeakPtr<Audio2FaceRESTHandler>(SharedSelf2->AsShared()), ShapesFilePath2 = ShapesFilePath1, ShapesFileName2 = ShapesFileName1, Callback2 = Callback1] (FHttpRequestPtr req, FHttpResponsePtr resp, bool success)
-								{
-									if (TSharedPtr<Audio2FaceRESTHandler> SharedSelf3 = Self3.Pin())
-									{
-										bool totalSuccess = success;
-										if (success)
-										{
-											TSharedPtr<FJsonObject> JsonObject;
-											TSharedRef<TJsonReader<>> Reader = TJsonReaderFactory<>::Create(resp->GetContentAsString());
-											if (FJsonSerializer::Deserialize(Reader, JsonObject) && JsonObject.IsValid())
-											{
-												totalSuccess = totalSuccess && JsonObject->GetStringField(TEXT("status")) == TEXT("OK");
-											}
-											else
-											{
-												totalSuccess = false;
-											}
-										}
-										UE_LOGFMT(VoxtaLog, Log, "{0}", resp->GetContentAsString());
-
-										if (!totalSuccess)
-										{
-											UE_LOGFMT(VoxtaLog, Warning, "SetPlayerTrack failed, aborting GetBlendshapes");
-											SharedSelf3->m_currentState = CurrentA2FState::Idle;
-											AsyncTask(ENamedThreads::GameThread,
-												[totalSuccess, Callback3 = Callback2] ()
-												{
-													Callback3(FString(), totalSuccess);
-												});
-											return;
-										}
-
-										UE_LOGFMT(VoxtaLog, Log, "SetPlayerTrack success");
-
-										SharedSelf3->GenerateBlendShapes(ShapesFilePath2, ShapesFileName2,
-											[Self4 = TWeakPtr<Audio2FaceRESTHandler>(SharedSelf3->AsShared()), TotalSuccess = totalSuccess, ShapesFilePath3 = ShapesFilePath2, ShapesFileName3 = ShapesFileName2, Callback3 = Callback2] (FHttpRequestPtr req, FHttpResponsePtr resp, bool success)
-											{
-												if (TSharedPtr<Audio2FaceRESTHandler> SharedSelf4 = Self4.Pin())
-												{
-													bool totalSuccess = TotalSuccess && success;
-													if (success)
-													{
-														TSharedPtr<FJsonObject> JsonObject;
-														TSharedRef<TJsonReader<>> Reader = TJsonReaderFactory<>::Create(resp->GetContentAsString());
-														if (FJsonSerializer::Deserialize(Reader, JsonObject) && JsonObject.IsValid())
-														{
-															totalSuccess = totalSuccess && JsonObject->GetStringField(TEXT("status")) == TEXT("OK");
-														}
-														else
-														{
-															totalSuccess = false;
-														}
-													}
-													UE_LOGFMT(VoxtaLog, Log, "{0}", resp->GetContentAsString());
-
-													AsyncTask(ENamedThreads::GameThread,
-														[Self5 = TWeakPtr<Audio2FaceRESTHandler>(SharedSelf4->AsShared()), TotalSuccess2 = totalSuccess, ShapesFilePath4 = ShapesFilePath3, ShapesFileName4 = ShapesFileName3, Callback4 = Callback3] ()
-														{
-															if (TSharedPtr<Audio2FaceRESTHandler> SharedSelf5 = Self5.Pin())
-															{
-																if (TotalSuccess2)
-																{
-																	UE_LOGFMT(VoxtaLog, Log, "GenerateBlendShapes success");
-																	SharedSelf5->m_currentState = CurrentA2FState::Idle;
-																	Callback4(FPaths::Combine(ShapesFilePath4, ShapesFileName4), TotalSuccess2);
-																}
-																else
-																{
-																	UE_LOGFMT(VoxtaLog, Warning, "GenerateBlendShapes failed, aborting GetBlendshapes");
-																	SharedSelf5->m_currentState = CurrentA2FState::Idle;
-																	Callback4(FString(), TotalSuccess2);
-																	return;
-																}
-															}
-															else
-															{
-																UE_LOGFMT(VoxtaLog, Error, "Audio2FaceRESTHandler was destroyed before the we could send the response of the "
-																	" blendshapes back to the gamethread. Aborting blendshape generation...");
-															}
-														});
-												}
-												else
-												{
-													UE_LOGFMT(VoxtaLog, Error, "Audio2FaceRESTHandler was destroyed before the GenerateBlendShapes response could be handled, "
-															"Aborting blendshape generation...");
-												}
-											});
-									}
-									else
-									{
-										UE_LOGFMT(VoxtaLog, Error, "Audio2FaceRESTHandler was destroyed before the SetPlayerTrack response could be handled, "
-												"Aborting blendshape generation...");
-									}
-								});
-						}
-						else
-						{
-							UE_LOGFMT(VoxtaLog, Error, "Audio2FaceRESTHandler was destroyed before the SetPlayerRootPath response could be handled, "
-									"Aborting blendshape generation...");
-						}
-					});
-			}
-			else
+			if (TSharedPtr<Audio2FaceRESTHandler> sharedSelf = Self.Pin())
 			{
-				UE_LOGFMT(VoxtaLog, Error, "Audio2FaceRESTHandler was destroyed before the background thread was able "
-						"to start. Aborting blendshape generation...");
+				sharedSelf->CancelQueuedJob(JobId);
 			}
 		});
+	}
+	const uint64 jobId = job->Id;
+	Pump();
+	return jobId;
+}
+
+void Audio2FaceRESTHandler::SetJobPriority(uint64 jobId, A2FJobPriority priority)
+{
+	FScopeLock lock(&m_lock);
+	const int queueIndex = m_queue.IndexOfByPredicate([jobId] (const TSharedRef<FBlendshapeJob, ESPMode::ThreadSafe>& job)
+		{
+			return job->Id == jobId;
+		});
+	if (queueIndex == INDEX_NONE || m_queue[queueIndex]->Priority == priority)
+	{
+		return;
+	}
+
+	// Counted in the class it ends up being solved with.
+	m_stats[static_cast<uint8>(m_queue[queueIndex]->Priority)].NumOfJobs--;
+	m_stats[static_cast<uint8>(priority)].NumOfJobs++;
+	m_queue[queueIndex]->Priority = priority;
+	m_queue.StableSort([] (const TSharedRef<FBlendshapeJob, ESPMode::ThreadSafe>& a,
+		const TSharedRef<FBlendshapeJob, ESPMode::ThreadSafe>& b)
+		{
+			return a->Priority < b->Priority;
+		});
 }
 
 bool Audio2FaceRESTHandler::IsInitializing() const
 {
-	return m_currentState == CurrentA2FState::Initializing;
+	FScopeLock lock(&m_lock);
+	return m_endpoints.ContainsByPredicate([] (const FEndpoint& endpoint)
+		{
+			return endpoint.State == CurrentA2FState::Initializing;
+		});
 }
 
 bool Audio2FaceRESTHandler::IsAvailable() const
 {
-	return m_currentState == CurrentA2FState::Idle;
+	FScopeLock lock(&m_lock);
+	return m_endpoints.ContainsByPredicate([] (const FEndpoint& endpoint)
+		{
+			return endpoint.State == CurrentA2FState::Idle || endpoint.State == CurrentA2FState::Busy;
+		});
+}
+
+FA2FJobStats Audio2FaceRESTHandler::GetStats(A2FJobPriority priority) const
+{
+	FScopeLock lock(&m_lock);
+	return m_stats[static_cast<uint8>(priority)];
+}
+
+void Audio2FaceRESTHandler::DumpToLog() const
+{
+	FScopeLock lock(&m_lock);
+	UE_LOGFMT(VoxtaLog, Log, "A2F: {0} endpoints, {1} jobs queued.", m_endpoints.Num(), m_queue.Num());
+	for (const FEndpoint& endpoint : m_endpoints)
+	{
+		SENSITIVE_LOG1(VoxtaLog, Log, "A2F endpoint {0}:", endpoint.BaseUrl);
+		UE_LOGFMT(VoxtaLog, Log, "  {0}, {1} jobs solved, avg solve {2} ms.", GetStateName(endpoint.State),
+			endpoint.NumOfSolvedJobs,
+			FMath::RoundToInt(endpoint.TotalSolveSeconds * 1000.0 / FMath::Max<int64>(endpoint.NumOfSolvedJobs, 1)));
+	}
+
+	for (uint8 i = 0; i < static_cast<uint8>(A2FJobPriority::Count); i++)
+	{
+		const FA2FJobStats& stats = m_stats[i];
+		const int64 numOfStarted = FMath::Max<int64>(stats.NumOfJobs - stats.NumOfCancelled, 1);
+		UE_LOGFMT(VoxtaLog, Log, "A2F {0}: {1} jobs, {2} failed, {3} cancelled. Queued avg {4} ms (max {5} ms), "
+			"solve avg {6} ms (max {7} ms).", GetPriorityName(static_cast<A2FJobPriority>(i)), stats.NumOfJobs,
+			stats.NumOfFailures, stats.NumOfCancelled,
+			FMath::RoundToInt(stats.TotalQueueSeconds * 1000.0 / numOfStarted),
+			FMath::RoundToInt(stats.MaxQueueSeconds * 1000.0),
+			FMath::RoundToInt(stats.TotalSolveSeconds * 1000.0 / numOfStarted),
+			FMath::RoundToInt(stats.MaxSolveSeconds * 1000.0));
+	}
+
+	for (uint8 i = 0; i < static_cast<uint8>(JobStep::Count); i++)
+	{
+		const FStepStats& stats = m_stepStats[i];
+		UE_LOGFMT(VoxtaLog, Log, "A2F step {0}: {1} requests, {2} skipped. Avg {3} ms (max {4} ms).",
+			GetStepName(static_cast<JobStep>(i)), stats.NumOfRequests, stats.NumOfSkipped,
+			FMath::RoundToInt(stats.TotalSeconds * 1000.0 / FMath::Max<int64>(stats.NumOfRequests, 1)),
+			FMath::RoundToInt(stats.MaxSeconds * 1000.0));
+	}
+}
+
+void Audio2FaceRESTHandler::Pump()
+{
+	TArray<TTuple<int32, FString, TSharedRef<FBlendshapeJob, ESPMode::ThreadSafe>>> startedJobs;
+	{
+		FScopeLock lock(&m_lock);
+		const double now = FPlatformTime::Seconds();
+		for (int i = 0; i < m_endpoints.Num() && !m_queue.IsEmpty(); i++)
+		{
+			FEndpoint& endpoint = m_endpoints[i];
+			if (endpoint.State != CurrentA2FState::Idle)
+			{
+				continue;
+			}
+
+			TSharedRef<FBlendshapeJob, ESPMode::ThreadSafe> job = m_queue[0];
+			m_queue.RemoveAt(0);
+			endpoint.State = CurrentA2FState::Busy;
+			job->StartTime = now;
+
+			FA2FJobStats& stats = m_stats[static_cast<uint8>(job->Priority)];
+			const double queueSeconds = now - job->QueuedTime;
+			stats.TotalQueueSeconds += queueSeconds;
+			stats.MaxQueueSeconds = FMath::Max(stats.MaxQueueSeconds, queueSeconds);
+			startedJobs.Emplace(i, endpoint.BaseUrl, job);
+		}
+	}
+
+	for (const TTuple<int32, FString, TSharedRef<FBlendshapeJob, ESPMode::ThreadSafe>>& startedJob : startedJobs)
+	{
+		AdvanceJob(startedJob.Get<0>(), startedJob.Get<1>(), startedJob.Get<2>(), JobStep::SetRootPath);
+	}
+}
+
+void Audio2FaceRESTHandler::AdvanceJob(int32 endpointIndex, const FString& baseUrl,
+	const TSharedRef<FBlendshapeJob, ESPMode::ThreadSafe>& job, JobStep step)
+{
+	if (IsCancelled(job->CancellationToken))
+	{
+		UE_LOGFMT(VoxtaLog, Log, "GetBlendshapes was cancelled before {0}.", GetStepName(step));
+		CompleteJob(endpointIndex, job, false);
+		return;
+	}
+
+	{
+		FScopeLock lock(&m_lock);
+		const FEndpoint& endpoint = m_endpoints[endpointIndex];
+		// The player keeps its root path & track between jobs, so those requests are only sent when they change.
+		while (step != JobStep::Export && (step == JobStep::SetRootPath ?
+			endpoint.HasRootPath : endpoint.LoadedTrack == job->WavFileName))
+		{
+			m_stepStats[static_cast<uint8>(step)].NumOfSkipped++;
+			job->NumOfSkippedSteps++;
+			step = static_cast<JobStep>(static_cast<uint8>(step) + 1);
+		}
+	}
+
+	job->StepStartTime = FPlatformTime::Seconds();
+	auto onResponse = [Self = TWeakPtr<Audio2FaceRESTHandler>(AsShared()), endpointIndex, baseUrl, job, step]
+		(FHttpRequestPtr req, FHttpResponsePtr resp, bool success)
+		{
+			TSharedPtr<Audio2FaceRESTHandler> sharedSelf = Self.Pin();
+			if (!sharedSelf.IsValid())
+			{
+				UE_LOGFMT(VoxtaLog, Error, "Audio2FaceRESTHandler was destroyed before the {0} response could be "
+					"handled, Aborting blendshape generation...", GetStepName(step));
+				NotifyJob(job, false);
+				return;
+			}
+			sharedSelf->OnJobStepCompleted(endpointIndex, baseUrl, job, step, resp, success);
+		};
+
+	switch (step)
+	{
+		case JobStep::SetRootPath:
+			SetPlayerRootPath(baseUrl, onResponse, job->CancellationToken);
+			break;
+		case JobStep::SetTrack:
+			SetPlayerTrack(baseUrl, job->WavFileName, onResponse, job->CancellationToken);
+			break;
+		default:
+			GenerateBlendShapes(baseUrl, job->ShapesFilePath, job->ShapesFileName, onResponse, job->CancellationToken);
+			break;
+	}
+}
+
+void Audio2FaceRESTHandler::OnJobStepCompleted(int32 endpointIndex, const FString& baseUrl,
+	const TSharedRef<FBlendshapeJob, ESPMode::ThreadSafe>& job, JobStep step, const FHttpResponsePtr& response,
+	bool success)
+{
+	const double stepSeconds = FPlatformTime::Seconds() - job->StepStartTime;
+	const bool isCancelled = IsCancelled(job->CancellationToken);
+	const bool isOk = success && !isCancelled && IsStatusOk(response);
+	// A2F answers errors of a job with a status in the body, anything else means the instance itself is in trouble.
+	const bool isEndpointFailure = !isCancelled &&
+		(!success || !response.IsValid() || !EHttpResponseCodes::IsOk(response->GetResponseCode()));
+	job->StepSeconds[static_cast<uint8>(step)] += stepSeconds;
+	{
+		FScopeLock lock(&m_lock);
+		FStepStats& stats = m_stepStats[static_cast<uint8>(step)];
+		stats.NumOfRequests++;
+		stats.TotalSeconds += stepSeconds;
+		stats.MaxSeconds = FMath::Max(stats.MaxSeconds, stepSeconds);
+
+		FEndpoint& endpoint = m_endpoints[endpointIndex];
+		if (isOk && step == JobStep::SetRootPath)
+		{
+			endpoint.HasRootPath = true;
+		}
+		else if (isOk && step == JobStep::SetTrack)
+		{
+			endpoint.LoadedTrack = job->WavFileName;
+		}
+		else if (!isOk)
+		{
+			// Unknown what the player holds now (aborted request, restarted instance), so everything is sent again.
+			endpoint.HasRootPath = false;
+			endpoint.LoadedTrack.Reset();
+		}
+	}
+
+	if (isEndpointFailure)
+	{
+		OnEndpointFailed(endpointIndex, baseUrl, job, step);
+		return;
+	}
+	if (!isOk)
+	{
+		// A restarted instance loses its root path, which only shows once a later step fails.
+		if (!isCancelled && job->NumOfSkippedSteps > 0 && !job->HasRetried)
+		{
+			UE_LOGFMT(VoxtaLog, Warning, "A2F {0} failed for job {1} after skipping cached steps, retrying with "
+				"all steps.", GetStepName(step), job->Id);
+			job->HasRetried = true;
+			job->NumOfSkippedSteps = 0;
+			AdvanceJob(endpointIndex, baseUrl, job, JobStep::SetRootPath);
+			return;
+		}
+		UE_LOGFMT(VoxtaLog, Log, "GetBlendshapes stopped after {0} (cancelled: {1}).", GetStepName(step), isCancelled);
+		CompleteJob(endpointIndex, job, false);
+		return;
+	}
+
+	if (step == JobStep::Export)
+	{
+		CompleteJob(endpointIndex, job, true);
+		return;
+	}
+	AdvanceJob(endpointIndex, baseUrl, job, static_cast<JobStep>(static_cast<uint8>(step) + 1));
+}
+
+void Audio2FaceRESTHandler::OnEndpointFailed(int32 endpointIndex, const FString& baseUrl,
+	const TSharedRef<FBlendshapeJob, ESPMode::ThreadSafe>& job, JobStep step)
+{
+	bool isRequeued = false;
+	{
+		FScopeLock lock(&m_lock);
+		// Not idle until it answers again, a dead instance fails fast and would otherwise fail the whole queue.
+		FEndpoint& endpoint = m_endpoints[endpointIndex];
+		endpoint.State = CurrentA2FState::Initializing;
+
+		isRequeued = job->NumOfRequeues < MAX_JOB_REQUEUES;
+		if (isRequeued)
+		{
+			job->NumOfRequeues++;
+			job->NumOfSkippedSteps = 0;
+			job->HasRetried = false;
+			// In front of its class, as it was the first in line when it was picked up.
+			m_queue.Insert(job, 0);
+			m_queue.StableSort([] (const TSharedRef<FBlendshapeJob, ESPMode::ThreadSafe>& a,
+				const TSharedRef<FBlendshapeJob, ESPMode::ThreadSafe>& b)
+				{
+					return a->Priority < b->Priority;
+				});
+		}
+		else
+		{
+			m_stats[static_cast<uint8>(job->Priority)].NumOfFailures++;
+		}
+	}
+
+	SENSITIVE_LOG2(VoxtaLog, Warning, "A2F endpoint {0} failed {1}, probing it again before it gets another job.",
+		baseUrl, GetStepName(step));
+	if (isRequeued)
+	{
+		UE_LOGFMT(VoxtaLog, Log, "Requeued A2F blendshape job {0} for another endpoint.", job->Id);
+	}
+	else
+	{
+		UE_LOGFMT(VoxtaLog, Warning, "A2F blendshape job {0} failed on {1} endpoints, aborting GetBlendshapes.",
+			job->Id, job->NumOfRequeues + 1);
+		NotifyJob(job, false);
+	}
+
+	InitializeEndpoint(endpointIndex, baseUrl);
+	Pump();
+}
+
+void Audio2FaceRESTHandler::CompleteJob(int32 endpointIndex, const TSharedRef<FBlendshapeJob, ESPMode::ThreadSafe>& job,
+	bool success)
+{
+	const double solveSeconds = FPlatformTime::Seconds() - job->StartTime;
+	{
+		FScopeLock lock(&m_lock);
+		FEndpoint& endpoint = m_endpoints[endpointIndex];
+		endpoint.State = CurrentA2FState::Idle;
+		endpoint.NumOfSolvedJobs += success ? 1 : 0;
+		endpoint.TotalSolveSeconds += success ? solveSeconds : 0.0;
+
+		FA2FJobStats& stats = m_stats[static_cast<uint8>(job->Priority)];
+		stats.TotalSolveSeconds += solveSeconds;
+		stats.MaxSolveSeconds = FMath::Max(stats.MaxSolveSeconds, solveSeconds);
+		if (IsCancelled(job->CancellationToken))
+		{
+			stats.NumOfCancelled++;
+		}
+		else if (!success)
+		{
+			stats.NumOfFailures++;
+		}
+	}
+
+	if (success)
+	{
+		UE_LOGFMT(VoxtaLog, Log, "A2F blendshape job {0} ({1}) solved in {2} ms (root path {3} ms, track {4} ms, "
+			"export {5} ms), after {6} ms in the queue.", job->Id, GetPriorityName(job->Priority),
+			FMath::RoundToInt(solveSeconds * 1000.0),
+			FMath::RoundToInt(job->StepSeconds[static_cast<uint8>(JobStep::SetRootPath)] * 1000.0),
+			FMath::RoundToInt(job->StepSeconds[static_cast<uint8>(JobStep::SetTrack)] * 1000.0),
+			FMath::RoundToInt(job->StepSeconds[static_cast<uint8>(JobStep::Export)] * 1000.0),
+			FMath::RoundToInt((job->StartTime - job->QueuedTime) * 1000.0));
+	}
+	else if (!IsCancelled(job->CancellationToken))
+	{
+		UE_LOGFMT(VoxtaLog, Warning, "A2F blendshape job {0} failed, aborting GetBlendshapes.", job->Id);
+	}
+	NotifyJob(job, success);
+	Pump();
+}
+
+void Audio2FaceRESTHandler::CancelQueuedJob(uint64 jobId)
+{
+	TSharedPtr<FBlendshapeJob, ESPMode::ThreadSafe> cancelledJob;
+	{
+		FScopeLock lock(&m_lock);
+		const int queueIndex = m_queue.IndexOfByPredicate([jobId] (const TSharedRef<FBlendshapeJob, ESPMode::ThreadSafe>& job)
+			{
+				return job->Id == jobId;
+			});
+		if (queueIndex == INDEX_NONE)
+		{
+			return;
+		}
+		cancelledJob = m_queue[queueIndex];
+		m_queue.RemoveAt(queueIndex);
+		m_stats[static_cast<uint8>(cancelledJob->Priority)].NumOfCancelled++;
+	}
+
+	UE_LOGFMT(VoxtaLog, Log, "GetBlendshapes was cancelled before it started.");
+	NotifyJob(cancelledJob.ToSharedRef(), false);
+}
+
+const TCHAR* Audio2FaceRESTHandler::GetPriorityName(A2FJobPriority priority)
+{
+	switch (priority)
+	{
+		case A2FJobPriority::PlayingChunk:
+			return TEXT("PlayingChunk");
+		case A2FJobPriority::Prefetch:
+			return TEXT("Prefetch");
+		default:
+			return TEXT("Unknown");
+	}
+}
+
+const TCHAR* Audio2FaceRESTHandler::GetStepName(JobStep step)
+{
+	switch (step)
+	{
+		case JobStep::SetRootPath:
+			return TEXT("SetRootPath");
+		case JobStep::SetTrack:
+			return TEXT("SetTrack");
+		case JobStep::Export:
+			return TEXT("Export");
+		default:
+			return TEXT("Unknown");
+	}
+}
+
+const TCHAR* Audio2FaceRESTHandler::GetStateName(CurrentA2FState state)
+{
+	switch (state)
+	{
+		case CurrentA2FState::NotConnected:
+			return TEXT("NotConnected");
+		case CurrentA2FState::Initializing:
+			return TEXT("Initializing");
+		case CurrentA2FState::Idle:
+			return TEXT("Idle");
+		case CurrentA2FState::Busy:
+			return TEXT("Busy");
+		default:
+			return TEXT("Unknown");
+	}
+}
+
+void Audio2FaceRESTHandler::NotifyJob(const TSharedRef<FBlendshapeJob, ESPMode::ThreadSafe>& job, bool success)
+{
+	AsyncTask(ENamedThreads::GameThread, [job, success] ()
+	{
+		job->Callback(success ? FPaths::Combine(job->ShapesFilePath, job->ShapesFileName) : FString(), success);
+	});
 }
 
-void Audio2FaceRESTHandler::GetStatus(TFunction<void(FHttpRequestPtr, FHttpResponsePtr, bool)> Callback) const
+void Audio2FaceRESTHandler::GetStatus(const FString& baseUrl,
+	TFunction<void(FHttpRequestPtr, FHttpResponsePtr, bool)> Callback) const
 {
 	TSharedRef<IHttpRequest, ESPMode::ThreadSafe> Request = GetBaseRequest(Callback);
-	Request->SetURL("http://localhost:8011/status");
+	Request->SetURL(baseUrl + TEXT("/status"));
 	Request->SetVerb("GET");
 	Request->ProcessRequest();
 }
 
-void Audio2FaceRESTHandler::LoadUsdFile(TFunction<void(FHttpRequestPtr, FHttpResponsePtr, bool)> Callback) const
+void Audio2FaceRESTHandler::LoadUsdFile(const FString& baseUrl,
+	TFunction<void(FHttpRequestPtr, FHttpResponsePtr, bool)> Callback) const
 {
 	TSharedRef<IHttpRequest, ESPMode::ThreadSafe> Request = GetBaseRequest(Callback);
-	Request->SetURL("http://localhost:8011/A2F/USD/Load");
+	Request->SetURL(baseUrl + TEXT("/A2F/USD/Load"));
 	Request->SetVerb("POST");
 
 	TSharedPtr<FJsonObject> JsonObject = MakeShareable(new FJsonObject);
-	JsonObject->SetStringField(TEXT("file_name"), FString::Format(TEXT("{0}\\claire_solved_arkit.usd"),
-		{ IPluginManager::Get().FindPlugin("UnrealVoxta")->GetContentDir() }));
+	JsonObject->SetStringField(TEXT("file_name"), FString::Format(TEXT("{0}\\claire_solved_arkit.usd"), { m_contentDir }));
 
 	Request->SetContentAsString(JsonToString(JsonObject.ToSharedRef()));
 	Request->ProcessRequest();
 }
 
-void Audio2FaceRESTHandler::SetPlayerRootPath(TFunction<void(FHttpRequestPtr, FHttpResponsePtr, bool)> Callback) const
+void Audio2FaceRESTHandler::SetPlayerRootPath(const FString& baseUrl,
+	TFunction<void(FHttpRequestPtr, FHttpResponsePtr, bool)> Callback,
+	const FVoxtaCancellationTokenPtr& cancellationToken) const
 {
 	TSharedRef<IHttpRequest, ESPMode::ThreadSafe> Request = GetBaseRequest(Callback);
-	Request->SetURL("http://localhost:8011/A2F/Player/SetRootPath");
+	Request->SetURL(baseUrl + TEXT("/A2F/Player/SetRootPath"));
 	Request->SetVerb("POST");
 
 	TSharedPtr<FJsonObject> JsonObject = MakeShareable(new FJsonObject);
 	JsonObject->SetStringField(TEXT("a2f_player"), TEXT("/World/audio2face/Player"));
-	JsonObject->SetStringField(TEXT("dir_path"), FString::Format(TEXT("{0}\\A2FCache"),
-		{ IPluginManager::Get().FindPlugin("UnrealVoxta")->GetContentDir() }));
+	JsonObject->SetStringField(TEXT("dir_path"), FString::Format(TEXT("{0}\\A2FCache"), { m_contentDir }));
 
 	Request->SetContentAsString(JsonToString(JsonObject.ToSharedRef()));
-	Request->ProcessRequest();
+	ProcessCancellableRequest(Request, cancellationToken);
 }
 
-void Audio2FaceRESTHandler::SetPlayerTrack(const FString& fileName, TFunction<void(FHttpRequestPtr, FHttpResponsePtr, bool)> Callback) const
+void Audio2FaceRESTHandler::SetPlayerTrack(const FString& baseUrl, const FString& fileName,
+	TFunction<void(FHttpRequestPtr, FHttpResponsePtr, bool)> Callback,
+	const FVoxtaCancellationTokenPtr& cancellationToken) const
 {
 	TSharedRef<IHttpRequest, ESPMode::ThreadSafe> Request = GetBaseRequest(Callback);
-	Request->SetURL("http://localhost:8011/A2F/Player/SetTrack");
+	Request->SetURL(baseUrl + TEXT("/A2F/Player/SetTrack"));
 	Request->SetVerb("POST");
 
 	TSharedPtr<FJsonObject> JsonObject = MakeShareable(new FJsonObject);
@@ -309,13 +697,15 @@ void Audio2FaceRESTHandler::SetPlayerTrack(const FString& fileName, TFunction<vo
 	JsonObject->SetArrayField(TEXT("time_range"), TimeRangeArray);
 
 	Request->SetContentAsString(JsonToString(JsonObject.ToSharedRef()));
-	Request->ProcessRequest();
+	ProcessCancellableRequest(Request, cancellationToken);
 }
 
-void Audio2FaceRESTHandler::GenerateBlendShapes(const FString& filePath, const FString& fileName, TFunction<void(FHttpRequestPtr, FHttpResponsePtr, bool)> Callback) const
+void Audio2FaceRESTHandler::GenerateBlendShapes(const FString& baseUrl, const FString& filePath, const FString& fileName,
+	TFunction<void(FHttpRequestPtr, FHttpResponsePtr, bool)> Callback,
+	const FVoxtaCancellationTokenPtr& cancellationToken) const
 {
 	TSharedRef<IHttpRequest, ESPMode::ThreadSafe> Request = GetBaseRequest(Callback);
-	Request->SetURL("http://localhost:8011/A2F/Exporter/ExportBlendshapes");
+	Request->SetURL(baseUrl + TEXT("/A2F/Exporter/ExportBlendshapes"));
 	Request->SetVerb("POST");
 
 	TSharedPtr<FJsonObject> JsonObject = MakeShareable(new FJsonObject);
@@ -327,7 +717,45 @@ void Audio2FaceRESTHandler::GenerateBlendShapes(const FString& filePath, const F
 	JsonObject->SetStringField(TEXT("fps"), TEXT("30"));
 
 	Request->SetContentAsString(JsonToString(JsonObject.ToSharedRef()));
-	Request->ProcessRequest();
+	ProcessCancellableRequest(Request, cancellationToken);
+}
+
+bool Audio2FaceRESTHandler::IsStatusOk(const FHttpResponsePtr& response)
+{
+	if (!response.IsValid())
+	{
+		return false;
+	}
+	const FString content = response->GetContentAsString();
+	UE_LOGFMT(VoxtaLog, Verbose, "{0}", content);
+
+	// Only the top-level status field matters, so the body is streamed instead of building a JsonObject.
+	auto reader = TJsonReaderFactory<>::CreateFromView(content);
+	EJsonNotation notation;
+	int depth = 0;
+	while (reader->ReadNext(notation))
+	{
+		switch (notation)
+		{
+			case EJsonNotation::ObjectStart:
+			case EJsonNotation::ArrayStart:
+				depth++;
+				break;
+			case EJsonNotation::ObjectEnd:
+			case EJsonNotation::ArrayEnd:
+				depth--;
+				break;
+			case EJsonNotation::String:
+				if (depth == 1 && reader->GetIdentifier() == TEXT("status"))
+				{
+					return reader->GetValueAsString() == TEXT("OK");
+				}
+				break;
+			default:
+				break;
+		}
+	}
+	return false;
 }
 
 FString Audio2FaceRESTHandler::JsonToString(TSharedRef<FJsonObject> jsonObject) const
@@ -350,9 +778,29 @@ TSharedRef<IHttpRequest, ESPMode::ThreadSafe> Audio2FaceRESTHandler::GetBaseRequ
 	Request->SetHeader("Content-Type", "application/json");
 	Request->SetHeader("accept", "application/json");
 	Request->SetTimeout(10.0f); // 10 seconds timeout
+	// The handler is thread-safe, so the next request of a job is sent straight from the http thread; the only hop
+	// to the game thread is the job callback.
+	Request->SetDelegateThreadPolicy(EHttpRequestDelegateThreadPolicy::CompleteOnHttpThread);
 	return Request;
 }
 
+void Audio2FaceRESTHandler::ProcessCancellableRequest(const TSharedRef<IHttpRequest, ESPMode::ThreadSafe>& request,
+	const FVoxtaCancellationTokenPtr& cancellationToken) const
+{
+	request->ProcessRequest();
+	// Registered after starting, so a token that is already cancelled aborts a running request instead of an unsent one.
+	if (cancellationToken.IsValid())
+	{
+		cancellationToken->OnCancelled([WeakRequest = TWeakPtr<IHttpRequest, ESPMode::ThreadSafe>(request)] ()
+		{
+			if (TSharedPtr<IHttpRequest, ESPMode::ThreadSafe> sharedRequest = WeakRequest.Pin())
+			{
+				sharedRequest->CancelRequest();
+			}
+		});
+	}
+}
+
 /*
 void Audio2FaceRESTHandler::GetPlayerTracks(TFunction<void(FHttpRequestPtr, FHttpResponsePtr, bool)> Callback)
 {
@@ -0,0 +1,64 @@
+// Copyright(c) 2024 grrimgrriefer & DZnnah, see LICENSE for details.
+
+#include "LipSyncDataA2F.h"
+#include "Math/VectorRegister.h"
+
+static_assert(ULipSyncDataA2F::CURVE_COUNT % 4 == 0, "LerpCurves processes 4 curves at a time, without a scalar tail.");
+
+void ULipSyncDataA2F::SetA2FCurveWeights(TArray<float>&& curveWeights, int framesPerSecond)
+{
+	ensureMsgf(curveWeights.Num() % CURVE_COUNT == 0, TEXT("A2F curve weights must have %d values per frame."),
+		CURVE_COUNT);
+	if (A2FCompactCurves::IsEnabled())
+	{
+		SetA2FCompactCurves(A2FCompactCurves::Encode(curveWeights, framesPerSecond, A2FCompactCurves::GetTolerance()));
+		return;
+	}
+
+	m_curveWeights = MoveTemp(curveWeights);
+	m_curveWeights.SetNum(m_curveWeights.Num() - m_curveWeights.Num() % CURVE_COUNT);
+	m_compactCurves = A2FCompactCurves();
+	m_isCompact = false;
+	m_framesPerSecond = framesPerSecond;
+}
+
+void ULipSyncDataA2F::SetA2FCompactCurves(A2FCompactCurves&& compactCurves)
+{
+	m_framesPerSecond = compactCurves.GetFramesPerSecond();
+	m_compactCurves = MoveTemp(compactCurves);
+	m_isCompact = true;
+	m_curveWeights.Empty();
+}
+
+bool ULipSyncDataA2F::SampleCurves(float frame, float* outCurves) const
+{
+	if (m_isCompact)
+	{
+		return m_compactCurves.Sample(frame, outCurves);
+	}
+
+	const int numOfFrames = GetNumOfFrames();
+	if (numOfFrames == 0)
+	{
+		return false;
+	}
+
+	const float clampedFrame = FMath::Clamp(frame, 0.f, static_cast<float>(numOfFrames - 1));
+	const int floorFrame = FMath::FloorToInt(clampedFrame);
+	const int ceilingFrame = FMath::Min(floorFrame + 1, numOfFrames - 1);
+	const float* curveWeights = m_curveWeights.GetData();
+	LerpCurves(curveWeights + floorFrame * CURVE_COUNT, curveWeights + ceilingFrame * CURVE_COUNT,
+		clampedFrame - floorFrame, outCurves);
+	return true;
+}
+
+void ULipSyncDataA2F::LerpCurves(const float* fromCurves, const float* toCurves, float alpha, float* outCurves)
+{
+	const VectorRegister4Float alphaVector = VectorSetFloat1(alpha);
+	for (int i = 0; i < CURVE_COUNT; i += 4)
+	{
+		const VectorRegister4Float fromVector = VectorLoad(fromCurves + i);
+		const VectorRegister4Float toVector = VectorLoad(toCurves + i);
+		VectorStore(VectorMultiplyAdd(VectorSubtract(toVector, fromVector), alphaVector, fromVector), outCurves + i);
+	}
+}
@@ -0,0 +1,69 @@
+// Copyright(c) 2024 grrimgrriefer & DZnnah, see LICENSE for details.
+
+#include "LipSyncSamplingSubsystem.h"
+#include "Audio2FacePlaybackHandler.h"
+#include "Engine/World.h"
+#include "Async/ParallelFor.h"
+
+void ULipSyncSamplingSubsystem::Initialize(FSubsystemCollectionBase& collection)
+{
+	Super::Initialize(collection);
+	m_preActorTickHandle = FWorldDelegates::OnWorldPreActorTick.AddUObject(this,
+		&ULipSyncSamplingSubsystem::OnWorldPreActorTick);
+}
+
+void ULipSyncSamplingSubsystem::Deinitialize()
+{
+	FWorldDelegates::OnWorldPreActorTick.Remove(m_preActorTickHandle);
+	m_preActorTickHandle.Reset();
+	m_A2FTimelines.Empty();
+	m_sampledTimelines.Empty();
+	Super::Deinitialize();
+}
+
+bool ULipSyncSamplingSubsystem::DoesSupportWorldType(const EWorldType::Type worldType) const
+{
+	return worldType == EWorldType::Game || worldType == EWorldType::PIE;
+}
+
+void ULipSyncSamplingSubsystem::Register(UAudio2FacePlaybackHandler* playbackHandler)
+{
+	if (playbackHandler != nullptr)
+	{
+		m_A2FTimelines.AddUnique(playbackHandler);
+	}
+}
+
+void ULipSyncSamplingSubsystem::Unregister(UAudio2FacePlaybackHandler* playbackHandler)
+{
+	m_A2FTimelines.RemoveSingleSwap(playbackHandler);
+}
+
+void ULipSyncSamplingSubsystem::OnWorldPreActorTick(UWorld* world, ELevelTick tickType, float deltaSeconds)
+{
+	// The delegate is shared by all worlds.
+	if (world != GetWorld() || m_A2FTimelines.IsEmpty())
+	{
+		return;
+	}
+
+	m_sampledTimelines.Reset();
+	for (int i = m_A2FTimelines.Num() - 1; i >= 0; i--)
+	{
+		if (UAudio2FacePlaybackHandler* playbackHandler = m_A2FTimelines[i].Get())
+		{
+			m_sampledTimelines.Add(playbackHandler);
+		}
+		else
+		{
+			m_A2FTimelines.RemoveAtSwap(i);
+		}
+	}
+
+	// Every handler only writes its own buffers, GC can't run while the game thread waits on the ParallelFor.
+	ParallelFor(m_sampledTimelines.Num(), [this] (int32 index)
+		{
+			m_sampledTimelines[index]->SampleTimeline();
+		}, m_sampledTimelines.Num() < MIN_PARALLEL_TIMELINES ? EParallelForFlags::ForceSingleThread :
+			EParallelForFlags::None);
+}
@@ -0,0 +1,45 @@
+// Copyright(c) 2024 grrimgrriefer & DZnnah, see LICENSE for details.
+
+#pragma once
+
+#include "CoreMinimal.h"
+
+/**
+ * FA2FBlendshapeResult
+ * The fields of an Audio2Face '_bsweight.json' export that are needed to create ULipSyncDataA2F.
+ */
+struct FA2FBlendshapeResult
+{
+	int32 Fps = 0;
+	int32 NumOfFrames = 0;
+	/** Number of values per row in the file, rows are padded or cut to ULipSyncDataA2F::CURVE_COUNT regardless. */
+	int32 NumOfCurvesPerFrame = 0;
+	/** Frame-major, ULipSyncDataA2F::CURVE_COUNT values per frame. */
+	TArray<float> CurveWeights;
+};
+
+/**
+ * A2FBlendshapeParser
+ * Stateless single-pass parser for the blendshape JSON exported by Audio2Face. The numbers of the 'weightMat' rows are
+ * written straight into one flat float buffer, instead of building a DOM with a heap-allocated FJsonValue per number.
+ * Unknown fields are skipped without allocating.
+ *
+ * Note: Thread-safe, intended to run on a worker thread.
+ */
+class VOXTAUTILITY_A2F_API A2FBlendshapeParser
+{
+#pragma region public API
+public:
+	/**
+	 * Parse the UTF-8 contents of a blendshape JSON file.
+	 *
+	 * @param data Pointer to the start of the file contents.
+	 * @param size Size of the file contents in bytes.
+	 * @param outResult The parsed curves, only valid if true was returned.
+	 * @param outError A description of where parsing failed, only set if false was returned.
+	 *
+	 * @return True if the file is valid JSON with a 'weightMat' array of number arrays and a positive 'exportFps'.
+	 */
+	static bool TryParse(const uint8* data, int64 size, FA2FBlendshapeResult& outResult, FString& outError);
+#pragma endregion
+};
@@ -0,0 +1,150 @@
+// Copyright(c) 2024 grrimgrriefer & DZnnah, see LICENSE for details.
+
+#pragma once
+
+#include "CoreMinimal.h"
+
+/**
+ * A2FCompactCurves
+ * Lossy, error-bounded encoding of the A2F curves of one voiceline, typically 10-20x smaller than the raw floats.
+ * - Curves that stay within the tolerance of a single value (most of the 52 ARKit curves) are stored as one float.
+ * - The other curves share a set of keyframes, every frame in between is within half the tolerance of the line
+ *   between its two surrounding keyframes.
+ * - Every remaining curve is quantized to 8 bits within its own range, or 16 bits if 8 would exceed half the
+ *   tolerance, with a per-curve scale & offset.
+ *
+ * Sampling only decodes the two surrounding keyframes, 4 curves at a time, so it stays cheap enough to run for every
+ * talking character on every game frame.
+ *
+ * Note: Immutable after Encode, so sampling is thread-safe.
+ */
+class VOXTAUTILITY_A2F_API A2FCompactCurves
+{
+#pragma region public API
+public:
+	/** @return True if new A2F lipsync is stored compacted (voxta.A2F.Compact.Enabled). */
+	static bool IsEnabled();
+
+	/** @return The maximum error of any decoded weight (voxta.A2F.Compact.Tolerance). */
+	static float GetTolerance();
+
+	/**
+	 * Compact the raw curves of one voiceline.
+	 *
+	 * @param curveWeights The ARKit curve values, frame-major with CURVE_COUNT values per frame.
+	 * @param framesPerSecond The fps that the curves were generated at.
+	 * @param tolerance The maximum error of any decoded weight, at any frame.
+	 *
+	 * @return The compacted curves, empty if there are no frames.
+	 */
+	static A2FCompactCurves Encode(TConstArrayView<float> curveWeights, int32 framesPerSecond, float tolerance);
+
+	/**
+	 * Write the curve weights at a point in time into a preallocated buffer, same as ULipSyncDataA2F::SampleCurves.
+	 *
+	 * @param frame The fractional frame index, points past the last frame are clamped on it.
+	 * @param outCurves The buffer to write the CURVE_COUNT weights into.
+	 *
+	 * @return False if there are no frames, outCurves is left untouched in that case.
+	 */
+	bool Sample(float frame, float* outCurves) const;
+
+	/**
+	 * Decode every frame, for code that needs the raw curves.
+	 *
+	 * @param outCurveWeights Receives the curve values, frame-major with CURVE_COUNT values per frame.
+	 */
+	void Decode(TArray<float>& outCurveWeights) const;
+
+	/** @return The FPS that the curves were generated at. */
+	int32 GetFramesPerSecond() const
+	{
+		return m_framesPerSecond;
+	}
+
+	/** @return The number of frames of the original curves. */
+	int32 GetNumOfFrames() const
+	{
+		return m_numOfFrames;
+	}
+
+	/** @return The number of keyframes that are stored for the animated curves. */
+	int32 GetNumOfKeyFrames() const
+	{
+		return m_keyFrames.Num();
+	}
+
+	/** @return The number of curves that are not stored as a single value. */
+	int32 GetNumOfAnimatedCurves() const
+	{
+		return m_curves8.NumOfCurves + m_curves16.NumOfCurves;
+	}
+
+	/** @return The number of bytes held on the heap. */
+	int64 GetAllocatedSize() const;
+
+	/** Serialize for the VoiceLineCache, bumps FORMAT_VERSION on layout changes. Marks the archive as failed if invalid. */
+	friend VOXTAUTILITY_A2F_API FArchive& operator<<(FArchive& archive, A2FCompactCurves& curves);
+#pragma endregion
+
+#pragma region private helper classes
+private:
+	/**
+	 * The quantized curves of one bit depth. Keyframe-major, padded to a multiple of 4 curves so decoding needs no
+	 * scalar tail; padding lanes have a scale & offset of 0.
+	 */
+	template<typename QuantizedType>
+	struct TQuantizedCurves
+	{
+		int32 NumOfCurves = 0;
+		/** The index of every curve in the ARKit order. */
+		TArray<uint8> CurveIndices;
+		TArray<float> Scales;
+		TArray<float> Offsets;
+		TArray<QuantizedType> Values;
+
+		int32 GetStride() const
+		{
+			return Align(NumOfCurves, 4);
+		}
+	};
+#pragma endregion
+
+#pragma region data
+public:
+	/** Number of ARKit blendshape curves per frame. */
+	static constexpr int CURVE_COUNT = 52;
+
+private:
+	int32 m_framesPerSecond = 0;
+	int32 m_numOfFrames = 0;
+	/** The value of every curve that is not animated, 0 for the animated ones as they are written over anyway. */
+	float m_constantCurves[CURVE_COUNT] = {};
+	/** Ascending frame indices, always includes the first & last frame. */
+	TArray<int32> m_keyFrames;
+	TQuantizedCurves<uint8> m_curves8;
+	TQuantizedCurves<uint16> m_curves16;
+#pragma endregion
+
+#pragma region private API
+private:
+	/** @return True if the layout is consistent, checked after loading as the data comes from disk. */
+	bool IsValid() const;
+
+	/** Store the given curves at the keyframes, each quantized within its own range. */
+	template<typename QuantizedType>
+	void QuantizeCurves(const float* curveWeights, TConstArrayView<int32> curveIndices,
+		TQuantizedCurves<QuantizedType>& outCurves) const;
+
+	/** Interpolate & dequantize the curves of one bit depth into outCurves, scattered to their ARKit index. */
+	template<typename QuantizedType>
+	static void SampleQuantized(const TQuantizedCurves<QuantizedType>& curves, int32 fromKey, int32 toKey,
+		float alpha, float* outCurves);
+
+	template<typename QuantizedType>
+	static void SerializeQuantized(FArchive& archive, TQuantizedCurves<QuantizedType>& curves);
+
+	template<typename QuantizedType>
+	static bool IsValidQuantized(const TQuantizedCurves<QuantizedType>& curves, int32 numOfKeyFrames);
+#pragma endregion
+};
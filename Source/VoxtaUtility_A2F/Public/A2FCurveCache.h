@@ -0,0 +1,124 @@
+// Copyright(c) 2024 grrimgrriefer & DZnnah, see LICENSE for details.
+
+#pragma once
+
+#include "CoreMinimal.h"
+
+/**
+ * FA2FCurveCacheStats
+ * Counters of the A2FCurveCache since startup (or the last Clear), for profiling and the dump console command.
+ */
+struct FA2FCurveCacheStats
+{
+	int64 Hits = 0;
+	int64 Misses = 0;
+	int64 Stores = 0;
+	int64 Evictions = 0;
+	int64 DiskBytes = 0;
+	int32 DiskEntries = 0;
+};
+
+/**
+ * A2FCurveCache
+ * Process-wide, persistent cache of A2F lipsync results, keyed by the hash of the PCM samples that were sent to A2F.
+ * A hit skips the whole Audio2Face round trip (writing the wav, the REST requests & parsing the export), so
+ * scripted & repeated lines get their lipsync instantly, also in later sessions and without A2F running.
+ *
+ * Each result is a compact binary file under Saved/Voxta/A2FCurveCache: a versioned header, the range of every
+ * curve, and the weights quantized to 16 bits within that range. The least recently used files are deleted once the
+ * store exceeds voxta.A2F.CurveCache.DiskBudgetMB.
+ *
+ * Use 'voxta.A2F.CurveCache.Dump' to log the stats, 'voxta.A2F.CurveCache.Clear' to delete all files.
+ *
+ * Note: All functions are thread-safe, file access happens outside of the lock.
+ */
+class VOXTAUTILITY_A2F_API A2FCurveCache
+{
+#pragma region public API
+public:
+	/** @return The process-wide cache instance. */
+	static A2FCurveCache& Get();
+
+	/** @return True if the cache is enabled (voxta.A2F.CurveCache.Enabled). */
+	static bool IsEnabled();
+
+	/**
+	 * Hash the samples that are sent to A2F, together with their format. Headers & extra chunks are left out, so
+	 * the same audio gets the same key regardless of the container it was downloaded in.
+	 *
+	 * @param sampleData Pointer to the start of the PCM samples.
+	 * @param size Size of the PCM samples in bytes.
+	 * @param sampleRate The sample rate of the audio.
+	 * @param numOfChannels The number of interleaved channels.
+	 * @param bitsPerSample The size of a single sample.
+	 *
+	 * @return The key of the audio, never 0.
+	 */
+	static uint64 HashSamples(const uint8* sampleData, int64 size, uint32 sampleRate, uint16 numOfChannels,
+		uint16 bitsPerSample);
+
+	/**
+	 * Read a cached result.
+	 *
+	 * @param pcmHash The key returned by HashSamples.
+	 * @param outCurveWeights The dequantized weights, frame-major with ULipSyncDataA2F::CURVE_COUNT values per frame.
+	 * @param outFps The framerate of the curves.
+	 *
+	 * @return True if a valid result was found.
+	 */
+	bool TryLoad(uint64 pcmHash, TArray<float>& outCurveWeights, int32& outFps);
+
+	/**
+	 * Quantize and write a result to disk, replacing any previous file for the same key.
+	 *
+	 * @param pcmHash The key returned by HashSamples.
+	 * @param curveWeights Frame-major weights, ULipSyncDataA2F::CURVE_COUNT values per frame.
+	 * @param fps The framerate of the curves.
+	 */
+	void Store(uint64 pcmHash, TConstArrayView<float> curveWeights, int32 fps);
+
+	/** @return A snapshot of the counters. */
+	FA2FCurveCacheStats GetStats() const;
+
+	/** Delete every cached result and reset the counters. */
+	void Clear();
+
+	/** Log the stats. */
+	void DumpToLog() const;
+#pragma endregion
+
+#pragma region data
+private:
+	struct FDiskEntry
+	{
+		int64 FileSize = 0;
+		FDateTime LastAccess;
+	};
+
+	mutable FCriticalSection m_lock;
+	TMap<uint64, FDiskEntry> m_diskEntries;
+	int64 m_diskBytes = 0;
+	bool m_diskIndexBuilt = false;
+	FA2FCurveCacheStats m_stats;
+#pragma endregion
+
+#pragma region private API
+private:
+	A2FCurveCache() = default;
+
+	/** @return The folder of the disk store. */
+	static FString GetDiskFolder();
+
+	/** @return The file of the disk store that belongs to the given hash. */
+	static FString GetDiskFilePath(uint64 pcmHash);
+
+	/** Scan the disk store once, so results of previous sessions can be found. Must hold m_lock. */
+	void EnsureDiskIndex();
+
+	/** Delete the least recently used files until the budget is met. Must hold m_lock. */
+	void EnforceDiskBudget();
+
+	/** Drop an entry from the index and delete its file. Must hold m_lock. */
+	void RemoveDiskEntry(uint64 pcmHash);
+#pragma endregion
+};
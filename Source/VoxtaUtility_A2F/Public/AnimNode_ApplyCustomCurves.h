@@ -4,14 +4,39 @@
 
 #include "CoreMinimal.h"
 #include "Animation/AnimNodeBase.h"
+#include "Animation/AnimCurveTypes.h"
+#include "LipSyncDataA2F.h"
 #include "AnimNode_ApplyCustomCurves.generated.h"
 
 class IA2FWeightProvider;
 
+/**
+ * EA2FCurveGroup
+ * Groups of ARKit curves that FAnimNode_ApplyCustomCurves applies, so rigs that only use e.g. the mouth curves can
+ * skip the rest.
+ */
+UENUM(meta = (Bitflags, UseEnumValuesAsMaskValuesInEditor = "true"))
+enum class EA2FCurveGroup : uint8
+{
+	None		= 0			UMETA(Hidden),
+	Eyes		= 1 << 0	UMETA(DisplayName = "Eyes"),
+	Jaw			= 1 << 1	UMETA(DisplayName = "Jaw"),
+	Mouth		= 1 << 2	UMETA(DisplayName = "Mouth"),
+	Brows		= 1 << 3	UMETA(DisplayName = "Brows"),
+	Cheeks		= 1 << 4	UMETA(DisplayName = "Cheeks"),
+	Nose		= 1 << 5	UMETA(DisplayName = "Nose"),
+	Tongue		= 1 << 6	UMETA(DisplayName = "Tongue")
+};
+ENUM_CLASS_FLAGS(EA2FCurveGroup);
+
 /**
  * FAnimNode_ApplyCustomCurves
  * Animation node that applies custom curve values to a pose.
  * Used for driving facial animation curves (e.g., from lipsync data) in an animation graph.
+ *
+ * The weights are copied on the game thread in PreUpdate into one of two buffers, and handed to the evaluation in
+ * Update, so a late evaluation never reads a half-written snapshot. The curves of the mask are written into the pose in
+ * one sorted bulk merge; while the source is neutral the curves of the source pose are left untouched.
  */
 USTRUCT(BlueprintInternalUseOnly, Category = "Voxta")
 struct VOXTAUTILITY_A2F_API FAnimNode_ApplyCustomCurves : public FAnimNode_Base
@@ -64,10 +89,36 @@ public:
 
 #pragma region data
 private:
+	static constexpr int CURVE_COUNT = ULipSyncDataA2F::CURVE_COUNT;
+	static constexpr int32 ALL_CURVE_GROUPS = (1 << 7) - 1;
+
 	UPROPERTY(EditAnywhere, BlueprintReadWrite, Category = "Voxta", meta = (AllowPrivateAccess = "true", DisplayName = "Source"))
 	FPoseLink m_source;
 
+	/** The groups of ARKit curves that are applied, the others are left as they are in the source pose. */
+	UPROPERTY(EditAnywhere, Category = "Voxta", meta = (AllowPrivateAccess = "true", DisplayName = "Curve Mask",
+		Bitmask, BitmaskEnum = "/Script/VoxtaUtility_A2F.EA2FCurveGroup"))
+	int32 m_curveMask = ALL_CURVE_GROUPS;
+
 	IA2FWeightProvider* m_curveSource = nullptr;
-	TArray<float> m_cachedWeights = TArray<float>();
+	/** Written in PreUpdate (game thread) at m_writeIndex, read in Evaluate_AnyThread at m_readIndex. */
+	float m_weightBuffers[2][CURVE_COUNT] = {};
+	/** False while the source is neutral. */
+	bool m_hasWeights[2] = {};
+	int32 m_writeIndex = 0;
+	int32 m_readIndex = 1;
+
+	/** The ARKit indices of the masked curves, in the order of the sorted FBlendedCurve elements. */
+	TArray<uint8, TFixedAllocator<CURVE_COUNT>> m_sortedCurveIndices;
+	/** The mask that m_sortedCurveIndices was built for, INDEX_NONE if it was not built yet. */
+	int32 m_builtCurveMask = INDEX_NONE;
+	/** Reused every evaluation, so the bulk write doesn't allocate. */
+	FBlendedCurve m_lipSyncCurve;
+#pragma endregion
+
+#pragma region private API
+private:
+	/** Build m_sortedCurveIndices for the current curve mask. (game thread) */
+	void BuildCurveLookup();
 #pragma endregion
 };
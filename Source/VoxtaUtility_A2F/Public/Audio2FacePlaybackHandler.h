@@ -4,9 +4,12 @@
 
 #include "CoreMinimal.h"
 #include "LipSyncDataA2F.h"
+#include <atomic>
 #include "Audio2FacePlaybackHandler.generated.h"
 
 class UAudioComponent;
+class UImportedSoundWave;
+class ULipSyncSamplingSubsystem;
 
 /**
  * UAudio2FacePlaybackHandler
@@ -14,6 +17,10 @@ class UAudioComponent;
  * Each AI Character using A2F has one instance that manages its playback.
  * Provides methods to initialize with an audio component, play/stop A2F lipsync data,
  * and retrieve current curve weights for ARKit blendshapes.
+ *
+ * While playing, the curves are sampled once per frame by the ULipSyncSamplingSubsystem at the exact playback time
+ * of the UImportedSoundWave. Other sound waves, or worlds without the subsystem, fall back to sampling whenever the
+ * AudioComponent broadcasts its playback percent.
  */
 UCLASS()
 class VOXTAUTILITY_A2F_API UAudio2FacePlaybackHandler : public UObject
@@ -31,11 +38,13 @@ public:
 
 	/**
 	 * Fetch the curve values for the upcoming frame, mapping to the blendshapes of the ARKit.
-	 * Should only be called in pre-update via the Animator.
+	 * Lock-free, copies the last published sample and retries if a new one was published meanwhile.
 	 *
-	 * @param targetArrayRef The array to populate with new curve values.
+	 * @param outCurves The buffer to write the CURVE_COUNT curve values into.
+	 *
+	 * @return False if the pose is neutral (nothing playing), outCurves is left untouched in that case.
 	 */
-	void GetA2FCurveWeights(TArray<float>& targetArrayRef);
+	bool GetA2FCurveWeights(TArrayView<float> outCurves) const;
 
 	/**
 	 * Begin playback of the A2F lipsync data along with the audio in the AudioComponent.
@@ -47,8 +56,15 @@ public:
 
 	/**
 	 * Stop the playback and return to a lipsync state (closed mouth).
+	 * Forgets the lipsync data, Play can be called again for the next voiceline.
 	 */
 	void Stop();
+
+	/**
+	 * Sample the curves at the current playback time of the sound wave and publish them.
+	 * Called once per frame by the ULipSyncSamplingSubsystem, possibly on a worker thread, never concurrently.
+	 */
+	void SampleTimeline();
 #pragma endregion
 
 #pragma region UObject overrides
@@ -62,7 +78,7 @@ public:
 #pragma region data
 public:
 	/** Number of ARKit blendshape curves. */
-	static const int CURVE_COUNT = 52;
+	static constexpr int CURVE_COUNT = ULipSyncDataA2F::CURVE_COUNT;
 	/** Names of the ARKit blendshape curves. */
 	static const FName CURVE_NAMES[CURVE_COUNT];
 
@@ -73,12 +89,18 @@ private:
 	UPROPERTY()
 	UAudioComponent* m_audioComponent = nullptr;
 
-	FCriticalSection m_curvesGuard;
+	/** The sound that is playing, its played frames are the clock of SampleTimeline. */
+	TWeakObjectPtr<const UImportedSoundWave> m_importedSoundWave;
+	TWeakObjectPtr<ULipSyncSamplingSubsystem> m_samplingSubsystem;
 
+	/** Only bound if the timeline is not sampled by the ULipSyncSamplingSubsystem. */
 	FDelegateHandle m_playbackPercentHandle;
 	FDelegateHandle m_playbackFinishedHandle;
-	TArray<float> m_currentCurves;
-	bool m_forcedNeutral = true;
+	/** Double-buffered samples, a new one is written into the buffer that is not published. */
+	float m_curveBuffers[2][CURVE_COUNT] = {};
+	/** Incremented after every sample, the lowest bit is the index of the published buffer. */
+	std::atomic<uint32> m_curveSequence{0};
+	std::atomic<bool> m_forcedNeutral{true};
 #pragma endregion
 
 #pragma region private API
@@ -86,7 +108,20 @@ private:
 	void InitNeutralPose();
 
 	/**
-	 * Triggered by the UAudioComponent, updates the currentCurve data to represent the current state of the audio.
+	 * Write a new sample into the unpublished buffer and publish it.
+	 * Single writer per handler: the ULipSyncSamplingSubsystem task, which can run on a ParallelFor worker,
+	 * or the game thread when the timeline is not sampled by that subsystem.
+	 *
+	 * @param frame The fractional A2F frame to sample, or INDEX_NONE for all zeroes.
+	 */
+	void PublishCurves(float frame);
+
+	/** Stop being sampled by the ULipSyncSamplingSubsystem, if it was. */
+	void UnregisterTimeline();
+
+	/**
+	 * Fallback for sound waves without a playback clock, triggered by the UAudioComponent.
+	 * Updates the currentCurve data to represent the current state of the audio.
 	 * Applies interpolation to avoid framerate issues (A2F is rendered at 30fps).
 	 *
 	 * @param audioComponent The component currently playing the audio.
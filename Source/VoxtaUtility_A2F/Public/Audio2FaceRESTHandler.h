@@ -7,40 +7,112 @@
 #include "HttpModule.h"
 #include "Interfaces/IHttpRequest.h"
 #include "Interfaces/IHttpResponse.h"
+#include "VoxtaCancellationToken.h"
+
+/**
+ * A2FJobPriority
+ * The priority classes of the blendshape jobs of the Audio2FaceRESTHandler, from most to least urgent.
+ */
+enum class A2FJobPriority : uint8
+{
+	/** Lipsync the player is waiting for right now. */
+	PlayingChunk,
+	/** Lipsync that is prepared ahead of its playback. */
+	Prefetch,
+
+	Count
+};
+
+/**
+ * FA2FJobStats
+ * Counters of one priority class of the blendshape jobs since startup.
+ */
+struct FA2FJobStats
+{
+	int64 NumOfJobs = 0;
+	int64 NumOfFailures = 0;
+	/** Jobs that were cancelled, whether they were still queued or already running. */
+	int64 NumOfCancelled = 0;
+	/** Time between being queued and an endpoint picking the job up. */
+	double TotalQueueSeconds = 0.0;
+	double MaxQueueSeconds = 0.0;
+	/** Time between being picked up and the blendshapes being exported. */
+	double TotalSolveSeconds = 0.0;
+	double MaxSolveSeconds = 0.0;
+};
 
 /**
  * Audio2FaceRESTHandler
  * Manages the HTTP REST API for A2F_headless mode.
- * Handles initialization, blendshape generation, and state tracking for Audio2Face.
- * Not intended for parallel generation; manages single-threaded access.
+ * Handles initialization of one or more A2F instances (endpoints) and queues the blendshape jobs in front of them.
+ *
+ * Each endpoint solves one job at a time, as an A2F player only has a single track. Jobs are picked up in order of
+ * priority class, and per class in the order they were queued, by whichever endpoint is idle first. More endpoints
+ * (voxta.A2F.Endpoints) means more jobs in flight. An endpoint that fails at the transport or HTTP level is probed
+ * again before it gets another job, and its job is put back in front of the queue for the other endpoints.
+ *
+ * The root path & track of each endpoint's player are tracked here, so a job only sends the requests that change
+ * something; usually SetTrack & ExportBlendshapes. Responses are handled on the http thread.
+ *
+ * Use 'voxta.A2F.Dump' to log the queue wait & solve times, and the time spent per request type.
+ *
+ * Note: All functions are thread-safe. Job callbacks always run on the game thread.
  */
 class VOXTAUTILITY_A2F_API Audio2FaceRESTHandler : public TSharedFromThis<Audio2FaceRESTHandler>
 {
 #pragma region public API
 public:
 	/**
-	 * Check if A2F is running and attempt to initialize it.
-	 * Loads the USD file for Metahuman ARKit and sets the player root path.
+	 * @param endpointUrls The base urls of the A2F instances, e.g. http://localhost:8011. Empty to use the
+	 * comma-separated list of voxta.A2F.Endpoints when initializing.
+	 */
+	explicit Audio2FaceRESTHandler(const TArray<FString>& endpointUrls = TArray<FString>());
+
+	/**
+	 * Check which A2F endpoints are running and attempt to initialize them, endpoints that failed before are retried.
+	 * Loads the USD file for Metahuman ARKit and sets the player root path on each of them.
 	 */
 	void TryInitialize();
 
 	/**
-	 * Use the A2F export REST API to generate a JSON file containing all blendshape curve values for ARKit mapping.
-	 * Note: The wave file must be on the same machine as the A2F instance.
+	 * Queue a job that uses the A2F export REST API to generate a JSON file containing all blendshape curve values
+	 * for ARKit mapping. Rejected right away if no endpoint is connected or initializing.
+	 * Note: The wave file must be readable by every endpoint, e.g. by running them on the same machine.
 	 *
 	 * @param wavFileName The name of the audio file to use for lipsync data generation.
 	 * @param shapesFilePath The path to write the JSON shapes file to.
 	 * @param shapesFileName The name of the JSON shapes file.
+	 * @param priority The priority class of the job.
+	 * @param cancellationToken Optional token, cancelling it removes the job from the queue or aborts its outstanding
+	 * request, which frees the endpoint for the next one.
 	 * @param callback Callback with the path of the JSON file and success status.
+	 *
+	 * @return The id of the job, or 0 if it was rejected.
 	 */
-	void GetBlendshapes(const FString& wavFileName, const FString& shapesFilePath, const FString& shapesFileName,
+	uint64 GetBlendshapes(const FString& wavFileName, const FString& shapesFilePath, const FString& shapesFileName,
+		A2FJobPriority priority, FVoxtaCancellationTokenPtr cancellationToken,
 		TFunction<void(const FString&, bool /*success*/)> callback);
 
-	/** @return True if A2F is currently initializing. */
+	/**
+	 * Move a queued job into another priority class, e.g. when its voiceline is now the one being played.
+	 * Does nothing if the job was already picked up.
+	 *
+	 * @param jobId The id returned by GetBlendshapes.
+	 * @param priority The new priority class.
+	 */
+	void SetJobPriority(uint64 jobId, A2FJobPriority priority);
+
+	/** @return True if any A2F endpoint is currently initializing. */
 	bool IsInitializing() const;
 
-	/** @return True if A2F is ready to generate new lipsync data. */
+	/** @return True if at least one A2F endpoint is connected, so new jobs will be solved. */
 	bool IsAvailable() const;
+
+	/** @return A snapshot of the counters of the given priority class. */
+	FA2FJobStats GetStats(A2FJobPriority priority) const;
+
+	/** Log the state of every endpoint and the counters of all priority classes. */
+	void DumpToLog() const;
 #pragma endregion
 
 #pragma region private helper classes
@@ -53,25 +125,135 @@ private:
 		Idle,
 		Busy
 	};
+
+	/** The REST requests of a blendshape job, in the order they are sent. */
+	enum class JobStep : uint8
+	{
+		SetRootPath,
+		SetTrack,
+		Export,
+
+		Count
+	};
+
+	struct FStepStats
+	{
+		int64 NumOfRequests = 0;
+		/** Requests that weren't sent, as the player already had that state. */
+		int64 NumOfSkipped = 0;
+		double TotalSeconds = 0.0;
+		double MaxSeconds = 0.0;
+	};
+
+	struct FEndpoint
+	{
+		FString BaseUrl;
+		CurrentA2FState State = CurrentA2FState::NotConnected;
+		/** The last player state the endpoint confirmed, reset whenever a request fails. */
+		bool HasRootPath = false;
+		FString LoadedTrack;
+		int64 NumOfSolvedJobs = 0;
+		double TotalSolveSeconds = 0.0;
+	};
+
+	struct FBlendshapeJob
+	{
+		uint64 Id = 0;
+		FString WavFileName;
+		FString ShapesFilePath;
+		FString ShapesFileName;
+		A2FJobPriority Priority = A2FJobPriority::Prefetch;
+		FVoxtaCancellationTokenPtr CancellationToken;
+		TFunction<void(const FString&, bool)> Callback;
+		double QueuedTime = 0.0;
+		double StartTime = 0.0;
+		double StepStartTime = 0.0;
+		double StepSeconds[static_cast<uint8>(JobStep::Count)] = {};
+		int32 NumOfSkippedSteps = 0;
+		/** Skipped steps are only retried once, in case the endpoint lost its state. */
+		bool HasRetried = false;
+		/** Times the job was put back in the queue because its endpoint failed. */
+		int32 NumOfRequeues = 0;
+	};
 #pragma endregion
 
 #pragma region data
 private:
-	std::atomic<CurrentA2FState> m_currentState = CurrentA2FState::NotConnected;
+	/** A job that keeps failing on every endpoint it is handed to is failed instead of requeued forever. */
+	static constexpr int32 MAX_JOB_REQUEUES = 2;
+
+	mutable FCriticalSection m_lock;
+	/** Indices are stable, the list is only filled once by the first TryInitialize. */
+	TArray<FEndpoint> m_endpoints;
+	TArray<FString> m_configuredEndpointUrls;
+	/** Cached, as the requests are built off the game thread. */
+	FString m_contentDir;
+	/** Sorted by priority class, and per class in the order the jobs were queued. */
+	TArray<TSharedRef<FBlendshapeJob, ESPMode::ThreadSafe>> m_queue;
+	uint64 m_nextJobId = 1;
+	FA2FJobStats m_stats[static_cast<uint8>(A2FJobPriority::Count)];
+	FStepStats m_stepStats[static_cast<uint8>(JobStep::Count)];
 #pragma endregion
 
 #pragma region private API
-	/** Send a request to the http://localhost:8011/status REST call (GET) */
-	void GetStatus(TFunction<void(FHttpRequestPtr, FHttpResponsePtr, bool)> callback) const;
-	/** Send a request to the http://localhost:8011/A2F/USD/Load" REST call (POST) */
-	void LoadUsdFile(TFunction<void(FHttpRequestPtr, FHttpResponsePtr, bool)> callback) const;
-	/** Send a request to the http://localhost:8011/A2F/Player/SetRootPath" REST call (POST) */
-	void SetPlayerRootPath(TFunction<void(FHttpRequestPtr, FHttpResponsePtr, bool)> callback) const;
-	/** Send a request to the http://localhost:8011/A2F/Player/SetTrack" REST call (POST) */
-	void SetPlayerTrack(const FString& fileName, TFunction<void(FHttpRequestPtr, FHttpResponsePtr, bool)> callback) const;
-	/** Send a request to the http://localhost:8011/A2F/Exporter/ExportBlendshapes" REST call (POST) */
-	void GenerateBlendShapes(const FString& filePath, const FString& fileName,
-		TFunction<void(FHttpRequestPtr, FHttpResponsePtr, bool)> callback) const;
+	/** Run the initialization requests of one endpoint, and start solving queued jobs once it is idle. */
+	void InitializeEndpoint(int32 endpointIndex, const FString& baseUrl);
+
+	/** Mark an endpoint as connected or not, failing the queued jobs if no endpoint is left to solve them. */
+	void OnEndpointInitialized(int32 endpointIndex, bool success);
+
+	/** Hand queued jobs to idle endpoints, and drop the jobs that were cancelled while queued. */
+	void Pump();
+
+	/** Send the request of the given step of a job, or of the first later step the endpoint doesn't have yet. */
+	void AdvanceJob(int32 endpointIndex, const FString& baseUrl, const TSharedRef<FBlendshapeJob, ESPMode::ThreadSafe>& job,
+		JobStep step);
+
+	/** Update the tracked player state with the response of a step, then move on to the next step or complete the job. */
+	void OnJobStepCompleted(int32 endpointIndex, const FString& baseUrl,
+		const TSharedRef<FBlendshapeJob, ESPMode::ThreadSafe>& job, JobStep step, const FHttpResponsePtr& response,
+		bool success);
+
+	/**
+	 * Probe an endpoint again after a request of a job failed at the transport or HTTP level, and put the job back in
+	 * front of its priority class so another endpoint can solve it.
+	 */
+	void OnEndpointFailed(int32 endpointIndex, const FString& baseUrl,
+		const TSharedRef<FBlendshapeJob, ESPMode::ThreadSafe>& job, JobStep step);
+
+	/** Bookkeeping once a job completed on an endpoint, then frees the endpoint for the next one. */
+	void CompleteJob(int32 endpointIndex, const TSharedRef<FBlendshapeJob, ESPMode::ThreadSafe>& job, bool success);
+
+	/** Remove a job from the queue once its token is cancelled, does nothing if it was already picked up. */
+	void CancelQueuedJob(uint64 jobId);
+
+	/** @return The readable name of a priority class. */
+	static const TCHAR* GetPriorityName(A2FJobPriority priority);
+
+	/** @return The readable name of a job step. */
+	static const TCHAR* GetStepName(JobStep step);
+
+	/** @return The readable name of an endpoint state. */
+	static const TCHAR* GetStateName(CurrentA2FState state);
+
+	/** Invoke the callback of a job on the game thread. */
+	static void NotifyJob(const TSharedRef<FBlendshapeJob, ESPMode::ThreadSafe>& job, bool success);
+
+	/** Send a request to the {baseUrl}/status REST call (GET) */
+	void GetStatus(const FString& baseUrl, TFunction<void(FHttpRequestPtr, FHttpResponsePtr, bool)> callback) const;
+	/** Send a request to the {baseUrl}/A2F/USD/Load" REST call (POST) */
+	void LoadUsdFile(const FString& baseUrl, TFunction<void(FHttpRequestPtr, FHttpResponsePtr, bool)> callback) const;
+	/** Send a request to the {baseUrl}/A2F/Player/SetRootPath" REST call (POST) */
+	void SetPlayerRootPath(const FString& baseUrl, TFunction<void(FHttpRequestPtr, FHttpResponsePtr, bool)> callback,
+		const FVoxtaCancellationTokenPtr& cancellationToken = nullptr) const;
+	/** Send a request to the {baseUrl}/A2F/Player/SetTrack" REST call (POST) */
+	void SetPlayerTrack(const FString& baseUrl, const FString& fileName,
+		TFunction<void(FHttpRequestPtr, FHttpResponsePtr, bool)> callback,
+		const FVoxtaCancellationTokenPtr& cancellationToken = nullptr) const;
+	/** Send a request to the {baseUrl}/A2F/Exporter/ExportBlendshapes" REST call (POST) */
+	void GenerateBlendShapes(const FString& baseUrl, const FString& filePath, const FString& fileName,
+		TFunction<void(FHttpRequestPtr, FHttpResponsePtr, bool)> callback,
+		const FVoxtaCancellationTokenPtr& cancellationToken = nullptr) const;
 
 	// TODO: implement these, maybe? idk yet
 	//void GetInstance(TFunction<void(FHttpRequestPtr, FHttpResponsePtr, bool)> callback);
@@ -80,6 +262,15 @@ private:
 	//void GetPlayerTracks(TFunction<void(FHttpRequestPtr, FHttpResponsePtr, bool)> callback);
 	//void GetBlendshapeSolver(TFunction<void(FHttpRequestPtr, FHttpResponsePtr, bool)> callback);
 
+	/**
+	 * Check the {"status": "OK"} body that A2F answers with on success, without building a JsonObject.
+	 *
+	 * @param response The response, can be null.
+	 *
+	 * @return True if the response is valid and reports OK.
+	 */
+	static bool IsStatusOk(const FHttpResponsePtr& response);
+
 	/**
 	 * Serialize a JsonObject into an FString.
 	 *
@@ -99,5 +290,15 @@ private:
 	 */
 	TSharedRef<IHttpRequest, ESPMode::ThreadSafe> GetBaseRequest(
 		TFunction<void(FHttpRequestPtr, FHttpResponsePtr, bool)> callback) const;
+
+	/**
+	 * Send the request, and cancel it as soon as the token is cancelled.
+	 * The response callback is then invoked without success.
+	 *
+	 * @param request The prepared HTTP request.
+	 * @param cancellationToken The token of the job that the request belongs to, can be null.
+	 */
+	void ProcessCancellableRequest(const TSharedRef<IHttpRequest, ESPMode::ThreadSafe>& request,
+		const FVoxtaCancellationTokenPtr& cancellationToken) const;
 #pragma endregion
 };
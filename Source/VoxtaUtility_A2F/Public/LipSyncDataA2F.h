@@ -4,6 +4,8 @@
 
 #include "CoreMinimal.h"
 #include "LipSyncBaseData.h"
+#include "VoxtaObjectPool.h"
+#include "A2FCompactCurves.h"
 #include "LipSyncDataA2F.generated.h"
 
 /**
@@ -12,6 +14,9 @@
  * Holds all data required for playback of Audio2Face lipsync generation.
  * Keeps A2F logic modular and separated from other lipsync types.
  * Each instance holds the lipsync data for a single voiceline and is responsible for its own cleanup.
+ *
+ * The curves are kept either as raw floats, or as A2FCompactCurves when voxta.A2F.Compact.Enabled is on, which is an
+ * order of magnitude smaller for queued & cached voicelines. Sampling works the same for both.
  */
 UCLASS(Category = "Voxta")
 class VOXTAUTILITY_A2F_API ULipSyncDataA2F : public UObject, public ILipSyncBaseData
@@ -22,12 +27,23 @@ class VOXTAUTILITY_A2F_API ULipSyncDataA2F : public UObject, public ILipSyncBase
 public:
 	/**
 	 * Clean up the A2F-lipsync data.
-	 * Removes this object from the root set, allowing it to be garbage collected.
+	 * Returns this object to the VoxtaObjectPool, which unroots it if the pool is full.
 	 * Should be called when playback is finished and the data is no longer needed.
 	 */
 	virtual void ReleaseData() override
 	{
-		RemoveFromRoot();
+		m_curveWeights.Empty();
+		m_compactCurves = A2FCompactCurves();
+		m_isCompact = false;
+		m_framesPerSecond = 0;
+		RenewGuid();
+		VoxtaObjectPool::Get().Release(this);
+	}
+
+	/** @return The number of bytes held by the curve weights. */
+	virtual int64 GetAllocatedSize() const override
+	{
+		return m_isCompact ? m_compactCurves.GetAllocatedSize() : m_curveWeights.GetAllocatedSize();
 	}
 #pragma endregion
 
@@ -45,15 +61,20 @@ public:
 	/**
 	 * Register the genereated curves from A2F as part of this data object.
 	 * These are returned by the A2F_headless REST api.
+	 * Compacted right away if A2FCompactCurves::IsEnabled, prefer SetA2FCompactCurves when that already happened on a
+	 * worker thread.
 	 *
-	 * @param sourceCurves The ARKit curve values per setting per frame.
+	 * @param curveWeights The ARKit curve values, frame-major with CURVE_COUNT values per frame. Moved into this object.
 	 * @param framesPerSecond The fps that this data was generated at (high framerates will interpolate)
 	 */
-	void SetA2FCurveWeights(const TArray<TArray<float>>& sourceCurves, int framesPerSecond)
-	{
-		m_curveWeights = sourceCurves;
-		m_framesPerSecond = framesPerSecond;
-	}
+	void SetA2FCurveWeights(TArray<float>&& curveWeights, int framesPerSecond);
+
+	/**
+	 * Register curves that were already compacted, e.g. on a worker thread or loaded from the voiceline cache.
+	 *
+	 * @param compactCurves The compacted curves of the voiceline. Moved into this object.
+	 */
+	void SetA2FCompactCurves(A2FCompactCurves&& compactCurves);
 
 	/** @return The FPS that the curves were generated at. */
 	int GetFramePerSecond() const
@@ -61,16 +82,67 @@ public:
 		return m_framesPerSecond;
 	}
 
-	/** @return A direct reference to the generated curve weights. */
-	const TArray<TArray<float>>& GetA2FCurveWeights() const
+	/** @return The number of frames that A2F generated. */
+	int GetNumOfFrames() const
+	{
+		return m_isCompact ? m_compactCurves.GetNumOfFrames() : m_curveWeights.Num() / CURVE_COUNT;
+	}
+
+	/** @return True if the curves are stored as A2FCompactCurves. */
+	bool IsCompact() const
 	{
-		return m_curveWeights;
+		return m_isCompact;
 	}
+
+	/**
+	 * Copy the generated curve weights, decoding them if they are compacted.
+	 *
+	 * @param outCurveWeights Receives the curve values, frame-major with CURVE_COUNT values per frame.
+	 */
+	void GetA2FCurveWeights(TArray<float>& outCurveWeights) const
+	{
+		if (m_isCompact)
+		{
+			m_compactCurves.Decode(outCurveWeights);
+		}
+		else
+		{
+			outCurveWeights = m_curveWeights;
+		}
+	}
+
+	/**
+	 * Write the curve weights at a point in time into a preallocated buffer, interpolating between the two
+	 * surrounding frames. Points past the last frame are clamped on it.
+	 *
+	 * @param frame The fractional frame index, e.g. the playback time multiplied by the fps.
+	 * @param outCurves The buffer to write the CURVE_COUNT weights into.
+	 *
+	 * @return False if there are no frames, outCurves is left untouched in that case.
+	 */
+	bool SampleCurves(float frame, float* outCurves) const;
+
+	/**
+	 * Interpolate all curves of two frames, 4 curves at a time.
+	 *
+	 * @param fromCurves The CURVE_COUNT weights at alpha 0.
+	 * @param toCurves The CURVE_COUNT weights at alpha 1.
+	 * @param alpha The blend factor between both frames.
+	 * @param outCurves The buffer to write the CURVE_COUNT weights into, may alias one of the inputs.
+	 */
+	static void LerpCurves(const float* fromCurves, const float* toCurves, float alpha, float* outCurves);
 #pragma endregion
 
 #pragma region data
+public:
+	/** Number of ARKit blendshape curves per frame. */
+	static constexpr int CURVE_COUNT = A2FCompactCurves::CURVE_COUNT;
+
 private:
 	int m_framesPerSecond = 0;
-	TArray<TArray<float>> m_curveWeights;
+	/** Frame-major, one contiguous allocation for the whole voiceline. Empty if the curves are compacted. */
+	TArray<float> m_curveWeights;
+	A2FCompactCurves m_compactCurves;
+	bool m_isCompact = false;
 #pragma endregion
 };
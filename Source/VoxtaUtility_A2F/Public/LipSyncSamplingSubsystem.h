@@ -0,0 +1,80 @@
+// Copyright(c) 2024 grrimgrriefer & DZnnah, see LICENSE for details.
+
+#pragma once
+
+#include "CoreMinimal.h"
+#include "Subsystems/WorldSubsystem.h"
+#include "LipSyncSamplingSubsystem.generated.h"
+
+class UAudio2FacePlaybackHandler;
+
+/**
+ * ULipSyncSamplingSubsystem
+ * Samples the lipsync of every talking character once per frame, right before the actors (and their anim instances)
+ * tick, in one ParallelFor pass. Each timeline is sampled at the exact playback position of its sound, instead of
+ * whenever the audio component happens to broadcast its playback percent, so the curves line up with the rendered
+ * frame and the cost per character is one interpolation of its curves.
+ *
+ * UAudio2FacePlaybackHandler registers itself while it is playing, the anim nodes read the published samples in
+ * their PreUpdate as before.
+ *
+ * Note: Only exists in game & PIE worlds. Register & Unregister must be called on the game thread.
+ */
+UCLASS()
+class VOXTAUTILITY_A2F_API ULipSyncSamplingSubsystem : public UWorldSubsystem
+{
+	GENERATED_BODY()
+
+#pragma region UWorldSubsystem overrides
+public:
+	/** Hook into the start of every world tick. */
+	virtual void Initialize(FSubsystemCollectionBase& collection) override;
+
+	/** Unhook from the world tick and forget all timelines. */
+	virtual void Deinitialize() override;
+
+protected:
+	/** @return True for game & PIE worlds, editor previews don't play voicelines. */
+	virtual bool DoesSupportWorldType(const EWorldType::Type worldType) const override;
+#pragma endregion
+
+#pragma region public API
+public:
+	/**
+	 * Start sampling the timeline of a playback handler every frame.
+	 *
+	 * @param playbackHandler The handler that started playing A2F lipsync.
+	 */
+	void Register(UAudio2FacePlaybackHandler* playbackHandler);
+
+	/**
+	 * Stop sampling the timeline of a playback handler.
+	 *
+	 * @param playbackHandler The handler that stopped playing.
+	 */
+	void Unregister(UAudio2FacePlaybackHandler* playbackHandler);
+
+	/** @return The number of timelines that are sampled every frame. */
+	int32 GetNumOfTimelines() const
+	{
+		return m_A2FTimelines.Num();
+	}
+#pragma endregion
+
+#pragma region data
+private:
+	/** Below this many timelines, waking up the task graph costs more than sampling them on the game thread. */
+	static constexpr int32 MIN_PARALLEL_TIMELINES = 8;
+
+	TArray<TWeakObjectPtr<UAudio2FacePlaybackHandler>> m_A2FTimelines;
+	/** Reused every frame, the timelines that are still alive. */
+	TArray<UAudio2FacePlaybackHandler*> m_sampledTimelines;
+	FDelegateHandle m_preActorTickHandle;
+#pragma endregion
+
+#pragma region private API
+private:
+	/** Sample every registered timeline. (game thread) */
+	void OnWorldPreActorTick(UWorld* world, ELevelTick tickType, float deltaSeconds);
+#pragma endregion
+};
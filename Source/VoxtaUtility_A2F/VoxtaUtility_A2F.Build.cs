@@ -16,6 +16,6 @@ public class VoxtaUtility_A2F : ModuleRules
 
 		PublicDependencyModuleNames.AddRange(new [] { "Core", "CoreUObject", "Engine" });
 
-		PrivateDependencyModuleNames.AddRange(new [] { "Json", "VoxtaData", "HTTP", "Projects" });
+		PrivateDependencyModuleNames.AddRange(new [] { "Json", "VoxtaData", "LogUtility", "HTTP", "Projects", "VoxtaAudioUtility" });
 	}
 }
\ No newline at end of file
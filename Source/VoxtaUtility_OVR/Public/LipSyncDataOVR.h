@@ -4,10 +4,10 @@
 
 #include "CoreMinimal.h"
 #include "LipSyncBaseData.h"
+#include "VoxtaObjectPool.h"
+#include "OVRLipSyncFrame.h"
 #include "LipSyncDataOVR.generated.h"
 
-class UOVRLipSyncFrameSequence;
-
 /**
  * ULipSyncDataOVR
  * Contains all the data required for playback of OVR lipsync generation.
@@ -22,12 +22,25 @@ class VOXTAUTILITY_OVR_API ULipSyncDataOVR : public UObject, public ILipSyncBase
 public:
 	/**
 	 * Clean up the OVR-lipsync data that was made & kept in memory for playback of the voiceline that is tied
-	 * to this data structure.
+	 * to this data structure. Returns this object to the VoxtaObjectPool, which unroots it if the pool is full.
 	 */
 	virtual void ReleaseData() override
 	{
 		m_ovrLipSyncFrameSequence = nullptr;
-		RemoveFromRoot();
+		RenewGuid();
+		VoxtaObjectPool::Get().Release(this);
+	}
+
+	/** @return The estimated number of bytes held by the frame sequence, all frames have the same number of visemes. */
+	virtual int64 GetAllocatedSize() const override
+	{
+		if (m_ovrLipSyncFrameSequence == nullptr || m_ovrLipSyncFrameSequence->Num() == 0)
+		{
+			return 0;
+		}
+		const FOVRLipSyncFrame& firstFrame = (*m_ovrLipSyncFrameSequence)[0];
+		return static_cast<int64>(m_ovrLipSyncFrameSequence->Num()) *
+			(sizeof(FOVRLipSyncFrame) + firstFrame.VisemeScores.GetAllocatedSize());
 	}
 #pragma endregion
 
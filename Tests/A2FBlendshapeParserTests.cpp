@@ -0,0 +1,144 @@
+// Copyright(c) 2024 grrimgrriefer & DZnnah, see LICENSE for details.
+
+#pragma once
+#include "CQTest.h"
+#include "A2FBlendshapeParser.h"
+#include "LipSyncDataA2F.h"
+#include "HAL/PlatformTime.h"
+#include "Dom/JsonObject.h"
+#include "Serialization/JsonReader.h"
+#include "Serialization/JsonSerializer.h"
+
+/**
+ * A2FBlendshapeParserTests
+ * Checks the streaming A2F blendshape parser against the engine JSON DOM, and times both on a generated voiceline.
+ */
+TEST_CLASS(A2FBlendshapeParserTests, "Voxta.A2F")
+{
+	static constexpr int CURVE_COUNT = ULipSyncDataA2F::CURVE_COUNT;
+	static constexpr int A2F_FPS = 30;
+	/** A ten second voiceline. */
+	static constexpr int NUM_OF_FRAMES = A2F_FPS * 10;
+
+	FString m_json;
+	FTCHARToUTF8* m_utf8 = nullptr;
+
+	/** Mirrors the layout A2F writes, including the fields the parser has to skip. */
+	BEFORE_EACH()
+	{
+		FRandomStream randomStream(1337);
+		m_json = FString::Printf(TEXT("{\n  \"exportFps\": %d,\n  \"trackPath\": \"C:\\\\A2F\\\\VoiceLine \\\"1\\\".wav\",\n"
+			"  \"numPoses\": %d,\n  \"numFrames\": %d,\n  \"facsNames\": [\"EyeBlinkLeft\", \"JawOpen\"],\n"
+			"  \"meta\": { \"valid\": true, \"offset\": null, \"scale\": -1.5e-3 },\n  \"weightMat\": [\n"),
+			A2F_FPS, CURVE_COUNT, NUM_OF_FRAMES);
+		for (int frame = 0; frame < NUM_OF_FRAMES; frame++)
+		{
+			m_json += TEXT("    [");
+			for (int curve = 0; curve < CURVE_COUNT; curve++)
+			{
+				m_json += FString::Printf(curve == 0 ? TEXT("%.17g") : TEXT(", %.17g"),
+					static_cast<double>(randomStream.FRand()) * 1.1 - 0.05);
+			}
+			m_json += frame == NUM_OF_FRAMES - 1 ? TEXT("]\n") : TEXT("],\n");
+		}
+		m_json += TEXT("  ]\n}\n");
+		m_utf8 = new FTCHARToUTF8(*m_json);
+	}
+
+	AFTER_EACH()
+	{
+		delete m_utf8;
+		m_utf8 = nullptr;
+		m_json.Empty();
+	}
+
+	/** Both parsers must produce the same floats, the fast path is exact for every weight A2F writes. */
+	TEST_METHOD(TryParse_CompareWithJsonDom_ExpectEqual)
+	{
+		FA2FBlendshapeResult result;
+		FString error;
+		ASSERT_THAT(IsTrue(A2FBlendshapeParser::TryParse(reinterpret_cast<const uint8*>(m_utf8->Get()),
+			m_utf8->Length(), result, error)));
+		ASSERT_THAT(IsTrue(result.Fps == A2F_FPS));
+		ASSERT_THAT(IsTrue(result.NumOfCurvesPerFrame == CURVE_COUNT));
+		ASSERT_THAT(IsTrue(result.NumOfFrames == NUM_OF_FRAMES));
+
+		TSharedPtr<FJsonObject> jsonObject;
+		ASSERT_THAT(IsTrue(FJsonSerializer::Deserialize(TJsonReaderFactory<>::Create(m_json), jsonObject)));
+		const TArray<TSharedPtr<FJsonValue>>& weightMat = jsonObject->GetArrayField(TEXT("weightMat"));
+		bool allEqual = true;
+		for (int frame = 0; frame < weightMat.Num(); frame++)
+		{
+			const TArray<TSharedPtr<FJsonValue>>& values = weightMat[frame]->AsArray();
+			for (int curve = 0; curve < CURVE_COUNT; curve++)
+			{
+				allEqual &= result.CurveWeights[frame * CURVE_COUNT + curve] == static_cast<float>(values[curve]->AsNumber());
+			}
+		}
+		ASSERT_THAT(IsTrue(allEqual));
+	}
+
+	/** Short rows are zero-padded, long rows are cut, and malformed input is rejected instead of half-parsed. */
+	TEST_METHOD(TryParse_IrregularAndMalformedInput_ExpectPaddedOrRejected)
+	{
+		FA2FBlendshapeResult result;
+		FString error;
+		const FTCHARToUTF8 irregular(TEXT("{\"weightMat\": [[0.5, 1e-2], [], [-2E+1]], \"exportFps\": 60}"));
+		ASSERT_THAT(IsTrue(A2FBlendshapeParser::TryParse(reinterpret_cast<const uint8*>(irregular.Get()),
+			irregular.Length(), result, error)));
+		ASSERT_THAT(IsTrue(result.NumOfFrames == 3 && result.NumOfCurvesPerFrame == 2));
+		ASSERT_THAT(IsTrue(result.CurveWeights[0] == 0.5f && result.CurveWeights[1] == 0.01f));
+		ASSERT_THAT(IsTrue(result.CurveWeights[2] == 0.f && result.CurveWeights[CURVE_COUNT] == 0.f));
+		ASSERT_THAT(IsTrue(result.CurveWeights[2 * CURVE_COUNT] == -20.f));
+
+		for (const TCHAR* malformed : { TEXT("{\"exportFps\": 30, \"weightMat\": [[0.1, ]]}"),
+			TEXT("{\"exportFps\": 30, \"weightMat\": [[0.1]]"), TEXT("{\"exportFps\": 30}"),
+			TEXT("{\"weightMat\": [[0.1]]}"), TEXT("{\"exportFps\": 30, \"weightMat\": [[.5]]}") })
+		{
+			const FTCHARToUTF8 utf8(malformed);
+			error.Empty();
+			ASSERT_THAT(IsFalse(A2FBlendshapeParser::TryParse(reinterpret_cast<const uint8*>(utf8.Get()),
+				utf8.Length(), result, error)));
+			ASSERT_THAT(IsFalse(error.IsEmpty()));
+		}
+	}
+
+	/** Time to get from the file contents to the flat curve buffer, which used to happen on the game thread. */
+	TEST_METHOD(TryParse_TenSecondVoiceline_ReportThroughput)
+	{
+		constexpr int numOfRuns = 20;
+		double startTime = FPlatformTime::Seconds();
+		for (int run = 0; run < numOfRuns; run++)
+		{
+			FString fileContents;
+			FFileHelper::BufferToString(fileContents, reinterpret_cast<const uint8*>(m_utf8->Get()), m_utf8->Length());
+			TSharedPtr<FJsonObject> jsonObject;
+			FJsonSerializer::Deserialize(TJsonReaderFactory<>::Create(fileContents), jsonObject);
+			const TArray<TSharedPtr<FJsonValue>>& weightMat = jsonObject->GetArrayField(TEXT("weightMat"));
+			TArray<float> curveWeights;
+			curveWeights.SetNumZeroed(weightMat.Num() * CURVE_COUNT);
+			for (int frame = 0; frame < weightMat.Num(); frame++)
+			{
+				const TArray<TSharedPtr<FJsonValue>>& values = weightMat[frame]->AsArray();
+				for (int curve = 0; curve < FMath::Min(values.Num(), CURVE_COUNT); curve++)
+				{
+					curveWeights[frame * CURVE_COUNT + curve] = values[curve]->AsNumber();
+				}
+			}
+		}
+		const double domSeconds = FPlatformTime::Seconds() - startTime;
+
+		FA2FBlendshapeResult result;
+		FString error;
+		startTime = FPlatformTime::Seconds();
+		for (int run = 0; run < numOfRuns; run++)
+		{
+			A2FBlendshapeParser::TryParse(reinterpret_cast<const uint8*>(m_utf8->Get()), m_utf8->Length(), result, error);
+		}
+		const double streamingSeconds = FPlatformTime::Seconds() - startTime;
+
+		TestRunner->AddInfo(FString::Printf(TEXT("A2F blendshape JSON of %d KiB: json dom %.2f ms, streaming %.2f ms"),
+			m_utf8->Length() / 1024, domSeconds * 1e3 / numOfRuns, streamingSeconds * 1e3 / numOfRuns));
+		ASSERT_THAT(IsTrue(result.NumOfFrames == NUM_OF_FRAMES));
+	}
+};
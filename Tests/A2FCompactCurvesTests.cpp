@@ -0,0 +1,116 @@
+// Copyright(c) 2024 grrimgrriefer & DZnnah, see LICENSE for details.
+
+#pragma once
+#include "CQTest.h"
+#include "A2FCompactCurves.h"
+#include "LipSyncDataA2F.h"
+#include "Serialization/MemoryWriter.h"
+#include "Serialization/MemoryReader.h"
+
+/**
+ * A2FCompactCurvesTests
+ * Checks the error bound, size & serialization of A2FCompactCurves on a speech-like voiceline.
+ * A2FCurveBenchmarks reports how fast they are sampled.
+ */
+TEST_CLASS(A2FCompactCurvesTests, "Voxta.A2F")
+{
+	static constexpr int CURVE_COUNT = ULipSyncDataA2F::CURVE_COUNT;
+	static constexpr float TOLERANCE = 0.005f;
+	static constexpr int A2F_FPS = 30;
+
+	TArray<float> m_curveWeights;
+	int m_numOfFrames = 0;
+
+	/** Every 4th curve moves with the speech, which pauses for half a second every 2 seconds. The others barely move. */
+	BEFORE_EACH()
+	{
+		// A ten second voiceline
+		m_numOfFrames = A2F_FPS * 10;
+		m_curveWeights.SetNumUninitialized(m_numOfFrames * CURVE_COUNT);
+		for (int frame = 0; frame < m_numOfFrames; frame++)
+		{
+			const float seconds = static_cast<float>(frame) / A2F_FPS;
+			const float talking = FMath::Fmod(seconds, 2.5f) < 2.f ? 1.f : 0.f;
+			for (int curve = 0; curve < CURVE_COUNT; curve++)
+			{
+				m_curveWeights[frame * CURVE_COUNT + curve] = curve % 4 == 0 ?
+					talking * (0.5f + 0.4f * FMath::Sin(UE_TWO_PI * (1.5f + 0.25f * (curve % 5)) * seconds + curve)) :
+					0.02f * (curve % 7) + 0.001f * FMath::Sin(3.f * seconds + curve);
+			}
+		}
+	}
+
+	AFTER_EACH()
+	{
+		m_curveWeights.Empty();
+	}
+
+	/** Every decoded weight, also between frames, must stay within the tolerance of the raw interpolation. */
+	TEST_METHOD(Encode_SpeechLikeCurves_ExpectWithinTolerance)
+	{
+		const A2FCompactCurves compactCurves = A2FCompactCurves::Encode(m_curveWeights, A2F_FPS, TOLERANCE);
+		ASSERT_THAT(IsTrue(compactCurves.GetNumOfFrames() == m_numOfFrames));
+
+		float compactSample[CURVE_COUNT];
+		float rawSample[CURVE_COUNT];
+		float maxError = 0.f;
+		for (float frame = 0.f; frame <= m_numOfFrames - 1; frame += 0.25f)
+		{
+			ASSERT_THAT(IsTrue(compactCurves.Sample(frame, compactSample)));
+			const int floorFrame = FMath::FloorToInt(frame);
+			const int ceilingFrame = FMath::Min(floorFrame + 1, m_numOfFrames - 1);
+			ULipSyncDataA2F::LerpCurves(m_curveWeights.GetData() + floorFrame * CURVE_COUNT,
+				m_curveWeights.GetData() + ceilingFrame * CURVE_COUNT, frame - floorFrame, rawSample);
+			for (int i = 0; i < CURVE_COUNT; i++)
+			{
+				maxError = FMath::Max(maxError, FMath::Abs(compactSample[i] - rawSample[i]));
+			}
+		}
+
+		TestRunner->AddInfo(FString::Printf(TEXT("A2F compact curves: max error %.5f at tolerance %.5f"), maxError,
+			TOLERANCE));
+		ASSERT_THAT(IsTrue(maxError <= TOLERANCE + 1e-5f));
+	}
+
+	TEST_METHOD(Encode_SpeechLikeCurves_ExpectOrderOfMagnitudeSmaller)
+	{
+		const A2FCompactCurves compactCurves = A2FCompactCurves::Encode(m_curveWeights, A2F_FPS, TOLERANCE);
+
+		const int64 rawBytes = m_curveWeights.GetAllocatedSize();
+		const int64 compactBytes = compactCurves.GetAllocatedSize() + sizeof(A2FCompactCurves);
+		TestRunner->AddInfo(FString::Printf(TEXT("A2F compact curves: %d of %d curves animated, %d of %d keyframes, "
+			"%lld bytes instead of %lld (%.1fx)"), compactCurves.GetNumOfAnimatedCurves(), CURVE_COUNT,
+			compactCurves.GetNumOfKeyFrames(), m_numOfFrames, compactBytes, rawBytes,
+			static_cast<double>(rawBytes) / compactBytes));
+		ASSERT_THAT(IsTrue(compactBytes * 10 <= rawBytes));
+	}
+
+	/** The voiceline cache stores the serialized curves, loading must give the exact same samples. */
+	TEST_METHOD(Serialize_RoundTrip_ExpectSameSamples)
+	{
+		A2FCompactCurves compactCurves = A2FCompactCurves::Encode(m_curveWeights, A2F_FPS, TOLERANCE);
+		TArray<uint8> bytes;
+		FMemoryWriter writer(bytes);
+		writer << compactCurves;
+
+		A2FCompactCurves loadedCurves;
+		FMemoryReader reader(bytes);
+		reader << loadedCurves;
+		ASSERT_THAT(IsFalse(reader.IsError()));
+		ASSERT_THAT(IsTrue(loadedCurves.GetFramesPerSecond() == A2F_FPS));
+
+		TArray<float> decodedCurves;
+		TArray<float> decodedLoadedCurves;
+		compactCurves.Decode(decodedCurves);
+		loadedCurves.Decode(decodedLoadedCurves);
+		ASSERT_THAT(IsTrue(decodedCurves == decodedLoadedCurves));
+
+		// A truncated file fails instead of sampling out of bounds.
+		bytes.SetNum(bytes.Num() / 2);
+		A2FCompactCurves truncatedCurves;
+		FMemoryReader truncatedReader(bytes);
+		truncatedReader << truncatedCurves;
+		ASSERT_THAT(IsTrue(truncatedReader.IsError()));
+		ASSERT_THAT(IsTrue(truncatedCurves.GetNumOfFrames() == 0));
+	}
+};
@@ -0,0 +1,216 @@
+// Copyright(c) 2024 grrimgrriefer & DZnnah, see LICENSE for details.
+
+#pragma once
+#include "CQTest.h"
+#include "LipSyncDataA2F.h"
+#include "A2FCompactCurves.h"
+#include "HAL/PlatformTime.h"
+#include "HAL/IConsoleManager.h"
+
+/**
+ * A2FCurveBenchmarks
+ * Microbenchmark for sampling the A2F curves of many talking characters every game frame, comparing the flat storage
+ * & vectorized interpolation against the previous per-frame arrays with a scalar loop.
+ * Results are reported as info messages, the asserts only guard correctness.
+ * Compaction is turned off while these run, so the lipsync data keeps the flat curves. The compacted curves are
+ * benchmarked on their own copy, A2FCompactCurvesTests covers their correctness.
+ *
+ * NOTE: Unlike VoxtaClientTests, these do not require VoxtaServer to be running.
+ */
+TEST_CLASS(A2FCurveBenchmarks, "Voxta.Benchmarks")
+{
+	static constexpr int CURVE_COUNT = ULipSyncDataA2F::CURVE_COUNT;
+	static constexpr int NUM_OF_CHARACTERS = 50;
+	static constexpr int A2F_FPS = 30;
+	static constexpr int GAME_FPS = 60;
+	static constexpr int VOICELINE_SECONDS = 10;
+	static constexpr float COMPACT_TOLERANCE = 0.005f;
+
+	TArray<TArray<TArray<float>>> m_legacyCurves;
+	TArray<ULipSyncDataA2F*> m_lipSyncData;
+	IConsoleVariable* m_compactEnabled = nullptr;
+	bool m_wasCompactEnabled = false;
+
+	/** Every character gets its own deterministic voiceline, so the curves are spread over memory like in a game. */
+	BEFORE_EACH()
+	{
+		m_compactEnabled = IConsoleManager::Get().FindConsoleVariable(TEXT("voxta.A2F.Compact.Enabled"));
+		m_wasCompactEnabled = m_compactEnabled->GetBool();
+		m_compactEnabled->Set(false);
+
+		FRandomStream randomStream(1337);
+		const int numOfFrames = A2F_FPS * VOICELINE_SECONDS;
+		for (int character = 0; character < NUM_OF_CHARACTERS; character++)
+		{
+			TArray<TArray<float>>& legacyFrames = m_legacyCurves.AddDefaulted_GetRef();
+			TArray<float> flatFrames;
+			flatFrames.Reserve(numOfFrames * CURVE_COUNT);
+			for (int frame = 0; frame < numOfFrames; frame++)
+			{
+				TArray<float>& legacyFrame = legacyFrames.AddDefaulted_GetRef();
+				for (int curve = 0; curve < CURVE_COUNT; curve++)
+				{
+					const float weight = randomStream.FRand();
+					legacyFrame.Add(weight);
+					flatFrames.Add(weight);
+				}
+			}
+
+			ULipSyncDataA2F* data = NewObject<ULipSyncDataA2F>();
+			data->SetA2FCurveWeights(MoveTemp(flatFrames), A2F_FPS);
+			m_lipSyncData.Add(data);
+		}
+	}
+
+	AFTER_EACH()
+	{
+		for (ULipSyncDataA2F* data : m_lipSyncData)
+		{
+			data->RemoveFromRoot();
+		}
+		m_lipSyncData.Empty();
+		m_legacyCurves.Empty();
+		m_compactEnabled->Set(m_wasCompactEnabled);
+	}
+
+	/** Both paths must produce the same weights, up to the rounding of the reordered lerp. */
+	TEST_METHOD(SampleCurves_CompareWithLegacyLerp_ExpectNearlyEqual)
+	{
+		float sampledCurves[CURVE_COUNT];
+		bool allNear = true;
+		for (float frame = 0.f; frame < A2F_FPS * VOICELINE_SECONDS - 1; frame += 0.37f)
+		{
+			ASSERT_THAT(IsTrue(m_lipSyncData[0]->SampleCurves(frame, sampledCurves)));
+			const TArray<float>& floor = m_legacyCurves[0][FMath::FloorToInt(frame)];
+			const TArray<float>& ceiling = m_legacyCurves[0][FMath::CeilToInt(frame)];
+			const float blend = frame - FMath::FloorToInt(frame);
+			for (int i = 0; i < CURVE_COUNT; i++)
+			{
+				allNear &= FMath::IsNearlyEqual(sampledCurves[i], floor[i] * (1.f - blend) + ceiling[i] * blend, 1e-5f);
+			}
+		}
+		ASSERT_THAT(IsTrue(allNear));
+
+		// Past the end clamps on the last frame.
+		ASSERT_THAT(IsTrue(m_lipSyncData[0]->SampleCurves(1e6f, sampledCurves)));
+		ASSERT_THAT(IsTrue(FMemory::Memcmp(sampledCurves, m_legacyCurves[0].Last().GetData(), sizeof(sampledCurves)) == 0));
+	}
+
+	/** Every character samples its curves and hands them to its anim node once per game frame. */
+	TEST_METHOD(SampleCurves_FiftyTalkingCharacters_ReportThroughput)
+	{
+		const int numOfTicks = GAME_FPS * VOICELINE_SECONDS;
+		TArray<TArray<float>> currentCurves;
+		TArray<TArray<float>> animNodeCurves;
+		currentCurves.SetNum(NUM_OF_CHARACTERS);
+		animNodeCurves.SetNum(NUM_OF_CHARACTERS);
+
+		double startTime = FPlatformTime::Seconds();
+		for (int tick = 0; tick < numOfTicks; tick++)
+		{
+			// Characters don't start talking on the same frame.
+			for (int character = 0; character < NUM_OF_CHARACTERS; character++)
+			{
+				const TArray<TArray<float>>& frames = m_legacyCurves[character];
+				const float frame = FMath::Fmod(static_cast<float>(tick + character * 7) * A2F_FPS /
+					GAME_FPS, static_cast<float>(frames.Num() - 1));
+				const int floorFrame = FMath::FloorToInt(frame);
+				const int ceilingFrame = FMath::CeilToInt(frame);
+				if (floorFrame == ceilingFrame)
+				{
+					currentCurves[character] = frames[floorFrame];
+				}
+				else
+				{
+					const float blend = frame - floorFrame;
+					currentCurves[character].SetNum(CURVE_COUNT);
+					for (int i = 0; i < CURVE_COUNT; i++)
+					{
+						currentCurves[character][i] = frames[floorFrame][i] * (1.f - blend) + frames[ceilingFrame][i] * blend;
+					}
+				}
+				animNodeCurves[character] = currentCurves[character];
+			}
+		}
+		const double legacySeconds = FPlatformTime::Seconds() - startTime;
+
+		for (int character = 0; character < NUM_OF_CHARACTERS; character++)
+		{
+			currentCurves[character].SetNumZeroed(CURVE_COUNT);
+			animNodeCurves[character].SetNumZeroed(CURVE_COUNT);
+		}
+		startTime = FPlatformTime::Seconds();
+		for (int tick = 0; tick < numOfTicks; tick++)
+		{
+			for (int character = 0; character < NUM_OF_CHARACTERS; character++)
+			{
+				const ULipSyncDataA2F* data = m_lipSyncData[character];
+				const float frame = FMath::Fmod(static_cast<float>(tick + character * 7) * A2F_FPS /
+					GAME_FPS, static_cast<float>(data->GetNumOfFrames() - 1));
+				data->SampleCurves(frame, currentCurves[character].GetData());
+				FMemory::Memcpy(animNodeCurves[character].GetData(), currentCurves[character].GetData(),
+					CURVE_COUNT * sizeof(float));
+			}
+		}
+		const double flatSeconds = FPlatformTime::Seconds() - startTime;
+
+		const double totalSamples = static_cast<double>(numOfTicks) * NUM_OF_CHARACTERS;
+		TestRunner->AddInfo(FString::Printf(TEXT("A2F curves for %d characters: legacy %.1f ns/character/frame, "
+			"flat %.1f ns/character/frame"), NUM_OF_CHARACTERS, legacySeconds * 1e9 / totalSamples,
+			flatSeconds * 1e9 / totalSamples));
+		ASSERT_THAT(IsTrue(animNodeCurves[0].Num() == CURVE_COUNT));
+	}
+
+	/** Same as above, flat vs compacted. The curves are random, which is the worst case for the compaction. */
+	TEST_METHOD(SampleCurves_FiftyTalkingCharacters_CompactReportThroughput)
+	{
+		TArray<A2FCompactCurves> compactCurves;
+		for (int character = 0; character < NUM_OF_CHARACTERS; character++)
+		{
+			TArray<float> flatFrames;
+			for (const TArray<float>& legacyFrame : m_legacyCurves[character])
+			{
+				flatFrames.Append(legacyFrame);
+			}
+			compactCurves.Add(A2FCompactCurves::Encode(flatFrames, A2F_FPS, COMPACT_TOLERANCE));
+		}
+
+		const int numOfTicks = GAME_FPS * VOICELINE_SECONDS;
+		float curves[CURVE_COUNT];
+		float checksum = 0.f;
+
+		double startTime = FPlatformTime::Seconds();
+		for (int tick = 0; tick < numOfTicks; tick++)
+		{
+			for (int character = 0; character < NUM_OF_CHARACTERS; character++)
+			{
+				const ULipSyncDataA2F* data = m_lipSyncData[character];
+				const float frame = FMath::Fmod(static_cast<float>(tick + character * 7) * A2F_FPS /
+					GAME_FPS, static_cast<float>(data->GetNumOfFrames() - 1));
+				data->SampleCurves(frame, curves);
+				checksum += curves[0];
+			}
+		}
+		const double flatSeconds = FPlatformTime::Seconds() - startTime;
+
+		startTime = FPlatformTime::Seconds();
+		for (int tick = 0; tick < numOfTicks; tick++)
+		{
+			for (int character = 0; character < NUM_OF_CHARACTERS; character++)
+			{
+				const A2FCompactCurves& characterCurves = compactCurves[character];
+				const float frame = FMath::Fmod(static_cast<float>(tick + character * 7) * A2F_FPS /
+					GAME_FPS, static_cast<float>(characterCurves.GetNumOfFrames() - 1));
+				characterCurves.Sample(frame, curves);
+				checksum -= curves[0];
+			}
+		}
+		const double compactSeconds = FPlatformTime::Seconds() - startTime;
+
+		const double totalSamples = static_cast<double>(numOfTicks) * NUM_OF_CHARACTERS;
+		TestRunner->AddInfo(FString::Printf(TEXT("A2F curves for %d characters: flat %.1f ns/character/frame, "
+			"compact %.1f ns/character/frame"), NUM_OF_CHARACTERS, flatSeconds * 1e9 / totalSamples,
+			compactSeconds * 1e9 / totalSamples));
+		ASSERT_THAT(IsTrue(FMath::Abs(checksum) <= totalSamples * COMPACT_TOLERANCE));
+	}
+};
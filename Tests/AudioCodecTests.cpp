@@ -0,0 +1,195 @@
+// Copyright(c) 2024 grrimgrriefer & DZnnah, see LICENSE for details.
+
+#pragma once
+#include "CQTest.h"
+#include "RuntimeAudioImporter/RuntimeAudioImporterLibrary.h"
+#include "RuntimeAudioImporter/LazyPCMSource.h"
+#include "WavChunkWalker.h"
+
+/**
+ * AudioCodecTests
+ * Checks the format negotiation helpers of the RuntimeAudioImporterLibrary.
+ *
+ * NOTE: Unlike VoxtaClientTests, these do not require VoxtaServer to be running.
+ */
+TEST_CLASS(AudioCodecTests, "Voxta.AudioCodecs")
+{
+	/** The most compact format has to be advertised first, WAV stays accepted as the fallback. */
+	TEST_METHOD(GetSupportedContentTypes_ExpectOpusFirstAndWavIncluded)
+	{
+		const TArray<FString> contentTypes = URuntimeAudioImporterLibrary::GetSupportedContentTypes();
+
+		ASSERT_THAT(IsTrue(contentTypes.Num() > 0));
+		ASSERT_THAT(AreEqual(contentTypes[0], FString(TEXT("audio/ogg; codecs=opus"))));
+		ASSERT_THAT(IsTrue(contentTypes.Contains(TEXT("audio/x-wav"))));
+	}
+
+	TEST_METHOD(GetAudioFormatFromContentType_KnownTypes_ExpectMatchingFormat)
+	{
+		ASSERT_THAT(IsTrue(URuntimeAudioImporterLibrary::GetAudioFormatFromContentType(
+			TEXT("audio/ogg; codecs=opus")) == ERuntimeAudioFormat::OggOpus));
+		ASSERT_THAT(IsTrue(URuntimeAudioImporterLibrary::GetAudioFormatFromContentType(
+			TEXT("Audio/Ogg;Codecs=\"opus\"")) == ERuntimeAudioFormat::OggOpus));
+		ASSERT_THAT(IsTrue(URuntimeAudioImporterLibrary::GetAudioFormatFromContentType(
+			TEXT("audio/opus")) == ERuntimeAudioFormat::OggOpus));
+		ASSERT_THAT(IsTrue(URuntimeAudioImporterLibrary::GetAudioFormatFromContentType(
+			TEXT("audio/ogg; codecs=vorbis")) == ERuntimeAudioFormat::OggVorbis));
+		ASSERT_THAT(IsTrue(URuntimeAudioImporterLibrary::GetAudioFormatFromContentType(
+			TEXT("audio/x-wav")) == ERuntimeAudioFormat::Wav));
+	}
+
+	/** Plain ogg can hold either codec and unknown types are sniffed from the data, so both fall back to Auto. */
+	TEST_METHOD(GetAudioFormatFromContentType_AmbiguousOrUnknown_ExpectAuto)
+	{
+		ASSERT_THAT(IsTrue(URuntimeAudioImporterLibrary::GetAudioFormatFromContentType(
+			TEXT("audio/ogg")) == ERuntimeAudioFormat::Auto));
+		ASSERT_THAT(IsTrue(URuntimeAudioImporterLibrary::GetAudioFormatFromContentType(
+			TEXT("application/octet-stream")) == ERuntimeAudioFormat::Auto));
+		ASSERT_THAT(IsTrue(URuntimeAudioImporterLibrary::GetAudioFormatFromContentType(
+			FString()) == ERuntimeAudioFormat::Auto));
+	}
+
+	/** The lipsync generators parse the re-encoded WAV with the WavChunkWalker, so it has to round-trip. */
+	TEST_METHOD(EncodeWavPCM16_FloatInput_ExpectParsable16BitWav)
+	{
+		constexpr int sampleRate = 48000;
+		constexpr int numOfFrames = 4800;
+		TArray<float> samples;
+		samples.SetNumUninitialized(numOfFrames);
+		for (int i = 0; i < numOfFrames; i++)
+		{
+			samples[i] = FMath::Sin(i * 0.05f) * 0.5f;
+		}
+
+		FDecodedAudioStruct decodedAudio;
+		decodedAudio.PCMInfo.PCMData = FRuntimeBulkDataBuffer<float>(samples);
+		decodedAudio.PCMInfo.PCMNumOfFrames = numOfFrames;
+		decodedAudio.SoundWaveBasicInfo.NumOfChannels = 1;
+		decodedAudio.SoundWaveBasicInfo.SampleRate = sampleRate;
+		decodedAudio.SoundWaveBasicInfo.AudioFormat = ERuntimeAudioFormat::OggOpus;
+
+		TArray<uint8> wavData;
+		ASSERT_THAT(IsTrue(URuntimeAudioImporterLibrary::EncodeWavPCM16(decodedAudio, wavData)));
+
+		FWavLayout layout;
+		ASSERT_THAT(IsTrue(WavChunkWalker::TryParse(wavData.GetData(), wavData.Num(), layout)));
+		ASSERT_THAT(AreEqual(static_cast<int>(layout.BitsPerSample), 16));
+		ASSERT_THAT(AreEqual(static_cast<int>(layout.NumChannels), 1));
+		ASSERT_THAT(AreEqual(static_cast<int>(layout.SampleRate), sampleRate));
+		ASSERT_THAT(AreEqual(static_cast<int>(layout.DataSize), numOfFrames * 2));
+	}
+
+	/** Voicelines are decoded with the format of their content type, which has to pick the codec that can read them. */
+	TEST_METHOD(DecodeAudioData_WavContentType_ExpectDecodedSamples)
+	{
+		constexpr int sampleRate = 24000;
+		constexpr int numOfFrames = 2400;
+		TArray<float> samples;
+		samples.SetNumUninitialized(numOfFrames);
+		for (int i = 0; i < numOfFrames; i++)
+		{
+			samples[i] = FMath::Sin(i * 0.05f) * 0.5f;
+		}
+
+		FDecodedAudioStruct decodedAudio;
+		decodedAudio.PCMInfo.PCMData = FRuntimeBulkDataBuffer<float>(samples);
+		decodedAudio.PCMInfo.PCMNumOfFrames = numOfFrames;
+		decodedAudio.SoundWaveBasicInfo.NumOfChannels = 1;
+		decodedAudio.SoundWaveBasicInfo.SampleRate = sampleRate;
+
+		TArray<uint8> wavData;
+		ASSERT_THAT(IsTrue(URuntimeAudioImporterLibrary::EncodeWavPCM16(decodedAudio, wavData)));
+
+		FEncodedAudioStruct encodedAudio(wavData, URuntimeAudioImporterLibrary::GetAudioFormatFromContentType(TEXT("audio/x-wav")));
+		FDecodedAudioStruct roundTrippedAudio;
+		ASSERT_THAT(IsTrue(URuntimeAudioImporterLibrary::DecodeAudioData(MoveTemp(encodedAudio), roundTrippedAudio)));
+		ASSERT_THAT(IsTrue(roundTrippedAudio.SoundWaveBasicInfo.AudioFormat == ERuntimeAudioFormat::Wav));
+		ASSERT_THAT(AreEqual(static_cast<int>(roundTrippedAudio.SoundWaveBasicInfo.SampleRate), sampleRate));
+		ASSERT_THAT(AreEqual(static_cast<int>(roundTrippedAudio.PCMInfo.PCMNumOfFrames), numOfFrames));
+	}
+
+	/** Shared bytes are read by the lipsync generators while decoding, so placeholder sizes are fixed in a copy. */
+	TEST_METHOD(DecodeAudioData_SharedWavWithPlaceholders_ExpectSharedBytesUntouched)
+	{
+		constexpr int sampleRate = 24000;
+		constexpr int numOfFrames = 2400;
+		TArray<float> samples;
+		samples.SetNumZeroed(numOfFrames);
+
+		FDecodedAudioStruct decodedAudio;
+		decodedAudio.PCMInfo.PCMData = FRuntimeBulkDataBuffer<float>(samples);
+		decodedAudio.PCMInfo.PCMNumOfFrames = numOfFrames;
+		decodedAudio.SoundWaveBasicInfo.NumOfChannels = 1;
+		decodedAudio.SoundWaveBasicInfo.SampleRate = sampleRate;
+
+		TArray<uint8> wavData;
+		ASSERT_THAT(IsTrue(URuntimeAudioImporterLibrary::EncodeWavPCM16(decodedAudio, wavData)));
+		FWavLayout waveLayout;
+		ASSERT_THAT(IsTrue(WavChunkWalker::TryParse(wavData.GetData(), wavData.Num(), waveLayout)));
+
+		// What streaming TTS backends write, before the final sizes are known
+		FMemory::Memset(wavData.GetData() + 4, 0xFF, 4);
+		FMemory::Memset(wavData.GetData() + waveLayout.DataOffset - 4, 0xFF, 4);
+		const FSharedAudioBytes sharedWav = MakeShared<const TArray<uint8>, ESPMode::ThreadSafe>(MoveTemp(wavData));
+		ASSERT_THAT(IsTrue(WavChunkWalker::HasStreamingPlaceholders(sharedWav->GetData(), sharedWav->Num())));
+
+		FEncodedAudioStruct encodedAudio(sharedWav, ERuntimeAudioFormat::Wav);
+		FDecodedAudioStruct roundTrippedAudio;
+		ASSERT_THAT(IsTrue(URuntimeAudioImporterLibrary::DecodeAudioData(MoveTemp(encodedAudio), roundTrippedAudio)));
+		ASSERT_THAT(AreEqual(static_cast<int>(roundTrippedAudio.PCMInfo.PCMNumOfFrames), numOfFrames));
+		ASSERT_THAT(IsTrue(WavChunkWalker::HasStreamingPlaceholders(sharedWav->GetData(), sharedWav->Num())));
+	}
+
+	/** The render thread only gets blocks that were decoded ahead, those have to match the eagerly decoded samples. */
+	TEST_METHOD(LazyPCMSource_WavBlocks_ExpectPrimedWindowMatchesAndMissBeyondIt)
+	{
+		constexpr int sampleRate = 48000;
+		constexpr int numOfFrames = FLazyPCMSource::BlockFrames * FLazyPCMSource::NumOfCacheSlots * 2 + 123;
+		TArray<float> samples;
+		samples.SetNumUninitialized(numOfFrames);
+		for (int i = 0; i < numOfFrames; i++)
+		{
+			samples[i] = FMath::Sin(i * 0.01f) * 0.5f;
+		}
+
+		FDecodedAudioStruct decodedAudio;
+		decodedAudio.PCMInfo.PCMData = FRuntimeBulkDataBuffer<float>(samples);
+		decodedAudio.PCMInfo.PCMNumOfFrames = numOfFrames;
+		decodedAudio.SoundWaveBasicInfo.NumOfChannels = 1;
+		decodedAudio.SoundWaveBasicInfo.SampleRate = sampleRate;
+
+		TArray<uint8> wavData;
+		ASSERT_THAT(IsTrue(URuntimeAudioImporterLibrary::EncodeWavPCM16(decodedAudio, wavData)));
+		const FSharedAudioBytes sharedWav = MakeShared<const TArray<uint8>, ESPMode::ThreadSafe>(MoveTemp(wavData));
+
+		// The source comes back primed, WAV keeps its native sample rate
+		FEncodedAudioStruct encodedAudio(sharedWav, ERuntimeAudioFormat::Auto);
+		TSharedPtr<FLazyPCMSource, ESPMode::ThreadSafe> lazySource = URuntimeAudioImporterLibrary::CreateLazyPCMSource(encodedAudio);
+		ASSERT_THAT(IsTrue(lazySource.IsValid()));
+		ASSERT_THAT(IsTrue(encodedAudio.AudioFormat == ERuntimeAudioFormat::Wav));
+		ASSERT_THAT(AreEqual(lazySource->GetNumOfFrames(), static_cast<int64>(numOfFrames)));
+		ASSERT_THAT(AreEqual(lazySource->GetSampleRate(), static_cast<uint32>(sampleRate)));
+
+		// Reading across a block boundary within the primed window
+		constexpr int firstFrame = FLazyPCMSource::BlockFrames - 100;
+		constexpr int numOfReadFrames = 1024;
+		TArray<float> readSamples;
+		readSamples.SetNumZeroed(numOfReadFrames);
+		ASSERT_THAT(AreEqual(lazySource->ReadFrames(firstFrame, numOfReadFrames, readSamples.GetData()), numOfReadFrames));
+		for (int i = 0; i < numOfReadFrames; i++)
+		{
+			// 16-bit quantization
+			ASSERT_THAT(IsNear(readSamples[i], samples[firstFrame + i], 1.0f / 16384.0f));
+		}
+
+		// Past the read-ahead window nothing is decoded yet, so the read stops instead of waiting
+		const int64 missedFrame = static_cast<int64>(FLazyPCMSource::BlockFrames) * FLazyPCMSource::NumOfCacheSlots;
+		ASSERT_THAT(AreEqual(lazySource->ReadFrames(missedFrame, numOfReadFrames, readSamples.GetData()), 0));
+
+		// The full decode is unaffected by the block cache
+		TArray<float> allSamples;
+		ASSERT_THAT(IsTrue(lazySource->DecodeAll(allSamples)));
+		ASSERT_THAT(AreEqual(allSamples.Num(), numOfFrames));
+		ASSERT_THAT(IsNear(allSamples.Last(), samples.Last(), 1.0f / 16384.0f));
+	}
+};
@@ -0,0 +1,333 @@
+// Copyright(c) 2024 grrimgrriefer & DZnnah, see LICENSE for details.
+
+#pragma once
+#include "CQTest.h"
+#include "RuntimeAudioImporter/RAW_TranscodeKernels.h"
+#include "RuntimeAudioImporter/RAW_StreamingResampler.h"
+#include "AudioResampler.h"
+#include "RuntimeAudioImporter/AudioStructs.h"
+#include "HAL/PlatformTime.h"
+
+#define BENCHMARK_SAMPLE_RATE 24000
+#define BENCHMARK_RENDER_BLOCK 1024
+#define BENCHMARK_ITERATIONS 50
+#define BENCHMARK_TRANSCODE_SECONDS 10
+#define BENCHMARK_RESAMPLE_SECONDS 5
+
+/**
+ * AudioKernelsBenchmarks
+ * Microbenchmarks for the sample conversion kernels used on the audio hot paths.
+ * Results are reported as info messages, the asserts only guard correctness.
+ *
+ * NOTE: Unlike VoxtaClientTests, these do not require VoxtaServer to be running.
+ */
+TEST_CLASS(AudioKernelsBenchmarks, "Voxta.Benchmarks")
+{
+	TArray<int16> m_int16Samples;
+
+	/** Fill a buffer with a few seconds of deterministic pseudo-speech (sine sweep + noise). */
+	BEFORE_EACH()
+	{
+		FRandomStream randomStream(1337);
+		m_int16Samples.SetNumUninitialized(BENCHMARK_SAMPLE_RATE * 8);
+		for (int i = 0; i < m_int16Samples.Num(); i++)
+		{
+			const float sweep = FMath::Sin(i * (0.01f + i * 0.0000001f)) * 0.6f;
+			const float noise = randomStream.FRandRange(-0.2f, 0.2f);
+			m_int16Samples[i] = static_cast<int16>(FMath::Clamp(sweep + noise, -1.f, 1.f) * 32767.f);
+		}
+	}
+
+	/** The SIMD kernel must produce exactly the same floats as the scalar reference used by dr_wav. */
+	TEST_METHOD(ConvertInt16ToFloat_CompareWithScalar_ExpectBitIdentical)
+	{
+		TArray<float> simdOutput;
+		simdOutput.SetNumUninitialized(m_int16Samples.Num());
+		// Odd offset & length to exercise the unaligned and tail paths.
+		FRAW_TranscodeKernels::ConvertInt16ToFloat(m_int16Samples.GetData() + 3, simdOutput.GetData(), m_int16Samples.Num() - 7);
+
+		bool allEqual = true;
+		for (int i = 0; i < m_int16Samples.Num() - 7; i++)
+		{
+			allEqual &= simdOutput[i] == static_cast<float>(m_int16Samples[i + 3]) * FRAW_TranscodeKernels::Int16ToFloatScale;
+		}
+		ASSERT_THAT(IsTrue(allEqual));
+	}
+
+	/** Converts the buffer in render-block sized pieces, like OnGeneratePCMAudio does. */
+	TEST_METHOD(ConvertInt16ToFloat_PerRenderBlock_ReportThroughput)
+	{
+		TArray<float> renderBlock;
+		renderBlock.SetNumUninitialized(BENCHMARK_RENDER_BLOCK);
+
+		double scalarSeconds = 0;
+		double kernelSeconds = 0;
+		for (int iteration = 0; iteration < BENCHMARK_ITERATIONS; iteration++)
+		{
+			double startTime = FPlatformTime::Seconds();
+			for (int offset = 0; offset + BENCHMARK_RENDER_BLOCK <= m_int16Samples.Num(); offset += BENCHMARK_RENDER_BLOCK)
+			{
+				for (int i = 0; i < BENCHMARK_RENDER_BLOCK; i++)
+				{
+					renderBlock[i] = static_cast<float>(m_int16Samples[offset + i]) * FRAW_TranscodeKernels::Int16ToFloatScale;
+				}
+			}
+			scalarSeconds += FPlatformTime::Seconds() - startTime;
+
+			startTime = FPlatformTime::Seconds();
+			for (int offset = 0; offset + BENCHMARK_RENDER_BLOCK <= m_int16Samples.Num(); offset += BENCHMARK_RENDER_BLOCK)
+			{
+				FRAW_TranscodeKernels::ConvertInt16ToFloat(m_int16Samples.GetData() + offset,
+					renderBlock.GetData(), BENCHMARK_RENDER_BLOCK);
+			}
+			kernelSeconds += FPlatformTime::Seconds() - startTime;
+		}
+
+		const double totalSamples = static_cast<double>(m_int16Samples.Num()) * BENCHMARK_ITERATIONS;
+		TestRunner->AddInfo(FString::Printf(TEXT("int16->float per %d-sample block: scalar %.3f ns/sample, kernel %.3f ns/sample"),
+			BENCHMARK_RENDER_BLOCK, scalarSeconds * 1e9 / totalSamples, kernelSeconds * 1e9 / totalSamples));
+		ASSERT_THAT(IsTrue(renderBlock.Num() == BENCHMARK_RENDER_BLOCK));
+	}
+
+	/**
+	 * Transcodes a multi-second 48kHz stereo buffer with the specialized kernel and with the legacy per-sample
+	 * FMath::GetMappedRangeValueClamped mapping, asserting both produce identical samples.
+	 */
+	template <typename FromType, typename ToType>
+	bool BenchmarkTranscode(const TCHAR* pairName)
+	{
+		const int64 sampleCount = 48000 * 2 * BENCHMARK_TRANSCODE_SECONDS;
+		TArray64<FromType> input;
+		input.SetNumUninitialized(sampleCount);
+		for (int64 i = 0; i < sampleCount; i++)
+		{
+			// Slightly out-of-range for floats on purpose, to cover clamping.
+			const float value = FMath::Clamp(FMath::Sin(i * 0.0123f) * 1.05f, -1.05f, 1.05f);
+			input[i] = TRAWTranscoder<float, FromType>::TranscodeSample(value);
+		}
+
+		TArray64<ToType> legacyOutput;
+		legacyOutput.SetNumUninitialized(sampleCount);
+		const FVector2D fromRange(TRAWSampleRange<FromType>::Min, TRAWSampleRange<FromType>::Max);
+		const FVector2D toRange(TRAWSampleRange<ToType>::Min, TRAWSampleRange<ToType>::Max);
+		double startTime = FPlatformTime::Seconds();
+		for (int64 i = 0; i < sampleCount; i++)
+		{
+			legacyOutput[i] = static_cast<ToType>(FMath::GetMappedRangeValueClamped(fromRange, toRange, input[i]));
+		}
+		const double legacySeconds = FPlatformTime::Seconds() - startTime;
+
+		TArray64<ToType> kernelOutput;
+		kernelOutput.SetNumUninitialized(sampleCount);
+		startTime = FPlatformTime::Seconds();
+		TRAWTranscoder<FromType, ToType>::Transcode(input.GetData(), sampleCount, kernelOutput.GetData());
+		const double kernelSeconds = FPlatformTime::Seconds() - startTime;
+
+		TestRunner->AddInfo(FString::Printf(TEXT("%s over %ds of 48kHz stereo: legacy %.2f ms, kernel %.2f ms (%.1fx)"),
+			pairName, BENCHMARK_TRANSCODE_SECONDS, legacySeconds * 1000.0, kernelSeconds * 1000.0,
+			legacySeconds / FMath::Max(kernelSeconds, 1e-9)));
+		return FMemory::Memcmp(legacyOutput.GetData(), kernelOutput.GetData(), sampleCount * sizeof(ToType)) == 0;
+	}
+
+	TEST_METHOD(TranscodeRAWData_Int16ToFloat_ExpectLegacyIdentical)
+	{
+		ASSERT_THAT(IsTrue(BenchmarkTranscode<int16, float>(TEXT("int16->float"))));
+	}
+
+	TEST_METHOD(TranscodeRAWData_FloatToInt16_ExpectLegacyIdentical)
+	{
+		ASSERT_THAT(IsTrue(BenchmarkTranscode<float, int16>(TEXT("float->int16"))));
+	}
+
+	TEST_METHOD(TranscodeRAWData_UInt8ToFloat_ExpectLegacyIdentical)
+	{
+		ASSERT_THAT(IsTrue(BenchmarkTranscode<uint8, float>(TEXT("uint8->float"))));
+	}
+
+	TEST_METHOD(TranscodeRAWData_Int32ToFloat_ExpectLegacyIdentical)
+	{
+		ASSERT_THAT(IsTrue(BenchmarkTranscode<int32, float>(TEXT("int32->float"))));
+	}
+
+	TEST_METHOD(TranscodeRAWData_FloatToInt32_ExpectLegacyIdentical)
+	{
+		ASSERT_THAT(IsTrue(BenchmarkTranscode<float, int32>(TEXT("float->int32"))));
+	}
+
+	TEST_METHOD(TranscodeRAWData_Int16ToUInt8_ExpectLegacyIdentical)
+	{
+		ASSERT_THAT(IsTrue(BenchmarkTranscode<int16, uint8>(TEXT("int16->uint8"))));
+	}
+
+	/** Corrupt float sources must be clamped the same way by the SIMD kernels as by the scalar path. */
+	template <typename ToType>
+	static bool TranscodeNonFinite_MatchesScalar()
+	{
+		const float nan = std::numeric_limits<float>::quiet_NaN();
+		const float infinity = std::numeric_limits<float>::infinity();
+		const float input[] = { nan, infinity, -infinity, -nan, 0.f, -0.f, 1.f, -1.f, 2.f, -2.f, 0.5f, nan };
+		constexpr int numOfSamples = UE_ARRAY_COUNT(input);
+
+		ToType kernelOutput[numOfSamples];
+		TRAWTranscoder<float, ToType>::Transcode(input, numOfSamples, kernelOutput);
+		for (int i = 0; i < numOfSamples; i++)
+		{
+			if (kernelOutput[i] != TRAWTranscoder<float, ToType>::TranscodeSample(input[i]))
+			{
+				return false;
+			}
+		}
+		return true;
+	}
+
+	TEST_METHOD(TranscodeRAWData_NonFiniteFloat_ExpectScalarIdentical)
+	{
+		ASSERT_THAT(IsTrue(TranscodeNonFinite_MatchesScalar<int16>()));
+		ASSERT_THAT(IsTrue(TranscodeNonFinite_MatchesScalar<int32>()));
+		ASSERT_THAT(IsTrue(TranscodeNonFinite_MatchesScalar<uint8>()));
+	}
+
+	TEST_METHOD(TranscodeRAWData_Int8ToFloat_ExpectLegacyIdentical)
+	{
+		ASSERT_THAT(IsTrue(BenchmarkTranscode<int8, float>(TEXT("int8->float"))));
+	}
+
+	TEST_METHOD(TranscodeRAWData_UInt16ToInt16_ExpectLegacyIdentical)
+	{
+		ASSERT_THAT(IsTrue(BenchmarkTranscode<uint16, int16>(TEXT("uint16->int16"))));
+	}
+
+	/** Resident PCM memory of a typical message (6 chunks of ~5 seconds of 24kHz mono TTS audio). */
+	TEST_METHOD(PCMStorage_TypicalMessageChunkSet_ReportMemory)
+	{
+		const int chunkCount = 6;
+		const int framesPerChunk = BENCHMARK_SAMPLE_RATE * 5;
+
+		TArray<float> floatSamples;
+		floatSamples.SetNumUninitialized(framesPerChunk);
+		FRAW_TranscodeKernels::ConvertInt16ToFloat(m_int16Samples.GetData(), floatSamples.GetData(), framesPerChunk);
+
+		int64 floatBytes = 0;
+		int64 int16Bytes = 0;
+		for (int chunk = 0; chunk < chunkCount; chunk++)
+		{
+			FPCMStruct floatStorage;
+			floatStorage.PCMData = FRuntimeBulkDataBuffer<float>(floatSamples);
+			floatStorage.PCMNumOfFrames = framesPerChunk;
+
+			FPCMStruct int16Storage;
+			int16Storage.PCMDataInt16 = FRuntimeBulkDataBuffer<int16>(TArray<int16>(m_int16Samples.GetData(), framesPerChunk));
+			int16Storage.PCMNumOfFrames = framesPerChunk;
+
+			floatBytes += floatStorage.GetAllocatedSize();
+			int16Bytes += int16Storage.GetAllocatedSize();
+		}
+
+		TestRunner->AddInfo(FString::Printf(TEXT("PCM memory for %d chunks: float %.2f MiB, int16 %.2f MiB"),
+			chunkCount, floatBytes / (1024.0 * 1024.0), int16Bytes / (1024.0 * 1024.0)));
+		ASSERT_THAT(AreEqual(floatBytes, int16Bytes * 2));
+	}
+
+	/** Resamples a 1kHz tone and measures the signal-to-noise ratio against the ideal tone at the destination rate. */
+	static double MeasureToneSNR(const Audio::FAlignedFloatBuffer& output, uint32 destinationRate)
+	{
+		double signalEnergy = 0;
+		double noiseEnergy = 0;
+		// The edges are skipped, both resamplers treat the signal as starting and ending in silence.
+		for (int i = output.Num() / 4; i < output.Num() * 3 / 4; i++)
+		{
+			const double ideal = FMath::Sin(2.0 * UE_DOUBLE_PI * 1000.0 * i / destinationRate) * 0.5;
+			signalEnergy += ideal * ideal;
+			noiseEnergy += (output[i] - ideal) * (output[i] - ideal);
+		}
+		return 10.0 * FMath::LogX(10.0, signalEnergy / FMath::Max(noiseEnergy, 1e-30));
+	}
+
+	/** Feeding the stream in irregular blocks must give the same samples as resampling it in one go. */
+	TEST_METHOD(StreamingResampler_IrregularBlocks_ExpectIdenticalToSingleBlock)
+	{
+		TArray<float> input;
+		input.SetNumUninitialized(m_int16Samples.Num());
+		FRAW_TranscodeKernels::ConvertInt16ToFloat(m_int16Samples.GetData(), input.GetData(), input.Num());
+
+		// Interpreted as stereo, to cover the channel interleaving.
+		const int64 numOfFrames = input.Num() / 2;
+		FRAW_StreamingResampler singleBlock(ERAW_ResamplerQuality::Balanced, 2, 22050, 48000);
+		TArray<float> expected;
+		expected.SetNumUninitialized((singleBlock.GetMaxNumOfOutputFrames(numOfFrames) + singleBlock.GetMaxNumOfFlushFrames()) * 2);
+		int64 expectedFrames = singleBlock.Process(input.GetData(), numOfFrames, expected.GetData());
+		expectedFrames += singleBlock.Flush(expected.GetData() + expectedFrames * 2);
+
+		FRAW_StreamingResampler blockwise(ERAW_ResamplerQuality::Balanced, 2, 22050, 48000);
+		TArray<float> actual;
+		actual.SetNumZeroed(expected.Num());
+		FRandomStream randomStream(42);
+		int64 actualFrames = 0;
+		for (int64 offset = 0; offset < numOfFrames;)
+		{
+			const int64 blockFrames = FMath::Min<int64>(randomStream.RandRange(1, 5000), numOfFrames - offset);
+			actualFrames += blockwise.Process(input.GetData() + offset * 2, blockFrames, actual.GetData() + actualFrames * 2);
+			offset += blockFrames;
+		}
+		actualFrames += blockwise.Flush(actual.GetData() + actualFrames * 2);
+
+		ASSERT_THAT(AreEqual(actualFrames, expectedFrames));
+		ASSERT_THAT(AreEqual(expectedFrames, singleBlock.GetNumOfOutputFrames(numOfFrames)));
+		ASSERT_THAT(IsTrue(FMemory::Memcmp(actual.GetData(), expected.GetData(), expectedFrames * 2 * sizeof(float)) == 0));
+	}
+
+	/** Compares cost & quality of every tier against the engine's BestSinc resampler, which was used before. */
+	TEST_METHOD(StreamingResampler_QualityTiers_ReportCostAndSNR)
+	{
+		constexpr uint32 sourceRate = BENCHMARK_SAMPLE_RATE;
+		constexpr uint32 destinationRate = 48000;
+		Audio::FAlignedFloatBuffer tone;
+		tone.SetNumUninitialized(sourceRate * BENCHMARK_RESAMPLE_SECONDS);
+		for (int i = 0; i < tone.Num(); i++)
+		{
+			tone[i] = FMath::Sin(2.0 * UE_DOUBLE_PI * 1000.0 * i / sourceRate) * 0.5;
+		}
+
+		{
+			const Audio::FResamplingParameters parameters = { Audio::EResamplingMethod::BestSinc, 1,
+				static_cast<float>(sourceRate), static_cast<float>(destinationRate), tone };
+			Audio::FAlignedFloatBuffer output;
+			output.AddUninitialized(Audio::GetOutputBufferSize(parameters));
+			Audio::FResamplerResults results;
+			results.OutBuffer = &output;
+
+			const double startTime = FPlatformTime::Seconds();
+			Audio::Resample(parameters, results);
+			const double seconds = FPlatformTime::Seconds() - startTime;
+			output.SetNum(results.OutputFramesGenerated);
+			TestRunner->AddInfo(FString::Printf(TEXT("Audio::Resample BestSinc %d->%d over %ds: %.2f ms, SNR %.1f dB"),
+				sourceRate, destinationRate, BENCHMARK_RESAMPLE_SECONDS, seconds * 1000.0, MeasureToneSNR(output, destinationRate)));
+		}
+
+		const TCHAR* tierNames[] = { TEXT("Fast"), TEXT("Balanced"), TEXT("Best") };
+		const double minimumSNR[] = { 40.0, 60.0, 90.0 };
+		for (int tier = 0; tier < 3; tier++)
+		{
+			FRAW_StreamingResampler resampler(static_cast<ERAW_ResamplerQuality>(tier), 1, sourceRate, destinationRate);
+			Audio::FAlignedFloatBuffer output;
+			output.SetNumUninitialized(resampler.GetMaxNumOfOutputFrames(tone.Num()) + resampler.GetMaxNumOfFlushFrames());
+
+			// Fed per render block, like a streamed voiceline would be.
+			const double startTime = FPlatformTime::Seconds();
+			int64 outputFrames = 0;
+			for (int offset = 0; offset < tone.Num(); offset += BENCHMARK_RENDER_BLOCK)
+			{
+				const int blockFrames = FMath::Min(BENCHMARK_RENDER_BLOCK, tone.Num() - offset);
+				outputFrames += resampler.Process(tone.GetData() + offset, blockFrames, output.GetData() + outputFrames);
+			}
+			outputFrames += resampler.Flush(output.GetData() + outputFrames);
+			const double seconds = FPlatformTime::Seconds() - startTime;
+			output.SetNum(outputFrames);
+
+			const double snr = MeasureToneSNR(output, destinationRate);
+			TestRunner->AddInfo(FString::Printf(TEXT("StreamingResampler %s %d->%d over %ds: %.2f ms, SNR %.1f dB"),
+				tierNames[tier], sourceRate, destinationRate, BENCHMARK_RESAMPLE_SECONDS, seconds * 1000.0, snr));
+			ASSERT_THAT(IsTrue(snr > minimumSNR[tier]));
+		}
+	}
+};
@@ -0,0 +1,63 @@
+// Copyright(c) 2024 grrimgrriefer & DZnnah, see LICENSE for details.
+
+#pragma once
+#include "CQTest.h"
+#include "VoxtaDownloadRetryPolicy.h"
+
+/**
+ * DownloadTests
+ * Tests for the retry & hedging decisions of the voiceline downloads.
+ *
+ * NOTE: Unlike VoxtaClientTests, these do not require VoxtaServer to be running. The full retry path can be exercised
+ * against any local http server with voxta.Http.Debug.InjectedDelayMs and voxta.Http.Debug.InjectedFailurePercent.
+ */
+TEST_CLASS(DownloadTests, "Voxta.Downloads")
+{
+	VoxtaDownloadLatencyTracker m_tracker;
+
+	BEFORE_EACH()
+	{
+		m_tracker.Reset();
+	}
+
+	/** Hedging must stay disabled until there are enough samples to trust the percentile. */
+	TEST_METHOD(TryGetPercentile_TooFewSamples_ExpectFalse)
+	{
+		double seconds = 0.0;
+		ASSERT_THAT(IsFalse(m_tracker.TryGetPercentile(95.f, 1, seconds)));
+
+		m_tracker.AddSample(0.1);
+		m_tracker.AddSample(0.2);
+		ASSERT_THAT(IsFalse(m_tracker.TryGetPercentile(95.f, 3, seconds)));
+		ASSERT_THAT(IsTrue(m_tracker.TryGetPercentile(95.f, 2, seconds)));
+	}
+
+	TEST_METHOD(TryGetPercentile_HundredSamples_ExpectNearestRank)
+	{
+		// Only the most recent 64 are kept, which are 0.37 up to 1.00 seconds.
+		for (int i = 1; i <= 100; i++)
+		{
+			m_tracker.AddSample(i / 100.0);
+		}
+
+		double seconds = 0.0;
+		ASSERT_THAT(IsTrue(m_tracker.TryGetPercentile(50.f, 1, seconds)));
+		ASSERT_THAT(IsNear(seconds, 0.68, 0.0001));
+		ASSERT_THAT(IsTrue(m_tracker.TryGetPercentile(100.f, 1, seconds)));
+		ASSERT_THAT(IsNear(seconds, 1.0, 0.0001));
+		ASSERT_THAT(IsTrue(m_tracker.TryGetPercentile(0.f, 1, seconds)));
+		ASSERT_THAT(IsNear(seconds, 0.37, 0.0001));
+	}
+
+	/** Every retry waits twice as long as the one before, the jitter only shortens it to at most half. */
+	TEST_METHOD(GetRetryDelaySeconds_IncreasingRetries_ExpectExponentialBackoff)
+	{
+		const float firstDelay = VoxtaDownloadRetryPolicy::GetRetryDelaySeconds(0, 1.f);
+		ASSERT_THAT(IsNear(VoxtaDownloadRetryPolicy::GetRetryDelaySeconds(1, 1.f), firstDelay * 2.f, 0.0001f));
+		ASSERT_THAT(IsNear(VoxtaDownloadRetryPolicy::GetRetryDelaySeconds(2, 1.f), firstDelay * 4.f, 0.0001f));
+		ASSERT_THAT(IsNear(VoxtaDownloadRetryPolicy::GetRetryDelaySeconds(0, 0.f), firstDelay * 0.5f, 0.0001f));
+
+		// Out of range jitter is clamped, so a bad random value can never make it wait longer.
+		ASSERT_THAT(IsNear(VoxtaDownloadRetryPolicy::GetRetryDelaySeconds(0, 5.f), firstDelay, 0.0001f));
+	}
+};